@@ -188,7 +188,9 @@ void Cohort_destroy(struct cohort *testlist);
 template <typename Func, typename ...Params>
 bool run(Func f, enum testStatus expected, Params&&... params)
 {
-    return ( f(std::forward<Params>(params)...) == expected);
+    /* cast explicitly: C++20 deprecates comparing e.g. floats with enums */
+    using result_t = decltype(f(std::forward<Params>(params)...));
+    return ( f(std::forward<Params>(params)...) == static_cast<result_t>(expected));
 }
 #endif
 
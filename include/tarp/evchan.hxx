@@ -1,18 +1,34 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cerrno>
+#include <climits>
 #include <condition_variable>
+#include <ctime>
 #include <deque>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <stdexcept>
+#include <system_error>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <tarp/cxxcommon.hxx>
 #include <tarp/semaphore.hxx>
 #include <tarp/type_traits.hxx>
@@ -46,6 +62,85 @@ enum chanState {
 
 //
 
+// An immutable, intrusively reference-counted event payload.
+//
+// The payload is stored once, in a single allocation, and copying a
+// shared_event only bumps its reference count. This makes it cheap to fan
+// large events out to many channels (see ts::shared_broadcaster): each gets
+// a handle rather than a copy.
+//
+// NOTES:
+// (1) The payload is const, since all handles share it. Copy it out if a
+// mutable copy is needed.
+// (2) The reference count is atomic, so handles to the same payload can be
+// copied and destroyed from any thread, as with std::shared_ptr -- minus the
+// separate control block and weak count.
+// (3) A shared_event is implicitly constructible from a T, so a T can be
+// pushed as is to a channel or broadcaster of shared_event<T>.
+template<typename T>
+class shared_event {
+    struct block {
+        template<typename... Args>
+        explicit block(Args &&...args) : value(std::forward<Args>(args)...) {}
+
+        std::atomic<std::uint32_t> refs {1};
+        const T value;
+    };
+
+public:
+    using element_type = T;
+
+    shared_event() = default;
+
+    // Store the payload, constructed in place from args.
+    template<typename... Args>
+    explicit shared_event(std::in_place_t, Args &&...args)
+        : m_block(new block(std::forward<Args>(args)...)) {}
+
+    // See (3).
+    shared_event(const T &value) : shared_event(std::in_place, value) {}
+    shared_event(T &&value) : shared_event(std::in_place, std::move(value)) {}
+
+    shared_event(const shared_event &other) noexcept : m_block(other.m_block) {
+        if (m_block) {
+            m_block->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    shared_event(shared_event &&other) noexcept
+        : m_block(std::exchange(other.m_block, nullptr)) {}
+
+    shared_event &operator=(shared_event other) noexcept {
+        std::swap(m_block, other.m_block);
+        return *this;
+    }
+
+    ~shared_event() {
+        if (m_block &&
+            m_block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete m_block;
+        }
+    }
+
+    const T &operator*() const { return m_block->value; }
+
+    const T *operator->() const { return &m_block->value; }
+
+    const T *get() const { return m_block ? &m_block->value : nullptr; }
+
+    explicit operator bool() const { return m_block != nullptr; }
+
+    // The number of handles to the payload; 0 if empty.
+    std::uint32_t use_count() const {
+        return m_block ? m_block->refs.load(std::memory_order_relaxed) : 0;
+    }
+
+private:
+    block *m_block {nullptr};
+};
+
+//
+
 namespace interfaces {
 
 // Interface for a notifier.
@@ -114,6 +209,11 @@ public:
     std::pair<bool, std::optional<payload_t>> try_push(T &&...data) {
         return REAL->try_push(std::forward<T>(data)...);
     }
+
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        return REAL->try_push_n(first, last);
+    }
 };
 
 //
@@ -154,6 +254,15 @@ public:
 
     std::deque<payload_t> get_all() { return REAL->get_all(); }
 
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        return REAL->try_get_n(out, max);
+    }
+
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        return REAL->drain_into(events);
+    }
+
     auto &operator>>(std::optional<payload_t> &event) {
         REAL->operator>>(event);
         return *this;
@@ -212,6 +321,11 @@ public:
         return REAL->try_push_for(rel_time, std::forward<T>(data)...);
     }
 
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        return REAL->try_push_n(first, last);
+    }
+
     auto operator<<(const payload_t &event) { return REAL->operator<<(event); }
 
     auto operator<<(payload_t &&event) {
@@ -261,6 +375,15 @@ public:
         return REAL->try_get_for(rel_time);
     }
 
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        return REAL->try_get_n(out, max);
+    }
+
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        return REAL->drain_into(events);
+    }
+
     auto &operator>>(std::optional<payload_t> &event) {
         REAL->operator>>(event);
         return *this;
@@ -343,6 +466,15 @@ struct monitor_entry {
 static constexpr std::uint8_t APPLY = 1;
 static constexpr std::uint8_t CLEAR = 0;
 
+// Tell the CPU we are in a spin-wait loop.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
 //
 
 // An event channel is a homogenous queue that stores data items of a
@@ -598,8 +730,7 @@ public:
         // full, and no ring-buffer semantics => failed push.
         // NOTE: in this case, the state does not change in any way: no need
         // to call refresh_channel_state().
-        auto ret = opt_payload(std::move(m_msgs.back()));
-        return {false, std::move(ret)};
+        return {false, opt_payload(std::forward<T>(data)...)};
     }
 
     // Return the oldest buffered item from the channel.
@@ -632,6 +763,81 @@ public:
         return events;
     }
 
+    // Batch versions of try_push(), try_get() and get_all(). Each takes the
+    // lock and refreshes the channel state only once for the whole batch, so
+    // monitors get at most one notification per state change for it.
+
+    // Push the events in [first, last) until the channel is full -- or all
+    // of them, if the channel has ring-buffer semantics, discarding the
+    // oldest ones as needed. Events are copied or moved as *first allows
+    // (use std::make_move_iterator to move them). Return the number of
+    // events pushed: 0 if the channel is closed.
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        std::size_t n = 0;
+        for (; first != last; ++first, ++n) {
+            if (m_msgs.size() >= m_channel_capacity) {
+                if (!m_circular) {
+                    break;
+                }
+                m_msgs.pop_front();
+            }
+            m_msgs.emplace_back(*first);
+        }
+
+        if (n > 0) {
+            refresh_channel_state(l);
+        }
+        return n;
+    }
+
+    // Move up to max of the oldest buffered events to out, oldest first.
+    // Return the number of events moved.
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        std::size_t n = std::min(max, m_msgs.size());
+        auto end = m_msgs.begin() + n;
+        std::move(m_msgs.begin(), end, out);
+        m_msgs.erase(m_msgs.begin(), end);
+
+        if (n > 0) {
+            refresh_channel_state(l);
+        }
+        return n;
+    }
+
+    // Move all buffered events to the back of events (whose capacity is
+    // reused). Return the number of events moved.
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        std::size_t n = m_msgs.size();
+        events.reserve(events.size() + n);
+        std::move(m_msgs.begin(), m_msgs.end(), std::back_inserter(events));
+        m_msgs.clear();
+
+        if (n > 0) {
+            refresh_channel_state(l);
+        }
+        return n;
+    }
+
     // More convenient and expressive overloads for enqueuing
     // and dequeueing an element. See the comments in `class trunk` fmi.
     auto operator<<(payload_t &data) {
@@ -773,63 +979,81 @@ private:
 
 //
 
-// Unbuffered event channel i.e. a channel with capacity 0.
+// Concurrency policies for a ring_channel.
+// spsc: a single producer thread and a single consumer thread.
+// mpsc: any number of producer threads and a single consumer thread.
+// mpmc: any number of producer and consumer threads.
+struct spsc {};
+struct mpsc {};
+struct mpmc {};
+
+// A bounded, lock-free event channel backed by a preallocated ring buffer.
 //
-// No writes or reads are possible if the channel is closed. Closing a channel
-// unblocks all waiting actors.
+// A ring_channel implements the same rchan and wchan interfaces as an
+// event_channel, can be watched by a monitor in the same way, and has the
+// same capacity and ring-buffer (circular) semantics. It is mostly meant
+// for the common case of a single consumer: where an event_channel takes a
+// mutex -- and may allocate a deque block -- on every try_push and try_get,
+// the ring here is allocated once, when the channel is constructed, and
+// pushing and getting events is lock-free.
 //
-// Writes (see push()) to this channel can only be carried out when there's a
-// corresponding blocked receiver waiting.
+// Each slot in the ring has a sequence number that says whether the slot is
+// free to store the event at a given position or already stores it (as in
+// Dmitry Vyukov's bounded queue). With the spsc policy, the producer and
+// the consumer each own their position in the ring, and try_push and
+// try_get are wait-free. With the mpsc policy, producers claim their slot by
+// CAS; with the mpmc policy, so do consumers. The producer and consumer
+// positions live on separate cache lines so producers and the consumer do
+// not keep invalidating each other's line.
 //
-// Reads (see get()) from this channel can only be carried out when there's a
-// corresponding blocked sender waiting.
+// In circular mode, a push into a full channel first discards the oldest
+// event, then stores the new one in its place: when the ring is full, the
+// slot freed is the one the new event goes into. Since producers then also
+// take events off the ring, the consumer claims events by CAS in this mode.
+// NOTE a producer that finds the ring full may have to retry a (short) while
+// if the oldest slot is claimed but not yet written by another producer, or
+// taken but not yet freed by the consumer.
 //
-// The channel can be monitored for readability or writability. NOTE: a monitor
-// does **not** count as a **waiting** (i.e. blocking) receiver or sender.
-// As a consequence, if all actors are monitors, no messages can/will be sent or
-// received because monitors only use try_get/try_push (see comments below).
+// Monitors get the same edge-triggered notifications as for an
+// event_channel. Notifying takes a mutex, but only when the state of the
+// channel changes (e.g. it becomes readable, or stops being writable), and
+// only once the channel is monitored at all.
 //
-template<typename... types>
-class trunk
-    : public interfaces::wtrunk<trunk<types...>, types...>
-    , public interfaces::rtrunk<trunk<types...>, types...> {
+// NOTE: unlike with an event_channel:
+// - unless the policy is mpmc, try_get(), get_all() and clear() must only be
+//   called by one thread at a time: the consumer. With the spsc policy, the
+//   same goes for try_push().
+// - close() does not destroy the events buffered at the time, as it can be
+//   called by any thread. These can no longer be read however, and the
+//   channel reports itself empty; they are destroyed with the channel.
+template<typename ring_policy, typename... types>
+class ring_channel
+    : public wchan<ring_channel<ring_policy, types...>, types...>
+    , public rchan<ring_channel<ring_policy, types...>, types...>
+    , public std::enable_shared_from_this<ring_channel<ring_policy, types...>> {
     //
-    using is_tuple =
-      typename tarp::type_traits::type_or_tuple<types...>::is_tuple;
-    using this_type = trunk<types...>;
+    static_assert(std::is_same_v<ring_policy, spsc> ||
+                  std::is_same_v<ring_policy, mpsc> ||
+                  std::is_same_v<ring_policy, mpmc>);
+
+    using this_type = ring_channel<ring_policy, types...>;
     using lock_t = std::unique_lock<std::mutex>;
     using mutex_t = std::mutex;
     using payload_type = tarp::type_traits::type_or_tuple_t<types...>;
 
-    // Structure that represents a blocked, waiting writer (sender) or
-    // reader (receiver).
-    struct operation {
-        // Sender CTOR.
-        template<typename... T>
-        operation(T &&...d) {
-            if constexpr (tarp::type_traits::is_tuple_v<T...>) {
-                data.emplace(std::make_tuple(std::forward<T>(d)...));
-            } else {
-                data.emplace(std::forward<T>(d)...);
-            }
-        }
-
-        // Receiver CTOR.
-        operation() = default;
-
-        // Sender data to send or receiver data placeholder to populate.
-        std::optional<payload_type> data;
-
-        // True if data successfully sent/received.
-        bool done = false;
-
-        // Lets us individually wake up a sender or receiver. This helps
-        // prevent thundering herds.
-        std::condition_variable condvar;
+    static constexpr bool multi_producer = !std::is_same_v<ring_policy, spsc>;
+    static constexpr bool multi_consumer = std::is_same_v<ring_policy, mpmc>;
+    static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    // seq is 2*pos when the slot is free to store the event at position pos
+    // in the ring, and 2*pos+1 once it stores it. NOTE the sequence numbers
+    // are doubled so that a full ring can be told apart from an empty one
+    // even when the capacity is 1.
+    struct slot {
+        std::atomic<std::uint64_t> seq {0};
+        std::optional<payload_type> value;
     };
 
-    // Structure that represents a monitor to be notified of changes in the
-    // channel state.
     struct monitor_entry {
         monitor_entry(std::shared_ptr<notifier> notifier) : notif(notifier) {}
 
@@ -839,104 +1063,49 @@ class trunk
 public:
     using payload_t = payload_type;
     using Ts = std::tuple<types...>;
-    using wtrunk_t = interfaces::wtrunk<this_type, types...>;
-    using rtrunk_t = interfaces::rtrunk<this_type, types...>;
-
-    DISALLOW_COPY_AND_MOVE(trunk);
-    trunk() = default;
+    using wchan_t = interfaces::wchan<this_type, types...>;
+    using rchan_t = interfaces::rchan<this_type, types...>;
 
-    // return a wtrunk interface reference.
-    interfaces::wtrunk<this_type, types...> &as_wtrunk() { return *this; }
+    DISALLOW_COPY_AND_MOVE(ring_channel);
 
-    // return an rtrunk interface reference.
-    interfaces::rtrunk<this_type, types...> &as_rtrunk() { return *this; }
+    // Make a channel that can buffer channel_capacity events.
+    // See the event_channel constructor fmi.
+    ring_channel(std::uint32_t channel_capacity, bool circular)
+        : m_circular(circular)
+        , m_capacity(channel_capacity)
+        , m_pow2((channel_capacity & (channel_capacity - 1)) == 0) {
+        if (m_capacity == 0) {
+            auto errmsg = "nonsensical max capacity of 0 for buffered channel";
+            throw std::logic_error(errmsg);
+        }
 
-    // Convenience notation for pushing to a channel.
-    //
-    // NOTE: this just calls push(), so it is blocking.
-    //
-    // NOTE: chaining/cascading is not permitted because the returned value
-    // is that of push() (see comments fmi) in order to avoid losing data on
-    // failure, rather than *this.
-    // That is, the following is not allowed:
-    // mychan << event1 << event2 ... << eventn;
-    //
-    // NOTE: the input is expected to be a payload_t. If it is a multi-type
-    // payload, then the caller must make a tuple.
-    // trunk<unsigned> chan;
-    // auto [ok, returned] = chan << 1u;
-    //
-    // trunk<unsigned, unsigned> chan;
-    // auto [ok, returned] = chan << tuple(1u, 1u);
-    auto operator<<(const payload_t &data) {
-        // return *this;
-        return push(data);
+        m_slots = std::make_unique<slot[]>(m_capacity);
+        for (std::uint64_t i = 0; i < m_capacity; ++i) {
+            m_slots[i].seq.store(2 * i, std::memory_order_relaxed);
+        }
     }
 
-    auto operator<<(payload_t &&data) {
-        // return *this;
-        return push(std::move(data));
+    // return a wchan interface reference.
+    interfaces::wchan<this_type, types...> &as_wchan() { return *this; }
+
+    // return a wchan interface shared ptr. NOTE: this may only be called
+    // if the ring_channel has been constructed as a std::shared_ptr.
+    std::shared_ptr<interfaces::wchan<this_type, types...>>
+    as_wchan_sharedptr() {
+        return this->shared_from_this();
     }
 
-    // Convenience notation for getting from a channel.
-    //
-    // NOTE: this just calls get(), so it is blocking.
-    //
-    // NOTE: chaining is allowed in this case. std::optional-wrapped
-    // payloads are stored in the arguments.
-    //
-    // trunk<int> chan;
-    // chan << 1;
-    // chan << 2;
-    // chan << 3;
-    // std::optional<int> a, b, c;
-    // chan >> a >> b >> c;
-    //  # NOTE: this will make (and block in) a call to get() 3 times.
-    auto &operator>>(std::optional<payload_t> &event) {
-        auto res = get();
-        if (res.has_value()) {
-            event.emplace(std::move(res.value()));
-        }
-        return *this;
+    // return an rchan interface reference.
+    interfaces::rchan<this_type, types...> &as_rchan() { return *this; }
+
+    // return an rchan interface shared ptr. NOTE: this may only be called
+    // if the ring_channel has been constructed as a std::shared_ptr.
+    std::shared_ptr<interfaces::rchan<this_type, types...>>
+    as_rchan_sharedptr() {
+        return this->shared_from_this();
     }
 
-    // Add a monitor to be notified of changes involving the specified states.
-    //
-    // NOTE: a notification is emitted in two cases:
-    // - state becomes active (rising-edge notification)
-    // - state stops being active (falling-edge notification)
-    //
-    // For example, if state == chanState::READABLE, then a notification will
-    // be emitted when:
-    // - the channel becomes readable
-    // - the channel becomes unreadable
-    //
-    // The edge-triggered semantics makes it easy to implement either edge
-    // or level - triggered mechanisms on top.
-    //
-    // NOTE: once a monitor is added, this channel owns a shared_ptr reference
-    // to the associated notifier. Since .notify() may be invoked at any
-    // time, the monitor must ensure its notifier does not access resources
-    // that have gone out of scope. For example, the notifier might outlive the
-    // monitor since it's a shared_ptr; thus the notifier implementation must
-    // be designed such that this case is properly handled.
-    //
-    // NOTE: a monitor should be prepared to handle spurious notifications.
-    // E.g. if a WRITABLE notification is received, there is no guarantee the
-    // channel will still be writable by the time the monitor eventually acts
-    // on the notification, since *multiple* monitors could've been registered
-    // and notified. Therefore there is an inherent race between monitors. Other
-    // such situations may also result in a notification not reflecting the
-    // true state of the channel. Therefore monitors should use the
-    // try_{get,push} methods and be prepared to handle failures.
-    //
-    // == @return ==
-    // Return a bitfield indicating the currently pending state events on the
-    // channel. This is useful if a monitor is added after the occurence of
-    // an event. Specifically, it is meant to prevent this type of scenario:
-    //  - receiver calls get(), blocking forever.
-    //  - monitor is added for state=WRITABLE
-    //  - .. monitor never notified; receiver waits forever.
+    // See event_channel::add_monitor fmi.
     std::uint32_t add_monitor(std::shared_ptr<notifier> notifier,
                               std::uint32_t states) {
         struct monitor_entry mon(notifier);
@@ -951,32 +1120,1695 @@ public:
             m_send_monitors.push_back(mon);
         }
 
-        return m_state_mask;
+        // The state is not tracked until there is a monitor; start now. NOTE
+        // either the fence here or the one in update_state() comes first, so
+        // either we see the latest push/get or its caller sees m_monitored.
+        if (!m_monitored.load(std::memory_order_relaxed)) {
+            m_monitored.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto closed = m_state_mask.load(std::memory_order_relaxed) &
+                          chanState::CLOSED;
+            m_state_mask.store(current_state() | closed,
+                               std::memory_order_relaxed);
+        }
+
+        return m_state_mask.load(std::memory_order_relaxed);
     }
 
-    // Close a channel.
-    //
-    // A closed channel cannot be reopened.
-    // No read/write operations are possible on a closed channel.
-    //
-    // When the channel is closed, all blocked senders and receivers,
-    // and all monitors are woken.
-    // NOTE:
-    //     Since any receivers/senders currently engaged in a blocking wait
-    //     will be woken and immediately thereafter will access fields of this
-    //     class, the caller must ensure the object does not go out of scope
-    //     as this happens.
+    // Close the channel. See event_channel::close() and the NOTE above fmi.
     void close() {
-        decltype(m_recv_waitq) recvq;
-        decltype(m_send_waitq) sendq;
         std::vector<std::shared_ptr<notifier>> monitors;
 
         {
             lock_t l {m_mtx};
-            m_closed = true;
-            m_state_mask |= chanState::CLOSED;
+            m_closed.store(true, std::memory_order_release);
+            m_state_mask.fetch_or(chanState::CLOSED, std::memory_order_relaxed);
 
-            // clear the send and recv wait queues.
+            // gather all monitors and clear the monitor queues.
+            auto get_all_and_clear = [&monitors](auto &ls) {
+                for (auto &i : ls) {
+                    monitors.push_back(i.notif);
+                }
+                ls.clear();
+            };
+            get_all_and_clear(m_recv_monitors);
+            get_all_and_clear(m_send_monitors);
+        }
+
+        // notify all monitors
+        for (auto &mon : monitors) {
+            mon->notify(chanState::CLOSED, APPLY);
+        }
+    }
+
+    // True if channel is closed, else False.
+    bool closed() const { return m_closed.load(std::memory_order_acquire); }
+
+    // True if there are no queued items.
+    bool empty() const { return size() == 0; }
+
+    // Return the number of events currently enqueued. With the mpsc policy
+    // this includes those producers are in the middle of storing.
+    std::size_t size() const {
+        if (closed()) {
+            return 0;
+        }
+
+        auto head = m_head.load(std::memory_order_acquire);
+        auto tail = m_tail.load(std::memory_order_acquire);
+        return tail > head ? std::min<std::uint64_t>(tail - head, m_capacity)
+                           : 0;
+    }
+
+    // Discard all events currently enqueued. Consumer only.
+    void clear() {
+        std::optional<payload_t> event;
+        for (std::uint32_t i = 0; i < m_capacity && take(event); ++i) {
+        }
+        update_state();
+    }
+
+    // See event_channel::try_push() fmi.
+    template<typename... T>
+    std::pair<bool, std::optional<payload_type>> try_push(T &&...data) {
+        if (m_closed.load(std::memory_order_relaxed)) {
+            return {false, opt_payload(std::forward<T>(data)...)};
+        }
+
+        std::uint64_t pos;
+        if (!reserve_slot(pos)) {
+            return {false, opt_payload(std::forward<T>(data)...)};
+        }
+
+        auto &s = at(pos);
+        store(s, std::forward<T>(data)...);
+        s.seq.store(2 * pos + 1, std::memory_order_release);
+
+        update_state();
+        return {true, std::nullopt};
+    }
+
+    // See event_channel::try_push_n() fmi.
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        if (m_closed.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+
+        std::size_t n = 0;
+        std::uint64_t pos;
+        for (; first != last && reserve_slot(pos); ++first, ++n) {
+            auto &s = at(pos);
+            s.value.emplace(*first);
+            s.seq.store(2 * pos + 1, std::memory_order_release);
+        }
+
+        if (n > 0) {
+            update_state();
+        }
+        return n;
+    }
+
+    // See event_channel::try_get() fmi. Consumer only.
+    std::optional<payload_t> try_get() {
+        if (m_closed.load(std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+
+        std::optional<payload_t> ret;
+        if (!take(ret)) {
+            return std::nullopt;
+        }
+
+        update_state();
+        return ret;
+    }
+
+    // Return all the events currently buffered. Consumer only.
+    // NOTE at most as many events as the channel can hold are returned, so
+    // this returns even if producers keep pushing.
+    std::deque<payload_t> get_all() {
+        std::deque<payload_t> events;
+        if (m_closed.load(std::memory_order_relaxed)) {
+            return events;
+        }
+
+        std::optional<payload_t> event;
+        for (std::uint32_t i = 0; i < m_capacity && take(event); ++i) {
+            events.push_back(std::move(*event));
+        }
+
+        update_state();
+        return events;
+    }
+
+    // See event_channel::try_get_n() fmi. Consumer only.
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        if (m_closed.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+
+        std::size_t n = 0;
+        std::optional<payload_t> event;
+        for (; n < max && take(event); ++n) {
+            *out++ = std::move(*event);
+        }
+
+        if (n > 0) {
+            update_state();
+        }
+        return n;
+    }
+
+    // See event_channel::drain_into() and get_all() fmi. Consumer only.
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        return try_get_n(std::back_inserter(events), m_capacity);
+    }
+
+    // See event_channel fmi.
+    auto operator<<(payload_t &data) { return try_push(std::move(data)); }
+
+    auto operator<<(payload_t &&data) { return try_push(std::move(data)); }
+
+    auto &operator>>(std::optional<payload_t> &event) {
+        event.reset(); /* defensive programming here */
+        auto res = try_get();
+        if (res.has_value()) {
+            event.emplace(std::move(res.value()));
+        }
+        return *this;
+    }
+
+private:
+    slot &at(std::uint64_t pos) const {
+        return m_slots[m_pow2 ? (pos & (m_capacity - 1)) : (pos % m_capacity)];
+    }
+
+    // Claim the slot for the next event to be pushed: false if the ring is
+    // full.
+    bool reserve(std::uint64_t &pos) {
+        pos = m_tail.load(std::memory_order_relaxed);
+
+        for (;;) {
+            auto seq = at(pos).seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::int64_t>(seq - 2 * pos);
+
+            // still holds the event from one lap back.
+            if (diff < 0) {
+                return false;
+            }
+
+            // another producer claimed it first.
+            if (diff > 0) {
+                pos = m_tail.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if constexpr (!multi_producer) {
+                m_tail.store(pos + 1, std::memory_order_relaxed);
+                return true;
+            } else if (m_tail.compare_exchange_weak(
+                         pos, pos + 1, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    // Claim the slot for the next event to be pushed, making room for it if
+    // the channel is circular: false if the ring is full.
+    //
+    // NOTE: the slot at pos may also be held up by a consumer (or another
+    // producer) that has moved m_head past it but not freed it yet. The ring
+    // is then not full, and discarding would take out the next event instead,
+    // and so on for as long as the slot is held up: wait for it instead.
+    bool reserve_slot(std::uint64_t &pos) {
+        while (!reserve(pos)) {
+            if (!m_circular) {
+                return false;
+            }
+
+            auto head = m_head.load(std::memory_order_relaxed);
+            if (static_cast<std::int64_t>(pos - head) >=
+                static_cast<std::int64_t>(m_capacity)) {
+                discard_oldest(head);
+            } else {
+                cpu_relax();
+            }
+        }
+        return true;
+    }
+
+    // Take the oldest event off the ring, if any.
+    bool take(std::optional<payload_t> &event) {
+        auto pos = m_head.load(std::memory_order_relaxed);
+
+        for (;;) {
+            auto seq = at(pos).seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::int64_t>(seq - (2 * pos + 1));
+
+            // the event at pos has not been stored yet: empty.
+            if (diff < 0) {
+                return false;
+            }
+
+            // pos is stale: the event was taken by another consumer or
+            // discarded by a producer (and the slot maybe reused since).
+            if (diff > 0) {
+                pos = m_head.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (!m_circular && !multi_consumer) {
+                m_head.store(pos + 1, std::memory_order_relaxed);
+                break;
+            }
+
+            // else another consumer may be taking it or a producer discarding
+            // it; pos is reloaded on failure
+            if (m_head.compare_exchange_weak(
+                  pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        auto &s = at(pos);
+        event.emplace(std::move(*s.value));
+        s.value.reset();
+        s.seq.store(2 * (pos + m_capacity), std::memory_order_release);
+        return true;
+    }
+
+    // Discard the oldest event, at pos, to make room in a full circular
+    // channel. The caller retries its push regardless of whether this
+    // succeeded: if it did not, the event has been taken off the ring by
+    // someone else. NOTE pos is not reloaded, since the event at the head
+    // by now may no longer be one that has to go.
+    void discard_oldest(std::uint64_t pos) {
+        auto &s = at(pos);
+
+        if (s.seq.load(std::memory_order_acquire) != 2 * pos + 1) {
+            return;
+        }
+
+        if (!m_head.compare_exchange_strong(
+              pos, pos + 1, std::memory_order_relaxed)) {
+            return;
+        }
+
+        s.value.reset();
+        s.seq.store(2 * (pos + m_capacity), std::memory_order_release);
+    }
+
+    // The state of the channel as it is now, as a chanState mask.
+    std::uint32_t current_state() const {
+        std::uint32_t state = 0;
+
+        auto head = m_head.load(std::memory_order_acquire);
+        if (at(head).seq.load(std::memory_order_acquire) == 2 * head + 1) {
+            state |= chanState::READABLE;
+        }
+
+        if (m_circular) {
+            state |= chanState::WRITABLE;
+        } else {
+            auto tail = m_tail.load(std::memory_order_acquire);
+            if (at(tail).seq.load(std::memory_order_acquire) == 2 * tail) {
+                state |= chanState::WRITABLE;
+            }
+        }
+
+        return state;
+    }
+
+    // Called after every push and get: send out state change notifications,
+    // if the channel is monitored and its state has changed.
+    void update_state() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!m_monitored.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        if (current_state() == m_state_mask.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        lock_t l {m_mtx};
+        refresh_channel_state(l);
+    }
+
+    // See event_channel::refresh_channel_state() fmi.
+    // NOTE this goes round until the state stops changing. The state seen
+    // here may be missing a concurrent push or get whose caller in turn saw
+    // the state mask before we changed it, and so left it to us.
+    void refresh_channel_state(lock_t &) {
+        auto notify_monitors = [](auto &ls, auto state_flags, auto action) {
+            for (auto it = ls.begin(); it != ls.end();) {
+                // NOTE: notifier->notify() **must not** call us back, else we
+                // will get a deadlock.
+                if (!it->notif->notify(state_flags, action)) {
+                    it = ls.erase(it);
+                    continue;
+                }
+                ++it;
+            }
+        };
+
+        using S = chanState;
+
+        for (;;) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            auto old_state = m_state_mask.load(std::memory_order_relaxed);
+            if (old_state & S::CLOSED) {
+                return;
+            }
+
+            auto current_state = this->current_state();
+            if (current_state == old_state) {
+                return;
+            }
+
+            // rising edges
+            if ((current_state & S::READABLE) && !(old_state & S::READABLE)) {
+                notify_monitors(m_recv_monitors, S::READABLE, APPLY);
+            }
+            if ((current_state & S::WRITABLE) && !(old_state & S::WRITABLE)) {
+                notify_monitors(m_send_monitors, S::WRITABLE, APPLY);
+            }
+
+            // falling edges
+            if ((old_state & S::READABLE) && !(current_state & S::READABLE)) {
+                notify_monitors(m_recv_monitors, S::READABLE, CLEAR);
+            }
+            if ((old_state & S::WRITABLE) && !(current_state & S::WRITABLE)) {
+                notify_monitors(m_send_monitors, S::WRITABLE, CLEAR);
+            }
+
+            m_state_mask.store(current_state, std::memory_order_relaxed);
+        }
+    }
+
+    // See event_channel::opt_payload() fmi.
+    template<typename... T>
+    constexpr auto opt_payload(T &&...data) {
+        std::optional<payload_type> opt;
+        if constexpr (tarp::type_traits::is_tuple_v<T...>) {
+            opt.emplace(std::make_tuple(std::forward<T>(data)...));
+        } else {
+            opt.emplace(std::forward<T>(data)...);
+        }
+        return opt;
+    }
+
+    // Store data as the event in slot s.
+    template<typename... T>
+    void store(slot &s, T &&...data) {
+        if constexpr (tarp::type_traits::is_tuple_v<T...>) {
+            s.value.emplace(std::make_tuple(std::forward<T>(data)...));
+        } else {
+            s.value.emplace(std::forward<T>(data)...);
+        }
+    }
+
+private:
+    // consumer position: next event to get.
+    alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> m_head {0};
+
+    // producer position: next slot to store an event in.
+    alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> m_tail {0};
+
+    alignas(CACHE_LINE_SIZE) const bool m_circular = false;
+    const std::uint32_t m_capacity = 0;
+    const bool m_pow2 = false;
+    std::unique_ptr<slot[]> m_slots;
+
+    std::atomic<bool> m_closed {false};
+    std::atomic<bool> m_monitored {false};
+
+    // Only kept up to date once the channel is monitored.
+    // See event_channel::m_state_mask fmi.
+    std::atomic<std::uint32_t> m_state_mask {chanState::WRITABLE};
+
+    mutable mutex_t m_mtx;
+
+    // send and receive monitor queues.
+    std::list<struct monitor_entry> m_send_monitors;
+    std::list<struct monitor_entry> m_recv_monitors;
+};
+
+
+//
+
+// A conflating channel is an event channel that only keeps the most recent
+// event for each key: a push for a key that already has an event pending
+// overwrites that event in place instead of queueing another one.
+//
+// This suits consumers that only care about the latest state of each of a
+// set of things (instruments, devices, sensors etc). A circular
+// event_channel is not good enough for this: when full, it drops the oldest
+// event, whatever its key, and a slow consumer still gets to process every
+// stale update that has not been dropped. With a conflating channel, a slow
+// consumer does work proportional to the number of distinct keys updated
+// rather than to the number of updates.
+//
+// The key of an event is obtained by calling key_of on it (see the
+// constructor). The channel implements the wchan and rchan interfaces and
+// can be monitored just like an event_channel.
+//
+// === Ordering ===
+// -----------------
+// Events are read in the order in which their keys _became_ pending: an
+// overwrite updates the pending event but does not move it back in the
+// queue, so a key that is updated continuously cannot be starved by others.
+// Once read, a key is no longer pending and its next push queues it anew.
+//
+// === Channel Capacity ===
+// -------------------------
+// The capacity of the channel is the maximum number of keys that may have an
+// event pending at the same time. Pushes for pending keys always succeed
+// (unless the channel is closed); pushes for other keys fail when the
+// channel is full. Accordingly, the channel is WRITABLE as long as a new key
+// can be pushed.
+//
+// === Storage ===
+// ----------------
+// All storage is allocated at construction time. Pending events live in a
+// preallocated array of capacity slots that is used as a ring buffer in
+// first-pending order. Keys are looked up through an open-addressed (linear
+// probing) index over the slot array, kept at most half full, with
+// backward-shift deletion so no tombstones build up.
+//
+// === Thread Safety ===
+// ----------------------
+// Like event_channel, all operations are serialized with a mutex. key_of and
+// the hash of the key are computed outside of it.
+//
+template<typename ts_policy, typename key_t, typename... types>
+class conflating_channel
+    : public wchan<conflating_channel<ts_policy, key_t, types...>, types...>
+    , public rchan<conflating_channel<ts_policy, key_t, types...>, types...>
+    , public std::enable_shared_from_this<
+        conflating_channel<ts_policy, key_t, types...>> {
+    //
+    using this_type = conflating_channel<ts_policy, key_t, types...>;
+    using lock_t = std::unique_lock<std::mutex>;
+    using mutex_t = std::mutex;
+    using payload_type = tarp::type_traits::type_or_tuple_t<types...>;
+
+    struct monitor_entry {
+        monitor_entry(std::shared_ptr<notifier> notifier) : notif(notifier) {}
+
+        std::shared_ptr<notifier> notif;
+    };
+
+    // A pending event and its key. hash is the (mixed) hash of key.
+    struct slot {
+        std::uint64_t hash = 0;
+        std::optional<key_t> key;
+        std::optional<payload_type> value;
+    };
+
+public:
+    using payload_t = payload_type;
+    using Ts = std::tuple<types...>;
+    using wchan_t = interfaces::wchan<this_type, types...>;
+    using rchan_t = interfaces::rchan<this_type, types...>;
+    using key_fn_t = std::function<key_t(const payload_t &)>;
+
+    DISALLOW_COPY_AND_MOVE(conflating_channel);
+
+    // Make a conflating channel that can hold events for up to max_keys
+    // distinct keys at a time. key_of must return the key of an event. It
+    // can be left unspecified if events are tuples whose first element is
+    // (convertible to) the key.
+    explicit conflating_channel(std::uint32_t max_keys, key_fn_t key_of = {})
+        : m_capacity(max_keys), m_key_of(std::move(key_of)) {
+        if (m_capacity == 0) {
+            auto errmsg = "nonsensical max capacity of 0 for conflating channel";
+            throw std::logic_error(errmsg);
+        }
+
+        if (!m_key_of) {
+            if constexpr (tarp::type_traits::is_tuple_v<types...>) {
+                using first_t = std::tuple_element_t<0, payload_t>;
+                if constexpr (std::is_convertible_v<first_t, key_t>) {
+                    m_key_of = [](const payload_t &ev) {
+                        return key_t(std::get<0>(ev));
+                    };
+                }
+            }
+        }
+
+        if (!m_key_of) {
+            throw std::logic_error("no key function for conflating channel");
+        }
+
+        // at most half full, so probe sequences stay short.
+        unsigned bits = 1;
+        while ((std::uint64_t {1} << bits) < std::uint64_t {m_capacity} * 2) {
+            ++bits;
+        }
+        m_index.assign(std::size_t {1} << bits, 0);
+        m_index_mask = m_index.size() - 1;
+        m_index_shift = 64 - bits;
+
+        m_slots = std::make_unique<slot[]>(m_capacity);
+    }
+
+    // return a wchan interface reference.
+    interfaces::wchan<this_type, types...> &as_wchan() { return *this; }
+
+    // return a wchan interface shared ptr. NOTE: this may only be called
+    // if the channel has been constructed as a std::shared_ptr.
+    std::shared_ptr<interfaces::wchan<this_type, types...>>
+    as_wchan_sharedptr() {
+        return this->shared_from_this();
+    }
+
+    // return an rchan interface reference.
+    interfaces::rchan<this_type, types...> &as_rchan() { return *this; }
+
+    // return an rchan interface shared ptr. NOTE: this may only be called
+    // if the channel has been constructed as a std::shared_ptr.
+    std::shared_ptr<interfaces::rchan<this_type, types...>>
+    as_rchan_sharedptr() {
+        return this->shared_from_this();
+    }
+
+    // Add a monitor for the states specified in states.
+    // See event_channel::add_monitor fmi.
+    std::uint32_t add_monitor(std::shared_ptr<notifier> notifier,
+                              std::uint32_t states) {
+        struct monitor_entry mon(notifier);
+
+        lock_t l {m_mtx};
+
+        if (states & chanState::READABLE) {
+            m_recv_monitors.push_back(mon);
+        }
+
+        if (states & chanState::WRITABLE) {
+            m_send_monitors.push_back(mon);
+        }
+
+        return m_state_mask;
+    }
+
+    // Close the channel. See event_channel::close() fmi.
+    void close() {
+        std::vector<std::shared_ptr<notifier>> monitors;
+
+        {
+            lock_t l {m_mtx};
+            m_closed = true;
+            m_state_mask |= chanState::CLOSED;
+            discard_all(l);
+
+            auto get_all_and_clear = [&monitors](auto &ls) {
+                for (auto &i : ls) {
+                    monitors.push_back(i.notif);
+                }
+                ls.clear();
+            };
+            get_all_and_clear(m_recv_monitors);
+            get_all_and_clear(m_send_monitors);
+        }
+
+        for (auto &mon : monitors) {
+            mon->notify(chanState::CLOSED, APPLY);
+        }
+    }
+
+    // True if channel is closed, else False.
+    bool closed() const {
+        lock_t l {m_mtx};
+        return m_closed;
+    }
+
+    // True if no key has an event pending.
+    bool empty() const {
+        lock_t l {m_mtx};
+        return m_count == 0;
+    }
+
+    // Return the number of keys that have an event pending.
+    std::size_t size() const {
+        lock_t l {m_mtx};
+        return m_count;
+    }
+
+    // Return the number of events that were overwritten by more recent ones
+    // for the same key before being read.
+    std::uint64_t num_conflated() const {
+        lock_t l {m_mtx};
+        return m_num_conflated;
+    }
+
+    // Discard all pending events.
+    void clear() {
+        lock_t l {m_mtx};
+        discard_all(l);
+        refresh_channel_state(l);
+    }
+
+    // Try to push a new event. If an event with the same key is pending, it
+    // is overwritten (keeping its place in the queue). Otherwise the event is
+    // queued if the channel is not full.
+    //
+    // This always fails if the channel is closed.
+    //
+    // If successful, return {true, nullopt}.
+    // Otherwise return {false, std::optional<data>}, whereby the data is not
+    // lost but returned to the caller.
+    template<typename... T>
+    std::pair<bool, std::optional<payload_type>> try_push(T &&...data) {
+        auto ev = opt_payload(std::forward<T>(data)...);
+        const key_t key = m_key_of(*ev);
+        const std::uint64_t hash = hash_of(key);
+
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return {false, std::move(ev)};
+        }
+
+        if (!put(l, key, hash, std::move(*ev))) {
+            return {false, std::move(ev)};
+        }
+
+        return {true, std::nullopt};
+    }
+
+    // Return the pending event whose key has been pending the longest, or
+    // nullopt if there is none.
+    std::optional<payload_t> try_get() {
+        lock_t l {m_mtx};
+
+        if (m_count == 0 or m_closed) {
+            return std::nullopt;
+        }
+
+        auto ret = pop_front(l);
+        refresh_channel_state(l);
+        return ret;
+    }
+
+    // Return all pending events, in first-pending order.
+    std::deque<payload_t> get_all() {
+        lock_t l {m_mtx};
+        std::deque<payload_t> events;
+
+        if (m_count == 0 or m_closed) {
+            return events;
+        }
+
+        while (m_count > 0) {
+            events.emplace_back(*pop_front(l));
+        }
+
+        refresh_channel_state(l);
+        return events;
+    }
+
+    // Batch versions of try_push(), try_get() and get_all(). Each takes the
+    // lock and refreshes the channel state only once for the whole batch.
+
+    // Push the events in [first, last) in turn, stopping at the first one
+    // whose key is not pending and does not fit. Return the number of events
+    // pushed (overwrites included): 0 if the channel is closed.
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        std::size_t n = 0;
+        std::uint32_t count = m_count;
+
+        for (; first != last; ++first, ++n) {
+            payload_t ev(*first);
+            const key_t key = m_key_of(ev);
+            if (!put(l, key, hash_of(key), std::move(ev), false)) {
+                break;
+            }
+        }
+
+        if (m_count != count) {
+            refresh_channel_state(l);
+        }
+        return n;
+    }
+
+    // Move up to max pending events to out, in first-pending order.
+    // Return the number of events moved.
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        std::size_t n = std::min<std::size_t>(max, m_count);
+        for (std::size_t i = 0; i < n; ++i) {
+            *out++ = *pop_front(l);
+        }
+
+        if (n > 0) {
+            refresh_channel_state(l);
+        }
+        return n;
+    }
+
+    // Move all pending events to the back of events (whose capacity is
+    // reused). Return the number of events moved.
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        std::size_t n = m_count;
+        events.reserve(events.size() + n);
+        while (m_count > 0) {
+            events.emplace_back(*pop_front(l));
+        }
+
+        if (n > 0) {
+            refresh_channel_state(l);
+        }
+        return n;
+    }
+
+    // More convenient and expressive overloads for enqueuing
+    // and dequeueing an element. See the comments in `class trunk` fmi.
+    auto operator<<(payload_t &data) { return try_push(std::move(data)); }
+
+    auto operator<<(payload_t &&data) { return try_push(std::move(data)); }
+
+    auto &operator>>(std::optional<payload_t> &event) {
+        event.reset();
+        auto res = try_get();
+        if (res.has_value()) {
+            event.emplace(std::move(res.value()));
+        }
+        return *this;
+    }
+
+private:
+    // Spread the bits of the key hash over the high bits, which are the ones
+    // used to index m_index (see home()). std::hash is the identity for
+    // integers on common implementations, which clusters badly with strided
+    // keys otherwise.
+    static std::uint64_t hash_of(const key_t &key) {
+        return static_cast<std::uint64_t>(std::hash<key_t> {}(key)) *
+               0x9e3779b97f4a7c15ull;
+    }
+
+    // The position in m_index where the search for hash starts.
+    std::size_t home(std::uint64_t hash) const {
+        return static_cast<std::size_t>(hash >> m_index_shift);
+    }
+
+    // Return the position in m_index of the entry for key or, if key is not
+    // pending, of the empty entry where it would be inserted. Entries in
+    // m_index are slot indices + 1, with 0 marking an empty entry.
+    std::size_t probe(lock_t &, const key_t &key, std::uint64_t hash) const {
+        std::size_t pos = home(hash);
+
+        // terminates: m_index is never more than half full.
+        for (;;) {
+            std::uint32_t entry = m_index[pos];
+            if (entry == 0) {
+                return pos;
+            }
+
+            const auto &s = m_slots[entry - 1];
+            if (s.hash == hash && *s.key == key) {
+                return pos;
+            }
+
+            pos = (pos + 1) & m_index_mask;
+        }
+    }
+
+    // Overwrite the pending event for key with ev, or else queue ev if there
+    // is room. Return false (leaving ev untouched) if there is not.
+    bool put(lock_t &l,
+             const key_t &key,
+             std::uint64_t hash,
+             payload_t &&ev,
+             bool refresh = true) {
+        std::size_t pos = probe(l, key, hash);
+
+        // overwrite in place; the state does not change.
+        if (m_index[pos] != 0) {
+            *m_slots[m_index[pos] - 1].value = std::move(ev);
+            ++m_num_conflated;
+            return true;
+        }
+
+        if (m_count == m_capacity) {
+            return false;
+        }
+
+        std::uint32_t idx = m_head + m_count;
+        if (idx >= m_capacity) {
+            idx -= m_capacity;
+        }
+
+        auto &s = m_slots[idx];
+        s.hash = hash;
+        s.key.emplace(key);
+        s.value.emplace(std::move(ev));
+        m_index[pos] = idx + 1;
+        ++m_count;
+
+        if (refresh) {
+            refresh_channel_state(l);
+        }
+        return true;
+    }
+
+    // Remove the event at the head of the queue and return it.
+    // The channel must not be empty.
+    std::optional<payload_t> pop_front(lock_t &l) {
+        auto &s = m_slots[m_head];
+        unindex(l, m_head);
+
+        std::optional<payload_t> ev = std::move(s.value);
+        s.value.reset();
+        s.key.reset();
+
+        m_head = (m_head + 1 == m_capacity) ? 0 : m_head + 1;
+        --m_count;
+        return ev;
+    }
+
+    // Remove the m_index entry for slot idx. Entries further along the same
+    // probe sequence are shifted back into the hole, so lookups never need
+    // to skip over deleted entries.
+    void unindex(lock_t &, std::uint32_t idx) {
+        std::size_t hole = home(m_slots[idx].hash);
+        while (m_index[hole] != idx + 1) {
+            hole = (hole + 1) & m_index_mask;
+        }
+
+        std::size_t next = (hole + 1) & m_index_mask;
+        while (m_index[next] != 0) {
+            // the entry at next may fill the hole unless its home position
+            // lies (cyclically) after the hole.
+            std::size_t from_home = home(m_slots[m_index[next] - 1].hash);
+            std::size_t dist_home = (next - from_home) & m_index_mask;
+            std::size_t dist_hole = (next - hole) & m_index_mask;
+
+            if (dist_home >= dist_hole) {
+                m_index[hole] = m_index[next];
+                hole = next;
+            }
+
+            next = (next + 1) & m_index_mask;
+        }
+
+        m_index[hole] = 0;
+    }
+
+    // Drop all pending events.
+    void discard_all(lock_t &) {
+        for (std::uint32_t i = 0; i < m_count; ++i) {
+            std::uint32_t idx = m_head + i;
+            if (idx >= m_capacity) {
+                idx -= m_capacity;
+            }
+            m_slots[idx].key.reset();
+            m_slots[idx].value.reset();
+        }
+
+        std::fill(m_index.begin(), m_index.end(), 0);
+        m_head = 0;
+        m_count = 0;
+    }
+
+    // See event_channel::refresh_channel_state() fmi.
+    void refresh_channel_state(lock_t &) {
+        std::uint32_t current_state = 0;
+
+        // writable if a new key can be pushed.
+        if (m_count < m_capacity) {
+            current_state |= chanState::WRITABLE;
+        }
+
+        if (m_count > 0) {
+            current_state |= chanState::READABLE;
+        }
+
+        auto notify_monitors = [](auto &ls, auto state_flags, auto action) {
+            for (auto it = ls.begin(); it != ls.end();) {
+                // NOTE: notifier->notify() **must not** call us back, else we
+                // will get a deadlock.
+                if (!it->notif->notify(state_flags, action)) {
+                    it = ls.erase(it);
+                    continue;
+                }
+                ++it;
+            }
+        };
+
+        if (current_state == m_state_mask) {
+            return;
+        }
+
+        using S = chanState;
+
+        // rising edges
+        if ((current_state & S::READABLE) && !(m_state_mask & S::READABLE)) {
+            notify_monitors(m_recv_monitors, S::READABLE, APPLY);
+        }
+        if ((current_state & S::WRITABLE) && !(m_state_mask & S::WRITABLE)) {
+            notify_monitors(m_send_monitors, S::WRITABLE, APPLY);
+        }
+
+        // falling edges
+        if ((m_state_mask & S::READABLE) && !(current_state & S::READABLE)) {
+            notify_monitors(m_recv_monitors, S::READABLE, CLEAR);
+        }
+        if ((m_state_mask & S::WRITABLE) && !(current_state & S::WRITABLE)) {
+            notify_monitors(m_send_monitors, S::WRITABLE, CLEAR);
+        }
+
+        m_state_mask = current_state;
+        if (m_closed) {
+            m_state_mask |= chanState::CLOSED;
+        }
+    }
+
+    // See event_channel::opt_payload() fmi.
+    template<typename... T>
+    constexpr auto opt_payload(T &&...data) {
+        std::optional<payload_type> opt;
+        if constexpr (tarp::type_traits::is_tuple_v<T...>) {
+            opt.emplace(std::make_tuple(std::forward<T>(data)...));
+        } else {
+            opt.emplace(std::forward<T>(data)...);
+        }
+        return opt;
+    }
+
+private:
+    const std::uint32_t m_capacity = 0;
+    key_fn_t m_key_of;
+
+    mutable mutex_t m_mtx;
+    bool m_closed {false};
+
+    // pending events, in first-pending order starting at m_head.
+    std::unique_ptr<slot[]> m_slots;
+    std::uint32_t m_head = 0;
+    std::uint32_t m_count = 0;
+
+    // open-addressed index of m_slots by key; see probe().
+    std::vector<std::uint32_t> m_index;
+    std::size_t m_index_mask = 0;
+    unsigned m_index_shift = 0;
+
+    std::uint64_t m_num_conflated = 0;
+
+    // send and receive monitor queues.
+    std::list<struct monitor_entry> m_send_monitors;
+    std::list<struct monitor_entry> m_recv_monitors;
+
+    // See event_channel::m_state_mask fmi.
+    std::uint32_t m_state_mask = chanState::WRITABLE;
+};
+
+//
+
+// A batching channel is a channel adaptor that delivers events in batches:
+// events pushed one by one (wchan interface) are read as
+// std::vector<payload_t> batches (rchan interface).
+//
+// A batch is complete once it holds max_items events, or once max_delay has
+// passed since its first event was pushed, whichever comes first. This is
+// the usual (Nagle-style) latency/throughput trade-off: a consumer that
+// would otherwise be woken for every one of a burst of small events is
+// woken once per batch instead, at the cost of each event waiting for up to
+// max_delay before it can be read. Both knobs can be changed at any time.
+//
+// Complete batches are queued in an event_channel of batches (of capacity
+// max_batches), which is what monitors are added to: monitors are notified
+// of READABLE only when a batch is complete, and of WRITABLE when there is
+// room for another complete batch.
+//
+// NOTES:
+// (1) A batch whose deadline has passed is only completed when the channel
+// is next used: a push, a read, poll(), or a blocking read (get(),
+// try_get_until(), try_get_for()) which waits for exactly that. A consumer
+// that only relies on monitors should call poll() at next_deadline() e.g.
+// from a timer or via monitor::wait_until(), else a trailing batch can stay
+// pending until the next push.
+// (2) When max_batches complete batches are queued, the batch being filled
+// can still take up to max_items events. Beyond that pushes fail until the
+// consumer makes room.
+// (3) The vectors handed out to the consumer can be given back with
+// recycle(), to be reused for subsequent batches. This saves an allocation
+// per batch.
+// (4) Closing the channel discards all events, complete or not. Use flush()
+// first to deliver the events pending in the batch being filled.
+//
+template<typename ts_policy, typename... types>
+class batching_channel
+    : public wchan<batching_channel<ts_policy, types...>, types...>
+    , public rchan<batching_channel<ts_policy, types...>,
+                   std::vector<tarp::type_traits::type_or_tuple_t<types...>>>
+    , public std::enable_shared_from_this<
+        batching_channel<ts_policy, types...>> {
+    //
+    using this_type = batching_channel<ts_policy, types...>;
+    using lock_t = std::unique_lock<std::mutex>;
+    using mutex_t = std::mutex;
+    using payload_type = tarp::type_traits::type_or_tuple_t<types...>;
+    using batch_type = std::vector<payload_type>;
+    using batch_channel_t = event_channel<ts_policy, batch_type>;
+    using CLOCK = std::chrono::steady_clock;
+
+public:
+    using payload_t = payload_type;
+    using batch_t = batch_type;
+    using duration_t = CLOCK::duration;
+    using time_point_t = CLOCK::time_point;
+    using wchan_t = interfaces::wchan<this_type, types...>;
+    using rchan_t = interfaces::rchan<this_type, batch_t>;
+
+    DISALLOW_COPY_AND_MOVE(batching_channel);
+
+    // Make a channel that delivers batches of up to max_items events, at
+    // most max_delay after the first event of each was pushed, and that
+    // queues up to max_batches complete batches.
+    batching_channel(std::uint32_t max_items,
+                     duration_t max_delay,
+                     std::uint32_t max_batches = 16)
+        : m_batches(std::make_shared<batch_channel_t>(max_batches, false))
+        , m_max_batches(max_batches)
+        , m_max_items(max_items)
+        , m_max_delay(max_delay) {
+        if (m_max_items == 0) {
+            throw std::logic_error("nonsensical batch size of 0");
+        }
+        m_open.reserve(m_max_items);
+    }
+
+    // return a wchan interface reference.
+    interfaces::wchan<this_type, types...> &as_wchan() { return *this; }
+
+    // return a wchan interface shared ptr. NOTE: this may only be called
+    // if the channel has been constructed as a std::shared_ptr.
+    std::shared_ptr<interfaces::wchan<this_type, types...>>
+    as_wchan_sharedptr() {
+        return this->shared_from_this();
+    }
+
+    // return an rchan interface reference.
+    interfaces::rchan<this_type, batch_t> &as_rchan() { return *this; }
+
+    // return an rchan interface shared ptr. NOTE: this may only be called
+    // if the channel has been constructed as a std::shared_ptr.
+    std::shared_ptr<interfaces::rchan<this_type, batch_t>>
+    as_rchan_sharedptr() {
+        return this->shared_from_this();
+    }
+
+    // Add a monitor for the states specified in states. READABLE means a
+    // complete batch can be read. See event_channel::add_monitor fmi.
+    std::uint32_t add_monitor(std::shared_ptr<notifier> notifier,
+                              std::uint32_t states) {
+        return m_batches->add_monitor(notifier, states);
+    }
+
+    // Change the number of events that completes a batch. If the batch
+    // being filled already has that many, it is completed right away.
+    void set_max_items(std::uint32_t max_items) {
+        if (max_items == 0) {
+            throw std::logic_error("nonsensical batch size of 0");
+        }
+
+        lock_t l {m_mtx};
+        m_max_items = max_items;
+        if (m_open.size() >= m_max_items) {
+            seal(l);
+        }
+    }
+
+    std::uint32_t max_items() const {
+        lock_t l {m_mtx};
+        return m_max_items;
+    }
+
+    // Change how long after its first event a batch is completed. This
+    // applies to the batch being filled as well.
+    void set_max_delay(duration_t max_delay) {
+        {
+            lock_t l {m_mtx};
+            m_max_delay = max_delay;
+        }
+
+        // blocked readers must recompute how long to wait for.
+        m_cv.notify_all();
+    }
+
+    duration_t max_delay() const {
+        lock_t l {m_mtx};
+        return m_max_delay;
+    }
+
+    // Close the channel. All events are discarded, and monitors and blocked
+    // readers are woken. See (4).
+    void close() {
+        {
+            lock_t l {m_mtx};
+            m_closed = true;
+            m_open.clear();
+            m_pool.clear();
+        }
+
+        m_batches->close();
+        m_cv.notify_all();
+    }
+
+    // True if channel is closed, else False.
+    bool closed() const {
+        lock_t l {m_mtx};
+        return m_closed;
+    }
+
+    // True if there are no complete batches to read.
+    bool empty() const { return m_batches->empty(); }
+
+    // Return the number of complete batches ready to be read.
+    std::size_t size() const { return m_batches->size(); }
+
+    // Return the number of events in the batch being filled.
+    std::size_t pending() const {
+        lock_t l {m_mtx};
+        return m_open.size();
+    }
+
+    // Return the time when the batch being filled is due to be completed,
+    // or nullopt if it is empty. See (1).
+    std::optional<time_point_t> next_deadline() const {
+        lock_t l {m_mtx};
+        if (m_open.empty()) {
+            return std::nullopt;
+        }
+        return m_open_since + m_max_delay;
+    }
+
+    // Complete the batch being filled if it is due. Return true if a batch
+    // was completed. See (1).
+    bool poll() {
+        lock_t l {m_mtx};
+        return expire(l, CLOCK::now());
+    }
+
+    // Complete the batch being filled now, if it is not empty. Return true
+    // if a batch was completed (false if there was nothing to complete or
+    // there is no room for it, see (2)).
+    bool flush() {
+        lock_t l {m_mtx};
+        return seal(l);
+    }
+
+    // Give a batch obtained from the channel back to be reused. See (3).
+    void recycle(batch_t &&batch) {
+        batch.clear();
+
+        lock_t l {m_mtx};
+        if (!m_closed && m_pool.size() < m_max_batches) {
+            m_pool.push_back(std::move(batch));
+        }
+    }
+
+    // Add an event to the batch being filled, completing it if it is then
+    // full.
+    //
+    // This fails if the channel is closed, or if it is backed up, see (2).
+    //
+    // If successful, return {true, nullopt}.
+    // Otherwise return {false, std::optional<data>}, whereby the data is not
+    // lost but returned to the caller.
+    template<typename... T>
+    std::pair<bool, std::optional<payload_type>> try_push(T &&...data) {
+        lock_t l {m_mtx};
+
+        if (m_closed || !make_room(l, CLOCK::now())) {
+            return {false, opt_payload(std::forward<T>(data)...)};
+        }
+
+        store(l, std::forward<T>(data)...);
+        if (m_open.size() >= m_max_items) {
+            seal(l);
+        }
+
+        return {true, std::nullopt};
+    }
+
+    // Push the events in [first, last) under a single lock, completing
+    // batches as they fill up. Return the number of events pushed: 0 if the
+    // channel is closed.
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        auto now = CLOCK::now();
+        std::size_t n = 0;
+        for (; first != last && make_room(l, now); ++first, ++n) {
+            m_open.emplace_back(*first);
+            if (m_open.size() >= m_max_items) {
+                seal(l);
+            }
+        }
+
+        return n;
+    }
+
+    // Return the oldest complete batch, or nullopt if there is none.
+    std::optional<batch_t> try_get() {
+        return read([this] { return m_batches->try_get(); });
+    }
+
+    // Return all complete batches.
+    std::deque<batch_t> get_all() {
+        return read([this] { return m_batches->get_all(); });
+    }
+
+    // Move up to max of the oldest complete batches to out. Return the
+    // number of batches moved.
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        return read([this, &out, max] { return m_batches->try_get_n(out, max); });
+    }
+
+    // Move all complete batches to the back of batches. Return the number
+    // of batches moved.
+    std::size_t drain_into(std::vector<batch_t> &batches) {
+        return read([this, &batches] { return m_batches->drain_into(batches); });
+    }
+
+    // Return the oldest complete batch, waiting until there is one. A batch
+    // being filled is completed when it is due. Return nullopt if the
+    // channel is (or gets) closed.
+    std::optional<batch_t> get() { return do_get_until(time_point_t {}, false); }
+
+    // Like get(), but the wait has a deadline.
+    std::optional<batch_t> try_get_until(const time_point_t &abs_time) {
+        return do_get_until(abs_time, true);
+    }
+
+    template<class Rep, class Period>
+    std::optional<batch_t>
+    try_get_for(const std::chrono::duration<Rep, Period> &rel_time) {
+        return try_get_until(CLOCK::now() + rel_time);
+    }
+
+    // More convenient and expressive overloads for enqueuing
+    // and dequeueing an element. See the comments in `class trunk` fmi.
+    auto operator<<(const payload_t &data) { return try_push(data); }
+
+    auto operator<<(payload_t &&data) { return try_push(std::move(data)); }
+
+    auto &operator>>(std::optional<batch_t> &batch) {
+        batch = try_get();
+        return *this;
+    }
+
+private:
+    // Complete the batch being filled if it is full or due. Return true if a
+    // batch was completed.
+    bool expire(lock_t &l, time_point_t now) {
+        if (m_open.empty()) {
+            return false;
+        }
+
+        if (m_open.size() < m_max_items && now < m_open_since + m_max_delay) {
+            return false;
+        }
+
+        return seal(l);
+    }
+
+    // Make sure the batch being filled can take another event, completing
+    // it first if it is full or due. Return false if there is no room, see
+    // (2).
+    bool make_room(lock_t &l, time_point_t now) {
+        expire(l, now);
+
+        if (m_open.empty()) {
+            m_open_since = now;
+
+            // blocked readers must now wait until the batch is due.
+            m_cv.notify_one();
+            return true;
+        }
+
+        return m_open.size() < m_max_items;
+    }
+
+    // Queue the batch being filled as complete and start a new one. Return
+    // false if it is empty or there is no room for it.
+    bool seal(lock_t &) {
+        if (m_open.empty()) {
+            return false;
+        }
+
+        auto [ok, rejected] = m_batches->try_push(std::move(m_open));
+        if (!ok) {
+            m_open = std::move(*rejected);
+            m_stalled = true;
+            return false;
+        }
+
+        m_stalled = false;
+        if (m_pool.empty()) {
+            m_open = batch_t {};
+            m_open.reserve(m_max_items);
+        } else {
+            m_open = std::move(m_pool.back());
+            m_pool.pop_back();
+        }
+
+        m_cv.notify_one();
+        return true;
+    }
+
+    // Read from m_batches with f, completing the batch being filled first if
+    // it is due, and after if reading made room for it (see (2)).
+    template<typename F>
+    auto read(F &&f) {
+        poll();
+        auto res = f();
+        if (m_stalled) {
+            poll();
+        }
+        return res;
+    }
+
+    std::optional<batch_t> do_get_until(const time_point_t &abs_time,
+                                        bool timed) {
+        lock_t l {m_mtx};
+
+        for (;;) {
+            auto now = CLOCK::now();
+            expire(l, now);
+
+            auto batch = m_batches->try_get();
+            if (batch) {
+                if (m_stalled) {
+                    expire(l, now);
+                }
+                return batch;
+            }
+
+            if (m_closed || (timed && abs_time <= now)) {
+                return std::nullopt;
+            }
+
+            // wait for a batch, or until the batch being filled is due.
+            if (m_open.empty()) {
+                if (timed) {
+                    m_cv.wait_until(l, abs_time);
+                } else {
+                    m_cv.wait(l);
+                }
+                continue;
+            }
+
+            auto deadline = m_open_since + m_max_delay;
+            if (timed && abs_time < deadline) {
+                deadline = abs_time;
+            }
+            m_cv.wait_until(l, deadline);
+        }
+    }
+
+    // See event_channel::opt_payload() fmi.
+    template<typename... T>
+    constexpr auto opt_payload(T &&...data) {
+        std::optional<payload_type> opt;
+        if constexpr (tarp::type_traits::is_tuple_v<T...>) {
+            opt.emplace(std::make_tuple(std::forward<T>(data)...));
+        } else {
+            opt.emplace(std::forward<T>(data)...);
+        }
+        return opt;
+    }
+
+    // Append data as a new event to the batch being filled.
+    template<typename... T>
+    void store(lock_t &, T &&...data) {
+        if constexpr (tarp::type_traits::is_tuple_v<T...>) {
+            m_open.emplace_back(std::make_tuple(std::forward<T>(data)...));
+        } else {
+            m_open.emplace_back(std::forward<T>(data)...);
+        }
+    }
+
+private:
+    // complete batches.
+    const std::shared_ptr<batch_channel_t> m_batches;
+    const std::uint32_t m_max_batches = 0;
+
+    mutable mutex_t m_mtx;
+    std::condition_variable m_cv;
+    bool m_closed {false};
+
+    std::uint32_t m_max_items = 0;
+    duration_t m_max_delay {};
+
+    // the batch being filled, and when its first event was pushed.
+    batch_t m_open;
+    time_point_t m_open_since {};
+
+    // set when a complete batch found no room in m_batches; see (2).
+    std::atomic<bool> m_stalled {false};
+
+    // recycled batches; see (3).
+    std::vector<batch_t> m_pool;
+};
+
+//
+
+// Unbuffered event channel i.e. a channel with capacity 0.
+//
+// No writes or reads are possible if the channel is closed. Closing a channel
+// unblocks all waiting actors.
+//
+// Writes (see push()) to this channel can only be carried out when there's a
+// corresponding blocked receiver waiting.
+//
+// Reads (see get()) from this channel can only be carried out when there's a
+// corresponding blocked sender waiting.
+//
+// The channel can be monitored for readability or writability. NOTE: a monitor
+// does **not** count as a **waiting** (i.e. blocking) receiver or sender.
+// As a consequence, if all actors are monitors, no messages can/will be sent or
+// received because monitors only use try_get/try_push (see comments below).
+//
+template<typename... types>
+class trunk
+    : public interfaces::wtrunk<trunk<types...>, types...>
+    , public interfaces::rtrunk<trunk<types...>, types...> {
+    //
+    using is_tuple =
+      typename tarp::type_traits::type_or_tuple<types...>::is_tuple;
+    using this_type = trunk<types...>;
+    using lock_t = std::unique_lock<std::mutex>;
+    using mutex_t = std::mutex;
+    using payload_type = tarp::type_traits::type_or_tuple_t<types...>;
+
+    // Structure that represents a blocked, waiting writer (sender) or
+    // reader (receiver).
+    struct operation {
+        // Sender CTOR.
+        template<typename... T>
+        operation(T &&...d) {
+            if constexpr (tarp::type_traits::is_tuple_v<T...>) {
+                data.emplace(std::make_tuple(std::forward<T>(d)...));
+            } else {
+                data.emplace(std::forward<T>(d)...);
+            }
+        }
+
+        // Receiver CTOR.
+        operation() = default;
+
+        // Sender data to send or receiver data placeholder to populate.
+        std::optional<payload_type> data;
+
+        // True if data successfully sent/received.
+        bool done = false;
+
+        // Lets us individually wake up a sender or receiver. This helps
+        // prevent thundering herds.
+        std::condition_variable condvar;
+    };
+
+    // Structure that represents a monitor to be notified of changes in the
+    // channel state.
+    struct monitor_entry {
+        monitor_entry(std::shared_ptr<notifier> notifier) : notif(notifier) {}
+
+        std::shared_ptr<notifier> notif;
+    };
+
+public:
+    using payload_t = payload_type;
+    using Ts = std::tuple<types...>;
+    using wtrunk_t = interfaces::wtrunk<this_type, types...>;
+    using rtrunk_t = interfaces::rtrunk<this_type, types...>;
+
+    DISALLOW_COPY_AND_MOVE(trunk);
+    trunk() = default;
+
+    // return a wtrunk interface reference.
+    interfaces::wtrunk<this_type, types...> &as_wtrunk() { return *this; }
+
+    // return an rtrunk interface reference.
+    interfaces::rtrunk<this_type, types...> &as_rtrunk() { return *this; }
+
+    // Convenience notation for pushing to a channel.
+    //
+    // NOTE: this just calls push(), so it is blocking.
+    //
+    // NOTE: chaining/cascading is not permitted because the returned value
+    // is that of push() (see comments fmi) in order to avoid losing data on
+    // failure, rather than *this.
+    // That is, the following is not allowed:
+    // mychan << event1 << event2 ... << eventn;
+    //
+    // NOTE: the input is expected to be a payload_t. If it is a multi-type
+    // payload, then the caller must make a tuple.
+    // trunk<unsigned> chan;
+    // auto [ok, returned] = chan << 1u;
+    //
+    // trunk<unsigned, unsigned> chan;
+    // auto [ok, returned] = chan << tuple(1u, 1u);
+    auto operator<<(const payload_t &data) {
+        // return *this;
+        return push(data);
+    }
+
+    auto operator<<(payload_t &&data) {
+        // return *this;
+        return push(std::move(data));
+    }
+
+    // Convenience notation for getting from a channel.
+    //
+    // NOTE: this just calls get(), so it is blocking.
+    //
+    // NOTE: chaining is allowed in this case. std::optional-wrapped
+    // payloads are stored in the arguments.
+    //
+    // trunk<int> chan;
+    // chan << 1;
+    // chan << 2;
+    // chan << 3;
+    // std::optional<int> a, b, c;
+    // chan >> a >> b >> c;
+    //  # NOTE: this will make (and block in) a call to get() 3 times.
+    auto &operator>>(std::optional<payload_t> &event) {
+        auto res = get();
+        if (res.has_value()) {
+            event.emplace(std::move(res.value()));
+        }
+        return *this;
+    }
+
+    // Add a monitor to be notified of changes involving the specified states.
+    //
+    // NOTE: a notification is emitted in two cases:
+    // - state becomes active (rising-edge notification)
+    // - state stops being active (falling-edge notification)
+    //
+    // For example, if state == chanState::READABLE, then a notification will
+    // be emitted when:
+    // - the channel becomes readable
+    // - the channel becomes unreadable
+    //
+    // The edge-triggered semantics makes it easy to implement either edge
+    // or level - triggered mechanisms on top.
+    //
+    // NOTE: once a monitor is added, this channel owns a shared_ptr reference
+    // to the associated notifier. Since .notify() may be invoked at any
+    // time, the monitor must ensure its notifier does not access resources
+    // that have gone out of scope. For example, the notifier might outlive the
+    // monitor since it's a shared_ptr; thus the notifier implementation must
+    // be designed such that this case is properly handled.
+    //
+    // NOTE: a monitor should be prepared to handle spurious notifications.
+    // E.g. if a WRITABLE notification is received, there is no guarantee the
+    // channel will still be writable by the time the monitor eventually acts
+    // on the notification, since *multiple* monitors could've been registered
+    // and notified. Therefore there is an inherent race between monitors. Other
+    // such situations may also result in a notification not reflecting the
+    // true state of the channel. Therefore monitors should use the
+    // try_{get,push} methods and be prepared to handle failures.
+    //
+    // == @return ==
+    // Return a bitfield indicating the currently pending state events on the
+    // channel. This is useful if a monitor is added after the occurence of
+    // an event. Specifically, it is meant to prevent this type of scenario:
+    //  - receiver calls get(), blocking forever.
+    //  - monitor is added for state=WRITABLE
+    //  - .. monitor never notified; receiver waits forever.
+    std::uint32_t add_monitor(std::shared_ptr<notifier> notifier,
+                              std::uint32_t states) {
+        struct monitor_entry mon(notifier);
+
+        lock_t l {m_mtx};
+
+        if (states & chanState::READABLE) {
+            m_recv_monitors.push_back(mon);
+        }
+
+        if (states & chanState::WRITABLE) {
+            m_send_monitors.push_back(mon);
+        }
+
+        return m_state_mask;
+    }
+
+    // Close a channel.
+    //
+    // A closed channel cannot be reopened.
+    // No read/write operations are possible on a closed channel.
+    //
+    // When the channel is closed, all blocked senders and receivers,
+    // and all monitors are woken.
+    // NOTE:
+    //     Since any receivers/senders currently engaged in a blocking wait
+    //     will be woken and immediately thereafter will access fields of this
+    //     class, the caller must ensure the object does not go out of scope
+    //     as this happens.
+    void close() {
+        decltype(m_recv_waitq) recvq;
+        decltype(m_send_waitq) sendq;
+        std::vector<std::shared_ptr<notifier>> monitors;
+
+        {
+            lock_t l {m_mtx};
+            m_closed = true;
+            m_state_mask |= chanState::CLOSED;
+
+            // clear the send and recv wait queues.
             std::swap(recvq, m_recv_waitq);
             std::swap(sendq, m_send_waitq);
 
@@ -1117,6 +2949,61 @@ public:
         return try_get_until(deadline);
     }
 
+    // Batch versions of try_push() and try_get(). Each takes the lock and
+    // refreshes the channel state only once for the whole batch, so
+    // monitors get at most one notification per state change for it.
+
+    // Hand the events in [first, last) to waiting receivers, one each, for
+    // as long as there are any. Events are copied or moved as *first allows
+    // (use std::make_move_iterator to move them). Return the number of
+    // events handed over.
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        std::size_t n = 0;
+        for (; first != last && !m_recv_waitq.empty(); ++first, ++n) {
+            hand_to_receiver(l, *first);
+        }
+
+        if (n > 0) {
+            refresh_channel_state(l);
+        }
+        return n;
+    }
+
+    // Take the events of up to max waiting senders, longest-waiting first,
+    // and move them to out. Return the number of events taken.
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        lock_t l {m_mtx};
+
+        if (m_closed) {
+            return 0;
+        }
+
+        std::size_t n = 0;
+        for (; n < max && !m_send_waitq.empty(); ++n) {
+            *out++ = std::move(*take_from_sender(l));
+        }
+
+        if (n > 0) {
+            refresh_channel_state(l);
+        }
+        return n;
+    }
+
+    // Take the events of all waiting senders and move them to the back of
+    // events. Return the number of events taken.
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        return try_get_n(std::back_inserter(events),
+                         std::numeric_limits<std::size_t>::max());
+    }
+
 private:
     // Block until one of the following conditions is true:
     // 1) (use_deadline=true AND) the deadline has passed.
@@ -1245,12 +3132,18 @@ private:
     // and woken up.
     template<typename... T>
     void pass_data(lock_t &l, T &&...data) {
+        hand_to_receiver(l, std::forward<T>(data)...);
+        refresh_channel_state(l);
+    }
+
+    // See pass_data(); the caller refreshes the channel state.
+    template<typename... T>
+    void hand_to_receiver(lock_t &, T &&...data) {
         struct operation &receiver = m_recv_waitq.front();
         receiver.data.emplace(std::forward<T>(data)...);
         receiver.done = true;
         receiver.condvar.notify_one();
         m_recv_waitq.pop_front();
-        refresh_channel_state(l);
     }
 
     // Get the data from a waiting sender.
@@ -1258,12 +3151,18 @@ private:
     // selected. The data is *moved* from it. The sender is removed from the
     // wait queue and woken up.
     std::optional<payload_t> get_data(lock_t &l) {
+        auto data = take_from_sender(l);
+        refresh_channel_state(l);
+        return data;
+    }
+
+    // See get_data(); the caller refreshes the channel state.
+    std::optional<payload_t> take_from_sender(lock_t &) {
         struct operation &sender = m_send_waitq.front();
         auto data = std::move(sender.data);
         sender.done = true;
         sender.condvar.notify_one();
         m_send_waitq.pop_front();
-        refresh_channel_state(l);
         return data;
     }
 
@@ -1350,52 +3249,511 @@ private:
             notify_monitors(m_send_monitors, S::WRITABLE, APPLY);
         }
 
-        // the channel has become NOT READABLE/WRITABLE; falling edge
-        if ((m_state_mask & S::READABLE) && !(current_state & S::READABLE)) {
-            notify_monitors(m_recv_monitors, S::READABLE, CLEAR);
+        // the channel has become NOT READABLE/WRITABLE; falling edge
+        if ((m_state_mask & S::READABLE) && !(current_state & S::READABLE)) {
+            notify_monitors(m_recv_monitors, S::READABLE, CLEAR);
+        }
+        if ((m_state_mask & S::WRITABLE) && !(current_state & S::WRITABLE)) {
+            notify_monitors(m_send_monitors, S::WRITABLE, CLEAR);
+        }
+
+        m_state_mask = current_state;
+        if (m_closed) {
+            m_state_mask |= chanState::CLOSED;
+        }
+    }
+
+    // return a std::optional event payload, stored according to its
+    // type_or_tuple semantics.
+    template<typename... T>
+    constexpr auto opt_payload(T &&...data) {
+        std::optional<payload_type> opt;
+        if constexpr (tarp::type_traits::is_tuple_v<T...>) {
+            opt.emplace(std::make_tuple(std::forward<T>(data)...));
+        } else {
+            opt.emplace(std::forward<T>(data)...);
+        }
+        return opt;
+    }
+
+private:
+    using CLOCK = std::chrono::steady_clock;
+    const CLOCK::time_point m_past_tp {CLOCK::now()};
+
+    mutable mutex_t m_mtx;
+    bool m_closed {false};
+
+    // sender and receiver wait queues.
+    std::list<std::reference_wrapper<struct operation>> m_send_waitq;
+    std::list<std::reference_wrapper<struct operation>> m_recv_waitq;
+
+    // send and receive monitor queues.
+    std::list<struct monitor_entry> m_send_monitors;
+    std::list<struct monitor_entry> m_recv_monitors;
+
+    // an event can happen before the addition of any monitor;
+    // we need to track these so we can signal the true state of the channel
+    // when a monitor joins.
+    std::uint32_t m_state_mask = 0;
+};
+
+//
+
+// Thin wrappers around futex(2), for parking threads on a 32-bit atomic.
+namespace futex {
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+
+// Block as long as word == expected, for at most timeout (or indefinitely
+// if NULL). NOTE this may also return spuriously.
+inline void wait(std::atomic<std::uint32_t> &word,
+                 std::uint32_t expected,
+                 const struct timespec *timeout) {
+    syscall(SYS_futex,
+            reinterpret_cast<std::uint32_t *>(&word),
+            FUTEX_WAIT_PRIVATE,
+            expected,
+            timeout,
+            nullptr,
+            0);
+}
+
+// Wake at most num_waiters threads blocked in wait() on word.
+inline void wake(std::atomic<std::uint32_t> &word, int num_waiters) {
+    syscall(SYS_futex,
+            reinterpret_cast<std::uint32_t *>(&word),
+            FUTEX_WAKE_PRIVATE,
+            num_waiters,
+            nullptr,
+            nullptr,
+            0);
+}
+}  // namespace futex
+
+//
+
+// Bounded multi-producer multi-consumer (MPMC) trunk.
+//
+// An mpmc_trunk has the same interface as a trunk -- blocking push() and
+// get(), their try_ and timed (try_*_until, try_*_for) variants, monitors --
+// but it is buffered: up to a fixed number of events are stored in a
+// lock-free ring (an mpmc ring_channel), so that a push only has to wait
+// when the trunk is full, and a get only when it is empty. Where a trunk
+// serializes all senders and receivers on a single mutex and gives each
+// blocked operation its own condition variable, here events are passed
+// without taking any lock, and a thread that does have to wait first spins
+// for a while and then parks on a futex: one for receivers waiting for an
+// event, and one for senders waiting for room. Threads on the other side
+// only make the system call to wake one up when there are any parked.
+//
+// How long to spin adapts to how often spinning pays off: the spin limit is
+// doubled whenever a thread gets through while spinning and halved whenever
+// it ends up parking anyway. On single-CPU systems there is no spinning.
+//
+// NOTE unlike with a trunk:
+// - try_push() and try_get() succeed whenever there is room in the trunk,
+//   or an event in it, respectively, whether or not anyone is blocked on the
+//   other end.
+// - monitors are notified when the trunk becomes readable (not empty) and
+//   writable (not full); see ring_channel.
+// - closing the trunk discards the events still buffered.
+//
+// See trunk::close() for the caveat on destroying the trunk while threads
+// are still blocked in it.
+template<typename... types>
+class mpmc_trunk
+    : public interfaces::wtrunk<mpmc_trunk<types...>, types...>
+    , public interfaces::rtrunk<mpmc_trunk<types...>, types...> {
+    //
+    using this_type = mpmc_trunk<types...>;
+    using payload_type = tarp::type_traits::type_or_tuple_t<types...>;
+    using channel_t = ring_channel<mpmc, types...>;
+    using CLOCK = std::chrono::steady_clock;
+
+    static constexpr std::uint32_t MIN_SPINS = 16;
+    static constexpr std::uint32_t MAX_SPINS = 4096;
+    static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    // Threads parked waiting for the same condition. futex is bumped
+    // whenever they should check again.
+    struct waitq {
+        alignas(CACHE_LINE_SIZE) std::atomic<std::uint32_t> futex {0};
+        std::atomic<std::uint32_t> num_waiters {0};
+    };
+
+public:
+    using payload_t = payload_type;
+    using Ts = std::tuple<types...>;
+    using wtrunk_t = interfaces::wtrunk<this_type, types...>;
+    using rtrunk_t = interfaces::rtrunk<this_type, types...>;
+
+    DISALLOW_COPY_AND_MOVE(mpmc_trunk);
+
+    // Make a trunk that can buffer up to capacity events.
+    explicit mpmc_trunk(std::uint32_t capacity)
+        : m_chan(capacity, false)
+        , m_max_spins(std::thread::hardware_concurrency() > 1 ? MAX_SPINS : 0)
+        , m_spins(m_max_spins ? MIN_SPINS : 0) {}
+
+    // return a wtrunk interface reference.
+    interfaces::wtrunk<this_type, types...> &as_wtrunk() { return *this; }
+
+    // return an rtrunk interface reference.
+    interfaces::rtrunk<this_type, types...> &as_rtrunk() { return *this; }
+
+    // See trunk::operator<< fmi. NOTE: this is blocking.
+    auto operator<<(const payload_t &data) { return push(data); }
+
+    auto operator<<(payload_t &&data) { return push(std::move(data)); }
+
+    // See trunk::operator>> fmi. NOTE: this is blocking.
+    auto &operator>>(std::optional<payload_t> &event) {
+        auto res = get();
+        if (res.has_value()) {
+            event.emplace(std::move(res.value()));
+        }
+        return *this;
+    }
+
+    // See trunk::add_monitor() and the NOTE above fmi.
+    std::uint32_t add_monitor(std::shared_ptr<notifier> notifier,
+                              std::uint32_t states) {
+        return m_chan.add_monitor(std::move(notifier), states);
+    }
+
+    // Close the trunk. All blocked senders and receivers, and all monitors
+    // are woken. See trunk::close() fmi.
+    void close() {
+        m_chan.close();
+        wake(m_receivers, INT_MAX);
+        wake(m_senders, INT_MAX);
+    }
+
+    // True if the trunk is closed, else False.
+    bool closed() const { return m_chan.closed(); }
+
+    // The number of events currently buffered.
+    std::size_t size() const { return m_chan.size(); }
+
+    bool empty() const { return m_chan.empty(); }
+
+    // Push an event into the trunk, waiting for room if it is full.
+    // See trunk::push() fmi.
+    template<typename... T>
+    auto push(T &&...data) {
+        return do_try_push_until(CLOCK::time_point {},
+                                 false,
+                                 std::forward<T>(data)...);
+    }
+
+    // Push an event into the trunk if there is room, without waiting.
+    template<typename... T>
+    std::pair<bool, std::optional<payload_type>> try_push(T &&...data) {
+        auto res = m_chan.try_push(std::forward<T>(data)...);
+        if (res.first) {
+            wake_waiters(m_receivers, 1);
+        }
+        return res;
+    }
+
+    // Push the events in [first, last) until the trunk is full, without
+    // waiting. See event_channel::try_push_n() fmi.
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        auto n = m_chan.try_push_n(first, last);
+        if (n > 0) {
+            wake_waiters(m_receivers, n);
+        }
+        return n;
+    }
+
+    // Like push(), but the wait has a deadline.
+    template<typename timepoint, typename... T>
+    auto try_push_until(const timepoint &abs_time, T &&...data) {
+        return do_try_push_until(abs_time, true, std::forward<T>(data)...);
+    }
+
+    template<class Rep, class Period, typename... T>
+    auto try_push_for(const std::chrono::duration<Rep, Period> &rel_time,
+                      T &&...data) {
+        auto deadline = CLOCK::now() + rel_time;
+        return try_push_until(deadline, std::forward<T>(data)...);
+    }
+
+    // Get the oldest event in the trunk, waiting for one if it is empty.
+    // nullopt is returned if the trunk gets closed.
+    std::optional<payload_t> get() {
+        return do_try_get_until(CLOCK::time_point {}, false);
+    }
+
+    // Get the oldest event in the trunk, if any, without waiting.
+    std::optional<payload_t> try_get() {
+        auto event = m_chan.try_get();
+        if (event.has_value()) {
+            wake_waiters(m_senders, 1);
+        }
+        return event;
+    }
+
+    // Move up to max of the oldest events in the trunk to out, without
+    // waiting. See event_channel::try_get_n() fmi.
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        auto n = m_chan.try_get_n(out, max);
+        if (n > 0) {
+            wake_waiters(m_senders, n);
+        }
+        return n;
+    }
+
+    // Move all events in the trunk to the back of events, without waiting.
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        auto n = m_chan.drain_into(events);
+        if (n > 0) {
+            wake_waiters(m_senders, n);
+        }
+        return n;
+    }
+
+    // Like get(), but the wait has a deadline.
+    template<typename timepoint>
+    std::optional<payload_t> try_get_until(const timepoint &abs_time) {
+        return do_try_get_until(abs_time, true);
+    }
+
+    template<class Rep, class Period>
+    std::optional<payload_t>
+    try_get_for(const std::chrono::duration<Rep, Period> &rel_time) {
+        auto deadline = CLOCK::now() + rel_time;
+        return try_get_until(deadline);
+    }
+
+private:
+    // Return {true, nullopt} if the data has been pushed, else (closed or
+    // deadline passed) {false, optional<data>}. See trunk::push() fmi.
+    template<typename timepoint, typename... T>
+    std::pair<bool, std::optional<payload_type>>
+    do_try_push_until(const timepoint &abs_time,
+                      bool use_deadline,
+                      T &&...data) {
+        auto res = try_push(std::forward<T>(data)...);
+        if (res.first || closed()) {
+            return res;
+        }
+
+        // NOTE the event is handed back on every failed attempt.
+        auto event = std::move(res.second);
+        auto attempt = [this, &event] {
+            auto [ok, returned] = m_chan.try_push(std::move(*event));
+            if (!ok) {
+                event = std::move(returned);
+            }
+            return ok;
+        };
+
+        if (!wait_on(m_senders, attempt, abs_time, use_deadline)) {
+            return {false, std::move(event)};
+        }
+
+        wake_waiters(m_receivers, 1);
+        return {true, std::nullopt};
+    }
+
+    // See do_try_push_until fmi.
+    template<typename timepoint>
+    std::optional<payload_t> do_try_get_until(const timepoint &abs_time,
+                                              bool use_deadline) {
+        auto event = try_get();
+        if (event.has_value() || closed()) {
+            return event;
+        }
+
+        auto attempt = [this, &event] {
+            event = m_chan.try_get();
+            return event.has_value();
+        };
+
+        if (!wait_on(m_receivers, attempt, abs_time, use_deadline)) {
+            return std::nullopt;
+        }
+
+        wake_waiters(m_senders, 1);
+        return event;
+    }
+
+    // Call attempt() until it succeeds, the trunk is closed, or (if
+    // use_deadline=true) the deadline passes: spin first, then park on q.
+    // True if attempt() succeeded.
+    template<typename F, typename timepoint>
+    bool wait_on(waitq &q,
+                 F &attempt,
+                 const timepoint &abs_time,
+                 bool use_deadline) {
+        auto spins = m_spins.load(std::memory_order_relaxed);
+        for (std::uint32_t i = 0; i < spins; ++i) {
+            cpu_relax();
+            if (attempt()) {
+                adapt_spins(true);
+                return true;
+            }
+            if (closed()) {
+                return false;
+            }
+        }
+        adapt_spins(false);
+
+        for (;;) {
+            auto seq = q.futex.load(std::memory_order_acquire);
+
+            // NOTE the other side checks num_waiters after each push/get
+            // (see wake_waiters()), so either it sees us here or we see its
+            // push/get in the attempt that follows.
+            q.num_waiters.fetch_add(1, std::memory_order_seq_cst);
+
+            bool ok = attempt();
+            if (ok || closed()) {
+                q.num_waiters.fetch_sub(1, std::memory_order_relaxed);
+                return ok;
+            }
+
+            struct timespec timeout {};
+            if (use_deadline) {
+                auto now = timepoint::clock::now();
+                if (abs_time <= now) {
+                    q.num_waiters.fetch_sub(1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  abs_time - now);
+                timeout.tv_sec = static_cast<time_t>(ns.count() / 1000000000);
+                timeout.tv_nsec = static_cast<long>(ns.count() % 1000000000);
+            }
+
+            futex::wait(q.futex, seq, use_deadline ? &timeout : nullptr);
+            q.num_waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Wake up to n threads parked on q, if any, after n events were pushed
+    // or taken.
+    void wake_waiters(waitq &q, std::size_t n) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (q.num_waiters.load(std::memory_order_relaxed) > 0) {
+            wake(q, static_cast<int>(std::min<std::size_t>(n, INT_MAX)));
+        }
+    }
+
+    void wake(waitq &q, int num_waiters) {
+        q.futex.fetch_add(1, std::memory_order_release);
+        futex::wake(q.futex, num_waiters);
+    }
+
+    // Raise or lower the spin limit depending on whether spinning paid off.
+    void adapt_spins(bool paid_off) {
+        if (m_max_spins == 0) {
+            return;
+        }
+
+        auto spins = m_spins.load(std::memory_order_relaxed);
+        spins = paid_off ? std::min(spins * 2, m_max_spins)
+                         : std::max(spins / 2, MIN_SPINS);
+        m_spins.store(spins, std::memory_order_relaxed);
+    }
+
+private:
+    channel_t m_chan;
+
+    waitq m_receivers;
+    waitq m_senders;
+
+    const std::uint32_t m_max_spins;
+    std::atomic<std::uint32_t> m_spins;
+};
+
+//
+
+// A notifier that signals an eventfd, so that channels, trunks, aggregators
+// etc can be monitored through epoll or an event loop, without a thread
+// blocking on them. See tarp/evchan_pump.hxx for use with tarp::EventPump.
+//
+// Wakeups are coalesced: the eventfd is only written to on the first
+// notification since the reader last called acknowledge(). A burst of
+// notifications therefore costs a single write and makes the eventfd
+// readable once.
+//
+// NOTES:
+// (1) Only the rising edges (APPLY) of the states of interest signal the
+// eventfd. As the notifications are edge-triggered, the reader must call
+// acknowledge() _before_ draining the channel, and must either drain it
+// completely or call rearm() to be woken again for whatever is left.
+// (2) chanState::CLOSED always signals the eventfd; see closed().
+// (3) Once detach() is called, the notifier asks to be removed on its next
+// notification.
+class eventfd_notifier final : public notifier {
+public:
+    DISALLOW_COPY_AND_MOVE(eventfd_notifier);
+
+    // Throw std::system_error if the eventfd cannot be created.
+    explicit eventfd_notifier(std::uint32_t states = chanState::READABLE)
+        : m_states(states | chanState::CLOSED) {
+        m_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_fd < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "failed to create eventfd");
+        }
+    }
+
+    ~eventfd_notifier() override { ::close(m_fd); }
+
+    // The eventfd to poll for readability.
+    int fd() const { return m_fd; }
+
+    bool notify(std::uint32_t states, std::uint32_t action) override {
+        if (m_detached.load(std::memory_order_relaxed)) {
+            return false;
         }
-        if ((m_state_mask & S::WRITABLE) && !(current_state & S::WRITABLE)) {
-            notify_monitors(m_send_monitors, S::WRITABLE, CLEAR);
+
+        if (action != APPLY || !(states & m_states)) {
+            return true;
         }
 
-        m_state_mask = current_state;
-        if (m_closed) {
-            m_state_mask |= chanState::CLOSED;
+        if (states & chanState::CLOSED) {
+            m_closed.store(true, std::memory_order_release);
         }
+
+        rearm();
+        return true;
     }
 
-    // return a std::optional event payload, stored according to its
-    // type_or_tuple semantics.
-    template<typename... T>
-    constexpr auto opt_payload(T &&...data) {
-        std::optional<payload_type> opt;
-        if constexpr (tarp::type_traits::is_tuple_v<T...>) {
-            opt.emplace(std::make_tuple(std::forward<T>(data)...));
-        } else {
-            opt.emplace(std::forward<T>(data)...);
+    // Signal the eventfd, unless it has been signaled already since the last
+    // acknowledge().
+    void rearm() {
+        if (!m_signaled.exchange(true, std::memory_order_acq_rel)) {
+            std::uint64_t one = 1;
+            [[maybe_unused]] auto rc = ::write(m_fd, &one, sizeof(one));
         }
-        return opt;
     }
 
-private:
-    using CLOCK = std::chrono::steady_clock;
-    const CLOCK::time_point m_past_tp {CLOCK::now()};
-
-    mutable mutex_t m_mtx;
-    bool m_closed {false};
+    // Consume the signal, making the eventfd unreadable, and allow it to be
+    // signaled again. See (1).
+    void acknowledge() {
+        std::uint64_t count;
+        [[maybe_unused]] auto rc = ::read(m_fd, &count, sizeof(count));
+        m_signaled.store(false, std::memory_order_seq_cst);
+    }
 
-    // sender and receiver wait queues.
-    std::list<std::reference_wrapper<struct operation>> m_send_waitq;
-    std::list<std::reference_wrapper<struct operation>> m_recv_waitq;
+    // True if the monitored channel has been closed.
+    bool closed() const { return m_closed.load(std::memory_order_acquire); }
 
-    // send and receive monitor queues.
-    std::list<struct monitor_entry> m_send_monitors;
-    std::list<struct monitor_entry> m_recv_monitors;
+    // See (3).
+    void detach() { m_detached.store(true, std::memory_order_relaxed); }
 
-    // an event can happen before the addition of any monitor;
-    // we need to track these so we can signal the true state of the channel
-    // when a monitor joins.
-    std::uint32_t m_state_mask = 0;
+private:
+    const std::uint32_t m_states;
+    int m_fd {-1};
+    std::atomic<bool> m_signaled {false};
+    std::atomic<bool> m_closed {false};
+    std::atomic<bool> m_detached {false};
 };
 
 //
@@ -1415,6 +3773,14 @@ private:
 // caller in its place. This is normally some id or lookup key.
 //  NOTE: the label/id must uniquely identify a channel/trunk etc in the
 //  monitor.
+//
+// Internally, each watched channel gets a dense slot that its notifier
+// indexes directly, and the level/edge state is kept in bitsets, with the
+// ready slots queued in a ring. All of these are sized by watch(), so
+// neither channel notifications nor wait() hash or allocate.
+//  NOTE: wait(), wait_for() and wait_until() return a reference to a list
+//  that the monitor reuses: it is only valid until the next such call.
+//  A monitor is therefore meant to be waited on by a single thread.
 class monitor {
 private:
     using lockref = std::unique_lock<std::mutex> &;
@@ -1432,20 +3798,116 @@ private:
         using flags_t = std::uint32_t;
         using interest_mask_t = flags_t;
         using id_t = std::uint32_t;
+        using slot_t = std::uint32_t;
+        using bitset_t = std::vector<std::uint64_t>;
+
+        // Subscription entry. events is updated based on channel
+        // notifications. mask is the actual events the client is interested
+        // in being notified about. generation is bumped every time the slot
+        // is unwatched, so that stale notifiers can be told apart.
+        struct slot {
+            id_t id {0};
+            flags_t events {0};
+            interest_mask_t mask {0};
+            std::uint32_t generation {0};
+            bool used {false};
+        };
+
+        std::vector<slot> m_slots;
+        std::vector<slot_t> m_free_slots;
+
+        // id -> slot. Only used by watch() and unwatch().
+        std::unordered_map<id_t, slot_t> m_slot_of;
+
+        // Bitsets indexed by slot:
+        // - m_high: the channels in a state of interest. I.e. their level is
+        //   'high' --> used for level-triggered notifications.
+        // - m_edged: the channels that have entered a state of interest since
+        //   last time. Used for edge-triggered notifications.
+        // - m_queued: the channels currently in m_ready.
+        bitset_t m_high;
+        bitset_t m_edged;
+        bitset_t m_queued;
+        std::size_t m_num_high {0};
+
+        // Readiness ring: the slots that have gone high, in the order they
+        // did. Each slot is in it at most once, so it never needs more room
+        // than there are slots.
+        std::vector<slot_t> m_ready;
+        std::size_t m_ready_head {0};
+        std::size_t m_ready_count {0};
+
+        // (id, events) for each ready channel, as returned by wait().
+        std::vector<std::pair<id_t, flags_t>> m_results;
+
+        static bool test(const bitset_t &bits, slot_t i) {
+            return (bits[i / 64] >> (i % 64)) & 1;
+        }
+
+        static void set(bitset_t &bits, slot_t i) {
+            bits[i / 64] |= std::uint64_t {1} << (i % 64);
+        }
+
+        static void reset(bitset_t &bits, slot_t i) {
+            bits[i / 64] &= ~(std::uint64_t {1} << (i % 64));
+        }
+
+        void set_high(slot_t i) {
+            if (!test(m_high, i)) {
+                set(m_high, i);
+                ++m_num_high;
+            }
+
+            if (!test(m_queued, i)) {
+                set(m_queued, i);
+                m_ready[(m_ready_head + m_ready_count) % m_ready.size()] = i;
+                ++m_ready_count;
+            }
+        }
+
+        // The slot stays in the ring until the next get_latest().
+        void clear_high(slot_t i) {
+            if (test(m_high, i)) {
+                reset(m_high, i);
+                --m_num_high;
+            }
+            reset(m_edged, i);
+        }
+
+        slot_t pop_ready() {
+            slot_t i = m_ready[m_ready_head];
+            m_ready_head = (m_ready_head + 1) % m_ready.size();
+            --m_ready_count;
+            return i;
+        }
+
+        // Get a free slot, growing all per-slot state as needed.
+        slot_t new_slot() {
+            if (!m_free_slots.empty()) {
+                slot_t i = m_free_slots.back();
+                m_free_slots.pop_back();
+                return i;
+            }
+
+            slot_t i = static_cast<slot_t>(m_slots.size());
+            m_slots.emplace_back();
 
-        // Subscription entry. flags_t is updated based on channel
-        // notifications. interest_mask_t is the actual events the client is
-        // interested in being notified about.
-        std::unordered_map<id_t, std::pair<flags_t, interest_mask_t>>
-          m_notified_map;
+            std::size_t nwords = m_slots.size() / 64 + 1;
+            m_high.resize(nwords, 0);
+            m_edged.resize(nwords, 0);
+            m_queued.resize(nwords, 0);
 
-        // All the channels that are in a state of interest. I.e. their level
-        // is 'high' --> used for level-triggered notifications.
-        std::unordered_set<id_t> m_high;
+            // straighten out the ring while growing it.
+            std::vector<slot_t> ready(m_slots.size());
+            for (std::size_t k = 0; k < m_ready_count; ++k) {
+                ready[k] = m_ready[(m_ready_head + k) % m_ready.size()];
+            }
+            m_ready = std::move(ready);
+            m_ready_head = 0;
 
-        // All the channels that have entered a state of interest since last
-        // time. Used for edge-triggered notifications.
-        std::unordered_set<id_t> m_edged;
+            m_results.reserve(m_slots.size());
+            return i;
+        }
     };
 
     std::shared_ptr<struct state> m_state;
@@ -1454,8 +3916,11 @@ private:
     // channel state.
     class channel_notifier final : public notifier {
     public:
-        channel_notifier(std::uint32_t id, std::shared_ptr<struct state> state)
-            : m_lookup_key(id), m_state(std::move(state)) {}
+        channel_notifier(state::slot_t slot,
+                         std::uint32_t generation,
+                         std::shared_ptr<struct state> state)
+            : m_slot(slot), m_generation(generation), m_state(std::move(state)) {
+        }
 
         bool notify(uint32_t events, uint32_t action) override {
             bool wake = (action == APPLY);
@@ -1470,25 +3935,19 @@ private:
                 std::unique_lock l {state->m_mtx};
 
                 // unsubscribed => remove notifier.
-                auto found = state->m_notified_map.find(m_lookup_key);
-                if (found == state->m_notified_map.end()) {
-                    state->m_edged.erase(m_lookup_key);
-                    state->m_high.erase(m_lookup_key);
+                auto &slot = state->m_slots[m_slot];
+                if (!slot.used || slot.generation != m_generation) {
                     return false;
                 }
 
                 using S = chanState;
 
-                [[maybe_unused]] auto &[stored_events, interest_mask] =
-                  found->second;
+                auto &stored_events = slot.events;
+                auto interest_mask = slot.mask;
                 std::uint32_t risen_states = 0;
                 std::uint32_t high_states = 0;
 
                 // Update existing state knowledge to latest.
-                //
-                // std::cerr << " * * * notification. id=" << m_lookup_key << "
-                // events=" << events  << " apply=" << action << std::endl;
-
                 if (action == APPLY) {
                     // Check for rising edges:
                     // state changes TO high=readable/writable
@@ -1517,23 +3976,22 @@ private:
                 // if we got any rising-edge notifications for any events of
                 // interest
                 if (risen_states & interest_mask) {
-                    state->m_edged.insert(m_lookup_key);
+                    state->set(state->m_edged, m_slot);
                 }
 
                 // if the level is high for any states of interest
                 if (high_states & interest_mask) {
-                    state->m_high.insert(m_lookup_key);
+                    state->set_high(m_slot);
                 } else {
                     // otherwise no edge and not high, so no notification at
                     // all.
-                    state->m_high.erase(m_lookup_key);
-                    state->m_edged.erase(m_lookup_key);
+                    state->clear_high(m_slot);
                 }
 
                 // chanState::CLOSED notifications are always passed through.
                 if (stored_events & chanState::CLOSED) {
-                    state->m_high.insert(m_lookup_key);
-                    state->m_edged.insert(m_lookup_key);
+                    state->set_high(m_slot);
+                    state->set(state->m_edged, m_slot);
                     wake = true;
                 }
             }
@@ -1547,48 +4005,49 @@ private:
         }
 
     private:
-        std::uint32_t m_lookup_key {0};
+        state::slot_t m_slot {0};
+        std::uint32_t m_generation {0};
         std::weak_ptr<struct state> m_state;
     };
 
     // Get the latest list of ready channels.
-    auto get_latest(lockref) {
-        decltype(m_state->m_edged) edged;
-        std::swap(edged, m_state->m_edged);
-
-        std::list<std::pair<state::id_t, state::flags_t>> results;
+    const auto &get_latest(lockref) {
+        auto &S = *m_state;
+        S.m_results.clear();
 
         // NOTE: currently only level-triggered monitoring is implemented
         // in the public API. To support edge-triggered monitoring we simply
-        // have to ONLY include a channel id in the result list IFF it appears
-        // in the edged list. I.e. there is an unhandled edge-triggered
-        // notification pending for it.
+        // have to ONLY include a channel in the result list IFF its m_edged
+        // bit is set. I.e. there is an unhandled edge-triggered notification
+        // pending for it.
         // Otherwise, if the monitoring for this channel is level-triggered,
-        // we ONLY put the entry in the results list IFF it appears in the
-        // 'high' list.
-        // Since currently we only support level-triggered monitoring, we simply
-        // copy the 'high' list of notifications. Note m_high is a superset of
+        // we ONLY put the entry in the results list IFF its m_high bit is set.
+        // Since currently we only support level-triggered monitoring, we
+        // simply report the 'high' channels. Note m_high is a superset of
         // m_edged since all rising-edge notifications make the level 'high',
         // and therefore trigger a level notification as well.
-        for (auto k : m_state->m_high) {
-            auto found = m_state->m_notified_map.find(k);
-            if (found == m_state->m_notified_map.end()) {
-                throw std::logic_error("BUG: failed lookup");
+        //
+        // Channels that are still high go back at the end of the ring; the
+        // others leave it.
+        for (std::size_t n = S.m_ready_count; n > 0; --n) {
+            auto i = S.pop_ready();
+            auto &slot = S.m_slots[i];
+
+            if (!slot.used || !state::test(S.m_high, i)) {
+                state::reset(S.m_queued, i);
+                continue;
             }
 
-            // get the actual (latest) events
-            auto [events, _] = found->second;
+            state::reset(S.m_queued, i);
+            S.set_high(i);
 
-            if (!events) {
-                continue;
+            if (slot.events) {
+                S.m_results.emplace_back(slot.id, slot.events);
             }
-
-            // std::cerr << "EVENT PENDING: k=" << k << " events=" << events <<
-            // std::endl;
-            results.push_back({k, events});
         }
 
-        return results;
+        std::fill(S.m_edged.begin(), S.m_edged.end(), 0);
+        return S.m_results;
     }
 
 public:
@@ -1597,13 +4056,12 @@ public:
     // block until an event happens OR the deadline is reached; return list of
     // events.
     template<typename timepoint>
-    auto wait_until(const timepoint &abs_time) {
+    const auto &wait_until(const timepoint &abs_time) {
         {
             std::unique_lock l {m_state->m_mtx};
-            if (!m_state->m_high.empty()) {
-                auto pending = get_latest(l);
+            if (m_state->m_num_high > 0) {
+                auto &pending = get_latest(l);
                 if (!pending.empty()) {
-                    // std::cerr << "pending not empty, returning now\n";
                     return pending;
                 }
             }
@@ -1615,18 +4073,17 @@ public:
     }
 
     template<class Rep, class Period>
-    auto wait_for(const std::chrono::duration<Rep, Period> &rel_time) {
+    const auto &wait_for(const std::chrono::duration<Rep, Period> &rel_time) {
         return wait_until(std::chrono::steady_clock::now() + rel_time);
     }
 
     // block until an event happens; return list of events.
-    auto wait() {
+    const auto &wait() {
         {
             std::unique_lock l {m_state->m_mtx};
-            if (!m_state->m_high.empty()) {
-                auto pending = get_latest(l);
+            if (m_state->m_num_high > 0) {
+                auto &pending = get_latest(l);
                 if (!pending.empty()) {
-                    // std::cerr << "pending not empty, returning now\n";
                     return pending;
                 }
             }
@@ -1649,14 +4106,22 @@ public:
 
         {
             std::unique_lock l {m_state->m_mtx};
-            m_state->m_notified_map[id] = {0, mask};
-            notifier = std::make_shared<channel_notifier>(id, m_state);
+            unwatch(l, id);
+
+            auto &S = *m_state;
+            auto i = S.new_slot();
+            auto &slot = S.m_slots[i];
+            slot.id = id;
+            slot.events = 0;
+            slot.mask = mask;
+            slot.used = true;
+            S.m_slot_of[id] = i;
+
+            notifier = std::make_shared<channel_notifier>(i, slot.generation,
+                                                          m_state);
             pending_evs = src.add_monitor(notifier, mask);
         }
 
-        // std::cerr << "added watch with mask " << static_cast<unsigned>(mask)
-        // << "; pending evs=" << pending_evs << std::endl;
-
         // see trunk::add_monitor().
         if (pending_evs & mask) {
             notifier->notify(pending_evs, APPLY);
@@ -1666,9 +4131,27 @@ public:
     // Stop monitoring the channel with the given id.
     void unwatch(std::uint32_t id) {
         std::unique_lock l {m_state->m_mtx};
-        m_state->m_notified_map.erase(id);
-        m_state->m_edged.erase(id);
-        m_state->m_high.erase(id);
+        unwatch(l, id);
+    }
+
+private:
+    void unwatch(lockref, std::uint32_t id) {
+        auto &S = *m_state;
+        auto found = S.m_slot_of.find(id);
+        if (found == S.m_slot_of.end()) {
+            return;
+        }
+
+        auto i = found->second;
+        S.m_slot_of.erase(found);
+        S.clear_high(i);
+
+        // its old notifier is now stale; see channel_notifier::notify().
+        auto &slot = S.m_slots[i];
+        slot.used = false;
+        slot.events = 0;
+        ++slot.generation;
+        S.m_free_slots.push_back(i);
     }
 };
 
@@ -1695,6 +4178,13 @@ public:
 // copyable, since one event is cloned to be written to an
 // arbitrary number of connected channels. Use an event_stream instead
 // if move-only events must be communicated.
+// For large events, use a broadcaster of shared_event (see
+// ts::shared_broadcaster) instead: the event is then stored once and each
+// channel only gets a reference-counted handle to it.
+//
+// The list of connected channels is copy-on-write: connect() publishes a new
+// list and dispatch() works off the list current when it starts, so
+// publishing and subscribers joining do not hold each other up.
 template<typename ts_policy, typename... types>
 class event_broadcaster final {
     static_assert(((std::is_copy_assignable_v<types> ||
@@ -1704,6 +4194,7 @@ class event_broadcaster final {
     using mutex_t = typename tarp::type_traits::ts_types<ts_policy>::mutex_t;
     using event_channel_t = event_channel<ts_policy, types...>;
     using wchan_t = wchan<event_channel_t, types...>;
+    using channel_list = std::vector<std::weak_ptr<wchan_t>>;
 
 public:
     using payload_t = typename event_channel_t::payload_t;
@@ -1736,30 +4227,34 @@ public:
     void dispatch() {
         lock_t l {m_mtx};
 
-        std::vector<std::shared_ptr<wchan_t>> channels;
-
-        for (auto it = m_event_channels.begin();
-             it != m_event_channels.end();) {
-            auto channel = it->lock();
+        auto channels = subscribers();
+        bool found_dead = false;
 
-            // lazily remove dangling dead channels.
-            if (!channel) {
-                it = m_event_channels.erase(it);
+        for (auto &channel : *channels) {
+            auto chan = channel.lock();
+            if (!chan) {
+                found_dead = true;
                 continue;
             }
+            m_targets.emplace_back(std::move(chan));
+        }
 
-            channels.emplace_back(channel);
-            ++it;
+        // lazily remove dangling dead channels.
+        if (found_dead) {
+            remove_dead_channels();
         }
 
-        auto events = m_event_buffer.get_all();
-        std::size_t num_channels = channels.size();
+        m_event_buffer.drain_into(m_events);
 
-        for (auto &event : events) {
-            for (std::size_t i = 0; i < num_channels; ++i) {
-                channels[i]->try_push(event);
+        for (auto &event : m_events) {
+            for (auto &chan : m_targets) {
+                chan->try_push(event);
             }
         }
+
+        // do not keep the channels alive past the dispatch.
+        m_events.clear();
+        m_targets.clear();
     }
 
     // More convenient and expressive overloads for enqueuing an event.
@@ -1775,23 +4270,49 @@ public:
 
     // Get the number of channels connected. This includes dangling
     // channels that are no longer alive.
-    std::size_t num_channels() const {
-        lock_t l {m_mtx};
-        return m_event_channels.size();
-    }
+    std::size_t num_channels() const { return subscribers()->size(); }
 
     // Join the broadcast group to receive events over the specified channel.
+    // This does not wait for any dispatch() in progress.
     void connect(std::weak_ptr<wchan_t> channel) {
-        lock_t l {m_mtx};
-        m_event_channels.push_back(channel);
+        lock_t l {m_subscribers_mtx};
+        auto channels = std::make_shared<channel_list>(*m_subscribers);
+        channels->push_back(std::move(channel));
+        m_subscribers = std::move(channels);
     }
 
 private:
+    std::shared_ptr<const channel_list> subscribers() const {
+        lock_t l {m_subscribers_mtx};
+        return m_subscribers;
+    }
+
+    void remove_dead_channels() {
+        lock_t l {m_subscribers_mtx};
+        auto channels = std::make_shared<channel_list>();
+        channels->reserve(m_subscribers->size());
+        for (auto &channel : *m_subscribers) {
+            if (!channel.expired()) {
+                channels->push_back(channel);
+            }
+        }
+        m_subscribers = std::move(channels);
+    }
+
     static inline constexpr std::size_t m_BUFFSZ {1000};
+
+    // serializes dispatch() calls; guards m_events and m_targets, which are
+    // kept to reuse their capacity.
     mutable mutex_t m_mtx;
     const bool m_autodispatch {false};
     event_channel_t m_event_buffer {m_BUFFSZ, true};
-    std::vector<std::weak_ptr<wchan_t>> m_event_channels;
+    std::vector<payload_t> m_events;
+    std::vector<std::shared_ptr<wchan_t>> m_targets;
+
+    // only guards swapping the pointer; see connect().
+    mutable mutex_t m_subscribers_mtx;
+    std::shared_ptr<const channel_list> m_subscribers {
+      std::make_shared<channel_list>()};
 };
 
 //
@@ -1854,11 +4375,28 @@ public:
         push_to_channel(m_event_buffer, std::forward<event_data_t>(data)...);
     }
 
+    // Batch version of push(), for the events in [first, last).
+    // See event_channel::try_push_n() fmi. Return the number of events
+    // enqueued (0 if autoflush=true and no one is listening).
+    template<typename InputIt>
+    std::size_t try_push_n(InputIt first, InputIt last) {
+        if (m_autoflush) {
+            auto chan = m_stream_channel.lock();
+            if (!chan) {
+                return 0;
+            }
+            return chan->try_push_n(first, last);
+        }
+
+        return m_event_buffer.try_push_n(first, last);
+    }
+
     // Send off all buffered events.
     void flush() {
         lock_t l {m_mtx};
 
-        auto events = m_event_buffer.get_all();
+        m_flushed.clear();
+        m_event_buffer.drain_into(m_flushed);
 
         auto chan = m_stream_channel.lock();
 
@@ -1868,16 +4406,9 @@ public:
             return;
         }
 
-        while (!events.empty()) {
-            if constexpr (((std::is_copy_assignable_v<types> ||
-                            std::is_copy_constructible_v<types>) &&
-                           ...)) {
-                chan->push(events.front());
-            } else {
-                chan->push(std::move(events.front()));
-            }
-            events.pop_front();
-        }
+        chan->try_push_n(std::make_move_iterator(m_flushed.begin()),
+                         std::make_move_iterator(m_flushed.end()));
+        m_flushed.clear();
     }
 
     // More convenient and expressive overloads for enqueuing
@@ -1922,6 +4453,9 @@ private:
     const std::size_t m_channel_capacity {0};
     event_channel_t m_event_buffer;
     std::weak_ptr<event_channel_t> m_stream_channel;
+
+    // events being flushed; kept to reuse its capacity.
+    std::vector<payload_t> m_flushed;
 };
 
 //
@@ -1959,6 +4493,15 @@ public:
 
     std::deque<payload_t> get_all() { return m_stream_channel->get_all(); }
 
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        return m_stream_channel->try_get_n(out, max);
+    }
+
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        return m_stream_channel->drain_into(events);
+    }
+
     auto &operator>>(std::optional<payload_t> &event) {
         m_stream_channel->operator>>(event);
         return *this;
@@ -1993,6 +4536,12 @@ private:
 // interface for a readable channel. Dequeing from the event_aggregator
 // dequeues from _one of_ its associated channels. When the event_aggregator
 // is readable, it means any one of its channels is readable.
+//
+// Internally, each channel is kept, by strong reference, in a dense slot.
+// The slots of the readable channels are set in a bitmap which try_get()
+// scans from a rotating cursor; this serves the readable channels in
+// round-robin order, and in O(1) amortized time regardless of how many
+// channels there are. The keys are only looked up by channel() and remove().
 template<typename ts_policy, typename key_t, typename... types>
 class event_aggregator final {
     //
@@ -2002,6 +4551,7 @@ class event_aggregator final {
     using event_wchan_t = wchan<event_channel_t, types...>;
     using payload_t = typename event_channel_t::payload_t;
     using this_type = event_rstream<ts_policy, types...>;
+    using slot_t = std::uint32_t;
 
     // This is meant to be stored in a shared_ptr to simplify lifetime
     // management. This is in order to prevent a notifier that outlives the
@@ -2011,25 +4561,122 @@ class event_aggregator final {
         std::mutex m_mtx;
         bool m_closed {false};
 
-        // all the member channels that are readable. (we are only interested
-        // in readability here). When this set is non-empty, we know the
-        // event_aggregator as a whole is readable.
-        std::unordered_set<key_t> m_readable;
+        // A managed channel. generation is bumped every time the slot is
+        // freed, so that the notifiers of removed channels can be told apart.
+        struct slot {
+            std::shared_ptr<event_channel_t> chan;
+            std::uint32_t generation {0};
+        };
+
+        std::vector<slot> m_slots;
+        std::vector<slot_t> m_free_slots;
+        std::unordered_map<key_t, slot_t> m_index;
+
+        // Bitmap of the slots of the readable member channels. (we are only
+        // interested in readability here). When it is not all zeroes, we know
+        // the event_aggregator as a whole is readable.
+        // m_summary has a bit set for each non-zero word of m_readable, so
+        // that sparse readiness is found without scanning every word.
+        std::vector<std::uint64_t> m_readable;
+        std::vector<std::uint64_t> m_summary;
+        std::size_t m_num_readable {0};
 
-        // keys tracking the alive-ness of notifiers used between
-        // event_aggregator and managed channels.
-        std::unordered_set<key_t> m_subscriptions;
+        // Where to resume looking for readable channels; see next_readable().
+        std::size_t m_cursor {0};
 
         // Notifiers used between event_aggregator and its clients.
         std::list<std::shared_ptr<notifier>> m_notifiers;
 
-        std::size_t m_idx {0};
-        std::vector<std::shared_ptr<event_channel_t>> m_channels;
-        std::unordered_map<key_t, std::weak_ptr<event_channel_t>> m_index;
+        bool readable(slot_t i) const {
+            return (m_readable[i / 64] >> (i % 64)) & 1;
+        }
+
+        // Mark slot i (un)readable. Return true if this made the
+        // event_aggregator as a whole (un)readable.
+        bool set_readable(slot_t i, bool on) {
+            if (readable(i) == on) {
+                return false;
+            }
+
+            std::size_t w = i / 64;
+            m_readable[w] ^= std::uint64_t {1} << (i % 64);
+
+            std::uint64_t summary_bit = std::uint64_t {1} << (w % 64);
+            if (m_readable[w]) {
+                m_summary[w / 64] |= summary_bit;
+            } else {
+                m_summary[w / 64] &= ~summary_bit;
+            }
+
+            if (on) {
+                return ++m_num_readable == 1;
+            }
+            return --m_num_readable == 0;
+        }
+
+        // Find the first bit set in bits at or after from, wrapping around.
+        // False if there is none.
+        static bool find_set(const std::vector<std::uint64_t> &bits,
+                             std::size_t from,
+                             std::size_t &pos) {
+            std::size_t nwords = bits.size();
+            from %= nwords * 64;
+            std::size_t w = from / 64;
+            std::uint64_t word = bits[w] & (~std::uint64_t {0} << (from % 64));
+
+            // nwords+1 words: the first one is revisited last, for the bits
+            // below from.
+            for (std::size_t k = 0; k <= nwords; ++k) {
+                if (word) {
+                    pos = w * 64 + static_cast<unsigned>(__builtin_ctzll(word));
+                    return true;
+                }
+                w = (w + 1) % nwords;
+                word = bits[w];
+            }
+
+            return false;
+        }
+
+        // Find the first readable slot at or after the cursor, wrapping
+        // around. False if there is none.
+        bool next_readable(slot_t &i) const {
+            if (m_num_readable == 0) {
+                return false;
+            }
+
+            // rest of the cursor's word; else first bit of the next non-zero
+            // word -- possibly the cursor's word again, wrapping around.
+            std::size_t start = m_cursor % (m_readable.size() * 64);
+            std::size_t w = start / 64;
+            std::uint64_t word =
+              m_readable[w] & (~std::uint64_t {0} << (start % 64));
 
-        // convert the key_t keys to uint32_t keys for internal use.
-        std::unordered_map<key_t, std::uint32_t> m_key_map;
-        std::uint32_t m_last_key {0};
+            if (!word) {
+                if (!find_set(m_summary, w + 1, w)) {
+                    return false;
+                }
+                word = m_readable[w];
+            }
+
+            i = static_cast<slot_t>(w * 64 + __builtin_ctzll(word));
+            return true;
+        }
+
+        // Get a free slot, growing the bitmap as needed.
+        slot_t new_slot() {
+            if (!m_free_slots.empty()) {
+                slot_t i = m_free_slots.back();
+                m_free_slots.pop_back();
+                return i;
+            }
+
+            slot_t i = static_cast<slot_t>(m_slots.size());
+            m_slots.emplace_back();
+            m_readable.resize(m_slots.size() / 64 + 1, 0);
+            m_summary.resize(m_readable.size() / 64 + 1, 0);
+            return i;
+        }
     };
 
     std::shared_ptr<struct state> m_state;
@@ -2042,8 +4689,11 @@ class event_aggregator final {
     // event_aggregator and its managed channels.
     class channel_notifier final : public notifier {
     public:
-        channel_notifier(std::uint32_t id, std::shared_ptr<struct state> state)
-            : m_lookup_key(id), m_state(std::move(state)) {}
+        channel_notifier(slot_t slot,
+                         std::uint32_t generation,
+                         std::shared_ptr<struct state> state)
+            : m_slot(slot), m_generation(generation), m_state(std::move(state)) {
+        }
 
         bool notify(uint32_t events, uint32_t action) override {
             // event_aggregator gone; return false to remove notifier.
@@ -2054,52 +4704,39 @@ class event_aggregator final {
 
             std::unique_lock l {state->m_mtx};
 
-            // channel no longer part of the event_aggregator => remove
-            // notifier.
-            if (state->m_subscriptions.count(m_lookup_key) == 0) {
+            if (state->m_closed) {
                 return false;
             }
 
-            if (state->m_closed) {
+            // channel no longer part of the event_aggregator => remove
+            // notifier.
+            auto &slot = state->m_slots[m_slot];
+            if (!slot.chan || slot.generation != m_generation) {
                 return false;
             }
 
-            using S = chanState;
-
-            bool rising_edge = false;
-            bool falling_edge = false;
-
-            /// if m_readable goes from empty to non-empty, then we have
-            /// a rising edge: the whole event_aggregator goes from
-            /// non-readable to readable.
-            if ((action == APPLY) and (events & chanState::READABLE)) {
-                rising_edge = state->m_readable.empty();
-                state->m_readable.insert(m_lookup_key);
+            if (!(events & (chanState::READABLE | chanState::CLOSED))) {
+                return true;
             }
 
-            // if m_readable goes from non-empty to empty, then we have
-            // a falling edge: the whole event_aggregator goes from
-            // readable to non-readable.
-            else if ((action == CLEAR) and (events & chanState::READABLE)) {
-                auto old_size = state->m_readable.size();
-                state->m_readable.erase(m_lookup_key);
-                if (old_size > 0 and state->m_readable.empty()) {
-                    falling_edge = true;
-                }
-            }
+            // a closed channel has nothing more to read.
+            bool readable =
+              (action == APPLY) && !(events & chanState::CLOSED);
 
-            // NOTE: We only notify on rising or falling edges
-            if (rising_edge) {
-                invoke_notifiers(state->m_notifiers, S::READABLE, APPLY);
-            } else if (falling_edge) {
-                invoke_notifiers(state->m_notifiers, S::READABLE, CLEAR);
+            // NOTE: We only notify on rising or falling edges: the whole
+            // event_aggregator going from non-readable to readable, or
+            // back.
+            if (state->set_readable(m_slot, readable)) {
+                invoke_notifiers(state->m_notifiers, chanState::READABLE,
+                                 readable ? APPLY : CLEAR);
             }
 
             return true;
         }
 
     private:
-        std::uint32_t m_lookup_key {0};
+        slot_t m_slot {0};
+        std::uint32_t m_generation {0};
         std::weak_ptr<struct state> m_state;
     };
 
@@ -2109,8 +4746,8 @@ class event_aggregator final {
                                  std::uint32_t action) {
         for (auto it = ls.begin(); it != ls.end();) {
             auto &notifier = *it;
-            bool must_remove = notifier->notify(flags, action);
-            if (must_remove) {
+            bool keep = notifier->notify(flags, action);
+            if (!keep) {
                 it = ls.erase(it);
                 continue;
             }
@@ -2140,10 +4777,7 @@ public:
 
             auto found = S.m_index.find(k);
             if (found != S.m_index.end()) {
-                auto chan = found->second.lock();
-                if (chan) {
-                    return chan;
-                }
+                return S.m_slots[found->second].chan;
             }
 
             if (S.m_closed) {
@@ -2151,16 +4785,13 @@ public:
             }
 
             auto chan = std::make_shared<event_channel_t>(chancap, true);
-            S.m_index[k] = chan;
-
-            std::uint32_t internal_key = S.m_last_key++;
-            S.m_key_map[k] = internal_key;
-
-            S.m_channels.push_back(chan);
+            auto i = S.new_slot();
+            auto &slot = S.m_slots[i];
+            slot.chan = chan;
+            S.m_index[k] = i;
 
             notifier =
-              std::make_shared<channel_notifier>(internal_key, m_state);
-            m_state->m_subscriptions.insert(internal_key);
+              std::make_shared<channel_notifier>(i, slot.generation, m_state);
             pending = chan->add_monitor(notifier, chanState::READABLE);
 
             channel = chan;
@@ -2176,65 +4807,63 @@ public:
     // Remove the channel with key k if found.
     void remove(const key_t &k) {
         auto &S = *m_state;
-        lock_t l {S.m_mtx};
-
         std::shared_ptr<event_channel_t> chan;
 
-        auto found = S.m_index.find(k);
-        if (found != S.m_index.end()) {
-            chan = found->second.lock();
+        {
+            lock_t l {S.m_mtx};
+
+            auto found = S.m_index.find(k);
+            if (found == S.m_index.end()) {
+                return;
+            }
+
+            auto i = found->second;
             S.m_index.erase(found);
-        }
 
-        if (!chan) {
-            return;
-        }
+            auto &slot = S.m_slots[i];
+            std::swap(chan, slot.chan);
+            ++slot.generation;
+            S.m_free_slots.push_back(i);
 
-        for (auto it = S.m_channels.begin(); it != S.m_channels.end();) {
-            if (*it == chan) {
-                it = S.m_channels.erase(it);
-                continue;
+            // falling edge.
+            if (S.set_readable(i, false)) {
+                invoke_notifiers(S.m_notifiers, chanState::READABLE, CLEAR);
             }
-            ++it;
         }
 
-        auto internal_key = S.m_key_map[k];
-        S.m_key_map.erase(k);
-        S.m_subscriptions.erase(internal_key);
-        auto size_before = S.m_readable.size();
-        S.m_readable.erase(internal_key);
-
-        // falling edge.
-        if (size_before > 0 && S.m_readable.empty()) {
-            invoke_notifiers(S.notifiers, chanState::READABLE, CLEAR);
-        }
+        // chan may be released here, outside the lock.
     }
 
     // Get an event from one of the channels. If there are no channels, or
     // if no channels have any events, then return std::nullopt;
     // Otherwise use a round-robin discpline when dequeuing in order to avoid
     // dequeuing from the same single channel all the time.
+    //
+    // NOTE: the aggregator lock is not held while dequeuing, since the
+    // channel may then notify the aggregator that it is no longer readable.
     std::optional<payload_t> try_get() {
         auto &S = *m_state;
-        auto &m_idx = S.m_idx;
-
-        lock_t l {S.m_mtx};
 
-        if (S.m_channels.empty()) {
-            return std::nullopt;
-        }
+        for (;;) {
+            std::shared_ptr<event_channel_t> chan;
 
-        std::size_t n = S.m_channels.size();
-        m_idx = m_idx % n;
+            {
+                lock_t l {S.m_mtx};
+                slot_t i;
+                if (!S.next_readable(i)) {
+                    return std::nullopt;
+                }
+                chan = S.m_slots[i].chan;
+                S.m_cursor = i + 1;
+            }
 
-        for (unsigned i = 0; i < n; ++i) {
-            auto res = S.m_channels[m_idx]->try_get();
-            m_idx = (m_idx + 1) % n;
-            if (res.has_value()) {
-                return res;
+            // If empty, another consumer got there first; the channel has
+            // then already been marked unreadable, so look again.
+            auto event = chan->try_get();
+            if (event.has_value()) {
+                return event;
             }
         }
-        return std::nullopt;
     }
 
     auto &operator>>(std::optional<payload_t> &event) {
@@ -2245,25 +4874,7 @@ public:
     // Get all events from across all channels. The events in the list returned
     // are intermixed by dequeing from each channel in round-robin order.
     std::deque<payload_t> get_all() {
-        auto &S = *m_state;
-        decltype(S.m_channels) channels;
-        std::uint32_t idx {0};
-
-        {
-            lock_t l {S.m_mtx};
-
-            // We need to copy all channel pointers so we can loop over the list
-            // without locking the mutex. Otherwise we deadlock, since
-            // some_channel.get_all() may trigger a notifier call, which will
-            // then try to grab this same lock.
-            channels = S.m_channels;
-
-            idx = S.m_idx;
-        }
-
-        if (channels.empty()) {
-            return {};
-        }
+        auto channels = readable_channels();
 
         std::size_t n = channels.size();
         std::vector<std::deque<payload_t>> events;
@@ -2276,12 +4887,12 @@ public:
 
         // round-robin over all event channels, taking one event from
         // each channel.
+        std::size_t idx = 0;
         while (!events.empty()) {
             idx = idx % events.size();
 
             if (events[idx].empty()) {
                 events.erase(events.begin() + idx);
-                idx++;  // for round-robin.
                 continue;
             }
 
@@ -2290,12 +4901,56 @@ public:
             idx++;
         }
 
-        {
-            lock_t l {S.m_mtx};
-            S.m_idx = idx;
+        return results;
+    }
+
+    // Batch version of try_get(): move up to max events to out, taking
+    // batches from the readable channels in round-robin order (a channel with
+    // fewer events than its share leaves the rest to the others). Each
+    // channel is locked at most once per round. As with try_get(), the
+    // aggregator lock is not held while dequeuing.
+    // Return the number of events moved.
+    template<typename OutputIt>
+    std::size_t try_get_n(OutputIt out, std::size_t max) {
+        auto channels = readable_channels();
+        std::size_t n = channels.size();
+        std::size_t total = 0;
+
+        // out is only valid until written to, so events go through here.
+        std::vector<payload_t> batch;
+
+        while (total < max && n > 0) {
+            // round: give each channel an even share of what is left.
+            std::size_t got_this_round = 0;
+            std::size_t share = (max - total + n - 1) / n;
+
+            for (std::size_t i = 0; i < n && total < max; ++i) {
+                batch.clear();
+                auto got = channels[i]->try_get_n(std::back_inserter(batch),
+                                                  std::min(share, max - total));
+                out = std::move(batch.begin(), batch.end(), out);
+                total += got;
+                got_this_round += got;
+            }
+
+            if (got_this_round == 0) {
+                break;
+            }
         }
 
-        return results;
+        return total;
+    }
+
+    // Move all events from across all channels to the back of events. Unlike
+    // with get_all(), the events are not intermixed: they are grouped by
+    // channel, starting with a different channel each call.
+    // Return the number of events moved.
+    std::size_t drain_into(std::vector<payload_t> &events) {
+        std::size_t total = 0;
+        for (auto &chan : readable_channels()) {
+            total += chan->drain_into(events);
+        }
+        return total;
     }
 
     // Monitor the event_aggregator for readability. The aggregator is:
@@ -2317,7 +4972,7 @@ public:
 
         S.m_notifiers.push_back(notifier);
 
-        if (!S.m_readable.empty()) {
+        if (S.m_num_readable > 0) {
             return chanState::READABLE;
         }
 
@@ -2329,34 +4984,61 @@ public:
     void close() {
         auto &S = *m_state;
         decltype(S.m_notifiers) notifiers;
-        decltype(S.m_channels) channels;
+        decltype(S.m_slots) slots;
 
+        // NOTE: the index and bitmaps refer to the slots, so they must go
+        // with them: the notifiers below may well call back into the
+        // event_aggregator.
         {
             lock_t l {S.m_mtx};
             S.m_closed = true;
             std::swap(notifiers, S.m_notifiers);
-            std::swap(channels, S.m_channels);
+            std::swap(slots, S.m_slots);
+            S.m_free_slots.clear();
+            S.m_index.clear();
+            S.m_readable.clear();
+            S.m_summary.clear();
+            S.m_num_readable = 0;
         }
 
-        for (auto &chan : channels) {
-            chan->close();
+        for (auto &slot : slots) {
+            if (slot.chan) {
+                slot.chan->close();
+            }
         }
 
         invoke_notifiers(notifiers, chanState::CLOSED, APPLY);
-
-        {
-            lock_t l {S.m_mtx};
-            S.m_channels.clear();
-            S.m_index.clear();
-            S.m_readable.clear();
-            S.m_subscriptions.clear();
-            S.m_key_map.clear();
-        }
     }
 
     bool closed() const { return m_state->m_closed; }
 
 private:
+    // Return the readable channels, in round-robin order, and advance the
+    // cursor so that the next call starts with a different channel.
+    // The channels are returned by strong reference so they can be dequeued
+    // from without holding the lock; see try_get().
+    std::vector<std::shared_ptr<event_channel_t>> readable_channels() {
+        auto &S = *m_state;
+        std::vector<std::shared_ptr<event_channel_t>> channels;
+
+        lock_t l {S.m_mtx};
+        channels.reserve(S.m_num_readable);
+
+        slot_t first;
+        if (!S.next_readable(first)) {
+            return channels;
+        }
+
+        slot_t i = first;
+        do {
+            channels.push_back(S.m_slots[i].chan);
+            S.m_cursor = i + 1;
+        } while (channels.size() < S.m_num_readable && S.next_readable(i));
+
+        S.m_cursor = first + 1;
+        return channels;
+    }
+
     static inline unsigned int m_DEFAULT_CHANCAP {100};
 };
 
@@ -2376,6 +5058,13 @@ template<typename... types>
 using event_broadcaster =
   impl::event_broadcaster<tarp::type_traits::thread_safe, types...>;
 
+// A broadcaster that stores each event once and fans out shared_event
+// handles to it; subscribers connect channels of shared_event<payload>.
+template<typename... types>
+using shared_broadcaster = impl::event_broadcaster<
+  tarp::type_traits::thread_safe,
+  shared_event<tarp::type_traits::type_or_tuple_t<types...>>>;
+
 template<typename key_t, typename... types>
 using event_aggregator =
   impl::event_aggregator<tarp::type_traits::thread_safe, key_t, types...>;
@@ -2391,10 +5080,35 @@ using event_wstream =
 template<typename... types>
 using trunk = impl::trunk<types...>;
 
+template<typename key_t, typename... types>
+using conflating_channel =
+  impl::conflating_channel<tarp::type_traits::thread_safe, key_t, types...>;
+
+template<typename... types>
+using batching_channel =
+  impl::batching_channel<tarp::type_traits::thread_safe, types...>;
+
+template<typename... types>
+using spsc_channel = impl::ring_channel<impl::spsc, types...>;
+
+template<typename... types>
+using mpsc_channel = impl::ring_channel<impl::mpsc, types...>;
+
+template<typename... types>
+using mpmc_channel = impl::ring_channel<impl::mpmc, types...>;
+
+template<typename... types>
+using mpmc_trunk = impl::mpmc_trunk<types...>;
+
 using chanState = evchan::chanState;
 
+template<typename T>
+using shared_event = evchan::shared_event<T>;
+
 using monitor = impl::monitor;
 
+using eventfd_notifier = impl::eventfd_notifier;
+
 }  // namespace ts
 
 //
@@ -2412,6 +5126,14 @@ template<typename... types>
 using event_broadcaster =
   impl::event_broadcaster<tarp::type_traits::thread_unsafe, types...>;
 
+template<typename key_t, typename... types>
+using conflating_channel =
+  impl::conflating_channel<tarp::type_traits::thread_unsafe, key_t, types...>;
+
+template<typename... types>
+using batching_channel =
+  impl::batching_channel<tarp::type_traits::thread_unsafe, types...>;
+
 template<typename key_t, typename... types>
 using event_aggregator =
   impl::event_aggregator<tarp::type_traits::thread_safe, key_t, types...>;
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <tarp/error.h>
+#include <tarp/evchan.hxx>
+#include <tarp/event.hxx>
+
+namespace tarp {
+namespace evchan {
+
+// Bridge producer threads to a tarp::EventPump, with no thread in between.
+//
+// Register chan with pump such that, whenever chan becomes readable,
+// on_events is called on the pump thread with a batch of up to batchsz
+// events. chan can be anything that supports add_monitor() for
+// chanState::READABLE and try_get_n(): an event_channel or its rchan
+// interface, a ring channel, a trunk or mpmc_trunk, an event_wstream, an
+// event_aggregator.
+//
+// on_events takes a std::vector<payload_t> & (the events may be moved out)
+// and, like any other EventPump callback, must return true to remain
+// registered and false otherwise. It is called with an empty batch when
+// chan is closed, after which the bridge unregisters itself.
+//
+// Return the result of EventPump::set_fd_event_callback().
+//
+// NOTES:
+// (1) Wakeups are coalesced (see impl::eventfd_notifier): a burst of pushes
+// results in a single eventfd write and a single call of on_events.
+// (2) When more than batchsz events are pending, the rest are delivered on
+// subsequent iterations of the pump, so other callbacks are not starved.
+// (3) The bridge holds a reference to chan for as long as it is registered.
+template<typename chan_t, typename callback_t>
+int attach_to_pump(tarp::EventPump &pump,
+                   std::shared_ptr<chan_t> chan,
+                   callback_t on_events,
+                   std::size_t batchsz = 64) {
+    using payload_t = typename decltype(chan->try_get())::value_type;
+
+    auto notifier = std::make_shared<impl::eventfd_notifier>();
+    auto batch = std::make_shared<std::vector<payload_t>>();
+    batch->reserve(batchsz);
+
+    auto cb = [chan, notifier, batch, batchsz,
+               on_events = std::move(on_events)](int, std::uint32_t) mutable {
+        notifier->acknowledge();
+
+        batch->clear();
+        chan->try_get_n(std::back_inserter(*batch), batchsz);
+
+        bool closed = notifier->closed();
+        if (batch->empty() && !closed) {
+            return true;
+        }
+
+        if (!on_events(*batch) || closed) {
+            notifier->detach();
+            return false;
+        }
+
+        // see (2).
+        if (batch->size() == batchsz) {
+            notifier->rearm();
+        }
+
+        return true;
+    };
+
+    int rc = pump.set_fd_event_callback(notifier->fd(), FD_EVENT_READABLE,
+                                        std::move(cb));
+    if (rc != ERRORCODE_SUCCESS) {
+        notifier->detach();
+        return rc;
+    }
+
+    // The monitor only hears of changes from now on: catch up with events
+    // already pending (or the channel already being closed).
+    auto state = chan->add_monitor(notifier, chanState::READABLE);
+    if (state & chanState::CLOSED) {
+        notifier->notify(chanState::CLOSED, impl::APPLY);
+    } else if (state & chanState::READABLE) {
+        notifier->rearm();
+    }
+
+    return rc;
+}
+
+}  // namespace evchan
+}  // namespace tarp
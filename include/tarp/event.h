@@ -6,23 +6,32 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 #include <tarp/dllist.h>
 
 #include "event_flags.h"
+#include "event_stats.h"
 
 /*
- * Maximum number of of user-defined event types. This is the maximum
- * value that is acceptable for passing to Evp_add_uev_watch and
+ * Upper bound (exclusive) for user-defined event types. This is the maximum
+ * value that is acceptable for passing to Evp_init_uev_watch and
  * Evp_push_uev.
  * NOTE The semantics of the values in the [0, MAX_USER_EVENT_TYPE_VALUE)
- * are entirely user-defined. */
-#define MAX_USER_EVENT_TYPE_VALUE 30
+ * are entirely user-defined.
+ * NOTE the event pump looks up the watchers of each event type in a table
+ * directly indexed by the event type and sized to fit the greatest event
+ * type watched. IOW event types are best kept dense, starting at 0; this
+ * bound merely keeps the table from growing unreasonably large. */
+#define MAX_USER_EVENT_TYPE_VALUE (1U << 16)
 
 struct timer_event;
 struct fd_event;
 struct user_event_watch;
+struct signal_watch;
+struct signalfd_siginfo;   /* sys/signalfd.h */
 
 /*
  * The following signatures are for user-provided callbacks associated
@@ -30,7 +39,7 @@ struct user_event_watch;
  *
  * The arguments to the callbacks are as follows:
  *
- * fdev, tev, uev are pointers to the same structure that was passed
+ * fdev, tev, uev, sw are pointers to the same structure that was passed
  * to the corresponding registration function (e.g. Evp_add_timer_ms)
  * when registering the callback. This structure should not be modified
  * by the user and once associated with a callback it must not be
@@ -69,17 +78,100 @@ typedef void (*user_event_callback)(
         void *data,
         void *priv);
 
+/*
+ * info is the siginfo read from the signalfd; info->ssi_signo is the
+ * signal number. See signalfd(2). */
+typedef void (*signal_callback)(
+        struct signal_watch *sw,
+        const struct signalfd_siginfo *info,
+        void *priv);
+
+/*
+ * Callback for functions posted to the event pump; see Evp_post. */
+typedef void (*post_callback)(void *arg);
+
 /*
  * Opque Event pump handle. The user gets one through Evp_new()
  * and must destroy it when no longer needed by calling Evp_destroy.
  */
 struct evp_handle;
 
+/*
+ * The OS event notification mechanism underlying the event pump.
+ *
+ * EVP_BACKEND_EPOLL: readiness-based; one epoll_wait call per event loop
+ * iteration.
+ *
+ * EVP_BACKEND_IO_URING: monitors are armed as (multishot) poll requests
+ * and FD_EVENT_RECV monitors on sockets as multishot recvs into a
+ * registered buffer ring; requests are batched and submitted in the same
+ * io_uring_enter call that waits for completions. If io_uring is unavailable (old kernel,
+ * disabled via sysctl, blocked by seccomp etc) the event pump silently
+ * falls back to epoll; see Evp_get_backend.
+ *
+ * EVP_BACKEND_SIMULATED: no OS event notification mechanism at all; for
+ * deterministic tests and benchmarks, and for profiling the dispatch path
+ * without system call noise. The event pump runs on a virtual clock (see
+ * Evp_now) that only moves when the pump has nothing else to do: it then
+ * jumps straight to the next timer expiration. A day's worth of timers
+ * therefore runs in however long it takes to dispatch them. File
+ * descriptors are simulated as well, by in-memory pipes (see
+ * Evp_sim_write). Evp_run returns once there is nothing left to simulate,
+ * i.e. no timer registered and no event pending. NOTE the simulation is
+ * meant to be single-threaded: events pushed from other threads are only
+ * seen when the pump next looks, and they do not stop the clock from
+ * jumping ahead. Signal watches are not supported.
+ *
+ * EVP_BACKEND_DEFAULT: currently epoll.
+ */
+enum evp_backend {
+    EVP_BACKEND_DEFAULT = 0,
+    EVP_BACKEND_EPOLL,
+    EVP_BACKEND_IO_URING,
+    EVP_BACKEND_SIMULATED
+};
+
 /*
  * An evp_handle or NULL if this could not be obtained;
  * If it fails, it is because of system or library calls e.g.
- * failure to initialize a mutex. */
+ * failure to create an eventfd.
+ *
+ * Evp_new is equivalent to Evp_new_with_backend(EVP_BACKEND_DEFAULT). */
 struct evp_handle *Evp_new(void);
+struct evp_handle *Evp_new_with_backend(enum evp_backend backend);
+
+/*
+ * Get the backend actually in use by the event pump. This may differ
+ * from the one requested at creation time as a result of fallback. */
+enum evp_backend Evp_get_backend(const struct evp_handle *handle);
+
+/*
+ * The current time on the clock of the event pump, which timer deadlines
+ * are relative to: the monotonic clock or, for EVP_BACKEND_SIMULATED, the
+ * virtual clock. The virtual clock starts out at the monotonic time the
+ * event pump was created at. */
+struct timespec Evp_now(const struct evp_handle *handle);
+
+/*
+ * Write len bytes of data into the simulated pipe fd is the read end of;
+ * EVP_BACKEND_SIMULATED only. The data is buffered until the pump next
+ * looks for events and a monitor is registered for fd: FD_EVENT_RECV
+ * monitors are then passed the data (see Evp_get_fdev_data), as much
+ * at a time as a single read would return; other monitors are only reported
+ * FD_EVENT_READABLE, and the data is discarded. A write of 0 bytes closes
+ * the pipe: once the data before it has been passed on, the monitor sees
+ * EOF (FD_EVENT_RECV monitors get a NULL buffer) and nothing is accepted
+ * afterward.
+ *
+ * The fd is only a key: it need not be (and is never used as) a real file
+ * descriptor. NOTE simulated fds are only ever readable, never writable;
+ * and FD_EVENT_DRAIN monitors cannot be registered, since they read from
+ * the fd directly.
+ *
+ * Return ERROR_MISCONFIGURED if the event pump does not use the simulated
+ * backend; ERROR_INVALIDVALUE if fd is negative, or the pipe is closed. */
+int Evp_sim_write(struct evp_handle *handle, int fd,
+                  const void *data, size_t len);
 
 /*
  * Destroy all internal state associated with the evp handle, then
@@ -97,6 +189,129 @@ void Evp_destroy(struct evp_handle **handle);
  * Pass -1 for an infinite loop. */
 void Evp_run(struct evp_handle *handle, int seconds);
 
+/*
+ * Make Evp_run return after the current (or, if the pump is not currently
+ * running, the next) loop iteration. Evp_run can be called again after.
+ *
+ * Thread-safe: this is implemented via Evp_post and can therefore be called
+ * from inside a callback as well as from any other thread. */
+int Evp_stop(struct evp_handle *handle);
+
+/*
+ * Outcome of one step of the event loop; see Evp_run_once.
+ *
+ * (1) How long, in microseconds, before the pump has work to do of its own
+ * accord, i.e. before its next timer expires: the longest the caller
+ * should wait (e.g. on Evp_get_pollfd) before calling Evp_run_once again.
+ * 0 if events were left over by a dispatch budget (see
+ * Evp_set_dispatch_policy), in which case Evp_run_once should be called
+ * again straight away; -1 if no timer is registered. NOTE the timer wheel
+ * may need servicing before any timer is actually due (see timer_wheel.h),
+ * so the step taken then may well dispatch nothing.
+ *
+ * (2) True if Evp_stop was called; this has no other effect on Evp_run_once.
+ */
+struct evp_step {
+    unsigned handled;       /* number of events dispatched */
+    int64_t next_us;                                                /* (1) */
+    bool stop;                                                      /* (2) */
+};
+
+/*
+ * Run a single iteration of the event loop -- wait for events, then
+ * dispatch those that have occurred -- and return. This is for driving the
+ * event pump from some other loop, instead of through Evp_run.
+ *
+ * timeout_us is how long to wait for events, in microseconds: 0 to only
+ * poll, never blocking; -1 to wait for as long as it takes (Evp_run does
+ * this for each iteration). The timeout has microsecond resolution (it is
+ * implemented via the same timerfd used for timers), so it can be far
+ * shorter than a millisecond.
+ *
+ * If step is not NULL, it is populated with the outcome of the iteration
+ * (see evp_step). Return ERROR_RUNTIMEERROR if waiting for events fails,
+ * else ERRORCODE_SUCCESS.
+ *
+ * NOTE the usual rules apply: the event pump must only be run from one
+ * thread at a time, and not from inside its own callbacks. */
+int Evp_run_once(struct evp_handle *handle, int64_t timeout_us,
+                 struct evp_step *step);
+
+/*
+ * An fd that becomes readable whenever the event pump has events to
+ * dispatch -- fd events, signals, user events (including posted functions),
+ * and its next timer expiring -- for nesting the event pump into some other
+ * event loop (e.g. by monitoring the fd with another epoll instance): call
+ * Evp_run_once(handle, 0, &step) on readability, and again at the latest
+ * after step.next_us. The fd is owned by the event pump and must not be
+ * closed or read from.
+ *
+ * -1 if the backend has no such fd (EVP_BACKEND_IO_URING). */
+int Evp_get_pollfd(const struct evp_handle *handle);
+
+/*
+ * How much of a class of events the event pump may dispatch in a single
+ * loop iteration: at most max_events events, for at most max_us
+ * microseconds; 0 means no limit. The time budget is checked before each
+ * event, so it may be overrun by the duration of one callback. At least
+ * one event is always dispatched.
+ * For user events, an event is one Evp_push_uev or Evp_post, regardless of
+ * how many watches are invoked for it. */
+struct evp_budget {
+    uint32_t max_events;
+    uint32_t max_us;
+};
+
+struct evp_dispatch_policy {
+    struct evp_budget budget[EVP_NUM_EVENT_CLASSES];
+};
+
+/*
+ * By default, each loop iteration dispatches all pending signals, then all
+ * expired timers, then all fd events, then all queued user events. A burst of events of one class
+ * can then hold up the others for arbitrarily long: e.g. a flood of user
+ * events delays fd handling.
+ *
+ * With a dispatch policy set, each class is dispatched only up to its
+ * budget per iteration, and the class that goes first rotates round-robin
+ * from one iteration to the next. Events not dispatched for lack of budget
+ * are carried over, in order, to the next iteration; the event pump does
+ * not block waiting for new events while any are left.
+ *
+ * A NULL policy restores the default. Not thread-safe: call before Evp_run
+ * or from the thread running the event pump (e.g. via Evp_post). */
+int Evp_set_dispatch_policy(struct evp_handle *handle,
+        const struct evp_dispatch_policy *policy);
+
+/*
+ * Populate 'stats' with a snapshot of the statistics the event pump has
+ * gathered since it was created or since Evp_reset_stats was last called;
+ * see tarp/event_stats.h. Return ERROR_MISCONFIGURED if the library was
+ * built with EVP_STATS_LEVEL=0.
+ *
+ * Evp_get_stats is thread-safe and lock-free; each counter is read
+ * atomically, but the snapshot as a whole is not, as the event pump may
+ * be updating the statistics as they are being read.
+ * Evp_reset_stats is not thread-safe; call it from the thread running the
+ * event pump (e.g. via Evp_post) or when the event pump is not running. */
+int Evp_get_stats(const struct evp_handle *handle, struct evp_stats *stats);
+void Evp_reset_stats(struct evp_handle *handle);
+
+/*
+ * Record the execution time of the callback of the respective timer, fd
+ * monitor, or user event watch into hist (NULL to stop), in addition to
+ * the per-class histograms of the event pump. The histogram is owned by
+ * the caller and must outlive the association; it can be read at any
+ * time, from any thread. Only effective with EVP_STATS_LEVEL >= 2. */
+void Evp_set_timer_histogram(struct timer_event *tev,
+        struct evp_histogram *hist);
+void Evp_set_fdmon_histogram(struct fd_event *fdev,
+        struct evp_histogram *hist);
+void Evp_set_uev_watch_histogram(struct user_event_watch *uev,
+        struct evp_histogram *hist);
+void Evp_set_signal_watch_histogram(struct signal_watch *sw,
+        struct evp_histogram *hist);
+
 /*
  * Initialize the internal state of the timer callback and
  * set the interval duration.
@@ -125,13 +340,103 @@ void Evp_init_timer_fromtimespec(
 
 /*
  * Set/update the timer interval duration; NOTE nothing else gets
- * (re)initialized. */
+ * (re)initialized. For timers that are not periodic, this only takes
+ * effect on the next registration. */
 void Evp_set_timer_interval_secs(struct timer_event *tev, uint32_t seconds);
 void Evp_set_timer_interval_ms(struct timer_event *tev, uint32_t milliseconds);
 void Evp_set_timer_interval_us(struct timer_event *tev, uint32_t microseconds);
 void Evp_set_timer_interval_fromtimespec(struct timer_event *tev,
         struct timespec *timespec);
 
+/*
+ * Allow the timer to expire up to 'slack' past its deadline (0, the
+ * default, means as close to the deadline as possible). The event pump
+ * uses this latitude to expire timers whose windows overlap together, on
+ * a single wakeup, instead of waking up once for each of them. With many
+ * timers this can cut down the number of wakeups (and timerfd re-arms)
+ * drastically, which matters for idle CPU usage and power consumption.
+ * A timer never expires before its deadline regardless.
+ *
+ * The slack is kept across re-registrations and changes of the interval;
+ * it is reset by the Evp_init_timer_* functions. The _slack variants of
+ * the latter initialize the timer and set the slack in one go.
+ * NOTE the slack must not be changed while the timer is registered. */
+void Evp_set_timer_slack_us(struct timer_event *tev, uint32_t microseconds);
+void Evp_set_timer_slack_ms(struct timer_event *tev, uint32_t milliseconds);
+
+void Evp_init_timer_ms_slack(
+        struct timer_event *tev, uint32_t milliseconds, uint32_t slack_ms,
+        timer_callback cb, void *priv);
+
+void Evp_init_timer_us_slack(
+        struct timer_event *tev, uint32_t microseconds, uint32_t slack_us,
+        timer_callback cb, void *priv);
+
+/*
+ * What a periodic timer (see Evp_init_periodic_timer_ms) does when it
+ * has overrun, i.e. when its next deadline has already passed by the time
+ * it expires (e.g. because some callback ran for longer than the period):
+ *
+ * EVP_TIMER_CATCH_UP: no deadline is missed; the timer expires once per
+ * loop iteration until it has caught up.
+ *
+ * EVP_TIMER_SKIP: the deadlines already passed are skipped, such that the
+ * timer expires next on the first deadline still ahead, in phase with the
+ * previous ones. See Evp_get_timer_overruns.
+ */
+enum evp_timer_overrun {
+    EVP_TIMER_CATCH_UP = 0,
+    EVP_TIMER_SKIP
+};
+
+/*
+ * Initialize a periodic timer. Once registered, the timer expires every
+ * interval, until unregistered. Each deadline is the previous one plus the
+ * interval, rather than the time the timer expired at (or its callback
+ * returned at) plus the interval: the timer does not drift, and timers
+ * with the same interval, registered together, stay in phase.
+ *
+ * The first deadline is one interval after registration. On each
+ * expiration the event pump puts the timer back in the timer store, with
+ * its next deadline, before invoking the callback: the timer stays
+ * registered throughout and can be unregistered from the callback as
+ * usual (but not registered again until then).
+ *
+ * NOTE the interval (see Evp_set_timer_interval_ms) can be changed while
+ * the timer is registered; the change takes effect after the next
+ * expiration. A zero interval is rejected by Evp_register_timer.
+ *
+ * NOTE the slack (see Evp_set_timer_slack_us) applies to each expiration
+ * in turn but does not accumulate: it delays the expiration, not the
+ * deadline the next one is computed from. */
+void Evp_init_periodic_timer_ms(
+        struct timer_event *tev, uint32_t milliseconds,
+        enum evp_timer_overrun overrun,
+        timer_callback cb, void *priv);
+
+void Evp_init_periodic_timer_us(
+        struct timer_event *tev, uint32_t microseconds,
+        enum evp_timer_overrun overrun,
+        timer_callback cb, void *priv);
+
+void Evp_init_periodic_timer_fromtimespec(
+        struct timer_event *tev, struct timespec *timespec,
+        enum evp_timer_overrun overrun,
+        timer_callback cb, void *priv);
+
+/*
+ * Set/update the overrun policy of a periodic timer; NOTE nothing else
+ * gets (re)initialized. Like the interval, it can be changed while the
+ * timer is registered and takes effect from the next expiration. */
+void Evp_set_timer_overrun(struct timer_event *tev,
+        enum evp_timer_overrun overrun);
+
+/*
+ * The number of deadlines of a periodic timer skipped (see EVP_TIMER_SKIP)
+ * right before its current expiration; to be called from the callback.
+ * Always 0 with EVP_TIMER_CATCH_UP and for one-shot timers. */
+uint32_t Evp_get_timer_overruns(const struct timer_event *tev);
+
 /*
  * Register a timer with the event pump such that it is invoked on an
  * interval expiration. When this is called, an absolute timepoint is
@@ -152,8 +457,11 @@ void Evp_set_timer_interval_fromtimespec(struct timer_event *tev,
  *
  * NOTE a timer is automatically unregistered on each expiration. When the
  * callback gets invoked, the timer will have already been unregistered.
- * IOW to get the effect of a periodic timer, the registered callback should
- * re-register itself (by calling set_timer_interval and then register_timer).
+ * The callback can re-register the timer (by calling set_timer_interval
+ * and then register_timer), but the next deadline is then relative to the
+ * time of re-registration. For periodic timers, use
+ * Evp_init_periodic_timer_ms etc instead: these are not unregistered on
+ * expiration, and do not drift.
  */
 int Evp_register_timer(struct evp_handle *handle, struct timer_event *tev);
 void Evp_unregister_timer(struct evp_handle *handle, struct timer_event *tev);
@@ -165,6 +473,74 @@ int Evp_init_fdmon(
 int Evp_register_fdmon(struct evp_handle *handle, struct fd_event *fdev);
 void Evp_unregister_fdmon(struct evp_handle *handle, struct fd_event *fdev);
 
+/*
+ * For monitors initialized with FD_EVENT_RECV: get the data received, to be
+ * called from inside the fd_event_callback when 'events' has FD_EVENT_RECV
+ * set. The number of bytes is stored in len. A length of 0 means the
+ * end of file has been reached, and the monitor should be unregistered.
+ *
+ * NOTE the buffer is owned by the event pump and is only valid until
+ * the callback returns; the data must be copied out if needed afterward.
+ *
+ * NOTE with the io_uring backend the data is read as soon as it arrives,
+ * before the callback is invoked. Data read but not yet passed to the
+ * callback when the monitor is unregistered is discarded. */
+const uint8_t *Evp_get_fdev_data(const struct fd_event *fdev, size_t *len);
+
+/*
+ * Size of the buffers FD_EVENT_DRAIN monitors are drained into, and the
+ * maximum number of them filled per callback invocation; see
+ * Evp_get_fdev_slices. */
+#define EVP_DRAIN_SLICE_SIZE 4096
+#define EVP_DRAIN_MAX_SLICES 64
+
+/*
+ * A buffer of data read from an FD_EVENT_DRAIN monitor; see
+ * Evp_get_fdev_slices.
+ *
+ * (1) Free for the user to link the slice into a list of their own, once
+ * taken off the list it was handed out on.
+ *
+ * (2) Private to the event pump.
+ */
+struct slab_pool;
+struct evp_slice {
+    struct dlnode link;                                             /* (1) */
+    const uint8_t *data;
+    size_t len;
+    unsigned refs;                                                  /* (2) */
+    struct slab_pool *pool;                                         /* (2) */
+};
+
+/*
+ * For monitors initialized with FD_EVENT_DRAIN: get the data read, to be
+ * called from inside the fd_event_callback. This is a list of evp_slices
+ * (linked through their 'link' field, e.g. for Dll_foreach) in the order
+ * the data was read in; only the last slice may be partially filled. The
+ * list is empty if nothing was read. eof, if not NULL, is set to true if the
+ * end of file was reached, in which case the monitor should be unregistered.
+ * 'events' has FD_EVENT_ERROR set if a read failed.
+ *
+ * Each slice is handed out with one reference, held by the list. The slices
+ * left on the list when the callback returns are released by the event pump;
+ * to keep a slice, take it off the list instead (Dll_popnode), which
+ * transfers the reference to the caller, to be released with
+ * Evp_slice_release. Evp_slice_ref takes additional references, e.g. to
+ * share a slice between consumers.
+ *
+ * NOTE the slices come from a pool of buffers kept by the event pump, so
+ * draining does not allocate in the steady state. A slice may outlive the
+ * event pump it came from, but it must only be referenced and released by
+ * the thread that ran the event pump.
+ *
+ * NOTE a monitor is drained until EAGAIN, as edge-triggered notification
+ * requires, but no more than EVP_DRAIN_MAX_SLICES slices are filled per
+ * callback invocation: the monitor is then dispatched again in the next
+ * loop iteration, which does not wait for further events. */
+struct dllist *Evp_get_fdev_slices(const struct fd_event *fdev, bool *eof);
+void Evp_slice_ref(struct evp_slice *slice);
+void Evp_slice_release(struct evp_slice *slice);
+
 /*
  * Register a callback to be invoked for specific user events;
  * The event_type is a number that *must* be smaller than
@@ -180,12 +556,16 @@ void Evp_unregister_fdmon(struct evp_handle *handle, struct fd_event *fdev);
  * silently removed.
  *
  * NOTE
- * Only one callback can be bound to a particular event type; if this does
- * not suffice for a given scenario, the user should maintain state in
- * their own callback and multiplex as appropriate.
+ * Any number of callbacks can be bound to a particular event type. They are
+ * invoked in the order they were registered in. Finding the callbacks
+ * for an event is O(1) in the number of event types.
  *
- * NOTE if a callback has already been bound for a particular event type,
- * it must be un-bound before a new one can be registered in its place.
+ * NOTE it is safe to unregister any user event watch (including the one
+ * whose callback is running, and others bound to the same event type) from
+ * inside a callback. Watches unregistered this way are not invoked for
+ * the event being dispatched if they have not been already. Watches
+ * registered from inside a callback for the event type being dispatched
+ * may or may not be invoked for that event.
  */
 int Evp_init_uev_watch(
         struct user_event_watch *uev, unsigned event_type,
@@ -195,6 +575,72 @@ int Evp_register_uev_watch(struct evp_handle *handle, struct user_event_watch *u
 void Evp_unregister_uev_watch(struct evp_handle *handle, struct user_event_watch *uev);
 int Evp_push_uev(struct evp_handle *handle, unsigned event_type, void *data);
 
+/*
+ * Push n user events at once; all of them or (if any event_type is out of
+ * bounds) none. Cheaper than n calls to Evp_push_uev: the events are
+ * enqueued with a single atomic operation and the event pump is woken up
+ * (at most) once.
+ *
+ * Like Evp_push_uev, this is thread-safe. */
+struct uev_item {
+    unsigned event_type;
+    void *data;
+};
+
+int Evp_push_uev_batch(struct evp_handle *handle,
+        const struct uev_item *events, size_t n);
+
+/*
+ * Register a callback to be invoked when the signal signo is received.
+ *
+ * Signals are received through a signalfd (see signalfd(2)) monitored by
+ * the event pump like any other file descriptor -- rather than through an
+ * asynchronous signal handler -- and dispatched in the signals stage of
+ * the loop iteration (see Evp_set_dispatch_policy). The callback thus runs
+ * in the thread running the event pump and, unlike a signal handler, is
+ * free to call anything. The signalfd is only created once the first
+ * signal watch is registered.
+ *
+ * NOTE the signal must be *blocked* in every thread of the process (e.g.
+ * with pthread_sigmask in main, before any threads are created, or see
+ * tarp::block_signals in tarp/posix_signal_helpers.hxx). Otherwise it is
+ * delivered the traditional way instead: handled by its disposition (for
+ * most signals by default, this terminates the process) and never seen by
+ * the event pump. The event pump does not change the signal mask itself.
+ *
+ * NOTE like for user events, any number of watches can be registered for
+ * the same signal; they are invoked in the order they were registered in,
+ * and it is safe to unregister any of them from inside a callback.
+ * Standard signals do not queue: several instances of a signal generated
+ * before the event pump gets around to reading it may only be reported
+ * once (e.g. SIGCHLD for multiple children exiting at the same time).
+ *
+ * Evp_init_signal_watch returns ERROR_OUTOFBOUNDS if signo is not a valid
+ * signal number and ERROR_INVALIDVALUE for SIGKILL and SIGSTOP, which
+ * cannot be blocked. Evp_register_signal_watch returns ERROR_RUNTIMEERROR
+ * if the signalfd could not be created or updated, and ERROR_MISCONFIGURED
+ * for event pumps using EVP_BACKEND_SIMULATED. */
+int Evp_init_signal_watch(
+        struct signal_watch *sw, int signo,
+        signal_callback cb, void *priv);
+
+int Evp_register_signal_watch(struct evp_handle *handle, struct signal_watch *sw);
+void Evp_unregister_signal_watch(struct evp_handle *handle, struct signal_watch *sw);
+
+/*
+ * Have fn(arg) called by the event pump in the thread running Evp_run, in
+ * the user events stage of the next loop iteration. Calls posted are
+ * executed in FIFO order, interleaved with user events.
+ *
+ * Thread-safe, like Evp_push_uev, and wakes the event pump the same way.
+ * This is the way for other threads to hand work over to the event pump,
+ * e.g. to register callbacks, which is otherwise not thread-safe.
+ *
+ * NOTE calls still pending when the event pump is destroyed are discarded
+ * without being executed; any resources owned by 'arg' are leaked unless
+ * the caller keeps track of them. */
+int Evp_post(struct evp_handle *handle, post_callback fn, void *arg);
+
 
 #include "impl/event_impl.h"
 
@@ -88,31 +88,44 @@
 #include <functional>
 #include <chrono>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
-#include <unordered_map>
+#include <thread>
+#include <vector>
 
 #include <tarp/error.h>
 #include <tarp/log.h>
 #include <tarp/process.h>
 
+#include "event_coro.hxx"
 #include "event_flags.h"
+#include "event_stats.h"
 
 extern "C" {
     struct evp_handle;
     struct timer_event;
     struct fd_event;
     struct user_event_watch;
+    struct signal_watch;
+    struct signalfd_siginfo;
 }
 
 namespace tarp {
     using timer_callback = std::function<bool(void)>;
     using fd_callback    = std::function<bool(int fd, uint32_t events)>;
     using uev_callback   = std::function<bool(unsigned event_type, void *data)>;
+    using signal_callback =
+        std::function<bool(const struct signalfd_siginfo &info)>;
 
 
 class EventPump;
 class RawEventPumpInterface;
 class Process;
+class CoroutineState;
+
+namespace impl {
+class CallbackPool;
+}
 
 
 /*
@@ -229,6 +242,13 @@ private:
  * duration (e.g. chrono::seconds::max to chrono::microseconds).
  * Of course, the duration here is meant to store short, relative
  * intervals so under expected normal use this is a non-issue.
+ *
+ * The timer is periodic (see Evp_init_periodic_timer_ms): each deadline
+ * is one interval after the previous one, regardless of how long the
+ * callback takes, so the callback does not drift. A new interval takes
+ * effect after the next expiration; a new slack, or overrun policy (by
+ * default EVP_TIMER_SKIP; see enum evp_timer_overrun), on the next
+ * activation.
  */
 class TimerEventCallback : public CallbackCore<tarp::timer_callback> {
 public:
@@ -241,6 +261,8 @@ public:
     TimerEventCallback(void) = delete;
     ~TimerEventCallback(void);
     void set_interval(std::chrono::microseconds interval);
+    void set_slack(std::chrono::microseconds slack);
+    void set_overrun_policy(enum evp_timer_overrun overrun);
     void call(void) override;
 
 private:
@@ -249,8 +271,11 @@ private:
     int register_event_monitor(struct evp_handle *raw_evp_handle) override;
     int deregister_event_monitor(struct evp_handle *raw_evp_handle) override;
 
-    struct timer_event *m_raw_tev_handle;
+    struct timer_event *m_raw_tev_handle = nullptr;
+    struct timer_event m_tev;
     struct timespec m_interval;
+    uint32_t m_slack_us = 0;
+    enum evp_timer_overrun m_overrun = EVP_TIMER_SKIP;
 };
 
 
@@ -274,6 +299,7 @@ private:
     int deregister_event_monitor(struct evp_handle *raw_evp_handle) override;
 
     struct fd_event *m_raw_fdev_handle;
+    struct fd_event m_fdev;
     int m_fd;
     uint32_t m_flags;
     uint32_t m_revents;
@@ -300,10 +326,40 @@ private:
     int deregister_event_monitor(struct evp_handle *raw_evp_handle) override;
 
     struct user_event_watch *m_raw_uev_handle;
+    struct user_event_watch m_uev;
     unsigned m_event_type;
     void *m_event_data;
 };
 
+/*
+ * NOTE the signal must be blocked in all threads; see
+ * Evp_register_signal_watch and tarp::block_signals. */
+class SignalCallback : public CallbackCore<tarp::signal_callback> {
+public:
+    SignalCallback(
+            const tarp::Callback::construction_permit &permit,
+            std::shared_ptr<tarp::EventPump> evp,
+            int signo,
+            tarp::signal_callback cb);
+
+    SignalCallback(void) = delete;
+    ~SignalCallback(void);
+
+    void call(void) override;
+    void call(const struct signalfd_siginfo *info);
+
+private:
+    void initialize_raw_event_handle(void) override;
+    void destroy_raw_event_handle(void) override;
+    int register_event_monitor(struct evp_handle *raw_evp_handle) override;
+    int deregister_event_monitor(struct evp_handle *raw_evp_handle) override;
+
+    struct signal_watch *m_raw_sw_handle;
+    struct signal_watch m_sw;
+    int m_signo;
+    const struct signalfd_siginfo *m_info;
+};
+
 /*
  * Private EventPump interface accessible to the Callback interface.
  *
@@ -318,6 +374,23 @@ private:
     virtual void untrack_callback(size_t id) = 0;
 };
 
+/*
+ * How much of a class of events the EventPump may dispatch in a single
+ * loop iteration; zero means no limit. See evp_budget in tarp/event.h. */
+struct DispatchBudget {
+    uint32_t max_events = 0;
+    std::chrono::microseconds max_time {0};
+};
+
+/*
+ * Outcome of EventPump::run_once; see evp_step in tarp/event.h. next is -1us
+ * if no timer is registered. */
+struct LoopStep {
+    unsigned handled = 0;
+    std::chrono::microseconds next {-1};
+    bool stop = false;
+};
+
 /*
  * Ensure EventPumps are only created as std::shared_ptr's through
  * std::make_shared. */
@@ -332,6 +405,76 @@ std::shared_ptr<tarp::EventPump> make_event_pump(void);
  * event pump and cannot be moved around (create a new process instead
  * as needed).
  *
+ * (2) Thread-safe. Make run() return after the current loop iteration
+ * (see Evp_stop).
+ *
+ * (3) Thread-safe. Have fn called by the event pump, in the thread that
+ * is running it. Functions posted before the pump gets around to running
+ * them are all run in the same loop iteration, in FIFO order, and the
+ * pump is only woken up for the first one. Functions still pending when
+ * the EventPump is destructed are discarded.
+ *
+ * post_at is the same but only has fn called once the deadline (on the
+ * monotonic clock, which std::chrono::steady_clock is) has passed; a
+ * deadline already past when the pump gets around to it makes fn run
+ * straight away.
+ *
+ * (4) Any number of callbacks can be set for the same event type; they are
+ * all invoked, in the order they were set in, for each event pushed. A
+ * callback returning false is removed without affecting the others.
+ *
+ * (5) Bound the number of timer, fd, and user events (including posted
+ * functions), and signals, dispatched per loop iteration, and rotate
+ * between the classes so that none can starve the others; see
+ * Evp_set_dispatch_policy. Called with no arguments, it restores the
+ * default: no budgets. Throws
+ * std::invalid_argument if a time budget is negative or too large.
+ *
+ * (6) Thread-safe. A snapshot of the instrumentation statistics gathered by
+ * the pump; see Evp_get_stats and tarp/event_stats.h. Throws
+ * std::logic_error if the library was built without instrumentation.
+ * reset_stats is not thread-safe.
+ *
+ * (7) Let the timer expire up to 'slack' past its deadline so that it can
+ * share a wakeup with other timers; see Evp_set_timer_slack_us. The same
+ * can be had for explicit timer callbacks through
+ * TimerEventCallback::set_slack. Throws std::invalid_argument if the slack
+ * is negative or too large.
+ *
+ * (8) Invoke cb, in the thread running the pump, each time the signal signo
+ * is received; see Evp_register_signal_watch. The signal must be blocked in
+ * every thread (see tarp::block_signals). Throws std::invalid_argument if
+ * signo is not a valid signal number, or is SIGKILL or SIGSTOP.
+ *
+ * (9) Coroutine interface; only available when compiling as C++20 or later
+ * (see tarp/event_coro.hxx FMI). Not thread-safe.
+ *  - readable, writable: resume the awaiting coroutine, with the FD_EVENT_*
+ *    flags that occurred, once the fd becomes readable or writable.
+ *  - sleep_for: resume the awaiting coroutine after the given interval.
+ *    Throws std::invalid_argument if the interval is negative.
+ *  - user_event: resume the awaiting coroutine, with the data of the event,
+ *    when the next user event of the given type is pushed.
+ *  - spawn: start the task straight away, in the calling thread, and hand
+ *    it over to the pump; the task is destroyed on completion, or along with
+ *    the pump if still suspended then. An exception escaping the task
+ *    terminates the program, as it would a std::thread.
+ *  - frame_allocator: the allocator the frames of tasks created by the
+ *    coroutines run by the pump come from.
+ *
+ * (10) Run a single iteration of the event loop, waiting for events for at
+ * most 'timeout' (0 to only poll; negative to wait for as long as it takes);
+ * get_pollfd returns an fd that is readable whenever the pump has events to
+ * dispatch. For driving the pump from some other loop; see Evp_run_once and
+ * Evp_get_pollfd. run_once throws std::runtime_error if waiting for events
+ * fails.
+ *
+ * (11) Thread-safe. Called from the thread running the pump (i.e. from
+ * inside run() or run_once()), or from any thread while the pump is not
+ * running, these register the callback straight away and return the
+ * outcome. Called from any other thread while the pump is running, they
+ * post (see (3)) the registration to the pump instead and only return
+ * whether that succeeded; a registration that then fails is logged.
+ *
  * The EventPump is only constructible through make_event_pump.
  */
 class EventPump final :
@@ -357,12 +500,32 @@ public:
     EventPump(const EventPump::construction_permit &permit);
 
     void run(int seconds = -1);
+    void stop(void);                                 /* (2) */
+    tarp::LoopStep run_once(                         /* (10) */
+            std::chrono::microseconds timeout = std::chrono::microseconds::zero());
+    int get_pollfd(void) const;
     int push_event(unsigned event_type, void *data=nullptr);
+    int post(std::function<void(void)> fn);          /* (3) */
+    int post_at(std::chrono::steady_clock::time_point deadline,
+            std::function<void(void)> fn);
 
+    void set_dispatch_policy(                        /* (5) */
+            tarp::DispatchBudget timers      = {},
+            tarp::DispatchBudget fd_events   = {},
+            tarp::DispatchBudget user_events = {},
+            tarp::DispatchBudget signals     = {});
+
+    struct evp_stats stats(void) const;              /* (6) */
+    void reset_stats(void);
+
+    /* (11) */
     int set_fd_event_callback(int fd, uint32_t flags, tarp::fd_callback cb);
-    int set_user_event_callback(unsigned event_type, tarp::uev_callback cb);
-    int set_timer_callback(std::chrono::microseconds interval,
-            tarp::timer_callback cb);
+    int set_user_event_callback(unsigned event_type,        /* (4) */
+            tarp::uev_callback cb);
+    int set_timer_callback(std::chrono::microseconds interval,   /* (7) */
+            tarp::timer_callback cb,
+            std::chrono::microseconds slack = std::chrono::microseconds::zero());
+    int set_signal_callback(int signo, tarp::signal_callback cb);   /* (8) */
 
     std::shared_ptr<tarp::TimerEventCallback> make_explicit_timer_callback(
             std::chrono::microseconds interval);
@@ -373,6 +536,9 @@ public:
     std::shared_ptr<tarp::UserEventCallback> make_explicit_user_event_callback(
             unsigned event_type);
 
+    std::shared_ptr<tarp::SignalCallback> make_explicit_signal_callback(
+            int signo);
+
     /* (1) */
     std::shared_ptr<tarp::Process> make_process(
             std::initializer_list<std::string> cmd_spec,
@@ -384,22 +550,57 @@ public:
             Process::completion_cb completion_callback = nullptr
             );
 
+#ifdef TARP_EVP_COROUTINES
+    /* (9) */
+    tarp::FdAwaiter readable(int fd);
+    tarp::FdAwaiter writable(int fd);
+    tarp::SleepAwaiter sleep_for(std::chrono::microseconds interval);
+    tarp::UserEventAwaiter user_event(unsigned event_type);
+    void spawn(tarp::task<void> t);
+    tarp::FrameAllocator &frame_allocator(void);
+#endif
+
 private:
     struct evp_handle *get_raw_evp_handle(void) override;
     void untrack_callback(size_t id) override;
     void track_callback(std::shared_ptr<tarp::Callback> cb);
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make_callback(Args &&...args);
     int activate_and_track(std::shared_ptr<tarp::Callback> callback);
+    int register_on_pump_thread(std::shared_ptr<tarp::Callback> callback);
+    class PumpThreadGuard;
+    static void run_posted(void *evp);
 
     struct evp_handle *m_raw_state;
-    size_t m_callback_id;
-    std::unordered_map<size_t, std::shared_ptr<tarp::Callback>> m_callbacks;
     tarp::Callback::construction_permit m_callback_construction_permit;
+
+    /* callbacks are tracked in slot id-1; freed slots are reused first */
+    std::vector<std::shared_ptr<tarp::Callback>> m_callbacks;
+    std::vector<size_t> m_free_slots;
+    std::shared_ptr<tarp::impl::CallbackPool> m_callback_pool;
+
+    std::mutex m_posted_mtx;
+    std::vector<std::function<void(void)>> m_posted;
+
+    /* the thread running the pump, if any; see (11) */
+    std::mutex m_pump_thread_mtx;
+    std::thread::id m_pump_thread;
+
+    /* created on first use; see tarp/event_coro.hxx */
+    std::shared_ptr<tarp::CoroutineState> m_coroutines;
+#ifdef TARP_EVP_COROUTINES
+    tarp::CoroutineState &coroutine_state(void);
+#endif
 };
 
 
 
 #include "impl/event.txx"
 
+#ifdef TARP_EVP_COROUTINES
+#include "impl/event_coro.txx"
+#endif
+
 }; /* namespace tarp */
 
 #endif
@@ -0,0 +1,394 @@
+#ifndef TARP_EVENT_CORO_HXX
+#define TARP_EVENT_CORO_HXX
+
+/*
+ * C++20 coroutine support for tarp::EventPump.
+ *
+ * See tarp/event.hxx FMI.
+ *
+ * Only available when compiling as C++20 or later, in which case
+ * TARP_EVP_COROUTINES is defined; otherwise this header is empty. It is
+ * header-only: the library itself need not be built as C++20 (but see the
+ * CMAKE_CXX_STANDARD cmake cache variable).
+ *
+ *
+ * General API notes
+ * ==================
+ *
+ * A coroutine returning tarp::task<T> can suspend on the events of an
+ * EventPump instead of registering callbacks with it:
+ *
+ *    tarp::task<void> serve(tarp::EventPump &pump, int fd) {
+ *        for (;;) {
+ *            uint32_t events = co_await pump.readable(fd);
+ *            ...
+ *            co_await pump.sleep_for(10ms);
+ *        }
+ *    }
+ *
+ *    pump->spawn(serve(*pump, fd));
+ *    pump->run();
+ *
+ * Coroutines are resumed by the event pump, in the thread running it,
+ * straight from the dispatch of the (C) event they were waiting on; the
+ * single-threaded model of tarp/event.h is unchanged. In particular none of
+ * this is thread-safe: coroutines must only be spawned, awaited, and
+ * destroyed in the thread running the pump (or, before it runs, in the
+ * thread that will run it).
+ *
+ * Awaitables
+ * -----------
+ * Each awaitable embeds the raw event it waits on -- an fd_event,
+ * timer_event, or user_event_watch -- which therefore lives in the
+ * coroutine frame for as long as the coroutine is suspended. Awaiting
+ * allocates nothing, and no std::function is involved. The raw event is
+ * registered when the coroutine suspends and unregistered when it is
+ * resumed or, should the coroutine be destroyed while suspended, when the
+ * awaitable is destructed. Failure to register the event throws
+ * std::runtime_error from the co_await expression.
+ *
+ * Frame allocation
+ * -----------------
+ * The frames of tasks created while the pump is running a coroutine --
+ * i.e. by the coroutines it runs -- come from the FrameAllocator of that
+ * pump, which caches freed frames for reuse, per size class. A server
+ * whose connections are served by tasks, themselves spawned by an accept
+ * loop running as a task, thus only allocates frames until the cache has
+ * warmed up. Frames of tasks created anywhere else (e.g. those spawned
+ * from outside the pump) come from the global operator new.
+ * NOTE a task must therefore not outlive the pump its frame was allocated
+ * from.
+ */
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#define TARP_EVP_COROUTINES 1
+
+#include <array>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include <tarp/common.h>
+#include <tarp/error.h>
+#include <tarp/event.h>
+#include <tarp/log.h>
+
+namespace tarp {
+
+class EventPump;
+class CoroutineState;
+template <typename T = void> class task;
+
+/*
+ * Caching allocator for coroutine frames; there is one per EventPump (see
+ * EventPump::frame_allocator).
+ *
+ * Requests are rounded up to a multiple of GRANULE bytes, and blocks freed
+ * are kept on a free list for their size class, to be handed out again;
+ * the cache is only released when the allocator is destructed. Requests
+ * greater than the largest size class are passed through to the global
+ * operator new.
+ *
+ * (1) The number of blocks obtained from the global operator new, i.e.
+ * the number of allocations that could not be served from the cache.
+ *
+ * Not thread-safe.
+ */
+class FrameAllocator {
+public:
+    static constexpr std::size_t GRANULE  = 64;
+    static constexpr std::size_t NUM_BINS = 64;
+
+    FrameAllocator(void) = default;
+    ~FrameAllocator(void);
+
+    FrameAllocator(const FrameAllocator &)            = delete;
+    FrameAllocator &operator=(const FrameAllocator &) = delete;
+
+    void *allocate(std::size_t size);
+    void deallocate(void *block, std::size_t size) noexcept;
+
+    std::size_t num_allocated(void) const;                       /* (1) */
+    std::size_t num_cached(void) const;
+
+private:
+    struct free_block {
+        free_block *next;
+    };
+
+    static std::size_t bin_of(std::size_t size);
+
+    std::array<free_block *, NUM_BINS> m_bins {};
+    std::size_t m_num_allocated = 0;
+    std::size_t m_num_cached    = 0;
+};
+
+namespace impl {
+
+/*
+ * The frame allocator in use by the thread; see FrameAllocatorScope. */
+inline thread_local tarp::FrameAllocator *current_frame_allocator = nullptr;
+
+/*
+ * Have the frames of tasks created by the thread come from the given
+ * allocator, for the lifetime of the object. Scopes nest. */
+class FrameAllocatorScope {
+public:
+    explicit FrameAllocatorScope(tarp::FrameAllocator *allocator);
+    ~FrameAllocatorScope(void);
+
+    FrameAllocatorScope(const FrameAllocatorScope &)            = delete;
+    FrameAllocatorScope &operator=(const FrameAllocatorScope &) = delete;
+
+private:
+    tarp::FrameAllocator *m_prev;
+};
+
+/*
+ * Resume the coroutine, with the frame allocator of its pump in use. */
+void resume_on(tarp::FrameAllocator *allocator, std::coroutine_handle<> coro);
+
+}  /* namespace impl */
+
+/*
+ * Resumes the awaiting coroutine with the events that occurred on the fd
+ * (a bitmask of FD_EVENT_* flags); see EventPump::readable. */
+class FdAwaiter {
+public:
+    FdAwaiter(struct evp_handle *evp, tarp::FrameAllocator *frames,
+              int fd, uint32_t flags);
+    ~FdAwaiter(void);
+
+    FdAwaiter(const FdAwaiter &)            = delete;
+    FdAwaiter &operator=(const FdAwaiter &) = delete;
+
+    bool await_ready(void) const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> waiter);
+    uint32_t await_resume(void) const noexcept { return m_revents; }
+
+private:
+    static void on_event(struct fd_event *fdev, int fd, uint32_t events,
+                         void *priv);
+
+    struct evp_handle *m_evp;
+    tarp::FrameAllocator *m_frames;
+    struct fd_event m_fdev {};
+    std::coroutine_handle<> m_waiter;
+    int m_fd;
+    uint32_t m_flags;
+    uint32_t m_revents = 0;
+};
+
+/*
+ * Resumes the awaiting coroutine once the given interval has elapsed; see
+ * EventPump::sleep_for. */
+class SleepAwaiter {
+public:
+    SleepAwaiter(struct evp_handle *evp, tarp::FrameAllocator *frames,
+                 std::chrono::microseconds interval);
+    ~SleepAwaiter(void);
+
+    SleepAwaiter(const SleepAwaiter &)            = delete;
+    SleepAwaiter &operator=(const SleepAwaiter &) = delete;
+
+    bool await_ready(void) const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> waiter);
+    void await_resume(void) const noexcept {}
+
+private:
+    static void on_expiry(struct timer_event *tev, void *priv);
+
+    struct evp_handle *m_evp;
+    tarp::FrameAllocator *m_frames;
+    struct timer_event m_tev {};
+    std::coroutine_handle<> m_waiter;
+    struct timespec m_interval;
+};
+
+/*
+ * Resumes the awaiting coroutine with the data of the next user event of
+ * the given type; see EventPump::user_event. */
+class UserEventAwaiter {
+public:
+    UserEventAwaiter(struct evp_handle *evp, tarp::FrameAllocator *frames,
+                     unsigned event_type);
+    ~UserEventAwaiter(void);
+
+    UserEventAwaiter(const UserEventAwaiter &)            = delete;
+    UserEventAwaiter &operator=(const UserEventAwaiter &) = delete;
+
+    bool await_ready(void) const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> waiter);
+    void *await_resume(void) const noexcept { return m_data; }
+
+private:
+    static void on_event(struct user_event_watch *uev, unsigned event_type,
+                         void *data, void *priv);
+
+    struct evp_handle *m_evp;
+    tarp::FrameAllocator *m_frames;
+    struct user_event_watch m_watch {};
+    std::coroutine_handle<> m_waiter;
+    unsigned m_event_type;
+    void *m_data = nullptr;
+};
+
+namespace impl {
+
+/*
+ * State and behavior common to the promises of all tasks.
+ *
+ * (1) The coroutine awaiting the task. The task is started by a plain call
+ * from the awaiting coroutine (see start): if it completes straight away,
+ * the awaiting coroutine simply carries on, without suspending. Otherwise
+ * the task completes later, in a callback of the pump, and hands control
+ * back to the awaiting coroutine through symmetric transfer. Either way
+ * chains of tasks do not grow the stack, whether or not the compiler
+ * turns symmetric transfers into tail calls (GCC e.g. does not without
+ * optimization).
+ *
+ * (2) Set for tasks spawned on an EventPump (see EventPump::spawn), which
+ * are then owned by the pump rather than by a task object, and destroy
+ * themselves on completion.
+ */
+class TaskPromiseBase {
+public:
+    struct FinalAwaiter {
+        bool await_ready(void) const noexcept { return false; }
+        void await_resume(void) const noexcept {}
+
+        template <typename PROMISE>
+        std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<PROMISE> coro) noexcept
+        {
+            return coro.promise().on_completion();
+        }
+    };
+
+    TaskPromiseBase(void) = default;
+    ~TaskPromiseBase(void);
+
+    std::suspend_always initial_suspend(void) noexcept { return {}; }
+    FinalAwaiter final_suspend(void) noexcept { return {}; }
+    void unhandled_exception(void) noexcept;
+
+    static void *operator new(std::size_t size);
+    static void operator delete(void *frame, std::size_t size) noexcept;
+
+    bool start(std::coroutine_handle<> self,
+               std::coroutine_handle<> continuation);
+
+protected:
+    void rethrow_if_failed(void) const;
+
+private:
+    friend class tarp::CoroutineState;
+
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) frame_header {
+        tarp::FrameAllocator *allocator;
+    };
+
+    std::coroutine_handle<> on_completion(void) noexcept;
+
+    std::coroutine_handle<> m_continuation;                      /* (1) */
+    bool m_continuation_suspended = false;
+    std::exception_ptr m_exception;
+
+    tarp::CoroutineState *m_owner = nullptr;                     /* (2) */
+    std::coroutine_handle<> m_self;
+    TaskPromiseBase *m_prev = nullptr;
+    TaskPromiseBase *m_next = nullptr;
+};
+
+template <typename T>
+class TaskPromise final : public TaskPromiseBase {
+public:
+    tarp::task<T> get_return_object(void) noexcept;
+
+    template <typename U>
+    void return_value(U &&value);
+
+    T result(void);
+
+private:
+    std::optional<T> m_value;
+};
+
+template <>
+class TaskPromise<void> final : public TaskPromiseBase {
+public:
+    tarp::task<void> get_return_object(void) noexcept;
+    void return_void(void) noexcept {}
+    void result(void);
+};
+
+}  /* namespace impl */
+
+/*
+ * Coroutine task producing a T (which must be a value type).
+ *
+ * (1) Tasks are lazy: the coroutine does not start until the task is
+ * co_await-ed (or spawned; see EventPump::spawn). Awaiting a task resumes
+ * the awaiting coroutine, with the value the task co_returned, once the
+ * task completes; chains of tasks do not grow the stack (see
+ * impl::TaskPromiseBase). An exception escaping the coroutine is rethrown
+ * to the awaiting coroutine. A task can only be awaited once.
+ *
+ * (2) Destructing a task destroys its coroutine, whether or not it has
+ * completed.
+ */
+template <typename T>
+class task {
+public:
+    using promise_type = impl::TaskPromise<T>;
+    using handle_type  = std::coroutine_handle<promise_type>;
+
+    explicit task(handle_type coro) noexcept : m_coro(coro) {}
+    task(task &&other) noexcept;
+    task &operator=(task &&other) noexcept;
+    ~task(void);                                                 /* (2) */
+
+    task(const task &)            = delete;
+    task &operator=(const task &) = delete;
+
+    bool done(void) const noexcept;
+    auto operator co_await() noexcept;                           /* (1) */
+
+private:
+    friend class tarp::EventPump;
+
+    handle_type m_coro;
+};
+
+/*
+ * Coroutine state kept by each EventPump (created on first use): the
+ * frame allocator, and the tasks spawned on the pump. Those still
+ * suspended when the pump is destructed are destroyed with it. */
+class CoroutineState {
+public:
+    CoroutineState(void) = default;
+    ~CoroutineState(void);
+
+    CoroutineState(const CoroutineState &)            = delete;
+    CoroutineState &operator=(const CoroutineState &) = delete;
+
+    void adopt(std::coroutine_handle<> coro, impl::TaskPromiseBase &promise);
+    void release(impl::TaskPromiseBase &promise) noexcept;
+
+    tarp::FrameAllocator frames;
+
+private:
+    impl::TaskPromiseBase *m_spawned = nullptr;
+};
+
+}  /* namespace tarp */
+
+#endif  /* C++20 coroutines */
+
+#endif
@@ -19,11 +19,28 @@
  *
  * 3) whether event notifications are level-triggered (default) or
  * edge-triggered.
+ *
+ * 4) whether the event pump should read the data from the file descriptor
+ * on the user's behalf (FD_EVENT_RECV). Instead of being told the fd is
+ * readable, the callback is then handed the data that was read; see
+ * Evp_get_fdev_data fmi. FD_EVENT_RECV implies FD_EVENT_READABLE.
+ * With the io_uring backend the reads are completion-based, into a
+ * buffer ring registered with the kernel, so receiving data costs no
+ * extra system calls.
+ *
+ * 5) whether the event pump should drain the file descriptor on the user's
+ * behalf (FD_EVENT_DRAIN): on readability it reads until EAGAIN, into
+ * buffers from a pool kept by the event pump, and hands the callback the
+ * list of filled buffers, as ref-counted slices; see Evp_get_fdev_slices
+ * fmi. FD_EVENT_DRAIN implies FD_EVENT_READABLE, FD_EVENT_EDGE_TRIGGERED
+ * and FD_NONBLOCKING, and is mutually exclusive with FD_EVENT_RECV.
  */
 #define FD_EVENT_READABLE            1
 #define FD_EVENT_WRITABLE            2
 #define FD_EVENT_ERROR               4
 #define FD_EVENT_EDGE_TRIGGERED      8
 #define FD_NONBLOCKING               16
+#define FD_EVENT_RECV                32
+#define FD_EVENT_DRAIN               64
 
 #endif
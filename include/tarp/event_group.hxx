@@ -0,0 +1,202 @@
+#ifndef TARP_EVENT_GROUP_HXX
+#define TARP_EVENT_GROUP_HXX
+
+/*
+ * A group of event pumps (see tarp/event.hxx), each run in its own thread,
+ * optionally pinned to its own CPU core. Callbacks registered with the
+ * group are spread across the pumps according to a sharding policy.
+ *
+ * A single EventPump runs in a single thread and therefore saturates a
+ * single core. The group makes it possible to scale e.g. a connection
+ * handling loop across cores, with every pump owning and exclusively
+ * handling a subset of the file descriptors (and timers) -- i.e. no
+ * shared state and no locking on the data path.
+ *
+ *
+ * Threading
+ * ----------
+ * Before start(), the group is not running and it may only be used from
+ * the thread that will call start() and stop(); callbacks are registered
+ * directly with the respective pumps.
+ * Once started, the set_*_callback methods, post, and the listener methods
+ * may be called from any thread, including from inside callbacks running
+ * on any of the pumps: the registration is posted to the pump chosen by the
+ * sharding policy (see EventPump::post) and happens asynchronously, in that
+ * pump's thread. Errors are then logged rather than returned.
+ * start() and stop() must not be called concurrently with other methods.
+ *
+ * The pumps are accessible through pump(). The usual EventPump rules then
+ * apply: the only thread-safe EventPump methods are push_event, post and
+ * stop; everything else must be done from the pump's own thread -- e.g. by
+ * posting a function to it.
+ *
+ *
+ * Listeners
+ * ----------
+ * A listening socket can be replicated across the pumps such that each
+ * pump has its own socket and accepts its own connections. With
+ * SO_REUSEPORT, the kernel then load-balances incoming connections across
+ * the sockets, hence across the pumps. A connection accepted by a pump
+ * would typically be registered on that same pump, from the listener
+ * callback, to keep its handling on the same core (see listener_callback).
+ */
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <tarp/event.hxx>
+
+namespace tarp {
+
+/*
+ * Sharding policy of an EventPumpGroup: decides which pump each new
+ * callback is placed on.
+ *
+ * pick() gets the fd the callback is for (-1 for timers) and the current
+ * load of each pump (the number of live callbacks placed on it through the
+ * group) and must return an index into 'loads'. Calls to pick() are
+ * serialized by the group.
+ */
+class ShardingPolicy {
+public:
+    virtual ~ShardingPolicy(void) = default;
+    virtual size_t pick(int fd, const std::vector<size_t> &loads) = 0;
+};
+
+/* Cycle through the pumps in order. */
+class RoundRobinSharding final : public ShardingPolicy {
+public:
+    size_t pick(int fd, const std::vector<size_t> &loads) override;
+
+private:
+    size_t m_next = 0;
+};
+
+/*
+ * Place each fd on the pump given by hashing the fd, such that the same
+ * fd is always placed on the same pump. Timers are placed round-robin. */
+class FdHashSharding final : public ShardingPolicy {
+public:
+    size_t pick(int fd, const std::vector<size_t> &loads) override;
+
+private:
+    RoundRobinSharding m_timer_policy;
+};
+
+/* Place each callback on the pump with the fewest live callbacks. */
+class LeastLoadedSharding final : public ShardingPolicy {
+public:
+    size_t pick(int fd, const std::vector<size_t> &loads) override;
+};
+
+class EventPumpGroup final {
+public:
+    /*
+     * Invoked, on the pump that owns the listening socket, when the socket
+     * becomes readable, i.e. when there are connections to accept. Like
+     * fd_callback, but also gets the pump, so that connections accepted
+     * can be registered with it directly.  */
+    using listener_callback =
+        std::function<bool(tarp::EventPump &pump, int fd, uint32_t events)>;
+
+    /*
+     * Create a bound and listening socket and return its fd; or a negative
+     * value on failure. */
+    using socket_factory = std::function<int(void)>;
+
+    /*
+     * Create num_pumps event pumps; if 0, create one for each CPU the
+     * process is allowed to run on. If pin_threads=true, the thread running
+     * the i-th pump will be pinned to the i-th such CPU (modulo the number
+     * of CPUs). The default sharding policy is RoundRobinSharding.
+     */
+    explicit EventPumpGroup(size_t num_pumps = 0,
+                            std::unique_ptr<ShardingPolicy> policy = nullptr,
+                            bool pin_threads = true);
+
+    /* Stop the group, then close any listening sockets it owns. */
+    ~EventPumpGroup(void);
+
+    EventPumpGroup(const EventPumpGroup &)            = delete;
+    EventPumpGroup(EventPumpGroup &&)                 = delete;
+    EventPumpGroup &operator=(const EventPumpGroup &) = delete;
+    EventPumpGroup &operator=(EventPumpGroup &&)      = delete;
+
+    /*
+     * Start a thread for each pump, running it until stop() is called.
+     * Calling start() on a running group does nothing. A stopped group
+     * can be started again. */
+    void start(void);
+
+    /* Stop every pump and join its thread. */
+    void stop(void);
+    bool is_running(void) const;
+
+    size_t size(void) const;
+    std::shared_ptr<tarp::EventPump> pump(size_t idx) const;
+    size_t load(size_t idx) const;
+
+    void set_sharding_policy(std::unique_ptr<ShardingPolicy> policy);
+
+    /*
+     * Like the EventPump methods of the same name, but the callback is
+     * placed on a pump chosen by the sharding policy. */
+    int set_fd_event_callback(int fd, uint32_t flags, tarp::fd_callback cb);
+    int set_timer_callback(std::chrono::microseconds interval,
+                           tarp::timer_callback cb);
+
+    /*
+     * Have fn run by the pump with the specified index; see
+     * EventPump::post. */
+    int post(size_t idx, std::function<void(void)> fn);
+
+    /*
+     * Call make_socket once for each pump and register the socket it
+     * returns with that pump for readability, with cb as the callback.
+     * The sockets returned would typically have SO_REUSEPORT set and be
+     * bound to the same address.
+     *
+     * The group takes ownership of the sockets: they are closed when the
+     * group is destructed. If make_socket fails for any of the pumps, the
+     * sockets obtained up to that point are closed and nothing is
+     * registered. Likewise, if a socket fails to register with its pump,
+     * the ones registered already are unregistered, all the sockets are
+     * closed and the error is returned. NOTE if the group is running, the
+     * registrations are posted (see EventPump::post), so only a failure to
+     * post is caught and returned: other failures can only be logged. */
+    int replicate_listener(socket_factory make_socket, listener_callback cb);
+
+    /*
+     * replicate_listener with a factory that creates non-blocking TCP
+     * sockets with SO_REUSEPORT set, bound to addr. */
+    int add_reuseport_listener(const struct sockaddr *addr,
+                               socklen_t addrlen,
+                               listener_callback cb,
+                               int backlog = SOMAXCONN);
+
+private:
+    size_t pick_pump(int fd);
+    int place(size_t idx, std::function<int(void)> registration);
+    void run_pump(size_t idx);
+
+    std::vector<std::shared_ptr<tarp::EventPump>> m_pumps;
+    std::vector<std::atomic<size_t>> m_loads;
+    std::vector<std::thread> m_threads;
+    std::vector<int> m_cpus;
+    std::vector<int> m_listeners;
+
+    std::mutex m_mtx;
+    std::unique_ptr<ShardingPolicy> m_policy;
+    std::atomic<bool> m_running;
+};
+
+}; /* namespace tarp */
+
+#endif
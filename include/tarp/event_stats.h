@@ -0,0 +1,90 @@
+#ifndef TARP_EVENT_STATS_H
+#define TARP_EVENT_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Event pump instrumentation; see Evp_get_stats.
+ *
+ * What gets sampled is chosen at compile time (of the library) via
+ * EVP_STATS_LEVEL (see the EVP_STATS_LEVEL cmake cache variable):
+ *  0 - nothing; the instrumentation is compiled out entirely.
+ *  1 - per loop iteration: iteration count, time blocked waiting for
+ *      events, time spent dispatching, events dispatched per class, and
+ *      timer lag. A few clock reads per iteration.
+ *  2 - (default) as 1, plus the execution time of every callback, with the
+ *      slowest one on record. Two clock reads per callback.
+ * The layout of the structures below is the same regardless; what is not
+ * sampled simply stays 0.
+ */
+#ifndef EVP_STATS_LEVEL
+#define EVP_STATS_LEVEL 2
+#endif
+
+/*
+ * Classes of events dispatched by the event pump, in the order they are
+ * dispatched in by default; see Evp_set_dispatch_policy. */
+enum evp_event_class {
+    EVP_CLASS_SIGNAL = 0,
+    EVP_CLASS_TIMER,
+    EVP_CLASS_FD,
+    EVP_CLASS_USER,
+    EVP_NUM_EVENT_CLASSES
+};
+
+/*
+ * Log-bucketed histogram of durations in nanoseconds: count[i] is the
+ * number of samples in [2^i, 2^(i+1)) ns; count[0] also takes 0 and the
+ * last bucket takes everything from 2^(EVP_HIST_NUM_BUCKETS-1) ns (~2s)
+ * up.
+ *
+ * Histograms are written by the thread running the event pump only, with
+ * relaxed atomic stores; they can be read from any other thread (see
+ * Evp_get_stats) without locking. */
+#define EVP_HIST_NUM_BUCKETS 32
+
+struct evp_histogram {
+    uint64_t count[EVP_HIST_NUM_BUCKETS];
+};
+
+/*
+ * (1) How late timers fire relative to their deadline.
+ *
+ * (2) The slowest callback executed; priv is the priv pointer the callback
+ * was registered with (the Callback object for the C++ EventPump) -- or
+ * the argument, for functions posted with Evp_post.
+ */
+struct evp_stats {
+    uint64_t iterations;
+    uint64_t dispatched[EVP_NUM_EVENT_CLASSES];
+    uint64_t blocked_ns;               /* total time waiting for events */
+    uint64_t busy_ns;                  /* total time dispatching events */
+
+    struct evp_histogram blocked;      /* per loop iteration */
+    struct evp_histogram busy;         /* per loop iteration */
+    struct evp_histogram timer_lag;                                 /* (1) */
+    struct evp_histogram callbacks[EVP_NUM_EVENT_CLASSES];
+
+    struct {                                                        /* (2) */
+        uint64_t ns;
+        enum evp_event_class event_class;
+        const void *priv;
+    } slowest;
+};
+
+/*
+ * The total number of samples in the histogram, and the upper bound
+ * (in ns) of the bucket that holds the pth percentile sample, p in
+ * [0, 100]; 0 if the histogram is empty. */
+uint64_t Evp_histogram_count(const struct evp_histogram *hist);
+uint64_t Evp_histogram_percentile(const struct evp_histogram *hist, double p);
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif
+
+#endif
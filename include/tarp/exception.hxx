@@ -3,7 +3,7 @@
 #include <exception>
 #include <string>
 
-#if __cplusplus >= 202002L
+#if __cplusplus >= 202002L && __has_include(<format>)
 #include <format>
 #endif
 
@@ -90,7 +90,7 @@ void do_throwc(msg &&...vargs) {
 // to produce a formatted string.
 // Example:
 //    do_throw<std::logic_error>("BUG in myfunc: {}", errstr);
-#if __cplusplus >= 202002L
+#if __cplusplus >= 202002L && __has_include(<format>)
 
 template<typename exception_t, typename... msg>
 [[noreturn]] void do_throw(std::format_string<msg...> fmt, msg &&...vargs) {
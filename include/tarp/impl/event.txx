@@ -6,7 +6,7 @@ CallbackCore<FUNC_TYPE>::CallbackCore(
         std::shared_ptr<tarp::EventPump> evp,
         FUNC_TYPE cb)
     :
-    m_func(cb), m_evp(evp), m_isactive(false), m_isdead(false), m_id(0)
+    m_func(std::move(cb)), m_evp(std::move(evp)), m_isactive(false), m_isdead(false), m_id(0)
 {
     if (!m_evp.lock()) throw std::invalid_argument(
         "Illegal attempt to constructor callback from null EventPump");
@@ -62,7 +62,7 @@ bool CallbackCore<FUNC_TYPE>::is_active(void) const{
 
 template <typename FUNC_TYPE>
 void CallbackCore<FUNC_TYPE>::set_func(FUNC_TYPE f){
-    m_func = f;
+    m_func = std::move(f);
 }
 
 template <typename FUNC_TYPE>
@@ -0,0 +1,379 @@
+#ifndef TARP_EVENT_CORO_TPP
+#define TARP_EVENT_CORO_TPP
+
+/*
+ * FrameAllocator
+ */
+inline FrameAllocator::~FrameAllocator(void){
+    for (free_block *block : m_bins){
+        while (block){
+            free_block *next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+    }
+}
+
+inline std::size_t FrameAllocator::bin_of(std::size_t size){
+    return (size ? size - 1 : 0) / GRANULE;
+}
+
+inline void *FrameAllocator::allocate(std::size_t size){
+    std::size_t bin = bin_of(size);
+    if (bin >= NUM_BINS) return ::operator new(size);
+
+    if (free_block *block = m_bins[bin]){
+        m_bins[bin] = block->next;
+        --m_num_cached;
+        return block;
+    }
+
+    ++m_num_allocated;
+    return ::operator new((bin + 1) * GRANULE);
+}
+
+inline void FrameAllocator::deallocate(void *block, std::size_t size) noexcept {
+    std::size_t bin = bin_of(size);
+    if (bin >= NUM_BINS){
+        ::operator delete(block);
+        return;
+    }
+
+    m_bins[bin] = new (block) free_block{m_bins[bin]};
+    ++m_num_cached;
+}
+
+inline std::size_t FrameAllocator::num_allocated(void) const {
+    return m_num_allocated;
+}
+
+inline std::size_t FrameAllocator::num_cached(void) const {
+    return m_num_cached;
+}
+
+inline impl::FrameAllocatorScope::FrameAllocatorScope(
+        tarp::FrameAllocator *allocator)
+    : m_prev(current_frame_allocator)
+{
+    current_frame_allocator = allocator;
+}
+
+inline impl::FrameAllocatorScope::~FrameAllocatorScope(void){
+    current_frame_allocator = m_prev;
+}
+
+inline void impl::resume_on(tarp::FrameAllocator *allocator,
+                            std::coroutine_handle<> coro)
+{
+    FrameAllocatorScope scope(allocator);
+    coro.resume();
+}
+
+/*
+ * Awaitables
+ */
+inline FdAwaiter::FdAwaiter(struct evp_handle *evp,
+                            tarp::FrameAllocator *frames,
+                            int fd, uint32_t flags)
+    : m_evp(evp), m_frames(frames), m_fd(fd), m_flags(flags)
+{
+}
+
+inline FdAwaiter::~FdAwaiter(void){
+    Evp_unregister_fdmon(m_evp, &m_fdev);
+}
+
+inline void FdAwaiter::await_suspend(std::coroutine_handle<> waiter){
+    m_waiter = waiter;
+
+    if (Evp_init_fdmon(&m_fdev, m_fd, m_flags, on_event, this) != ERRORCODE_SUCCESS ||
+        Evp_register_fdmon(m_evp, &m_fdev) != ERRORCODE_SUCCESS)
+    {
+        throw std::runtime_error("Failed to register fd event monitor");
+    }
+}
+
+inline void FdAwaiter::on_event(struct fd_event *fdev, int fd,
+                                uint32_t events, void *priv)
+{
+    UNUSED(fd);
+    auto *self = static_cast<FdAwaiter *>(priv);
+
+    Evp_unregister_fdmon(self->m_evp, fdev);
+    self->m_revents = events;
+    impl::resume_on(self->m_frames, self->m_waiter);
+}
+
+inline SleepAwaiter::SleepAwaiter(struct evp_handle *evp,
+                                  tarp::FrameAllocator *frames,
+                                  std::chrono::microseconds interval)
+    : m_evp(evp), m_frames(frames)
+{
+    if (interval.count() < 0){
+        throw std::invalid_argument("Invalid (negative) sleep interval");
+    }
+
+    auto secs = std::chrono::duration_cast<std::chrono::seconds>(interval);
+    m_interval.tv_sec  = secs.count();
+    m_interval.tv_nsec = (interval - secs).count() * 1000;
+}
+
+inline SleepAwaiter::~SleepAwaiter(void){
+    Evp_unregister_timer(m_evp, &m_tev);
+}
+
+inline void SleepAwaiter::await_suspend(std::coroutine_handle<> waiter){
+    m_waiter = waiter;
+
+    Evp_init_timer_fromtimespec(&m_tev, &m_interval, on_expiry, this);
+    if (Evp_register_timer(m_evp, &m_tev) != ERRORCODE_SUCCESS){
+        throw std::runtime_error("Failed to register timer");
+    }
+}
+
+inline void SleepAwaiter::on_expiry(struct timer_event *tev, void *priv){
+    UNUSED(tev);
+    auto *self = static_cast<SleepAwaiter *>(priv);
+    impl::resume_on(self->m_frames, self->m_waiter);
+}
+
+inline UserEventAwaiter::UserEventAwaiter(struct evp_handle *evp,
+                                          tarp::FrameAllocator *frames,
+                                          unsigned event_type)
+    : m_evp(evp), m_frames(frames), m_event_type(event_type)
+{
+}
+
+inline UserEventAwaiter::~UserEventAwaiter(void){
+    Evp_unregister_uev_watch(m_evp, &m_watch);
+}
+
+inline void UserEventAwaiter::await_suspend(std::coroutine_handle<> waiter){
+    m_waiter = waiter;
+
+    if (Evp_init_uev_watch(&m_watch, m_event_type, on_event, this) != ERRORCODE_SUCCESS ||
+        Evp_register_uev_watch(m_evp, &m_watch) != ERRORCODE_SUCCESS)
+    {
+        throw std::runtime_error("Failed to register user event watch");
+    }
+}
+
+inline void UserEventAwaiter::on_event(struct user_event_watch *uev,
+                                       unsigned event_type,
+                                       void *data, void *priv)
+{
+    UNUSED(event_type);
+    auto *self = static_cast<UserEventAwaiter *>(priv);
+
+    Evp_unregister_uev_watch(self->m_evp, uev);
+    self->m_data = data;
+    impl::resume_on(self->m_frames, self->m_waiter);
+}
+
+/*
+ * Task promises
+ */
+inline impl::TaskPromiseBase::~TaskPromiseBase(void){
+    if (m_owner) m_owner->release(*this);
+}
+
+inline void impl::TaskPromiseBase::unhandled_exception(void) noexcept {
+    m_exception = std::current_exception();
+}
+
+/*
+ * The allocator the frame comes from is recorded in a header just before
+ * it, for operator delete. */
+inline void *impl::TaskPromiseBase::operator new(std::size_t size){
+    tarp::FrameAllocator *allocator = current_frame_allocator;
+
+    size += sizeof(frame_header);
+    void *block = allocator ? allocator->allocate(size) : ::operator new(size);
+    return new (block) frame_header{allocator} + 1;
+}
+
+inline void impl::TaskPromiseBase::operator delete(void *frame,
+                                                   std::size_t size) noexcept
+{
+    auto *header = static_cast<frame_header *>(frame) - 1;
+    tarp::FrameAllocator *allocator = header->allocator;
+
+    header->~frame_header();
+    if (allocator) allocator->deallocate(header, size + sizeof(frame_header));
+    else ::operator delete(header);
+}
+
+/*
+ * Run the task (self) on behalf of the awaiting coroutine (continuation)
+ * until it completes or first suspends; true if it suspended, in which case
+ * the awaiting coroutine must suspend as well, to be resumed on completion. */
+inline bool impl::TaskPromiseBase::start(std::coroutine_handle<> self,
+                                         std::coroutine_handle<> continuation)
+{
+    m_continuation = continuation;
+    self.resume();
+    if (self.done()) return false;
+
+    m_continuation_suspended = true;
+    return true;
+}
+
+inline void impl::TaskPromiseBase::rethrow_if_failed(void) const {
+    if (m_exception) std::rethrow_exception(m_exception);
+}
+
+inline std::coroutine_handle<> impl::TaskPromiseBase::on_completion(void) noexcept {
+    if (m_continuation){
+        /* else returning into start() */
+        if (m_continuation_suspended) return m_continuation;
+        return std::noop_coroutine();
+    }
+
+    /* spawned; nobody to hand the outcome to */
+    if (m_owner){
+        if (m_exception){
+            error("Unhandled exception escaped spawned coroutine task");
+            std::terminate();
+        }
+        m_self.destroy();
+    }
+
+    return std::noop_coroutine();
+}
+
+template <typename T>
+tarp::task<T> impl::TaskPromise<T>::get_return_object(void) noexcept {
+    return tarp::task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+template <typename T>
+template <typename U>
+void impl::TaskPromise<T>::return_value(U &&value){
+    m_value.emplace(std::forward<U>(value));
+}
+
+template <typename T>
+T impl::TaskPromise<T>::result(void){
+    rethrow_if_failed();
+    return std::move(*m_value);
+}
+
+inline tarp::task<void> impl::TaskPromise<void>::get_return_object(void) noexcept {
+    return tarp::task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+inline void impl::TaskPromise<void>::result(void){
+    rethrow_if_failed();
+}
+
+/*
+ * task
+ */
+template <typename T>
+task<T>::task(task &&other) noexcept
+    : m_coro(std::exchange(other.m_coro, {}))
+{
+}
+
+template <typename T>
+task<T> &task<T>::operator=(task &&other) noexcept {
+    if (this != &other){
+        if (m_coro) m_coro.destroy();
+        m_coro = std::exchange(other.m_coro, {});
+    }
+    return *this;
+}
+
+template <typename T>
+task<T>::~task(void){
+    if (m_coro) m_coro.destroy();
+}
+
+template <typename T>
+bool task<T>::done(void) const noexcept {
+    return !m_coro || m_coro.done();
+}
+
+template <typename T>
+auto task<T>::operator co_await() noexcept {
+    struct awaiter {
+        handle_type coro;
+
+        bool await_ready(void) const noexcept { return coro.done(); }
+
+        bool await_suspend(std::coroutine_handle<> waiter){
+            return coro.promise().start(coro, waiter);
+        }
+
+        T await_resume(void) { return coro.promise().result(); }
+    };
+
+    return awaiter{m_coro};
+}
+
+/*
+ * CoroutineState
+ */
+inline CoroutineState::~CoroutineState(void){
+    /* destroying a frame releases it from the list */
+    while (m_spawned) m_spawned->m_self.destroy();
+}
+
+inline void CoroutineState::adopt(std::coroutine_handle<> coro,
+                                  impl::TaskPromiseBase &promise)
+{
+    promise.m_owner = this;
+    promise.m_self  = coro;
+    promise.m_prev  = nullptr;
+    promise.m_next  = m_spawned;
+    if (m_spawned) m_spawned->m_prev = &promise;
+    m_spawned = &promise;
+}
+
+inline void CoroutineState::release(impl::TaskPromiseBase &promise) noexcept {
+    if (promise.m_prev) promise.m_prev->m_next = promise.m_next;
+    else m_spawned = promise.m_next;
+    if (promise.m_next) promise.m_next->m_prev = promise.m_prev;
+    promise.m_owner = nullptr;
+}
+
+/*
+ * EventPump coroutine interface
+ */
+inline tarp::CoroutineState &EventPump::coroutine_state(void){
+    if (!m_coroutines) m_coroutines = std::make_shared<tarp::CoroutineState>();
+    return *m_coroutines;
+}
+
+inline tarp::FrameAllocator &EventPump::frame_allocator(void){
+    return coroutine_state().frames;
+}
+
+inline tarp::FdAwaiter EventPump::readable(int fd){
+    return tarp::FdAwaiter(m_raw_state, &frame_allocator(), fd,
+                           FD_EVENT_READABLE);
+}
+
+inline tarp::FdAwaiter EventPump::writable(int fd){
+    return tarp::FdAwaiter(m_raw_state, &frame_allocator(), fd,
+                           FD_EVENT_WRITABLE);
+}
+
+inline tarp::SleepAwaiter EventPump::sleep_for(std::chrono::microseconds interval){
+    return tarp::SleepAwaiter(m_raw_state, &frame_allocator(), interval);
+}
+
+inline tarp::UserEventAwaiter EventPump::user_event(unsigned event_type){
+    return tarp::UserEventAwaiter(m_raw_state, &frame_allocator(),
+                                  event_type);
+}
+
+inline void EventPump::spawn(tarp::task<void> t){
+    auto coro = std::exchange(t.m_coro, {});
+    if (!coro) throw std::invalid_argument("Cannot spawn empty task");
+
+    coroutine_state().adopt(coro, coro.promise());
+    impl::resume_on(&frame_allocator(), coro);
+}
+
+#endif
@@ -7,10 +7,17 @@ extern "C" {
 
 struct timer_event {
     struct dlnode link;
+    struct dllist *slot;  /* list the timer is linked into, if registered */
     bool registered;
-    struct timespec tspec;
+    struct timespec tspec;    /* deadline, if registered; else interval */
+    struct timespec interval;
+    uint32_t slack_us;    /* tolerated delay past tspec; see timer_wheel.h */
+    bool periodic;
+    enum evp_timer_overrun overrun;
+    uint32_t overruns;
     timer_callback cb;
     void *priv;
+    struct evp_histogram *hist;
 };
 
 struct fd_event {
@@ -19,15 +26,31 @@ struct fd_event {
     int fd;
     uint32_t evmask;   /* events of interest */
     uint32_t revents;  /* events that have occured (returned by OS) */
+    const uint8_t *rxbuf; /* data received, for FD_EVENT_RECV monitors */
+    size_t rxlen;
+    struct dllist *slices; /* data drained, for FD_EVENT_DRAIN monitors */
+    bool eof;
     fd_event_callback cb;
     void *priv;
+    struct evp_histogram *hist;
 };
 
 struct user_event_watch {
+    struct dlnode link;
     void *priv;
     user_event_callback cb;
     unsigned event_type;
     bool registered;
+    struct evp_histogram *hist;
+};
+
+struct signal_watch {
+    struct dlnode link;
+    void *priv;
+    signal_callback cb;
+    int signo;
+    bool registered;
+    struct evp_histogram *hist;
 };
 
 
@@ -5,7 +5,7 @@
 #include <stdexcept>
 #include <string>
 
-#if __cplusplus >= 202002L
+#if __cplusplus >= 202002L && __has_include(<format>)
 #include <format>
 #endif
 
@@ -43,7 +43,7 @@ void println(Args &&...args) {
     (std::cout << ... << std::forward<Args>(args)) << '\n';
 }
 
-#if __cplusplus >= 202002L
+#if __cplusplus >= 202002L && __has_include(<format>)
 
 // C++23 introduces std::print, but this is missing in c++20.
 // C++20 does have std::format however. The below provides a
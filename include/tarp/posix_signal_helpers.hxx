@@ -56,4 +56,19 @@ set_up_signals(std::initializer_list<int> signals = {SIGINT, SIGTERM, SIGSEGV},
                bool exit_on_fail = true,
                bool verbose = true);
 
+/**
+ * @brief Block/unblock the specified signals in the calling thread.
+ *
+ * @details Threads inherit the signal mask of the thread that creates
+ * them. Signals to be received synchronously rather than through a
+ * signal handler -- e.g. through an event pump (see
+ * EventPump::set_signal_callback and Evp_register_signal_watch) -- must
+ * be blocked in *every* thread, so block_signals is best called early on
+ * in main, before any other threads are created.
+ *
+ * @throws std::system_error if the signal mask could not be changed.
+ */
+void block_signals(std::initializer_list<int> signals);
+void unblock_signals(std::initializer_list<int> signals);
+
 }  // namespace tarp
@@ -176,6 +176,13 @@ int sync_exec(
  * Both ioevent_cb and completion_cb are optional.
  *
  * priv is passed as-is to *both* ioevent_cb and completion_cb.
+ *
+ * NOTE the process is reaped as soon as SIGCHLD is received through the event
+ * pump (see Evp_register_signal_watch) if SIGCHLD is blocked in the calling
+ * thread -- which it then should be in all threads. Otherwise the event pump
+ * falls back to polling for the process's exit every
+ * ASYNC_PROCESS_REAPER_CHECK_INTERVAL_MS milliseconds.
+ * Either way, the subprocess starts out with an empty signal mask.
  */
 int async_exec(
         struct evp_handle *event_pump,
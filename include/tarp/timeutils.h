@@ -17,6 +17,7 @@ extern "C" {
 #define NSECS_PER_SEC  1000000000LU /* 1e9 */
 #define NSECS_PER_MSEC 1000000U     /* 1e6 */
 #define NSECS_PER_USEC 1000U        /* 1e3 */
+#define USECS_PER_MSEC 1000U        /* 1e3 */
 
 /*
  * timespec to double as the number of seconds or milliseconds */
@@ -1,12 +1,12 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 
 #include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/timerfd.h>
 
 #include <tarp/common.h>
@@ -15,7 +15,7 @@
 #include <tarp/error.h>
 #include <tarp/ioutils.h>
 #include <tarp/log.h>
-#include <tarp/staq.h>
+#include <tarp/math.h>
 #include <tarp/timeutils.h>
 
 #include "event_shared_defs.h"
@@ -36,12 +36,6 @@
 static_assert(sizeof(uint32_t) < sizeof(time_t),
               "sizeof uint32_t >= sizeof time_t");
 
-// staqnode destructor
-void user_event_destructor(struct staqnode *node) {
-    assert(node);
-    salloc(0, get_container(node, struct user_event, link));
-}
-
 // NOTE the os api handle must have been initialized
 static inline int initialize_eventfd_semaphore(struct evp_handle *handle) {
     assert(handle);
@@ -55,6 +49,8 @@ static inline int initialize_eventfd_semaphore(struct evp_handle *handle) {
     handle->sem.evmask = FD_EVENT_READABLE;
     handle->sem.fd = rc;
 
+    /* the simulated backend never waits; see evp_handle (15) */
+    if (handle->simulated) return 0;
     if (add_fd_event_monitor(handle->osapi, &handle->sem) != 0) return -1;
 
     return 0;
@@ -65,13 +61,16 @@ static inline int initialize_wait_timer(struct evp_handle *handle) {
     assert(handle);
     int rc;
 
+    handle->timerfd.evmask = FD_EVENT_READABLE;
+    handle->timerfd.fd = -1;
+    if (handle->simulated) return 0;
+
     rc = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
     if (rc < 0) {
         error("Failed to create timerfd: '%s'", strerror(errno));
         return -1;
     }
 
-    handle->timerfd.evmask = FD_EVENT_READABLE;
     handle->timerfd.fd = rc;
 
     if (add_fd_event_monitor(handle->osapi, &handle->timerfd) != 0) return -1;
@@ -79,39 +78,25 @@ static inline int initialize_wait_timer(struct evp_handle *handle) {
     return 0;
 }
 
-// NOTE that the pthread API does not normally set errno
-static int initialize_uevq_mutex(struct evp_handle *handle) {
-    int rc = 0;
-    pthread_mutexattr_t attr;
+static int initialize_event_pump_handle(struct evp_handle *handle,
+                                        enum evp_backend backend) {
+    assert(handle);
 
-    if ((rc = pthread_mutexattr_init(&attr)) != 0) {
-        error("pthread_attr_init error (%d)", rc);
-        return rc;
-    }
+    int rc = ERROR_RUNTIMEERROR;
 
-    if ((rc = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK)) !=
-        0) {
-        error("pthread_mutexattr_settype error (%d)", rc);
-        pthread_mutexattr_destroy(&attr);
-        return rc;
+    /* created on demand; see Evp_register_signal_watch */
+    handle->sigfd.fd = -1;
+    handle->sigfd.evmask = FD_EVENT_READABLE;
+    sigemptyset(&handle->sigmask);
+    for (size_t i = 0; i < ARRLEN(handle->sig_watches); ++i) {
+        Dll_init(&handle->sig_watches[i], NULL);
     }
 
-    if ((rc = pthread_mutex_init(&handle->uev_mtx, &attr)) != 0) {
-        error("pthread_mutex_init error (%d)", rc);
-        pthread_mutexattr_destroy(&attr);
-        return rc;
-    }
+    if ((handle->osapi = get_os_api_handle(backend)) == NULL) return rc;
 
-    pthread_mutexattr_destroy(&attr);
-    return 0;
-}
-
-static int initialize_event_pump_handle(struct evp_handle *handle) {
-    assert(handle);
-
-    int rc = ERROR_RUNTIMEERROR;
-
-    if ((handle->osapi = get_os_api_handle()) == NULL) return rc;
+    handle->simulated =
+      (get_os_api_backend(handle->osapi) == EVP_BACKEND_SIMULATED);
+    handle->vclock = time_now_monotonic();
 
     /* Initialize fd-based semaphore */
     if (initialize_eventfd_semaphore(handle) != 0) return rc;
@@ -119,69 +104,110 @@ static int initialize_event_pump_handle(struct evp_handle *handle) {
     /* Initialize fd-based timer */
     if (initialize_wait_timer(handle) != 0) return rc;
 
-    /* initialize mutext */
-    if (initialize_uevq_mutex(handle) != 0) return rc;
-
-    Dll_init(&handle->timers, NULL);
+    timer_wheel_init(&handle->timers, &handle->vclock);
     Dll_init(&handle->evq, NULL);
-    Staq_init(&handle->uevq, user_event_destructor);
-    memset(handle->watch,
-           0,
-           sizeof(struct user_event_watch *) * ARRLEN(handle->watch));
+    Dll_init(&handle->drained, NULL);
+    handle->slices = NULL;
+    uevq_init(&handle->uevq);
+    handle->uev_types = NULL;
+    handle->num_uev_types = 0;
+    handle->uev_cursor = NULL;
+    handle->uev_backlog = handle->uev_backlog_tail = NULL;
+    Evp_set_dispatch_policy(handle, NULL);
+    Evp_reset_stats(handle);
 
     return ERRORCODE_SUCCESS;
 }
 
-struct evp_handle *Evp_new(void) {
+struct evp_handle *Evp_new_with_backend(enum evp_backend backend) {
     struct evp_handle *handle = salloc(sizeof(struct evp_handle), NULL);
 
-    if (initialize_event_pump_handle(handle) != ERRORCODE_SUCCESS) {
+    if (initialize_event_pump_handle(handle, backend) != ERRORCODE_SUCCESS) {
         Evp_destroy(&handle);
     }
 
     return handle;
 }
 
+struct evp_handle *Evp_new(void) {
+    return Evp_new_with_backend(EVP_BACKEND_DEFAULT);
+}
+
+enum evp_backend Evp_get_backend(const struct evp_handle *handle) {
+    assert(handle);
+    return get_os_api_backend(handle->osapi);
+}
+
+/* The clock timers run on; see evp_handle (15). */
+static inline struct timespec clock_now(const struct evp_handle *handle) {
+    return handle->simulated ? handle->vclock : time_now_monotonic();
+}
+
+struct timespec Evp_now(const struct evp_handle *handle) {
+    assert(handle);
+    return clock_now(handle);
+}
+
+int Evp_sim_write(struct evp_handle *handle, int fd,
+                  const void *data, size_t len) {
+    assert(handle);
+    assert(data || len == 0);
+
+    if (!handle->simulated) return ERROR_MISCONFIGURED;
+    if (fd < 0) return ERROR_INVALIDVALUE;
+
+    return simulate_fd_write(handle->osapi, fd, data, len);
+}
+
 /*
  * Populate 'tspec' with an absolute MONOTONIC_CLOCK timepoint.
- * The difference between the timepoint and NOW is how long until the first
- * user-specified timer expires. If there is *no* timer in the timer queue,
- * then any arbitrary value (later than NOW) for the timepoint will do,
- * since this gets updated/recomputed each time the main event pump loop
- * unblocks.
+ * The difference between the timepoint and NOW is how long until the timer
+ * wheel next needs to be advanced (normally because the first user-specified
+ * timer expires). If there is *no* timer registered, then any arbitrary value
+ * (later than NOW) for the timepoint will do, since this gets
+ * updated/recomputed each time the main event pump loop unblocks.
  */
 static inline void pick_shortest_wait_time(struct timespec *tspec,
-                                           const struct dllist *timerq) {
+                                           const struct timer_wheel *timers) {
     assert(tspec);
-    assert(timerq);
-
-    if (Dll_empty(timerq)) {
-        *tspec = time_now_monotonic();
-        tspec->tv_sec += EVP_DEFAULT_WAIT_TIME_SECS;
-        if (tspec->tv_sec < EVP_DEFAULT_WAIT_TIME_SECS) {
-            warn(
-              "timespec overflow after EVP_DEFAULT_BLOCK_TIME_SECS addition");
-        }
-        return;
-    }
+    assert(timers);
 
-    struct timer_event *tev = Dll_front(timerq, struct timer_event, link);
-    if (tev && tspec) *tspec = tev->tspec; /* already an absolute timepoint */
+    if (timer_wheel_next_wakeup(timers, tspec)) return;
+
+    *tspec = time_now_monotonic();
+    tspec->tv_sec += EVP_DEFAULT_WAIT_TIME_SECS;
+    if (tspec->tv_sec < EVP_DEFAULT_WAIT_TIME_SECS) {
+        warn("timespec overflow after EVP_DEFAULT_BLOCK_TIME_SECS addition");
+    }
 }
 
 /*
  * Create an fd timer set to expire either:
- * 1) at the same time as the earliest-expiring timer in the timer queue
+ * 1) at the same time as the earliest-expiring timer in the timer wheel
  * 2) at some arbitrary time otherwise --- this makes no difference.
  *
  * Note if the timer is already set, re-arming it simply resets and updates
- * its state. */
-static int wake_on_first_timer(struct evp_handle *handle) {
+ * its state. If the deadline has not changed since the timer was last
+ * armed, it is left alone.
+ *
+ * If 'cap' is not NULL, the timer is set to expire no later than that
+ * (see Evp_run_once). */
+static int wake_on_first_timer(struct evp_handle *handle,
+                               const struct timespec *cap) {
+    /* the simulated backend moves the clock itself instead */
+    if (handle->simulated) return ERRORCODE_SUCCESS;
+
     struct itimerspec itspec;
     memset(&itspec, 0, sizeof(struct itimerspec));
     pick_shortest_wait_time(&itspec.it_value, &handle->timers);
+    if (cap && timespec_cmp(cap, &itspec.it_value) == LT) itspec.it_value = *cap;
     assert(itspec.it_value.tv_nsec < 999999999L);
 
+    if (timespec_cmp(&itspec.it_value, &handle->timerfd_deadline) == EQ) {
+        return ERRORCODE_SUCCESS;
+    }
+
+    handle->num_syscalls++;
     int rc =
       timerfd_settime(handle->timerfd.fd, TFD_TIMER_ABSTIME, &itspec, NULL);
     if (rc != 0) {
@@ -189,148 +215,748 @@ static int wake_on_first_timer(struct evp_handle *handle) {
         return rc;
     }
 
+    handle->timerfd_deadline = itspec.it_value;
     return ERRORCODE_SUCCESS;
 }
 
-// true if ts <= reference (monotonic time).
-// if reference=NULL, NOW is used.
-static inline bool elapsed(struct timespec *ts, struct timespec *reference) {
-    assert(ts);
+/*
+ * Read the data available for an FD_EVENT_RECV monitor into handle->rxbuf,
+ * for backends that only report readiness. Return false if there is
+ * nothing to pass to the callback (e.g. spurious wakeup). */
+static bool receive_data(struct evp_handle *handle, struct fd_event *fdev) {
+    if (!handle->rxbuf) handle->rxbuf = salloc(EVP_RECV_BUFFER_SIZE, NULL);
+
+    handle->num_syscalls++;
+    ssize_t rc = read(fdev->fd, handle->rxbuf, EVP_RECV_BUFFER_SIZE);
 
-    struct timespec now;
-    if (!reference) {
-        now = time_now_monotonic();
-        reference = &now;
+    if (rc < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return false;
+        }
+        fdev->revents = FD_EVENT_ERROR;
+        return true;
     }
 
-    return lte(ts, reference, timespec_cmp);
+    fdev->rxbuf = (rc > 0) ? handle->rxbuf : NULL; /* rc == 0: EOF */
+    fdev->rxlen = (size_t)rc;
+    fdev->revents = FD_EVENT_RECV;
+    return true;
 }
 
 /*
- * Ensure locking/unlocking the mutex never fails; if it does, it is
- * almost certainly a bug here and there is either a deadlock, corruption etc.
- * Recovery from this is a fool's errand. The problem needs to be fixed offline.
- * On failure, just exit (and fix the problem).
- */
-static inline void lock_mutex(pthread_mutex_t *mtx) {
-    int rc;
-    THROWS_ON((rc = pthread_mutex_lock(mtx)) != 0,
-              ERROR_RUNTIMEERROR,
-              "pthread_mutex_lock error (%d)",
-              rc);
+ * Read everything available from an FD_EVENT_DRAIN monitor, i.e. until
+ * EAGAIN, into slices from the slab pool, appended to handle->drained (see
+ * Evp_get_fdev_slices). Each read goes into the space left in the last
+ * slice, so only the last one may be partially filled.
+ * Return false if there is nothing to pass to the callback (e.g. spurious
+ * wakeup). If EVP_DRAIN_MAX_SLICES slices are filled before the fd has been
+ * drained, *more is set to true. */
+static bool drain_data(struct evp_handle *handle, struct fd_event *fdev,
+                       bool *more) {
+    struct evp_slice *slice = NULL;
+    unsigned num_slices = 0;
+    ssize_t rc;
+
+    if (!handle->slices) handle->slices = slab_pool_new(EVP_DRAIN_SLICE_SIZE);
+
+    fdev->eof = false;
+    *more = false;
+
+    for (;;) {
+        if (!slice || slice->len == EVP_DRAIN_SLICE_SIZE) {
+            if (num_slices == EVP_DRAIN_MAX_SLICES) {
+                *more = true;
+                break;
+            }
+
+            slice = slab_pool_alloc(handle->slices);
+            Dll_pushback(&handle->drained, slice, link);
+            num_slices++;
+        }
+
+        handle->num_syscalls++;
+        rc = read(fdev->fd, slab_pool_buffer(slice) + slice->len,
+                  EVP_DRAIN_SLICE_SIZE - slice->len);
+
+        if (rc > 0) {
+            slice->len += (size_t)rc;
+            continue;
+        }
+
+        if (rc == 0) {
+            fdev->eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fdev->revents |= FD_EVENT_ERROR;
+        }
+
+        break;
+    }
+
+    /* read nothing into the last one */
+    if (slice && slice->len == 0) {
+        Dll_popnode(&handle->drained, slice, link);
+        Evp_slice_release(slice);
+    }
+
+    return fdev->eof || (fdev->revents & FD_EVENT_ERROR) ||
+           !Dll_empty(&handle->drained);
 }
 
-static inline void unlock_mutex(pthread_mutex_t *mtx) {
-    int rc;
-    THROWS_ON((rc = pthread_mutex_unlock(mtx)) != 0,
-              ERROR_RUNTIMEERROR,
-              "pthread_mutex_unlock error (%d)",
-              rc);
+/*================================================
+ *============ Instrumentation ===================
+ *===============================================*/
+
+static inline uint64_t now_ns(void) {
+    struct timespec now = time_now_monotonic();
+    return (uint64_t)now.tv_sec * NSECS_PER_SEC + (uint64_t)now.tv_nsec;
 }
 
 /*
- * Look at every events list; if any unhandled events exist, then invoke
- * the associated event callback.
- *
- * The ORDER the lists are looked at is important. E.g. interrupts get looked
- * at first, then signals, then timers, then fd events, then user-defined
- * events, and so on. NOTE Currently only timers, fd events, and user-defined
- * events are implemented.
- *
- * Return the number of events dispatched. If time_taken is non-NULL,
- * then the number of milliseconds that the function took to run is stored
- * in it (as a floating point number). This is useful for debugging etc.
- */
-static unsigned dispatch_events(struct evp_handle *handle, double *time_taken) {
+ * The statistics are only ever written by the thread running the event
+ * pump, so a plain (but atomic) load and store will do: the counters can
+ * then be read by other threads without ever seeing a torn value, and
+ * without the cost of an atomic read-modify-write. */
+static inline void stat_add(uint64_t *counter, uint64_t n) {
+    uint64_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    __atomic_store_n(counter, value + n, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t stat_read(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static inline void hist_add(struct evp_histogram *hist, uint64_t ns) {
+    unsigned bucket = ns ? 63U - (unsigned)__builtin_clzll(ns) : 0;
+    if (bucket >= EVP_HIST_NUM_BUCKETS) bucket = EVP_HIST_NUM_BUCKETS - 1;
+    stat_add(&hist->count[bucket], 1);
+}
+
+/* Clock readings for the samples of each EVP_STATS_LEVEL; 0 if disabled. */
+static inline uint64_t loop_clock(void) {
+    return (EVP_STATS_LEVEL >= 1) ? now_ns() : 0;
+}
+
+static inline uint64_t callback_clock(void) {
+    return (EVP_STATS_LEVEL >= 2) ? now_ns() : 0;
+}
+
+/*
+ * Record one loop iteration that started waiting for events at 'start',
+ * started dispatching them at 'dispatch_start', and was done at 'end'. */
+static void record_iteration(struct evp_handle *handle,
+                             uint64_t start,
+                             uint64_t dispatch_start,
+                             uint64_t end) {
+    if (EVP_STATS_LEVEL < 1) return;
+    struct evp_stats *stats = &handle->stats;
+
+    stat_add(&stats->iterations, 1);
+    stat_add(&stats->blocked_ns, dispatch_start - start);
+    stat_add(&stats->busy_ns, end - dispatch_start);
+    hist_add(&stats->blocked, dispatch_start - start);
+    hist_add(&stats->busy, end - dispatch_start);
+}
+
+/*
+ * Record the execution time of a callback invoked at 'start' (see
+ * callback_clock). NOTE the callback may well have unregistered and freed
+ * the structure it was registered with: hist and priv must have been read
+ * from it before the call. */
+static void record_callback(struct evp_handle *handle,
+                            enum evp_event_class event_class,
+                            struct evp_histogram *hist,
+                            const void *priv,
+                            uint64_t start) {
+    if (EVP_STATS_LEVEL < 2) return;
+    struct evp_stats *stats = &handle->stats;
+    uint64_t ns = now_ns() - start;
+
+    hist_add(&stats->callbacks[event_class], ns);
+    if (hist) hist_add(hist, ns);
+
+    if (ns > stats->slowest.ns) {
+        __atomic_store_n(&stats->slowest.ns, ns, __ATOMIC_RELAXED);
+        __atomic_store_n(&stats->slowest.event_class, event_class,
+                         __ATOMIC_RELAXED);
+        __atomic_store_n(&stats->slowest.priv, priv, __ATOMIC_RELAXED);
+    }
+}
+
+static void copy_histogram(struct evp_histogram *dst,
+                           const struct evp_histogram *src) {
+    for (unsigned i = 0; i < EVP_HIST_NUM_BUCKETS; ++i) {
+        dst->count[i] = stat_read(&src->count[i]);
+    }
+}
+
+int Evp_get_stats(const struct evp_handle *handle, struct evp_stats *stats) {
     assert(handle);
+    assert(stats);
+
+    if (EVP_STATS_LEVEL < 1) return ERROR_MISCONFIGURED;
+
+    const struct evp_stats *src = &handle->stats;
+
+    stats->iterations = stat_read(&src->iterations);
+    stats->blocked_ns = stat_read(&src->blocked_ns);
+    stats->busy_ns = stat_read(&src->busy_ns);
+    copy_histogram(&stats->blocked, &src->blocked);
+    copy_histogram(&stats->busy, &src->busy);
+    copy_histogram(&stats->timer_lag, &src->timer_lag);
+
+    for (unsigned i = 0; i < EVP_NUM_EVENT_CLASSES; ++i) {
+        stats->dispatched[i] = stat_read(&src->dispatched[i]);
+        copy_histogram(&stats->callbacks[i], &src->callbacks[i]);
+    }
+
+    stats->slowest.ns = stat_read(&src->slowest.ns);
+    stats->slowest.event_class =
+      __atomic_load_n(&src->slowest.event_class, __ATOMIC_RELAXED);
+    stats->slowest.priv = __atomic_load_n(&src->slowest.priv, __ATOMIC_RELAXED);
+
+    return ERRORCODE_SUCCESS;
+}
+
+void Evp_reset_stats(struct evp_handle *handle) {
+    assert(handle);
+    memset(&handle->stats, 0, sizeof(handle->stats));
+}
+
+uint64_t Evp_histogram_count(const struct evp_histogram *hist) {
+    assert(hist);
+
+    uint64_t total = 0;
+    for (unsigned i = 0; i < EVP_HIST_NUM_BUCKETS; ++i) {
+        total += stat_read(&hist->count[i]);
+    }
+
+    return total;
+}
+
+uint64_t Evp_histogram_percentile(const struct evp_histogram *hist, double p) {
+    assert(hist);
+
+    uint64_t total = Evp_histogram_count(hist);
+    if (total == 0) return 0;
+
+    p = MAX(0.0, MIN(p, 100.0));
+    uint64_t rank = (uint64_t)(p / 100 * (double)total + 0.5);
+    rank = MAX(rank, 1);
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < EVP_HIST_NUM_BUCKETS - 1; ++i) {
+        seen += stat_read(&hist->count[i]);
+        if (seen >= rank) return (uint64_t)1 << (i + 1);
+    }
+
+    return UINT64_MAX;
+}
+
+void Evp_set_timer_histogram(struct timer_event *tev,
+                             struct evp_histogram *hist) {
+    assert(tev);
+    tev->hist = hist;
+}
+
+void Evp_set_fdmon_histogram(struct fd_event *fdev,
+                             struct evp_histogram *hist) {
+    assert(fdev);
+    fdev->hist = hist;
+}
+
+void Evp_set_uev_watch_histogram(struct user_event_watch *uev,
+                                 struct evp_histogram *hist) {
+    assert(uev);
+    uev->hist = hist;
+}
+
+void Evp_set_signal_watch_histogram(struct signal_watch *sw,
+                                    struct evp_histogram *hist) {
+    assert(sw);
+    sw->hist = hist;
+}
+
+/*
+ * Invoke the callback of every watch registered for the event_type. See
+ * evp_handle.uev_cursor fmi about unregistration from inside callbacks. */
+static unsigned dispatch_user_event(struct evp_handle *handle,
+                                    unsigned event_type,
+                                    void *data) {
+    if (event_type >= handle->num_uev_types) return 0;
 
-    uint64_t buff;
     unsigned num_handled = 0;
-    int rc = 0;
+    struct dlnode *node = Dll_peek_front(&handle->uev_types[event_type]);
+    struct user_event_watch *watch;
 
-    double start;
-    if (time_taken) start = time_now_monotonic_dbms();
+    while (node) {
+        watch = get_container(node, struct user_event_watch, link);
+        handle->uev_cursor = Dll_nextnode(node);
+
+        assert(watch->cb);
+        assert(watch->event_type == event_type);
+        struct evp_histogram *hist = watch->hist;
+        void *priv = watch->priv;
+        uint64_t start = callback_clock();
+        watch->cb(watch, event_type, data, priv);
+        record_callback(handle, EVP_CLASS_USER, hist, priv, start);
+        num_handled++;
 
-    struct timer_event *tev;
-    struct fd_event *fdev;
-    struct user_event *uev;
+        node = handle->uev_cursor;
+    }
+
+    handle->uev_cursor = NULL;
+    return num_handled;
+}
+
+/*
+ * Invoke the callback of every watch registered for the signal; see
+ * evp_handle (13). */
+static unsigned dispatch_signal(struct evp_handle *handle,
+                                const struct signalfd_siginfo *info) {
+    int signo = (int)info->ssi_signo;
+    if (signo <= 0 || signo >= NSIG) return 0;
 
-    /* handle timer expirations */
+    unsigned num_handled = 0;
+    struct dlnode *node = Dll_peek_front(&handle->sig_watches[signo]);
+    struct signal_watch *watch;
+
+    while (node) {
+        watch = get_container(node, struct signal_watch, link);
+        handle->sig_cursor = Dll_nextnode(node);
+
+        assert(watch->cb);
+        assert(watch->signo == signo);
+        struct evp_histogram *hist = watch->hist;
+        void *priv = watch->priv;
+        uint64_t start = callback_clock();
+        watch->cb(watch, info, priv);
+        record_callback(handle, EVP_CLASS_SIGNAL, hist, priv, start);
+        num_handled++;
+
+        node = handle->sig_cursor;
+    }
+
+    handle->sig_cursor = NULL;
+    return num_handled;
+}
+
+/*
+ * A dispatch budget (see evp_budget) being spent. */
+struct quota {
+    const struct evp_budget *budget;
+    uint32_t spent;
+    uint64_t start_us;
+};
+
+static inline uint64_t now_us(void) {
     struct timespec now = time_now_monotonic();
+    return (uint64_t)now.tv_sec * USECS_PER_SEC +
+           (uint64_t)now.tv_nsec / NSECS_PER_USEC;
+}
+
+static inline void start_quota(struct quota *quota,
+                               const struct evp_budget *budget) {
+    quota->budget = budget;
+    quota->spent = 0;
+    quota->start_us = budget->max_us ? now_us() : 0;
+}
+
+/*
+ * Take one event's worth out of the quota, if there is any left. The
+ * first event is always allowed. */
+static inline bool take_quota(struct quota *quota) {
+    const struct evp_budget *budget = quota->budget;
+
+    if (quota->spent > 0) {
+        if (budget->max_events && quota->spent >= budget->max_events) {
+            return false;
+        }
+
+        if (budget->max_us && now_us() - quota->start_us >= budget->max_us) {
+            return false;
+        }
+    }
+
+    quota->spent++;
+    return true;
+}
+
+/*
+ * Read signals off the signalfd one at a time and dispatch them until it
+ * has been drained. Signals left unread for lack of budget stay pending
+ * in the kernel. */
+static unsigned dispatch_signals(struct evp_handle *handle,
+                                 struct quota *quota) {
+    struct signalfd_siginfo info;
+    unsigned num_handled = 0;
+
+    while (handle->sig_pending) {
+        if (!take_quota(quota)) {
+            handle->backlog = true;
+            break;
+        }
+
+        handle->num_syscalls++;
+        if (read(handle->sigfd.fd, &info, sizeof(info)) != sizeof(info)) {
+            handle->sig_pending = false;  /* EAGAIN: drained */
+            break;
+        }
 
-    /*
-     * NOTE: use this form of iterating instead of the more readable to
-     * avoid the problem described below.
-     * Dll_foreach saves the 'next' element -- but this may well have been
-     * removed and freed from inside the callback associated with the current
-     * element. This may be the case for example when a client has registered
-     * a few related callbacks where one of them can unregster all of them on
-     * a certain event. This is a perfectly acceptable scenario and using
-     * Dll_foreach in that case risks using already-freed memory! */
-    while ((tev = Dll_front(&handle->timers, struct timer_event, link))) {
-        if (!elapsed(&tev->tspec, &now)) break;
-        Dll_popnode(&handle->timers, tev, link);
+        num_handled += dispatch_signal(handle, &info);
+    }
+
+    return num_handled;
+}
+
+/*
+ * Put a periodic timer that has just expired back in the wheel, with its
+ * deadline moved along by one interval -- from the previous deadline, so
+ * that the timer does not drift. If that is already past 'now', the
+ * timer has overrun: see enum evp_timer_overrun. */
+static void rearm_periodic_timer(struct evp_handle *handle,
+                                 struct timer_event *tev,
+                                 const struct timespec *now) {
+    struct timespec next;
+    timespec_add(&tev->tspec, &tev->interval, &next);
+    tev->overruns = 0;
+
+    if (tev->overrun == EVP_TIMER_SKIP && timespec_cmp(&next, now) != GT) {
+        uint64_t interval = (uint64_t)tev->interval.tv_sec * NSECS_PER_SEC +
+                            (uint64_t)tev->interval.tv_nsec;
+        uint64_t late = (uint64_t)(now->tv_sec - next.tv_sec) * NSECS_PER_SEC +
+                        (uint64_t)now->tv_nsec - (uint64_t)next.tv_nsec;
+        uint64_t missed = late / interval + 1;
+        uint64_t skip = missed * interval;
+        struct timespec ahead = {
+            .tv_sec = (time_t)(skip / NSECS_PER_SEC),
+            .tv_nsec = (long)(skip % NSECS_PER_SEC)
+        };
+
+        timespec_add(&next, &ahead, &next);
+        tev->overruns = (uint32_t)MIN(missed, UINT32_MAX);
+    }
+
+    tev->tspec = next;
+    timer_wheel_add(&handle->timers, tev);
+}
+
+/*
+ * NOTE: pop expired timers one at a time instead of iterating over the
+ * expired list to avoid the problem described below.
+ * Dll_foreach saves the 'next' element -- but this may well have been
+ * removed and freed from inside the callback associated with the current
+ * element. This may be the case for example when a client has registered
+ * a few related callbacks where one of them can unregster all of them on
+ * a certain event. This is a perfectly acceptable scenario and using
+ * Dll_foreach in that case risks using already-freed memory! */
+static unsigned dispatch_timers(struct evp_handle *handle,
+                                struct quota *quota) {
+    struct timer_event *tev;
+    unsigned num_handled = 0;
+    uint64_t now = 0;
+    struct timespec now_ts = {0};
+    bool have_now = false;
+
+    if (EVP_STATS_LEVEL >= 1 && !Dll_empty(&handle->timers.expired)) {
+        now_ts = clock_now(handle);
+        now = (uint64_t)now_ts.tv_sec * NSECS_PER_SEC + (uint64_t)now_ts.tv_nsec;
+        have_now = true;
+    }
+
+    while (!Dll_empty(&handle->timers.expired)) {
+        if (!take_quota(quota)) {
+            handle->backlog = true;
+            break;
+        }
+
+        tev = timer_wheel_pop_expired(&handle->timers);
         assert(tev->cb);
-        tev->registered = false;
-        tev->cb(tev, tev->priv);
+
+        if (EVP_STATS_LEVEL >= 1) {
+            uint64_t deadline = (uint64_t)tev->tspec.tv_sec * NSECS_PER_SEC +
+                                (uint64_t)tev->tspec.tv_nsec;
+            hist_add(&handle->stats.timer_lag,
+                     (now > deadline) ? now - deadline : 0);
+        }
+
+        if (tev->periodic) {
+            if (!have_now) {
+                now_ts = clock_now(handle);
+                have_now = true;
+            }
+            rearm_periodic_timer(handle, tev, &now_ts);
+        } else {
+            tev->registered = false;
+        }
+
+        struct evp_histogram *hist = tev->hist;
+        void *priv = tev->priv;
+        uint64_t start = callback_clock();
+        tev->cb(tev, priv);
+        record_callback(handle, EVP_CLASS_TIMER, hist, priv, start);
         num_handled++;
     }
 
-    /* Handle OS events */
-    while ((fdev = Dll_front(&handle->evq, struct fd_event, link))) {
-        Dll_popnode(&handle->evq, fdev, link);
+    return num_handled;
+}
 
-        /* semaphore post or loop wait timer? reset to 0 and carry on; */
-        if (fdev->fd == handle->sem.fd || fdev->fd == handle->timerfd.fd) {
+/*
+ * NOTE the fd_event is not touched once its callback has been invoked: the
+ * callback may well have unregistered and freed it. revents is cleared
+ * before the call for the same reason -- a non-zero revents marks an
+ * fd_event as queued on the evq (see Evp_unregister_fdmon). */
+static unsigned dispatch_fd_events(struct evp_handle *handle,
+                                   struct quota *quota) {
+    struct fd_event *fdev;
+    struct evp_slice *slice;
+    unsigned num_handled = 0;
+    uint32_t revents;
+    uint64_t buff;
+    int rc = 0;
+    bool more;
+
+    /* FD_EVENT_DRAIN monitors queued again (see below) are left for the
+     * next iteration */
+    size_t num_queued = Dll_count(&handle->evq);
+
+    while (num_queued-- > 0 &&
+           (fdev = Dll_front(&handle->evq, struct fd_event, link))) {
+        /* loop wait timer? reset to 0 and carry on; (the semaphore has
+         * already been cleared: see dispatch_events) */
+        if (fdev == &handle->timerfd) {
+            Dll_popnode(&handle->evq, fdev, link);
+            handle->num_syscalls++;
             rc = read(fdev->fd, &buff, sizeof(buff));
             UNUSED(rc);
+            fdev->revents = 0;
             continue;
         }
 
+        if (!take_quota(quota)) {
+            handle->backlog = true;
+            break;
+        }
+
+        Dll_popnode(&handle->evq, fdev, link);
+
+        /* data not already supplied by the backend: read it here */
+        if ((fdev->evmask & FD_EVENT_RECV) && !(fdev->revents & FD_EVENT_RECV)) {
+            if (!receive_data(handle, fdev)) {
+                fdev->revents = 0;
+                continue;
+            }
+        }
+
+        more = false;
+        if ((fdev->evmask & FD_EVENT_DRAIN) && (fdev->revents & FD_EVENT_READABLE)) {
+            if (!drain_data(handle, fdev, &more)) {
+                fdev->revents = 0;
+                continue;
+            }
+            fdev->slices = &handle->drained;
+        }
+
         /* else 'normal' fd event; dispatch by invoking callback */
         assert(fdev->cb);
-        fdev->cb(fdev, fdev->fd, fdev->revents, fdev->priv);
-        fdev->revents = 0; /* clear revents; assumed to have been handled */
+        revents = fdev->revents;
+        fdev->revents = 0;
+
+        /* not yet drained: queue it again before the callback (which may
+         * unregister it) runs */
+        if (more) {
+            fdev->revents = FD_EVENT_READABLE;
+            Dll_pushback(&handle->evq, fdev, link);
+            handle->backlog = true;
+        }
+
+        struct evp_histogram *hist = fdev->hist;
+        void *priv = fdev->priv;
+        uint64_t start = callback_clock();
+        fdev->cb(fdev, fdev->fd, revents, priv);
+        record_callback(handle, EVP_CLASS_FD, hist, priv, start);
         num_handled++;
+
+        /* release the slices not taken by the callback */
+        while ((slice = Dll_popfront(&handle->drained, struct evp_slice, link))) {
+            Evp_slice_release(slice);
+        }
     }
 
-    /* Handle user events */
-    struct user_event_watch *watch;
-    while (true) {
-        lock_mutex(&handle->uev_mtx);
-        uev = Staq_dq(&handle->uevq, struct user_event, link);
-        unlock_mutex(&handle->uev_mtx);
+    return num_handled;
+}
 
-        if (!uev) break; /* empty queue */
+/*
+ * Take everything queued up to this point in one go. Events pushed from
+ * inside the callbacks are left for the next loop iteration (the push will
+ * have woken up the loop again). */
+static unsigned dispatch_user_events(struct evp_handle *handle,
+                                     struct quota *quota) {
+    struct user_event *uev;
+    unsigned num_handled = 0;
+
+    struct user_event *taken = uevq_take_all(&handle->uevq);
+    if (taken) {
+        if (handle->uev_backlog) handle->uev_backlog_tail->next = taken;
+        else handle->uev_backlog = taken;
 
-        assert(uev->event_type < MAX_USER_EVENT_TYPE_VALUE);
-        watch = handle->watch[uev->event_type];
+        while (taken->next) taken = taken->next;
+        handle->uev_backlog_tail = taken;
+    }
+
+    while ((uev = handle->uev_backlog)) {
+        if (!take_quota(quota)) {
+            handle->backlog = true;
+            break;
+        }
 
-        if (watch) {
-            assert(watch->cb);
-            assert(watch->event_type == uev->event_type);
-            watch->cb(watch, watch->event_type, uev->data, watch->priv);
+        handle->uev_backlog = uev->next;
+
+        if (uev->fn) {
+            uint64_t start = callback_clock();
+            uev->fn(uev->data);
+            record_callback(handle, EVP_CLASS_USER, NULL, uev->data, start);
             num_handled++;
+        } else {
+            num_handled +=
+              dispatch_user_event(handle, uev->event_type, uev->data);
         }
 
-        salloc(0, uev);
+        uevq_release(&handle->uevq, uev);
+    }
+
+    if (!handle->uev_backlog) handle->uev_backlog_tail = NULL;
+    return num_handled;
+}
+
+typedef unsigned (*class_dispatcher)(struct evp_handle *handle,
+                                     struct quota *quota);
+
+static const class_dispatcher dispatchers[EVP_NUM_EVENT_CLASSES] = {
+    [EVP_CLASS_SIGNAL] = dispatch_signals,
+    [EVP_CLASS_TIMER] = dispatch_timers,
+    [EVP_CLASS_FD]    = dispatch_fd_events,
+    [EVP_CLASS_USER]  = dispatch_user_events
+};
+
+/*
+ * Look at every events list; if any unhandled events exist, then invoke
+ * the associated event callback.
+ *
+ * The ORDER the lists are looked at is important: signals get looked at
+ * first, then timers, then fd events, then user-defined events. With a
+ * dispatch policy set, the order instead
+ * rotates between the classes from one call to the next, and each class
+ * is only dispatched up to its budget; see evp_handle (11).
+ *
+ * Return the number of events dispatched. The time the function takes to
+ * run is accounted for in the stats (see Evp_run).
+ */
+static unsigned dispatch_events(struct evp_handle *handle) {
+    assert(handle);
+
+    unsigned num_handled = 0;
+    struct quota quota;
+
+    /* move expired timers onto the wheel's expired list */
+    struct timespec now = clock_now(handle);
+    timer_wheel_advance(&handle->timers, &now);
+
+    /* the signalfd is not dispatched as an fd event; see evp_handle (13) */
+    if (handle->sigfd.revents) {
+        Dll_popnode(&handle->evq, &handle->sigfd, link);
+        handle->sigfd.revents = 0;
+        handle->sig_pending = true;
+    }
+
+    /* Clear the semaphore before any user events are taken off the queue,
+     * whichever order the classes are dispatched in. A push made from
+     * inside a user event callback finds the queue empty and posts the
+     * semaphore again; were it only cleared later in the iteration (by
+     * dispatch_fd_events, with the user class going first), that wakeup
+     * would be lost and the event left queued until some other event woke
+     * up the pump. */
+    if (handle->sem.revents) {
+        uint64_t buff;
+        Dll_popnode(&handle->evq, &handle->sem, link);
+        handle->sem.revents = 0;
+        handle->num_syscalls++;
+        int rc = read(handle->sem.fd, &buff, sizeof(buff));
+        UNUSED(rc);
+    }
+
+    handle->backlog = false;
+    unsigned first = handle->budgeted ? handle->first_class : EVP_CLASS_SIGNAL;
+
+    for (unsigned i = 0; i < EVP_NUM_EVENT_CLASSES; ++i) {
+        unsigned class = (first + i) % EVP_NUM_EVENT_CLASSES;
+        start_quota(&quota, &handle->policy.budget[class]);
+        unsigned n = dispatchers[class](handle, &quota);
+        if (EVP_STATS_LEVEL >= 1) stat_add(&handle->stats.dispatched[class], n);
+        num_handled += n;
     }
 
-    if (time_taken) *time_taken = (time_now_monotonic_dbms() - start);
+    handle->first_class = (first + 1) % EVP_NUM_EVENT_CLASSES;
     return num_handled;
 }
 
+int Evp_set_dispatch_policy(struct evp_handle *handle,
+                            const struct evp_dispatch_policy *policy) {
+    assert(handle);
+
+    memset(&handle->policy, 0, sizeof(handle->policy));
+    handle->budgeted = false;
+
+    if (!policy) return ERRORCODE_SUCCESS;
+
+    handle->policy = *policy;
+    for (unsigned i = 0; i < EVP_NUM_EVENT_CLASSES; ++i) {
+        if (policy->budget[i].max_events || policy->budget[i].max_us) {
+            handle->budgeted = true;
+        }
+    }
+
+    return ERRORCODE_SUCCESS;
+}
+
 void dummy_timer_callback(struct timer_event *tev, void *priv) {
     UNUSED(tev);
     UNUSED(priv);
 }
 
+/*
+ * One iteration of the event loop: wait for events (or only poll, if
+ * 'block' is false) then dispatch them. Return the number of events
+ * dispatched, or -1 if waiting for events failed. */
+static int run_iteration(struct evp_handle *handle, bool block) {
+    uint64_t wait_start, dispatch_start, end;
+    unsigned num_handled;
+
+    wait_start = loop_clock();
+    if (pump_os_events(handle, block) != 0) return -1;
+    dispatch_start = loop_clock();
+
+    num_handled = dispatch_events(handle);
+
+    end = loop_clock();
+    record_iteration(handle, wait_start, dispatch_start, end);
+
+    debug("Event pump loop: handled %u events in %f ms",
+          num_handled, (double)(end - dispatch_start) / NSECS_PER_MSEC);
+
+    return (int)num_handled;
+}
+
+static inline double clock_now_dbs(const struct evp_handle *handle) {
+    struct timespec now = clock_now(handle);
+    return timespec2dbs(&now);
+}
+
 void Evp_run(struct evp_handle *handle, int seconds) {
-    int rc = 0;
-    double time;
     bool with_timeout = (seconds > -1);
 
-    double start = time_now_monotonic_dbs();
+    double start = clock_now_dbs(handle);
 
     /* to terminate the run on specified seconds timeout */
     struct timer_event timeout;
@@ -340,32 +966,88 @@ void Evp_run(struct evp_handle *handle, int seconds) {
     }
 
     for (;;) {
-        if (wake_on_first_timer(handle) != 0) break;
-        if (pump_os_events(handle) != 0) break;
+        if (wake_on_first_timer(handle, NULL) != 0) break;
+        if (run_iteration(handle, true) < 0) break;
+
+        if (handle->stop) break;
+        if (with_timeout && clock_now_dbs(handle) - start >= seconds) break;
+    }
 
-        rc = dispatch_events(handle, &time);
+    handle->stop = false;
+    if (with_timeout) Evp_unregister_timer(handle, &timeout);
+    debug("EventPump done after %f seconds", clock_now_dbs(handle) - start);
+}
 
-        debug("Event pump loop: handled %zu events in %f ms", rc, time);
+/*
+ * A bounded wait is had by capping the deadline the timerfd is armed with:
+ * the timerfd expiring is then simply another event to be dispatched (see
+ * dispatch_fd_events). Once the events have been dispatched the timerfd is
+ * re-armed for the first timer, timers the callbacks may have registered
+ * included, so that Evp_get_pollfd does become readable when the next timer
+ * expires. */
+int Evp_run_once(struct evp_handle *handle, int64_t timeout_us,
+                 struct evp_step *step) {
+    assert(handle);
 
-        if (with_timeout && time_now_monotonic_dbs() - start >= seconds) break;
+    struct timespec cap;
+    if (timeout_us > 0) {
+        struct timespec timeout = {
+            .tv_sec = timeout_us / USECS_PER_SEC,
+            .tv_nsec = (timeout_us % USECS_PER_SEC) * NSECS_PER_USEC
+        };
+        struct timespec now = time_now_monotonic();
+        timespec_add(&now, &timeout, &cap);
     }
 
-    if (with_timeout) Evp_unregister_timer(handle, &timeout);
-    debug("EventPump done after %f seconds", time_now_monotonic_dbs() - start);
+    if (wake_on_first_timer(handle, (timeout_us > 0) ? &cap : NULL) != 0) {
+        return ERROR_RUNTIMEERROR;
+    }
+
+    int num_handled = run_iteration(handle, timeout_us != 0);
+    if (num_handled < 0) return ERROR_RUNTIMEERROR;
+
+    if (wake_on_first_timer(handle, NULL) != 0) return ERROR_RUNTIMEERROR;
+
+    if (step) {
+        struct timespec next;
+        step->handled = (unsigned)num_handled;
+        step->stop = handle->stop;
+        step->next_us = -1;
+
+        if (handle->backlog) {
+            step->next_us = 0;
+        } else if (timer_wheel_next_wakeup(&handle->timers, &next)) {
+            struct timespec now = clock_now(handle);
+            int64_t ns = (int64_t)(next.tv_sec - now.tv_sec) * NSECS_PER_SEC +
+                         (next.tv_nsec - now.tv_nsec);
+            /* round up: waking up early only to find nothing to do is
+             * wasteful */
+            step->next_us = (ns > 0) ? (ns + NSECS_PER_USEC - 1) / NSECS_PER_USEC : 0;
+        }
+    }
+
+    handle->stop = false;
+    return ERRORCODE_SUCCESS;
+}
+
+int Evp_get_pollfd(const struct evp_handle *handle) {
+    assert(handle);
+    return get_os_api_pollfd(handle->osapi);
 }
 
 /*
  * Expects tev->tspec to *already* have been populated with an interval
  * duration. This function will then convert it to an absolute timepoint
- * on the monotonic clock by adding the duration to NOW.
+ * on the clock of the event pump by adding the duration to NOW.
  *
  * The timer *must not* be currently registered. */
-static int timer_duration_to_timepoint(struct timer_event *tev) {
+static int timer_duration_to_timepoint(const struct evp_handle *handle,
+                                       struct timer_event *tev) {
     assert(tev);
 
     long seconds_before = tev->tspec.tv_sec;
 
-    struct timespec now = time_now_monotonic();
+    struct timespec now = clock_now(handle);
     timespec_add(&now, &tev->tspec, &tev->tspec);
 
     // check for overflow
@@ -379,8 +1061,8 @@ static int timer_duration_to_timepoint(struct timer_event *tev) {
 
 /*
  * Expects tev->tspec to have already been populated with an interval duration.
- * This function calls timer_duration_to_timepoint and if successful enqueues
- * the timer into the timer queue. */
+ * This function calls timer_duration_to_timepoint and if successful adds
+ * the timer to the timer wheel -- O(1). */
 int Evp_register_timer(struct evp_handle *handle, struct timer_event *tev) {
     assert(handle);
     assert(tev);
@@ -388,87 +1070,100 @@ int Evp_register_timer(struct evp_handle *handle, struct timer_event *tev) {
 
     if (tev->registered) return ERROR_INVALIDVALUE;
 
-    int rc = timer_duration_to_timepoint(tev);
-    if (rc != ERRORCODE_SUCCESS) return rc;
-
-    struct timer_event *timer;
-
-    if (Dll_empty(&handle->timers)) {
-        Dll_pushfront(&handle->timers, tev, link);
-        tev->registered = true;
-        return ERRORCODE_SUCCESS;
-    }
-
-    Dll_foreach(&handle->timers, timer, struct timer_event, link) {
-        if (gt(&timer->tspec, &tev->tspec, timespec_cmp)) {
-            Dll_put_before(&handle->timers, timer, tev, link);
-            tev->registered = true;
-            return ERRORCODE_SUCCESS;
+    if (tev->periodic) {
+        if (tev->interval.tv_sec == 0 && tev->interval.tv_nsec == 0) {
+            return ERROR_INVALIDVALUE;
         }
+        tev->tspec = tev->interval;
+        tev->overruns = 0;
     }
 
-    // no existing timer expires before this one
-    Dll_pushback(&handle->timers, tev, link);
+    int rc = timer_duration_to_timepoint(handle, tev);
+    if (rc != ERRORCODE_SUCCESS) return rc;
+
+    timer_wheel_add(&handle->timers, tev);
     tev->registered = true;
 
     return ERRORCODE_SUCCESS;
 }
 
+/*
+ * The deadline of a registered timer (in tspec) is left alone: periodic
+ * timers pick up the new interval on their next expiration, one-shot timers
+ * on their next registration. */
+static inline void set_interval(struct timer_event *tev,
+                                const struct timespec *interval) {
+    tev->interval = *interval;
+    if (!tev->registered) tev->tspec = *interval;
+}
+
 void Evp_set_timer_interval_secs(struct timer_event *tev, uint32_t seconds) {
     assert(tev);
-    tev->tspec.tv_sec = seconds;
-    tev->tspec.tv_nsec = 0;
+    struct timespec interval = {.tv_sec = seconds, .tv_nsec = 0};
+    set_interval(tev, &interval);
 }
 
 void Evp_set_timer_interval_ms(struct timer_event *tev, uint32_t milliseconds) {
     assert(tev);
-    tev->tspec.tv_sec = milliseconds / MSECS_PER_SEC;
-    tev->tspec.tv_nsec = (milliseconds % MSECS_PER_SEC) * NSECS_PER_MSEC;
+    struct timespec interval = {
+        .tv_sec = milliseconds / MSECS_PER_SEC,
+        .tv_nsec = (milliseconds % MSECS_PER_SEC) * NSECS_PER_MSEC
+    };
+    set_interval(tev, &interval);
 }
 
 void Evp_set_timer_interval_us(struct timer_event *tev, uint32_t microseconds) {
     assert(tev);
-    tev->tspec.tv_sec = microseconds / USECS_PER_SEC;
-    tev->tspec.tv_nsec = (microseconds % USECS_PER_SEC) * NSECS_PER_USEC;
+    struct timespec interval = {
+        .tv_sec = microseconds / USECS_PER_SEC,
+        .tv_nsec = (microseconds % USECS_PER_SEC) * NSECS_PER_USEC
+    };
+    set_interval(tev, &interval);
 }
 
 void Evp_set_timer_interval_fromtimespec(struct timer_event *tev,
                                          struct timespec *tspec) {
     assert(tev);
     assert(tspec);
-    tev->tspec.tv_sec = tspec->tv_sec;
-    tev->tspec.tv_nsec = tspec->tv_nsec;
+    set_interval(tev, tspec);
 }
 
+/* NOTE the interval is set after this, since it depends on 'registered' */
 static inline void
 initialize_tev(struct timer_event *tev, timer_callback cb, void *priv) {
     tev->priv = priv;
     tev->cb = cb;
+    tev->slot = NULL;
     tev->registered = false;
+    tev->hist = NULL;
+    tev->slack_us = 0;
+    tev->periodic = false;
+    tev->overrun = EVP_TIMER_CATCH_UP;
+    tev->overruns = 0;
 }
 
 void Evp_init_timer_secs(struct timer_event *tev,
                          uint32_t seconds,
                          timer_callback cb,
                          void *priv) {
-    Evp_set_timer_interval_secs(tev, seconds);
     initialize_tev(tev, cb, priv);
+    Evp_set_timer_interval_secs(tev, seconds);
 }
 
 void Evp_init_timer_ms(struct timer_event *tev,
                        uint32_t milliseconds,
                        timer_callback cb,
                        void *priv) {
-    Evp_set_timer_interval_ms(tev, milliseconds);
     initialize_tev(tev, cb, priv);
+    Evp_set_timer_interval_ms(tev, milliseconds);
 }
 
 void Evp_init_timer_us(struct timer_event *tev,
                        uint32_t microseconds,
                        timer_callback cb,
                        void *priv) {
-    Evp_set_timer_interval_us(tev, microseconds);
     initialize_tev(tev, cb, priv);
+    Evp_set_timer_interval_us(tev, microseconds);
 }
 
 void Evp_init_timer_fromtimespec(struct timer_event *tev,
@@ -477,8 +1172,78 @@ void Evp_init_timer_fromtimespec(struct timer_event *tev,
                                  void *priv) {
     assert(tev);
     assert(tspec);
-    Evp_set_timer_interval_fromtimespec(tev, tspec);
     initialize_tev(tev, cb, priv);
+    Evp_set_timer_interval_fromtimespec(tev, tspec);
+}
+
+void Evp_init_periodic_timer_ms(struct timer_event *tev,
+                                uint32_t milliseconds,
+                                enum evp_timer_overrun overrun,
+                                timer_callback cb,
+                                void *priv) {
+    Evp_init_timer_ms(tev, milliseconds, cb, priv);
+    tev->periodic = true;
+    tev->overrun = overrun;
+}
+
+void Evp_init_periodic_timer_us(struct timer_event *tev,
+                                uint32_t microseconds,
+                                enum evp_timer_overrun overrun,
+                                timer_callback cb,
+                                void *priv) {
+    Evp_init_timer_us(tev, microseconds, cb, priv);
+    tev->periodic = true;
+    tev->overrun = overrun;
+}
+
+void Evp_init_periodic_timer_fromtimespec(struct timer_event *tev,
+                                          struct timespec *tspec,
+                                          enum evp_timer_overrun overrun,
+                                          timer_callback cb,
+                                          void *priv) {
+    Evp_init_timer_fromtimespec(tev, tspec, cb, priv);
+    tev->periodic = true;
+    tev->overrun = overrun;
+}
+
+void Evp_set_timer_overrun(struct timer_event *tev,
+                           enum evp_timer_overrun overrun) {
+    assert(tev);
+    tev->overrun = overrun;
+}
+
+uint32_t Evp_get_timer_overruns(const struct timer_event *tev) {
+    assert(tev);
+    return tev->overruns;
+}
+
+void Evp_init_timer_ms_slack(struct timer_event *tev,
+                             uint32_t milliseconds,
+                             uint32_t slack_ms,
+                             timer_callback cb,
+                             void *priv) {
+    Evp_init_timer_ms(tev, milliseconds, cb, priv);
+    Evp_set_timer_slack_ms(tev, slack_ms);
+}
+
+void Evp_init_timer_us_slack(struct timer_event *tev,
+                             uint32_t microseconds,
+                             uint32_t slack_us,
+                             timer_callback cb,
+                             void *priv) {
+    Evp_init_timer_us(tev, microseconds, cb, priv);
+    Evp_set_timer_slack_us(tev, slack_us);
+}
+
+void Evp_set_timer_slack_us(struct timer_event *tev, uint32_t microseconds) {
+    assert(tev);
+    tev->slack_us = microseconds;
+}
+
+void Evp_set_timer_slack_ms(struct timer_event *tev, uint32_t milliseconds) {
+    assert(tev);
+    uint64_t us = (uint64_t)milliseconds * USECS_PER_MSEC;
+    tev->slack_us = (uint32_t)MIN(us, UINT32_MAX);
 }
 
 void Evp_unregister_timer(struct evp_handle *handle, struct timer_event *tev) {
@@ -486,7 +1251,7 @@ void Evp_unregister_timer(struct evp_handle *handle, struct timer_event *tev) {
     assert(tev);
 
     if (tev->registered) {
-        Dll_popnode(&handle->timers, tev, link);
+        timer_wheel_remove(&handle->timers, tev);
         tev->registered = false;
     }
 }
@@ -501,11 +1266,18 @@ int Evp_init_fdmon(struct fd_event *fdev,
 
     if (fd < 0) return ERROR_INVALIDVALUE;
 
+    if (flags & FD_EVENT_RECV) flags |= FD_EVENT_READABLE;
+
+    if (flags & FD_EVENT_DRAIN) {
+        if (flags & FD_EVENT_RECV) return ERROR_INVALIDVALUE;
+        flags |= FD_EVENT_READABLE | FD_EVENT_EDGE_TRIGGERED | FD_NONBLOCKING;
+    }
+
     if (!(flags & FD_EVENT_READABLE || flags & FD_EVENT_WRITABLE)) {
         return ERROR_INVALIDVALUE;
     }
 
-    if (fdev->evmask & FD_NONBLOCKING) {
+    if (flags & FD_NONBLOCKING) {
         fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
     }
 
@@ -513,7 +1285,13 @@ int Evp_init_fdmon(struct fd_event *fdev,
     fdev->evmask = flags;
     fdev->fd = fd;
     fdev->priv = priv;
+    fdev->revents = 0;
+    fdev->rxbuf = NULL;
+    fdev->rxlen = 0;
+    fdev->slices = NULL;
+    fdev->eof = false;
     fdev->registered = false;
+    fdev->hist = NULL;
 
     return ERRORCODE_SUCCESS;
 }
@@ -541,25 +1319,78 @@ void Evp_unregister_fdmon(struct evp_handle *handle, struct fd_event *fdev) {
         fdev->registered = false;
         remove_fd_event_monitor(handle->osapi, fdev);
     }
+
+    /* still queued for dispatch; see dispatch_fd_events */
+    if (fdev->revents) {
+        Dll_popnode(&handle->evq, fdev, link);
+        fdev->revents = 0;
+    }
+}
+
+const uint8_t *Evp_get_fdev_data(const struct fd_event *fdev, size_t *len) {
+    assert(fdev);
+    assert(len);
+
+    *len = fdev->rxlen;
+    return fdev->rxbuf;
+}
+
+struct dllist *Evp_get_fdev_slices(const struct fd_event *fdev, bool *eof) {
+    assert(fdev);
+    assert(fdev->evmask & FD_EVENT_DRAIN);
+    assert(fdev->slices);
+
+    if (eof) *eof = fdev->eof;
+    return fdev->slices;
+}
+
+void Evp_slice_ref(struct evp_slice *slice) {
+    assert(slice);
+    assert(slice->refs > 0);
+    slice->refs++;
+}
+
+void Evp_slice_release(struct evp_slice *slice) {
+    assert(slice);
+    assert(slice->refs > 0);
+
+    if (--slice->refs == 0) slab_pool_release(slice);
 }
 
 void Evp_destroy(struct evp_handle **handle) {
     assert(handle);
     assert(*handle);
 
-    remove_fd_event_monitor((*handle)->osapi, &(*handle)->sem);
-    remove_fd_event_monitor((*handle)->osapi, &(*handle)->timerfd);
+    if (!(*handle)->simulated) {
+        remove_fd_event_monitor((*handle)->osapi, &(*handle)->sem);
+        remove_fd_event_monitor((*handle)->osapi, &(*handle)->timerfd);
+        close((*handle)->timerfd.fd);
+    }
     close((*handle)->sem.fd);
-    close((*handle)->timerfd.fd);
 
-    destroy_os_api_handle((*handle)->osapi);
+    if ((*handle)->sigfd.fd >= 0) {
+        remove_fd_event_monitor((*handle)->osapi, &(*handle)->sigfd);
+        close((*handle)->sigfd.fd);
+    }
 
-    pthread_mutex_destroy(&(*handle)->uev_mtx);
+    destroy_os_api_handle((*handle)->osapi);
 
-    Dll_clear(&(*handle)->timers, false);
+    timer_wheel_clear(&(*handle)->timers);
     Dll_clear(&(*handle)->evq, false);
-    Staq_clear(&(*handle)->uevq, true);
 
+    struct user_event *uev;
+    while ((uev = (*handle)->uev_backlog)) {
+        (*handle)->uev_backlog = uev->next;
+        uevq_release(&(*handle)->uevq, uev);
+    }
+    uevq_destroy(&(*handle)->uevq);
+
+    /* NOTE the watches still registered are not touched: they may well
+     * have been freed already (see e.g. ~EventPump in event.cxx) */
+    salloc(0, (*handle)->uev_types);
+
+    salloc(0, (*handle)->rxbuf);
+    if ((*handle)->slices) slab_pool_destroy((*handle)->slices);
     salloc(0, *handle);
     *handle = NULL;
 }
@@ -577,10 +1408,30 @@ int Evp_init_uev_watch(struct user_event_watch *uev,
     uev->priv = priv;
     uev->event_type = event_type;
     uev->registered = false;
+    uev->hist = NULL;
 
     return ERRORCODE_SUCCESS;
 }
 
+/*
+ * Grow the table of user event types (see evp_handle) if needed so that
+ * it has an entry for event_type. Grows geometrically. */
+static void reserve_uev_types(struct evp_handle *handle, unsigned event_type) {
+    if (event_type < handle->num_uev_types) return;
+
+    size_t n = MAX(handle->num_uev_types * 2, (size_t)event_type + 1);
+    n = MIN(MAX(n, 16), (size_t)MAX_USER_EVENT_TYPE_VALUE);
+
+    handle->uev_types =
+      salloc(sizeof(struct dllist) * n, handle->uev_types);
+
+    for (size_t i = handle->num_uev_types; i < n; ++i) {
+        Dll_init(&handle->uev_types[i], NULL);
+    }
+
+    handle->num_uev_types = n;
+}
+
 int Evp_register_uev_watch(struct evp_handle *handle,
                            struct user_event_watch *uev) {
     assert(handle);
@@ -591,10 +1442,8 @@ int Evp_register_uev_watch(struct evp_handle *handle,
     // aready registered ?
     if (uev->registered) return ERROR_INVALIDVALUE;
 
-    // another callback aready registered ?
-    if (uev->event_type) return ERROR_CONFLICT;
-
-    handle->watch[uev->event_type] = uev;
+    reserve_uev_types(handle, uev->event_type);
+    Dll_pushback(&handle->uev_types[uev->event_type], uev, link);
     uev->registered = true;
     return ERRORCODE_SUCCESS;
 }
@@ -604,13 +1453,106 @@ void Evp_unregister_uev_watch(struct evp_handle *handle,
     assert(handle);
     assert(uev);
 
-    if (uev->event_type >= MAX_USER_EVENT_TYPE_VALUE) return;
     if (!uev->registered) return;
+    assert(uev->event_type < handle->num_uev_types);
 
-    handle->watch[uev->event_type] = NULL;
+    /* about to be invoked by dispatch_user_event? skip it */
+    if (handle->uev_cursor == &uev->link) {
+        handle->uev_cursor = Dll_nextnode(&uev->link);
+    }
+
+    Dll_popnode(&handle->uev_types[uev->event_type], uev, link);
     uev->registered = false;
 }
 
+int Evp_init_signal_watch(struct signal_watch *sw,
+                          int signo,
+                          signal_callback cb,
+                          void *priv) {
+    assert(sw);
+    assert(cb);
+
+    if (signo <= 0 || signo >= NSIG) return ERROR_OUTOFBOUNDS;
+    if (signo == SIGKILL || signo == SIGSTOP) return ERROR_INVALIDVALUE;
+
+    sw->cb = cb;
+    sw->priv = priv;
+    sw->signo = signo;
+    sw->registered = false;
+    sw->hist = NULL;
+
+    return ERRORCODE_SUCCESS;
+}
+
+/*
+ * Make the signalfd (creating it if it does not exist yet) watch the
+ * signals currently in handle->sigmask. */
+static int update_signalfd(struct evp_handle *handle) {
+    int fd = signalfd(handle->sigfd.fd, &handle->sigmask,
+                      SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        error("Failed to set up signalfd: '%s'", strerror(errno));
+        return ERROR_RUNTIMEERROR;
+    }
+
+    if (handle->sigfd.fd >= 0) return ERRORCODE_SUCCESS;
+
+    handle->sigfd.fd = fd;
+    if (add_fd_event_monitor(handle->osapi, &handle->sigfd) != 0) {
+        close(fd);
+        handle->sigfd.fd = -1;
+        return ERROR_RUNTIMEERROR;
+    }
+
+    return ERRORCODE_SUCCESS;
+}
+
+int Evp_register_signal_watch(struct evp_handle *handle,
+                              struct signal_watch *sw) {
+    assert(handle);
+    assert(sw);
+    assert(sw->cb);
+    assert(sw->signo > 0 && sw->signo < NSIG);
+
+    if (sw->registered) return ERROR_INVALIDVALUE;
+    if (handle->simulated) return ERROR_MISCONFIGURED;
+
+    if (!sigismember(&handle->sigmask, sw->signo)) {
+        sigaddset(&handle->sigmask, sw->signo);
+
+        if (update_signalfd(handle) != ERRORCODE_SUCCESS) {
+            sigdelset(&handle->sigmask, sw->signo);
+            return ERROR_RUNTIMEERROR;
+        }
+    }
+
+    Dll_pushback(&handle->sig_watches[sw->signo], sw, link);
+    sw->registered = true;
+    return ERRORCODE_SUCCESS;
+}
+
+void Evp_unregister_signal_watch(struct evp_handle *handle,
+                                 struct signal_watch *sw) {
+    assert(handle);
+    assert(sw);
+
+    if (!sw->registered) return;
+
+    /* about to be invoked by dispatch_signal? skip it */
+    if (handle->sig_cursor == &sw->link) {
+        handle->sig_cursor = Dll_nextnode(&sw->link);
+    }
+
+    Dll_popnode(&handle->sig_watches[sw->signo], sw, link);
+    sw->registered = false;
+
+    /* last watch for the signal: stop watching it */
+    if (Dll_empty(&handle->sig_watches[sw->signo])) {
+        sigdelset(&handle->sigmask, sw->signo);
+        update_signalfd(handle);
+    }
+}
+
 /* Unblock the main event loop via the eventfd */
 static inline int notify_event_pushlished(struct evp_handle *handle) {
     assert(handle);
@@ -626,18 +1568,75 @@ static inline int notify_event_pushlished(struct evp_handle *handle) {
     return ERRORCODE_SUCCESS;
 }
 
+/*
+ * Push the chain of events first .. last, waking up the event pump if the
+ * queue was empty; otherwise a wakeup is already pending. */
+static int push_events(struct evp_handle *handle,
+                       struct user_event *first,
+                       struct user_event *last) {
+    if (!uevq_push(&handle->uevq, first, last)) return ERRORCODE_SUCCESS;
+    return notify_event_pushlished(handle);
+}
+
 int Evp_push_uev(struct evp_handle *handle, unsigned event_type, void *data) {
     assert(handle);
 
     if (event_type >= MAX_USER_EVENT_TYPE_VALUE) return ERROR_OUTOFBOUNDS;
 
-    struct user_event *ev = salloc(sizeof(struct user_event), NULL);
+    struct user_event *ev = uevq_alloc(&handle->uevq);
     ev->event_type = event_type;
+    ev->fn = NULL;
     ev->data = data;
 
-    lock_mutex(&handle->uev_mtx);
-    Staq_enq(&handle->uevq, ev, link);
-    unlock_mutex(&handle->uev_mtx);
+    return push_events(handle, ev, ev);
+}
 
-    return notify_event_pushlished(handle);
+int Evp_push_uev_batch(struct evp_handle *handle,
+                       const struct uev_item *events,
+                       size_t n) {
+    assert(handle);
+
+    if (n == 0) return ERRORCODE_SUCCESS;
+    assert(events);
+
+    for (size_t i = 0; i < n; ++i) {
+        if (events[i].event_type >= MAX_USER_EVENT_TYPE_VALUE) {
+            return ERROR_OUTOFBOUNDS;
+        }
+    }
+
+    struct user_event *first = NULL, *last = NULL;
+    for (size_t i = 0; i < n; ++i) {
+        struct user_event *ev = uevq_alloc(&handle->uevq);
+        ev->event_type = events[i].event_type;
+        ev->fn = NULL;
+        ev->data = events[i].data;
+        ev->next = NULL;
+
+        if (last) last->next = ev;
+        else first = ev;
+        last = ev;
+    }
+
+    return push_events(handle, first, last);
+}
+
+int Evp_post(struct evp_handle *handle, post_callback fn, void *arg) {
+    assert(handle);
+    assert(fn);
+
+    struct user_event *ev = uevq_alloc(&handle->uevq);
+    ev->fn = fn;
+    ev->data = arg;
+
+    return push_events(handle, ev, ev);
+}
+
+static void stop_event_pump(void *arg) {
+    struct evp_handle *handle = arg;
+    handle->stop = true;
+}
+
+int Evp_stop(struct evp_handle *handle) {
+    return Evp_post(handle, stop_event_pump, handle);
 }
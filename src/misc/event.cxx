@@ -1,8 +1,13 @@
 #include <unistd.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 
+#include <array>
 #include <chrono>
+#include <cstddef>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <stdexcept>
 #include <sstream>
 #include <cstring>
@@ -57,12 +62,146 @@ static void user_event_callback_shim(
     cb->call(data);
 }
 
+static void signal_callback_shim(
+        struct signal_watch *sw,
+        const struct signalfd_siginfo *info, void *priv)
+{
+    assert(priv);
+    UNUSED(sw);
+
+    auto *cb = static_cast<tarp::SignalCallback*>(priv);
+    cb->call(info);
+}
+
+
+/*========================================
+ *============ CallbackPool ==============
+ *=======================================*/
+namespace tarp {
+namespace impl {
+
+/*
+ * Freelist allocator for the Callback objects of an EventPump (along with
+ * their shared_ptr control blocks; see EventPump::make_callback), so that
+ * short-lived callbacks only cost an allocation until the cache has warmed
+ * up.
+ *
+ * Requests are rounded up to a multiple of GRANULE bytes and freed blocks
+ * are kept on a list per size, to be handed out again most recently freed
+ * first. Larger requests are passed through to operator new.
+ *
+ * (1) Callbacks may be created and destructed in any thread (see
+ * EventPump::post), hence the lock. They can also outlive the pump: every
+ * allocated block holds a reference to the pool, which is only destructed
+ * along with the last of them.
+ */
+class CallbackPool {
+public:
+    static constexpr std::size_t GRANULE  = alignof(std::max_align_t);
+    static constexpr std::size_t NUM_BINS = 32;
+
+    CallbackPool(void) = default;
+    ~CallbackPool(void);
+
+    CallbackPool(const CallbackPool &)            = delete;
+    CallbackPool &operator=(const CallbackPool &) = delete;
+
+    void *allocate(std::size_t size);
+    void deallocate(void *block, std::size_t size) noexcept;
+
+private:
+    struct free_block { free_block *next; };
+    static std::size_t bin_of(std::size_t size);
+
+    std::mutex m_mtx;                                               /* (1) */
+    std::array<free_block *, NUM_BINS> m_bins {};
+};
+
+CallbackPool::~CallbackPool(void){
+    for (free_block *block : m_bins){
+        while (block){
+            free_block *next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+    }
+}
+
+std::size_t CallbackPool::bin_of(std::size_t size){
+    return (size ? size - 1 : 0) / GRANULE;
+}
+
+void *CallbackPool::allocate(std::size_t size){
+    std::size_t bin = bin_of(size);
+    if (bin >= NUM_BINS) return ::operator new(size);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (free_block *block = m_bins[bin]){
+            m_bins[bin] = block->next;
+            return block;
+        }
+    }
+
+    return ::operator new((bin + 1) * GRANULE);
+}
+
+void CallbackPool::deallocate(void *block, std::size_t size) noexcept {
+    std::size_t bin = bin_of(size);
+    if (bin >= NUM_BINS){
+        ::operator delete(block);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_bins[bin] = new (block) free_block{m_bins[bin]};
+}
+
+/*
+ * Allocator handing out single objects from a CallbackPool, for
+ * std::allocate_shared. */
+template <typename T>
+struct CallbackAllocator {
+    using value_type = T;
+
+    explicit CallbackAllocator(std::shared_ptr<CallbackPool> p)
+        : pool(std::move(p)) {}
+
+    template <typename U>
+    CallbackAllocator(const CallbackAllocator<U> &other)
+        : pool(other.pool) {}
+
+    T *allocate(std::size_t n){
+        return static_cast<T *>(pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        pool->deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const CallbackAllocator<U> &other) const {
+        return pool == other.pool;
+    }
+
+    template <typename U>
+    bool operator!=(const CallbackAllocator<U> &other) const {
+        return pool != other.pool;
+    }
+
+    std::shared_ptr<CallbackPool> pool;
+};
+
+}  /* namespace impl */
+}  /* namespace tarp */
+
 
 /*========================================
  *============ EventPump =================
  *=======================================*/
 EventPump::EventPump(const EventPump::construction_permit &permit)
-    : m_callback_id(0), m_callbacks(), m_callback_construction_permit()
+    : m_callback_construction_permit(), m_callbacks(), m_free_slots(),
+      m_callback_pool(std::make_shared<impl::CallbackPool>())
 {
     UNUSED(permit);
 
@@ -83,6 +222,10 @@ std::shared_ptr<EventPump> tarp::make_event_pump(void){
 }
 
 EventPump::~EventPump(void){
+    /* spawned coroutines still suspended hold raw events registered with
+     * the pump; destroy them first. */
+    m_coroutines.reset();
+
     /*
      * If we don't unset the lambda reference (see the m_func member in
      * CallbackCore.die()) for each callback object when the EventPump is
@@ -90,77 +233,274 @@ EventPump::~EventPump(void){
      * callback object that stores a lambda and the lambda that captures the
      * callback object will result in a memory leak as they both keep each other
      * alive. => IOW, we need to ensure this circular anchorage is broken. */
-    for (auto entry : m_callbacks) entry.second->die();
+    for (auto cb : m_callbacks){
+        if (cb) cb->die();
+    }
 
     Evp_destroy(&m_raw_state);
 }
 
+/*
+ * Mark the calling thread as the one running the pump for the duration of
+ * run() or run_once() -- including when a callback throws out of them; see
+ * register_on_pump_thread. */
+class EventPump::PumpThreadGuard {
+public:
+    explicit PumpThreadGuard(EventPump &evp) : m_evp(evp) {
+        std::lock_guard<std::mutex> lock(m_evp.m_pump_thread_mtx);
+        m_evp.m_pump_thread = std::this_thread::get_id();
+    }
+
+    ~PumpThreadGuard(void){
+        std::lock_guard<std::mutex> lock(m_evp.m_pump_thread_mtx);
+        m_evp.m_pump_thread = std::thread::id();
+    }
+
+    PumpThreadGuard(const PumpThreadGuard &) = delete;
+    PumpThreadGuard &operator=(const PumpThreadGuard &) = delete;
+
+private:
+    EventPump &m_evp;
+};
+
 void EventPump::run(int seconds){
+    PumpThreadGuard guard(*this);
     Evp_run(m_raw_state, seconds);
 }
 
+void EventPump::stop(void){
+    Evp_stop(m_raw_state);
+}
+
+tarp::LoopStep EventPump::run_once(std::chrono::microseconds timeout){
+    struct evp_step step;
+    int64_t timeout_us = (timeout.count() < 0) ? -1 : timeout.count();
+
+    PumpThreadGuard guard(*this);
+    int rc = Evp_run_once(m_raw_state, timeout_us, &step);
+
+    if (rc != ERRORCODE_SUCCESS){
+        throw std::runtime_error("Failed to wait for events");
+    }
+
+    return {step.handled, std::chrono::microseconds(step.next_us), step.stop};
+}
+
+int EventPump::get_pollfd(void) const {
+    return Evp_get_pollfd(m_raw_state);
+}
+
+static struct evp_budget to_evp_budget(const tarp::DispatchBudget &budget){
+    auto us = budget.max_time.count();
+    if (us < 0 || us > UINT32_MAX){
+        throw std::invalid_argument("Invalid dispatch time budget");
+    }
+
+    struct evp_budget b;
+    b.max_events = budget.max_events;
+    b.max_us = static_cast<uint32_t>(us);
+    return b;
+}
+
+void EventPump::set_dispatch_policy(tarp::DispatchBudget timers,
+                                    tarp::DispatchBudget fd_events,
+                                    tarp::DispatchBudget user_events,
+                                    tarp::DispatchBudget signals)
+{
+    struct evp_dispatch_policy policy;
+    policy.budget[EVP_CLASS_SIGNAL] = to_evp_budget(signals);
+    policy.budget[EVP_CLASS_TIMER] = to_evp_budget(timers);
+    policy.budget[EVP_CLASS_FD]    = to_evp_budget(fd_events);
+    policy.budget[EVP_CLASS_USER]  = to_evp_budget(user_events);
+
+    Evp_set_dispatch_policy(m_raw_state, &policy);
+}
+
+struct evp_stats EventPump::stats(void) const {
+    struct evp_stats stats;
+    if (Evp_get_stats(m_raw_state, &stats) != ERRORCODE_SUCCESS){
+        throw std::logic_error("Event pump built without instrumentation");
+    }
+
+    return stats;
+}
+
+void EventPump::reset_stats(void){
+    Evp_reset_stats(m_raw_state);
+}
+
 /*
  * If used in a multithreaded context, each thread should have its own
  * EventPump object. Otherwise, if an EventPump is shared between multiple
  * threads, the user must serialize and synchronize calls. The only explicitly
- * thread-safe method is this one -- push_event. */
+ * thread-safe methods are push_event, post, post_at, stop, stats, and the
+ * set_*_callback methods. */
 int EventPump::push_event(unsigned event_type, void *data){
     return Evp_push_uev(m_raw_state, event_type, data);
 }
 
+/*
+ * The functions are queued here rather than in the C event pump so that
+ * they get destructed along with the EventPump if never run. Only the
+ * first function queued since the pump last ran them is posted through to
+ * the C event pump; run_posted then runs all the functions queued up by
+ * that time. */
+int EventPump::post(std::function<void(void)> fn){
+    bool first;
+
+    {
+        std::lock_guard<std::mutex> lock(m_posted_mtx);
+        first = m_posted.empty();
+        m_posted.push_back(std::move(fn));
+    }
+
+    if (!first) return ERRORCODE_SUCCESS;
+    return Evp_post(m_raw_state, run_posted, this);
+}
+
+/*
+ * The deadline is only turned into a timer by the thread running the pump,
+ * since timers cannot be registered from any other thread. */
+int EventPump::post_at(std::chrono::steady_clock::time_point deadline,
+        std::function<void(void)> fn)
+{
+    return post([this, deadline, fn = std::move(fn)]() mutable {
+        using namespace std::chrono;
+        auto remaining = duration_cast<microseconds>(deadline - steady_clock::now());
+
+        if (remaining.count() <= 0){
+            fn();
+            return;
+        }
+
+        int rc = set_timer_callback(remaining, [fn = std::move(fn)]{
+            fn();
+            return false;
+        });
+
+        if (rc != ERRORCODE_SUCCESS){
+            error("Failed to arm timer for posted function: '%s'", tarp_strerror(rc));
+        }
+    });
+}
+
+void EventPump::run_posted(void *evp){
+    assert(evp);
+    auto *self = static_cast<tarp::EventPump *>(evp);
+
+    std::vector<std::function<void(void)>> posted;
+    {
+        std::lock_guard<std::mutex> lock(self->m_posted_mtx);
+        posted.swap(self->m_posted);
+    }
+
+    for (auto &fn : posted) fn();
+}
+
+/*
+ * The id of a callback is its slot in m_callbacks plus one, since 0 is the
+ * sentinel id value callbacks have when not given a tracking id. Ids are
+ * therefore reused once a callback has been untracked. */
 void EventPump::track_callback(std::shared_ptr<tarp::Callback> callback){
     assert(callback);
-    ++m_callback_id;
-
-    /* (on wraparound) skip 0 because that's the sentinel id value
-     * callbacks have when not given a tracking id. */
-    if (m_callback_id == 0) ++m_callback_id;
+    size_t slot;
+
+    if (!m_free_slots.empty()){
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+        m_callbacks[slot] = std::move(callback);
+    } else {
+        slot = m_callbacks.size();
+        m_callbacks.push_back(std::move(callback));
+    }
 
-    m_callbacks[m_callback_id] = callback;
-    callback->set_id(m_callback_id);
+    m_callbacks[slot]->set_id(slot + 1);
 }
 
 void EventPump::untrack_callback(size_t id){
-    size_t num_erased = m_callbacks.erase(id);
-    debug("UNTRACKED %zu callback(s) [id = %zu]", num_erased, id);
+    if (id == 0 || id > m_callbacks.size() || !m_callbacks[id - 1]) return;
+
+    /* the callback may be destructed here, and untrack others in turn; so
+     * only after the slot has been released */
+    auto callback = std::move(m_callbacks[id - 1]);
+    m_free_slots.push_back(id - 1);
+}
+
+/*
+ * Callbacks and their control blocks come from the pool in one allocation;
+ * see impl::CallbackPool. */
+template <typename T, typename... Args>
+std::shared_ptr<T> EventPump::make_callback(Args &&...args){
+    return std::allocate_shared<T>(
+            impl::CallbackAllocator<T>(m_callback_pool),
+            m_callback_construction_permit,
+            shared_from_this(), std::forward<Args>(args)...);
 }
 
 int EventPump::activate_and_track(std::shared_ptr<tarp::Callback> callback){
     int rc = callback->activate();
-    if (rc == ERRORCODE_SUCCESS) track_callback(callback);
+    if (rc == ERRORCODE_SUCCESS) track_callback(std::move(callback));
     return rc;
 }
 
+/*
+ * While the pump is running, only the thread running it touches the raw
+ * event registrations and the callback slots, so other threads post the
+ * registration to it. While it is not running, registrations are made
+ * straight away, with m_pump_thread_mtx held so that the pump cannot start
+ * running (see PumpThreadGuard) and other threads cannot register in the
+ * meantime. */
+int EventPump::register_on_pump_thread(std::shared_ptr<tarp::Callback> callback){
+    {
+        std::unique_lock<std::mutex> lock(m_pump_thread_mtx);
+
+        if (m_pump_thread == std::this_thread::get_id()){
+            lock.unlock();
+            return activate_and_track(std::move(callback));
+        }
+
+        if (m_pump_thread == std::thread::id()){
+            return activate_and_track(std::move(callback));
+        }
+    }
+
+    return post([this, callback = std::move(callback)]{
+        int rc = activate_and_track(callback);
+        if (rc != ERRORCODE_SUCCESS){
+            error("Failed to register posted callback: '%s'", tarp_strerror(rc));
+        }
+    });
+}
+
 int EventPump::set_timer_callback(
         std::chrono::microseconds interval,
-        tarp::timer_callback cb)
+        tarp::timer_callback cb,
+        std::chrono::microseconds slack)
 {
-    auto p = make_shared<TimerEventCallback>(
-            m_callback_construction_permit,
-            shared_from_this(), interval, cb);
-    return activate_and_track(p);
+    auto p = make_callback<TimerEventCallback>(interval, std::move(cb));
+    p->set_slack(slack);
+    return register_on_pump_thread(std::move(p));
+}
+
+int EventPump::set_signal_callback(int signo, tarp::signal_callback cb){
+    auto p = make_callback<SignalCallback>(signo, std::move(cb));
+    return register_on_pump_thread(std::move(p));
 }
 
 int EventPump::set_fd_event_callback(int fd, uint32_t flags, tarp::fd_callback cb){
-    auto p = make_shared<FdEventCallback>(
-            m_callback_construction_permit,
-            shared_from_this(), fd, flags, cb);
-    return activate_and_track(p);
+    auto p = make_callback<FdEventCallback>(fd, flags, std::move(cb));
+    return register_on_pump_thread(std::move(p));
 }
 
 int EventPump::set_user_event_callback(unsigned event_type, tarp::uev_callback cb){
-    auto p = make_shared<UserEventCallback>(
-            m_callback_construction_permit,
-            shared_from_this(), event_type, cb);
-    return activate_and_track(p);
+    auto p = make_callback<UserEventCallback>(event_type, std::move(cb));
+    return register_on_pump_thread(std::move(p));
 }
 
 shared_ptr<TimerEventCallback> EventPump::make_explicit_timer_callback(
             std::chrono::microseconds interval)
 {
-    auto p = make_shared<TimerEventCallback>(
-            m_callback_construction_permit,
-            shared_from_this(), interval, nullptr);
+    auto p = make_callback<TimerEventCallback>(interval, nullptr);
     track_callback(p);
     return p;
 }
@@ -168,9 +508,7 @@ shared_ptr<TimerEventCallback> EventPump::make_explicit_timer_callback(
 shared_ptr<FdEventCallback> EventPump::make_explicit_fd_event_callback(
             int fd, uint32_t flags)
 {
-    auto p = make_shared<FdEventCallback>(
-            m_callback_construction_permit,
-            shared_from_this(), fd, flags, nullptr);
+    auto p = make_callback<FdEventCallback>(fd, flags, nullptr);
     track_callback(p);
     return p;
 }
@@ -178,9 +516,14 @@ shared_ptr<FdEventCallback> EventPump::make_explicit_fd_event_callback(
 shared_ptr<UserEventCallback> EventPump::make_explicit_user_event_callback(
             unsigned event_type)
 {
-    auto p = make_shared<UserEventCallback>(
-            m_callback_construction_permit,
-            shared_from_this(), event_type, nullptr);
+    auto p = make_callback<UserEventCallback>(event_type, nullptr);
+    track_callback(p);
+    return p;
+}
+
+shared_ptr<SignalCallback> EventPump::make_explicit_signal_callback(int signo)
+{
+    auto p = make_callback<SignalCallback>(signo, nullptr);
     track_callback(p);
     return p;
 }
@@ -209,7 +552,7 @@ TimerEventCallback::TimerEventCallback(
         std::shared_ptr<tarp::EventPump> evp,
         chrono::microseconds interval,
         tarp::timer_callback cb)
-    : CallbackCore<tarp::timer_callback>(evp, cb)
+    : CallbackCore<tarp::timer_callback>(std::move(evp), std::move(cb))
 {
     UNUSED(permit);
     set_interval(interval);
@@ -218,6 +561,24 @@ TimerEventCallback::TimerEventCallback(
 
 void TimerEventCallback::set_interval(std::chrono::microseconds interval){
     chrono2timespec(interval, &m_interval, true);
+    if (m_raw_tev_handle){
+        Evp_set_timer_interval_fromtimespec(m_raw_tev_handle, &m_interval);
+    }
+}
+
+/*
+ * Unlike the interval, the slack and overrun policy only take effect
+ * on the next (re)registration of the timer. */
+void TimerEventCallback::set_slack(std::chrono::microseconds slack){
+    if (slack.count() < 0 || slack.count() > UINT32_MAX){
+        throw std::invalid_argument("Invalid timer slack");
+    }
+
+    m_slack_us = static_cast<uint32_t>(slack.count());
+}
+
+void TimerEventCallback::set_overrun_policy(enum evp_timer_overrun overrun){
+    m_overrun = overrun;
 }
 
 /*
@@ -228,18 +589,15 @@ TimerEventCallback::~TimerEventCallback(void){
 }
 
 void TimerEventCallback::initialize_raw_event_handle(void){
-    void *mem = salloc(sizeof(struct timer_event), NULL);
-    m_raw_tev_handle = static_cast<struct timer_event *>(mem);
+    m_raw_tev_handle = &m_tev;
 
-    Evp_init_timer_fromtimespec(
-            m_raw_tev_handle, &m_interval, timer_event_callback_shim, this);
+    Evp_init_periodic_timer_fromtimespec(
+            m_raw_tev_handle, &m_interval, m_overrun,
+            timer_event_callback_shim, this);
 }
 
 void TimerEventCallback::destroy_raw_event_handle(void){
-    if (m_raw_tev_handle){
-        salloc(0, m_raw_tev_handle);
-        m_raw_tev_handle = nullptr;
-    }
+    m_raw_tev_handle = nullptr;
 }
 
 int TimerEventCallback::register_event_monitor(struct evp_handle *raw_evp_handle)
@@ -247,6 +605,8 @@ int TimerEventCallback::register_event_monitor(struct evp_handle *raw_evp_handle
     assert(raw_evp_handle); assert(m_raw_tev_handle);
 
     Evp_set_timer_interval_fromtimespec(m_raw_tev_handle, &m_interval);
+    Evp_set_timer_overrun(m_raw_tev_handle, m_overrun);
+    Evp_set_timer_slack_us(m_raw_tev_handle, m_slack_us);
     return Evp_register_timer(raw_evp_handle, m_raw_tev_handle);
 }
 
@@ -257,16 +617,15 @@ int TimerEventCallback::deregister_event_monitor(struct evp_handle *raw_evp_hand
     return ERRORCODE_SUCCESS;
 }
 
+/*
+ * The timer is periodic: it is still registered, with its next deadline
+ * already set, when this is called. */
 void TimerEventCallback::call(void){
     assert_func_set();
 
     if (!m_func()){
         die(); return;
     }
-
-    if (activate() != ERRORCODE_SUCCESS){
-        throw std::runtime_error("Internal error");
-    }
 }
 
 
@@ -278,8 +637,8 @@ FdEventCallback::FdEventCallback(
         std::shared_ptr<tarp::EventPump> evp,
         int fd, uint32_t flags,
         tarp::fd_callback cb)
-    : CallbackCore<tarp::fd_callback>(evp, cb), m_fd(fd), m_flags(flags),
-      m_revents(0)
+    : CallbackCore<tarp::fd_callback>(std::move(evp), std::move(cb)),
+      m_fd(fd), m_flags(flags), m_revents(0)
 {
     UNUSED(permit);
     initialize_raw_event_handle();
@@ -290,8 +649,7 @@ FdEventCallback::~FdEventCallback(void){
 }
 
 void FdEventCallback::initialize_raw_event_handle(void){
-    void *mem = salloc(sizeof(struct fd_event), NULL);
-    m_raw_fdev_handle = static_cast<struct fd_event *>(mem);
+    m_raw_fdev_handle = &m_fdev;
 
     if (Evp_init_fdmon(m_raw_fdev_handle, m_fd, m_flags,
                 fd_event_callback_shim, this) != ERRORCODE_SUCCESS)
@@ -302,10 +660,7 @@ void FdEventCallback::initialize_raw_event_handle(void){
 }
 
 void FdEventCallback::destroy_raw_event_handle(void){
-    if (m_raw_fdev_handle){
-        salloc(0, m_raw_fdev_handle);
-        m_raw_fdev_handle = nullptr;
-    }
+    m_raw_fdev_handle = nullptr;
 }
 
 int FdEventCallback::register_event_monitor(struct evp_handle *raw_evp_handle){
@@ -340,7 +695,7 @@ UserEventCallback::UserEventCallback(
         uint32_t event_type,
         tarp::uev_callback cb)
     :
-        CallbackCore<tarp::uev_callback>(evp, cb),
+        CallbackCore<tarp::uev_callback>(std::move(evp), std::move(cb)),
         m_event_type(event_type), m_event_data(nullptr)
 {
     UNUSED(permit);
@@ -352,8 +707,7 @@ UserEventCallback::~UserEventCallback(void){
 }
 
 void UserEventCallback::initialize_raw_event_handle(void){
-    void *mem = salloc(sizeof(struct user_event_watch), NULL);
-    m_raw_uev_handle = static_cast<struct user_event_watch*>(mem);
+    m_raw_uev_handle = &m_uev;
 
     int rc = Evp_init_uev_watch(m_raw_uev_handle, m_event_type,
             user_event_callback_shim, this);
@@ -367,10 +721,7 @@ void UserEventCallback::initialize_raw_event_handle(void){
 }
 
 void UserEventCallback::destroy_raw_event_handle(void){
-    if (m_raw_uev_handle){
-        salloc(0, m_raw_uev_handle);
-        m_raw_uev_handle = nullptr;
-    }
+    m_raw_uev_handle = nullptr;
 }
 
 int UserEventCallback::register_event_monitor(struct evp_handle *raw_evp_handle){
@@ -400,6 +751,66 @@ void UserEventCallback::call(void *data){
     call();
 }
 
+/*================================================
+ * ============ SignalCallback ===================
+ * ==============================================*/
+SignalCallback::SignalCallback(
+        const Callback::construction_permit &permit,
+        std::shared_ptr<tarp::EventPump> evp,
+        int signo,
+        tarp::signal_callback cb)
+    :
+        CallbackCore<tarp::signal_callback>(std::move(evp), std::move(cb)),
+        m_signo(signo), m_info(nullptr)
+{
+    UNUSED(permit);
+    initialize_raw_event_handle();
+}
+
+SignalCallback::~SignalCallback(void){
+    die();
+}
+
+void SignalCallback::initialize_raw_event_handle(void){
+    m_raw_sw_handle = &m_sw;
+
+    int rc = Evp_init_signal_watch(m_raw_sw_handle, m_signo,
+            signal_callback_shim, this);
+
+    if (rc == ERRORCODE_SUCCESS) return;
+
+    destroy_raw_event_handle();
+    throw std::invalid_argument("Unacceptable signal number");
+}
+
+void SignalCallback::destroy_raw_event_handle(void){
+    m_raw_sw_handle = nullptr;
+}
+
+int SignalCallback::register_event_monitor(struct evp_handle *raw_evp_handle){
+    assert(raw_evp_handle); assert(m_raw_sw_handle);
+    return Evp_register_signal_watch(raw_evp_handle, m_raw_sw_handle);
+}
+
+int SignalCallback::deregister_event_monitor(struct evp_handle *raw_evp_handle)
+{
+    assert(raw_evp_handle); assert(m_raw_sw_handle);
+    Evp_unregister_signal_watch(raw_evp_handle, m_raw_sw_handle);
+    return ERRORCODE_SUCCESS;
+}
+
+void SignalCallback::call(void){
+    assert_func_set();
+    assert(m_info);
+    if (!m_func(*m_info)) die();
+}
+
+void SignalCallback::call(const struct signalfd_siginfo *info){
+    m_info = info;
+    call();
+    m_info = nullptr;
+}
+
 std::shared_ptr<tarp::Process> EventPump::make_process(
         std::initializer_list<std::string> cmd_spec,
         int ms_timeout,
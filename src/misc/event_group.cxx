@@ -0,0 +1,368 @@
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <tarp/common.h>
+#include <tarp/error.h>
+#include <tarp/log.h>
+
+#include <tarp/event.hxx>
+#include <tarp/event_group.hxx>
+
+using namespace std;
+using namespace tarp;
+
+/*================================================
+ *============ Sharding policies =================
+ *===============================================*/
+size_t RoundRobinSharding::pick(int fd, const std::vector<size_t> &loads){
+    UNUSED(fd);
+    assert(!loads.empty());
+
+    size_t idx = m_next % loads.size();
+    m_next = idx + 1;
+    return idx;
+}
+
+size_t FdHashSharding::pick(int fd, const std::vector<size_t> &loads){
+    assert(!loads.empty());
+
+    /* fds are small integers allocated lowest-first; the identity hash
+     * spreads them evenly */
+    if (fd < 0) return m_timer_policy.pick(fd, loads);
+    return static_cast<size_t>(fd) % loads.size();
+}
+
+size_t LeastLoadedSharding::pick(int fd, const std::vector<size_t> &loads){
+    UNUSED(fd);
+    assert(!loads.empty());
+
+    auto it = std::min_element(loads.begin(), loads.end());
+    return static_cast<size_t>(it - loads.begin());
+}
+
+/*========================================
+ *============ EventPumpGroup ============
+ *=======================================*/
+
+/* The CPUs the calling thread is allowed to run on, in ascending order */
+static std::vector<int> get_allowed_cpus(void){
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0){
+        for (int i = 0; i < CPU_SETSIZE; ++i){
+            if (CPU_ISSET(i, &set)) cpus.push_back(i);
+        }
+    } else {
+        warn("sched_getaffinity failed: '%s'", strerror(errno));
+    }
+
+    return cpus;
+}
+
+EventPumpGroup::EventPumpGroup(size_t num_pumps,
+                               std::unique_ptr<ShardingPolicy> policy,
+                               bool pin_threads)
+    : m_loads(), m_threads(), m_cpus(), m_listeners(), m_mtx(),
+      m_policy(std::move(policy)), m_running(false)
+{
+    std::vector<int> cpus = get_allowed_cpus();
+
+    if (num_pumps == 0) num_pumps = std::max<size_t>(cpus.size(), 1);
+    if (!m_policy) m_policy = std::make_unique<RoundRobinSharding>();
+
+    m_loads = std::vector<std::atomic<size_t>>(num_pumps);
+    for (size_t i = 0; i < num_pumps; ++i){
+        m_pumps.push_back(make_event_pump());
+        m_loads[i] = 0;
+        m_cpus.push_back((pin_threads && !cpus.empty()) ?
+                         cpus[i % cpus.size()] : -1);
+    }
+}
+
+EventPumpGroup::~EventPumpGroup(void){
+    stop();
+
+    /* destruct the pumps first so that no callback can still be
+     * monitoring the listeners once they are closed */
+    m_pumps.clear();
+    for (int fd : m_listeners) close(fd);
+}
+
+void EventPumpGroup::run_pump(size_t idx){
+    int cpu = m_cpus[idx];
+
+    if (cpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0){
+            warn("Failed to pin event pump %zu to cpu %d: '%s'",
+                 idx, cpu, strerror(rc));
+        }
+    }
+
+    m_pumps[idx]->run(-1);
+}
+
+void EventPumpGroup::start(void){
+    if (m_running) return;
+    m_running = true;
+
+    for (size_t i = 0; i < m_pumps.size(); ++i){
+        m_threads.emplace_back(&EventPumpGroup::run_pump, this, i);
+    }
+}
+
+void EventPumpGroup::stop(void){
+    if (!m_running) return;
+
+    /* NOTE a pump that has not started running yet will return at the end
+     * of its first iteration; see Evp_stop */
+    for (auto &pump : m_pumps) pump->stop();
+    for (auto &thread : m_threads) thread.join();
+
+    m_threads.clear();
+    m_running = false;
+}
+
+bool EventPumpGroup::is_running(void) const {
+    return m_running;
+}
+
+size_t EventPumpGroup::size(void) const {
+    return m_pumps.size();
+}
+
+std::shared_ptr<tarp::EventPump> EventPumpGroup::pump(size_t idx) const {
+    return m_pumps.at(idx);
+}
+
+size_t EventPumpGroup::load(size_t idx) const {
+    return m_loads.at(idx);
+}
+
+void EventPumpGroup::set_sharding_policy(std::unique_ptr<ShardingPolicy> policy)
+{
+    if (!policy) throw std::invalid_argument("Invalid (NULL) sharding policy");
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_policy = std::move(policy);
+}
+
+/*
+ * The load of the pump chosen is incremented here, right away, and not
+ * on registration; registrations may be asynchronous and placing several
+ * callbacks in quick succession must still see the load change. */
+size_t EventPumpGroup::pick_pump(int fd){
+    std::lock_guard<std::mutex> lock(m_mtx);
+
+    std::vector<size_t> loads;
+    loads.reserve(m_loads.size());
+    for (const auto &load : m_loads) loads.push_back(load);
+
+    size_t idx = m_policy->pick(fd, loads);
+    if (idx >= m_pumps.size()){
+        throw std::logic_error("Sharding policy picked invalid pump index");
+    }
+
+    ++m_loads[idx];
+    return idx;
+}
+
+/*
+ * Run the registration function in the thread of the pump with the given
+ * index: directly if the group is not running, else by posting it to the
+ * pump. In the latter case the result is not known until later, and
+ * failures can only be logged. */
+int EventPumpGroup::place(size_t idx, std::function<int(void)> registration)
+{
+    if (!m_running) return registration();
+
+    return m_pumps[idx]->post([idx, registration](){
+        try {
+            int rc = registration();
+            if (rc != ERRORCODE_SUCCESS){
+                error("Failed to register callback with event pump %zu: '%s'",
+                      idx, tarp_strerror(static_cast<unsigned>(rc)));
+            }
+        } catch (const std::exception &e){
+            error("Failed to register callback with event pump %zu: '%s'",
+                  idx, e.what());
+        }
+    });
+}
+
+int EventPumpGroup::set_fd_event_callback(int fd,
+                                          uint32_t flags,
+                                          tarp::fd_callback cb)
+{
+    if (fd < 0 || !cb) return ERROR_INVALIDVALUE;
+
+    size_t idx = pick_pump(fd);
+    auto &load = m_loads[idx];
+    tarp::EventPump *pump = m_pumps[idx].get();  /* see replicate_listener */
+
+    auto wrapper = [cb, &load](int fd_, uint32_t events){
+        if (cb(fd_, events)) return true;
+        --load;
+        return false;
+    };
+
+    int rc = place(idx, [pump, fd, flags, wrapper, &load](){
+        int rc_ = ERROR_INVALIDVALUE;
+        try {
+            rc_ = pump->set_fd_event_callback(fd, flags, wrapper);
+        } catch (...){
+            --load;
+            throw;
+        }
+        if (rc_ != ERRORCODE_SUCCESS) --load;
+        return rc_;
+    });
+
+    return rc;
+}
+
+int EventPumpGroup::set_timer_callback(std::chrono::microseconds interval,
+                                       tarp::timer_callback cb)
+{
+    if (!cb) return ERROR_INVALIDVALUE;
+
+    size_t idx = pick_pump(-1);
+    auto &load = m_loads[idx];
+    tarp::EventPump *pump = m_pumps[idx].get();  /* see replicate_listener */
+
+    auto wrapper = [cb, &load](){
+        if (cb()) return true;
+        --load;
+        return false;
+    };
+
+    return place(idx, [pump, interval, wrapper, &load](){
+        int rc = pump->set_timer_callback(interval, wrapper);
+        if (rc != ERRORCODE_SUCCESS) --load;
+        return rc;
+    });
+}
+
+int EventPumpGroup::post(size_t idx, std::function<void(void)> fn){
+    return m_pumps.at(idx)->post(std::move(fn));
+}
+
+int EventPumpGroup::replicate_listener(socket_factory make_socket,
+                                       listener_callback cb)
+{
+    if (!make_socket || !cb) return ERROR_INVALIDVALUE;
+
+    std::vector<int> fds;
+    for (size_t i = 0; i < m_pumps.size(); ++i){
+        int fd = make_socket();
+        if (fd < 0){
+            for (int sock : fds) close(sock);
+            return ERROR_RUNTIMEERROR;
+        }
+        fds.push_back(fd);
+    }
+
+    /* the listener callbacks registered so far, so they can be torn down
+     * again if a pump fails to register its own. Each entry is only ever
+     * accessed in the thread of its pump (see place). */
+    auto listeners = std::make_shared<
+        std::vector<std::shared_ptr<tarp::FdEventCallback>>>(m_pumps.size());
+
+    for (size_t i = 0; i < m_pumps.size(); ++i){
+        /* NOTE: a raw pointer; a shared_ptr captured in a callback (or
+         * posted function) owned by the pump itself would keep the pump
+         * alive forever */
+        tarp::EventPump *pump = m_pumps[i].get();
+        int fd = fds[i];
+
+        auto wrapper = [cb, pump](int fd_, uint32_t events){
+            return cb(*pump, fd_, events);
+        };
+
+        int rc = place(i, [pump, fd, wrapper, listeners, i](){
+            auto listener = pump->make_explicit_fd_event_callback(
+                    fd, FD_EVENT_READABLE);
+            listener->set_func(wrapper);
+
+            int rc_ = listener->activate();
+            if (rc_ != ERRORCODE_SUCCESS){
+                listener->die();
+                return rc_;
+            }
+
+            (*listeners)[i] = std::move(listener);
+            return rc_;
+        });
+
+        if (rc != ERRORCODE_SUCCESS){
+            error("Failed to register listener with event pump %zu", i);
+
+            /* tear down the listeners registered with the pumps before;
+             * their sockets are only closed once unregistered */
+            for (size_t j = 0; j < i; ++j){
+                int fd_ = fds[j];
+                int rc_ = place(j, [listeners, fd_, j](){
+                    auto &listener = (*listeners)[j];
+                    if (listener) listener->die();
+                    listener.reset();
+                    close(fd_);
+                    return ERRORCODE_SUCCESS;
+                });
+
+                if (rc_ != ERRORCODE_SUCCESS){
+                    error("Failed to unregister listener from event pump %zu",
+                          j);
+                }
+            }
+
+            for (size_t j = i; j < fds.size(); ++j) close(fds[j]);
+            return rc;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_listeners.insert(m_listeners.end(), fds.begin(), fds.end());
+    return ERRORCODE_SUCCESS;
+}
+
+int EventPumpGroup::add_reuseport_listener(const struct sockaddr *addr,
+                                           socklen_t addrlen,
+                                           listener_callback cb,
+                                           int backlog)
+{
+    if (!addr) return ERROR_INVALIDVALUE;
+
+    auto make_socket = [addr, addrlen, backlog](){
+        int fd = socket(addr->sa_family,
+                        SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0){
+            error("Failed to create listener socket: '%s'", strerror(errno));
+            return -1;
+        }
+
+        int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+            bind(fd, addr, addrlen) != 0 ||
+            listen(fd, backlog) != 0)
+        {
+            error("Failed to set up listener socket: '%s'", strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    };
+
+    return replicate_listener(make_socket, cb);
+}
@@ -5,20 +5,22 @@
 extern "C" {
 #endif
 
-#include <pthread.h>
+#include <signal.h>
 #include <sys/eventfd.h>
 #include <sys/timerfd.h>
 
 #include <tarp/dllist.h>
-#include <tarp/staq.h>
 
 #include <tarp/event.h>
 
-struct user_event {
-    struct staqnode link;
-    unsigned event_type;
-    void *data;
-};
+#include "slab_pool.h"
+#include "timer_wheel.h"
+#include "uev_queue.h"
+
+/*
+ * Size of the buffers data is read into for FD_EVENT_RECV monitors; IOW
+ * the maximum number of bytes passed to a callback in one invocation. */
+#define EVP_RECV_BUFFER_SIZE 4096
 
 /*
  * opaque handle; defined specifically for each platform's event API;
@@ -33,13 +35,13 @@ struct os_event_api_handle;
  * augmented e.g. for user-defined events to enqueue them into a priority
  * queue instead, optionally.
  *
- * (1) Timer queue. A *sorted* list of timers; insertions must ensure the list
- * remains sorted. The doubly-linked nodes allow for O(1) removal on cancellation
- * and when traversing the list for processing timer expirations. The main
- * event loop always goes to sleep until the first timer expires.
+ * (1) Timer store. A hierarchical timing wheel (see timer_wheel.h) giving
+ * O(1) registration and cancellation and amortized O(1) expiration. The main
+ * event loop always goes to sleep until the wheel next needs attention, i.e.
+ * until the first timer expires (or timers must cascade to a lower level).
  * On unblocking, the event pump goes in a specific order (see Evp_start fmi)
  * through the relevant queues and dispatches queued events.
- * The timer queue is populated by the user through e.g. Evp_register_timer_ms.
+ * The timer store is populated by the user through e.g. Evp_register_timer.
  *
  * (2) Event queue. A list of file descriptor events; this queue is populated
  * from the code that implements the interface with the OS-specic event API.
@@ -61,38 +63,115 @@ struct os_event_api_handle;
  * earliest expiration time.
  * This ensures that (unless the call unblocks due to some other e.g. fd
  * even occurring), the call unblocks as soon as a timer expires.
+ * The deadline the timerfd is armed with is cached so that it is only
+ * re-armed (which takes a system call) when the deadline changes.
  *
  * (5) User event queue. User events are enqueued by any 'publisher' function
  * by calling Evp_push_uev. Once enqueued, the events only get dequeued when
  * processed. Meaning the publisher cannot change or remove its event.
- * Since processing is always FIFO -style, a simple singly-linked list suffices
- * here.
- *
- * (6) The publisher(s) of user events could well be in separate threads
- * relative to the thread running the event pump. To ensure thread-safety,
- * Evp_push_uev will use this mutex to protect enqueue-ing actions to uevq.
- * Similarly, dispatch_events will use the mutex to protect dequeue-ing actions
- * from uevq. Note that all state is kept inside the evp_handle. In a
+ * The publisher(s) of user events could well be in separate threads
+ * relative to the thread running the event pump: the queue is a lock-free
+ * MPSC queue (see uev_queue.h) that dispatch_events drains in one go.
+ * Note that all state is kept inside the evp_handle. In a
  * multithreaded context, multiple event pumps can coexist (each thread
  * must have its own event pump) but the user must be careful of *sharing*
  * an event pump between threads without proper serialization and
  * synchronization measures.
  *
- * (7) This stores pointers to the user-defined event callback wrappers.
- * O(1) lookup can be had by using the event_type integer as a key in
- * an array for direct addressing. Of course, the event_type range must
- * be kept within reasonable limit -- see MAX_USER_EVENT_TYPE_VALUE fmi.
+ * (6) Only the push that finds the user event queue empty writes to the
+ * semaphore (3) to wake up the event pump; the rest ride on that wakeup.
+ *
+ * (7) This stores the user-defined event callback wrappers: a list of
+ * watches for each event type, in order of registration. O(1) lookup can be
+ * had by using the event_type integer as a key in an array for direct
+ * addressing. The array is grown as needed to cover the greatest event type
+ * registered; of course, the event_type range must be kept within
+ * reasonable limit -- see MAX_USER_EVENT_TYPE_VALUE fmi.
+ * uev_cursor is the node of the next watch to be invoked for the event
+ * being dispatched; unregistering that watch moves the cursor along, which
+ * makes it safe to unregister watches from inside callbacks.
+ *
+ * (8) Buffer for FD_EVENT_RECV monitors when the backend only reports
+ * readiness (see dispatch_events); allocated on first use.
+ *
+ * (9) The number of system calls made by the event loop itself (i.e.
+ * not counting any made by the user callbacks) to wait for and read
+ * events. Useful for benchmarking the different backends.
+ *
+ * (10) Set (from a call posted by Evp_stop) to make Evp_run return at the
+ * end of the current iteration; also set by the simulated backend once
+ * there is nothing left to simulate. Only ever accessed by the thread
+ * running the event pump, hence no synchronization.
+ *
+ * (11) Per-class dispatch budgets; see Evp_set_dispatch_policy. If
+ * 'budgeted' is false, there are none and the classes are dispatched in
+ * the fixed order timers, fd events, user events. Otherwise first_class is
+ * the class dispatched first in the next iteration. Events left over
+ * when a class runs out of budget stay queued where they are: expired
+ * timers on the expired list of the wheel, fd events on the evq (2), and
+ * user events -- already taken off the uevq -- on uev_backlog, in FIFO
+ * order. 'backlog' is then set so that pump_os_events polls instead of
+ * blocking.
+ *
+ * (12) Instrumentation; see Evp_get_stats and tarp/event_stats.h. Written
+ * only by the thread running the event pump, using relaxed atomic stores;
+ * readable from any thread.
+ *
+ * (13) Signals; see Evp_register_signal_watch. sigfd is the signalfd, created
+ * on first use (its fd is -1 until then), for the signals in sigmask, i.e.
+ * those with at least one watch registered. sig_watches holds the watches
+ * for each signal number; sig_cursor serves the same purpose as uev_cursor
+ * (7). The signalfd is taken off the evq (2) as soon as it is reported
+ * readable and sig_pending is set instead: the signals are then read and
+ * dispatched in their own stage, until the signalfd has been drained.
+ *
+ * (14) FD_EVENT_DRAIN monitors; see Evp_get_fdev_slices. The slab pool the
+ * slices are drained into is created on first use. 'drained' holds the
+ * slices passed to the callback being dispatched: it is kept here rather
+ * than in the fd_event since the callback may free the fd_event.
+ *
+ * (15) The clock timers run on; see Evp_now. For the simulated backend
+ * this is vclock, which only the backend moves forward (see sim-event.c);
+ * the semaphore (3) then goes unmonitored, and there is no timerfd (4).
+ * Otherwise it is the monotonic clock.
  */
 struct evp_handle {
-    struct dllist   timers;                                         /* (1) */
+    struct timer_wheel timers;                                      /* (1) */
     struct dllist   evq;                                            /* (2) */
 
     struct fd_event sem;                                            /* (3) */
     struct fd_event timerfd;                                        /* (4) */
+    struct timespec timerfd_deadline;
+
+    struct uevq     uevq;                                     /* (5), (6) */
+    struct dllist   *uev_types;                                     /* (7) */
+    size_t          num_uev_types;
+    struct dlnode   *uev_cursor;
+
+    uint8_t *rxbuf;                                                 /* (8) */
+    uint64_t num_syscalls;                                          /* (9) */
+    bool stop;                                                      /* (10) */
+
+    struct evp_dispatch_policy policy;                              /* (11) */
+    bool budgeted;
+    unsigned first_class;
+    struct user_event *uev_backlog;
+    struct user_event *uev_backlog_tail;
+    bool backlog;
+
+    struct evp_stats stats;                                         /* (12) */
+
+    struct fd_event sigfd;                                          /* (13) */
+    sigset_t        sigmask;
+    struct dllist   sig_watches[NSIG];
+    struct dlnode   *sig_cursor;
+    bool            sig_pending;
 
-    struct staq     uevq;                                           /* (5) */
-    pthread_mutex_t uev_mtx;                                        /* (6) */
-    struct user_event_watch *watch[MAX_USER_EVENT_TYPE_VALUE];      /* (7) */
+    struct slab_pool *slices;                                       /* (14) */
+    struct dllist     drained;
+
+    bool            simulated;                                      /* (15) */
+    struct timespec vclock;
 
 #ifdef __linux__
     struct os_event_api_handle *osapi;
@@ -105,14 +184,41 @@ struct evp_handle {
  * To support a specific platform, an interface consisting of the following
  * routines should be provided. See linux-event.c FMI.
  *
+ * get_os_api_handle should fall back to some other backend if the one
+ * requested is not available, and get_os_api_backend then reports the
+ * one actually in use.
+ *
+ * pump_os_events must block until at least one event occurs, then enqueue
+ * the fd_events that have occurred onto the evq, with revents set. If
+ * 'block' is false or handle->backlog is set, it must only poll instead of
+ * blocking. An
+ * fd_event may still be on the evq from a previous iteration (see
+ * evp_handle (11)), in which case it has a non-zero revents: the new
+ * events must then be OR-ed into it rather than it being enqueued again.
+ * For FD_EVENT_RECV monitors the backend may also supply the data by
+ * setting rxbuf and rxlen and flagging FD_EVENT_RECV in revents; else
+ * dispatch_events reads the data itself on readability.
+ *
+ * get_os_api_pollfd returns an fd that becomes readable whenever
+ * pump_os_events would find events (see Evp_get_pollfd), or -1 if the
+ * backend has none.
+ *
+ * simulate_fd_write feeds a simulated pipe (see Evp_sim_write); it is
+ * only ever called for the simulated backend.
+ *
  * Some portability issues may otherwise be:
  *  - eventfd - AFAIK, supported by FREEBSD as well; easily replaceable with
  *  a pipe otherwise.
  *  - timerfd
  */
-extern struct os_event_api_handle *get_os_api_handle(void);
+extern struct os_event_api_handle *get_os_api_handle(enum evp_backend backend);
 extern void destroy_os_api_handle(struct os_event_api_handle *os_api_handle);
-extern int pump_os_events(struct evp_handle *handle);
+extern enum evp_backend get_os_api_backend(
+        const struct os_event_api_handle *os_api_handle);
+extern int get_os_api_pollfd(const struct os_event_api_handle *os_api_handle);
+extern int pump_os_events(struct evp_handle *handle, bool block);
+extern int simulate_fd_write(struct os_event_api_handle *os_api_handle,
+                             int fd, const void *data, size_t len);
 
 extern int add_fd_event_monitor(
         struct os_event_api_handle *os_api_handle,
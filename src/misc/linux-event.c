@@ -13,19 +13,39 @@
 #include <tarp/event.h>
 
 #include "event_shared_defs.h"
+#include "linux-uring.h"
+#include "sim-event.h"
 
 
 #ifdef __linux__
 
 #define MAX_EPOLL_BATCH 50
 
+/*
+ * Either epoll_handle is valid (epoll backend), or uring is non-NULL
+ * (io_uring backend; see linux-uring.c), or sim is non-NULL (simulated
+ * backend; see sim-event.c). */
 struct os_event_api_handle {
     int epoll_handle;
+    struct uring_backend *uring;
+    struct sim_backend *sim;
 };
 
 
-struct os_event_api_handle *get_os_api_handle(void){
+struct os_event_api_handle *get_os_api_handle(enum evp_backend backend){
     struct os_event_api_handle *handle = salloc(sizeof(struct os_event_api_handle), NULL);
+    handle->epoll_handle = -1;
+
+    if (backend == EVP_BACKEND_SIMULATED){
+        handle->sim = sim_backend_new();
+        return handle;
+    }
+
+    if (backend == EVP_BACKEND_IO_URING){
+        if ((handle->uring = uring_backend_new()) != NULL) return handle;
+        info("io_uring unavailable; falling back to epoll");
+    }
+
     int rc = epoll_create1(EPOLL_CLOEXEC);
     if (rc < 0){
         error("epoll_create1 error: '%s'", strerror(errno));
@@ -40,10 +60,21 @@ struct os_event_api_handle *get_os_api_handle(void){
 void destroy_os_api_handle(struct os_event_api_handle *os_api_handle){
     if (!os_api_handle) return;
 
-    close(os_api_handle->epoll_handle);
+    if (os_api_handle->uring) uring_backend_destroy(os_api_handle->uring);
+    else if (os_api_handle->sim) sim_backend_destroy(os_api_handle->sim);
+    else close(os_api_handle->epoll_handle);
+
     salloc(0, os_api_handle);
 }
 
+enum evp_backend get_os_api_backend(
+        const struct os_event_api_handle *os_api_handle)
+{
+    assert(os_api_handle);
+    if (os_api_handle->sim) return EVP_BACKEND_SIMULATED;
+    return os_api_handle->uring ? EVP_BACKEND_IO_URING : EVP_BACKEND_EPOLL;
+}
+
 int add_fd_event_monitor(
         struct os_event_api_handle *os_api_handle,
         struct fd_event *fdev)
@@ -51,6 +82,14 @@ int add_fd_event_monitor(
     assert(fdev);
     assert(fdev->fd >= 0);
 
+    if (os_api_handle->uring){
+        return uring_add_fd_event_monitor(os_api_handle->uring, fdev);
+    }
+
+    if (os_api_handle->sim){
+        return sim_add_fd_event_monitor(os_api_handle->sim, fdev);
+    }
+
     uint32_t mask = 0;
     if (fdev->evmask & FD_EVENT_READABLE)       mask |= EPOLLIN | EPOLLRDHUP;
     if (fdev->evmask & FD_EVENT_WRITABLE)       mask |= EPOLLOUT;
@@ -81,6 +120,14 @@ int remove_fd_event_monitor(
     assert(os_api_handle);
     assert(fdev);
 
+    if (os_api_handle->uring){
+        return uring_remove_fd_event_monitor(os_api_handle->uring, fdev);
+    }
+
+    if (os_api_handle->sim){
+        return sim_remove_fd_event_monitor(os_api_handle->sim, fdev);
+    }
+
     int epollfd = os_api_handle->epoll_handle;
     struct epoll_event e; /* avoid bugs on old kernels */
     int rc = epoll_ctl(epollfd, EPOLL_CTL_DEL, fdev->fd, &e);
@@ -89,16 +136,42 @@ int remove_fd_event_monitor(
     return 0;
 }
 
-int pump_os_events(struct evp_handle *handle){
+int get_os_api_pollfd(const struct os_event_api_handle *os_api_handle){
+    assert(os_api_handle);
+    return os_api_handle->epoll_handle;
+}
+
+int simulate_fd_write(struct os_event_api_handle *os_api_handle, int fd,
+                      const void *data, size_t len)
+{
+    assert(os_api_handle);
+    assert(os_api_handle->sim);
+    return sim_write(os_api_handle->sim, fd, data, len);
+}
+
+int pump_os_events(struct evp_handle *handle, bool block){
     assert(handle);
+
+    if (handle->osapi->uring){
+        return uring_pump_events(handle->osapi->uring, handle, block);
+    }
+
+    if (handle->osapi->sim){
+        return sim_pump_events(handle->osapi->sim, handle, block);
+    }
+
     int epollfd = handle->osapi->epoll_handle;
 
     struct epoll_event buff[MAX_EPOLL_BATCH];
 
     /* Will unblock when the timerfd (see main event pump loop) or some
-     * other event fires, whichever happens first */
-    int rc = epoll_wait(epollfd, buff, MAX_EPOLL_BATCH, -1);
+     * other event fires, whichever happens first; unless there is a
+     * backlog of events to get through, in which case only poll */
+    handle->num_syscalls++;
+    int timeout = (block && !handle->backlog) ? -1 : 0;
+    int rc = epoll_wait(epollfd, buff, MAX_EPOLL_BATCH, timeout);
     if (rc < 0){
+        if (errno == EINTR) return 0;  /* interrupted by signal handler */
         error("epoll_wait error: '%s'", strerror(errno));
         return -1;
     }
@@ -107,7 +180,7 @@ int pump_os_events(struct evp_handle *handle){
     struct epoll_event *ev = buff;
     uint32_t revents;
 
-    for (int i = 0; i < rc; ++i, ev+=i){
+    for (int i = 0; i < rc; ++i, ++ev){
         fdev = ev->data.ptr;
 
         revents = 0;
@@ -117,8 +190,9 @@ int pump_os_events(struct evp_handle *handle){
         if (ev->events & EPOLLERR)    revents |= FD_EVENT_ERROR;
         if (ev->events & EPOLLHUP)    revents |= FD_EVENT_ERROR;
 
-        fdev->revents = revents;
-        Dll_pushback(&handle->evq, fdev, link);
+        /* still queued from a previous iteration? */
+        if (!fdev->revents) Dll_pushback(&handle->evq, fdev, link);
+        fdev->revents |= revents;
     }
 
     return 0;
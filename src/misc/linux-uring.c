@@ -0,0 +1,726 @@
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tarp/common.h>
+#include <tarp/dllist.h>
+#include <tarp/error.h>
+#include <tarp/event.h>
+#include <tarp/event_flags.h>
+#include <tarp/log.h>
+#include <tarp/math.h>
+
+#include "event_shared_defs.h"
+#include "linux-uring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <linux/io_uring.h>
+
+/*
+ * io_uring backend for the event pump.
+ *
+ * There is no dependency on liburing: the rings are set up and driven
+ * directly through the io_uring_setup/io_uring_enter/io_uring_register
+ * system calls.
+ *
+ * Each fd monitor is a 'watch' in a table indexed by file descriptor.
+ * A watch is armed by submitting one of the following requests:
+ *  - for level-triggered monitors: a single-shot poll. Once it completes,
+ *    it is re-armed at the start of the next call to uring_pump_events,
+ *    i.e. after the callback has run. A poll request checks readiness
+ *    immediately on submission so this gives level-triggered semantics.
+ *  - for edge-triggered monitors: a multishot poll that stays armed.
+ *  - for FD_EVENT_RECV monitors: a multishot recv with buffer selection
+ *    from a buffer ring registered with the kernel (the 'provided
+ *    buffers' mechanism). The kernel reads the data into one of the
+ *    buffers as soon as it arrives and the callback is handed the buffer;
+ *    the buffer is returned to the ring on the next uring_pump_events.
+ *    If the fd is not a socket, or multishot recvs or buffer rings are not
+ *    supported, FD_EVENT_RECV monitors degrade to polls and the read is
+ *    done by dispatch_events instead.
+ *
+ * SQEs are only queued when monitors are (re)armed; they are submitted
+ * in the same io_uring_enter call that waits for completions, so in the
+ * steady state the event loop makes one system call per iteration.
+ *
+ * The user_data of each request encodes the fd and the generation number
+ * of the watch. The generation is bumped when the monitor is removed,
+ * so completions for requests that were in flight at the time (and are
+ * being cancelled) can be recognized as stale and dropped. fd_event
+ * pointers are therefore never handed to the kernel, and it does not
+ * matter if the user frees the fd_event after unregistering it.
+ *
+ * A completion is only handed to the event pump when the fd_event is not
+ * already queued on the evq with data pending (each fd_event can only be
+ * queued once). Otherwise reaping stops and the remaining completions are
+ * left on the completion queue for the next call.
+ */
+
+#define URING_NUM_ENTRIES  256    /* submission queue size */
+#define URING_NUM_BUFS     128    /* must be a power of 2 */
+#define URING_BUF_GROUP    0
+#define URING_CANCEL_TAG   UINT64_MAX
+
+#ifndef POLLRDHUP
+#define POLLRDHUP 0x2000  /* only exposed by poll.h with _GNU_SOURCE */
+#endif
+
+struct uring_watch {
+    struct fd_event *fdev;  /* NULL if no monitor is registered for the fd */
+    uint32_t gen;
+    bool armed;             /* a request is in flight */
+    bool rearm;             /* on the rearm list */
+    bool recv;              /* armed as a multishot recv, not a poll */
+};
+
+struct uring_backend {
+    int ringfd;
+
+    /* submission queue */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail;       /* local tail; published on io_uring_enter */
+    struct io_uring_sqe *sqes;
+
+    /* completion queue */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;           /* same as sq_ring if FEAT_SINGLE_MMAP */
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    bool have_recv;
+
+    /* provided buffer ring; set up on first FD_EVENT_RECV registration */
+    struct io_uring_buf_ring *bufring;
+    size_t bufring_size;
+    uint16_t bufring_tail;
+    bool bufring_failed;
+    uint8_t *bufs;
+    uint16_t used[URING_NUM_BUFS];  /* buffers to give back to the ring */
+    unsigned num_used;
+
+    /* indexed by fd */
+    struct uring_watch *watches;
+    size_t num_watches;
+
+    /* fds whose watch needs re-arming; at most one entry per watch */
+    int *rearm;
+    size_t num_rearm;
+};
+
+static inline int sys_io_uring_setup(unsigned entries,
+                                     struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit,
+                                     unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static inline int sys_io_uring_register(int fd, unsigned opcode,
+                                        void *arg, unsigned nargs) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+static inline uint64_t make_tag(int fd, uint32_t gen) {
+    return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
+
+static bool probe_opcodes(struct uring_backend *u) {
+    const unsigned num_ops = 256;
+    size_t size = sizeof(struct io_uring_probe) +
+                  num_ops * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = salloc(size, NULL);
+
+    int rc = sys_io_uring_register(u->ringfd, IORING_REGISTER_PROBE,
+                                   probe, num_ops);
+    if (rc < 0) {
+        info("io_uring opcode probe failed: '%s'", strerror(errno));
+        salloc(0, probe);
+        return false;
+    }
+
+#define supported(op) \
+    ((op) <= probe->last_op && (probe->ops[(op)].flags & IO_URING_OP_SUPPORTED))
+
+    bool ok = supported(IORING_OP_POLL_ADD) &&
+              supported(IORING_OP_ASYNC_CANCEL);
+    u->have_recv = supported(IORING_OP_RECV);
+
+#undef supported
+
+    salloc(0, probe);
+    return ok;
+}
+
+static int map_rings(struct uring_backend *u, struct io_uring_params *p) {
+    u->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    u->cq_ring_size =
+      p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+
+    bool single_mmap = p->features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        u->sq_ring_size = MAX(u->sq_ring_size, u->cq_ring_size);
+        u->cq_ring_size = u->sq_ring_size;
+    }
+
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->ringfd,
+                      IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+        u->sq_ring = NULL;
+        return -1;
+    }
+
+    if (single_mmap) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, u->ringfd,
+                          IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) {
+            u->cq_ring = NULL;
+            return -1;
+        }
+    }
+
+    u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->ringfd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        return -1;
+    }
+
+    uint8_t *sq = u->sq_ring;
+    uint8_t *cq = u->cq_ring;
+
+    u->sq_head = (unsigned *)(sq + p->sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    u->sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+    u->sq_entries = *(unsigned *)(sq + p->sq_off.ring_entries);
+    u->sq_array = (unsigned *)(sq + p->sq_off.array);
+    u->sqe_tail = *u->sq_tail;
+
+    u->cq_head = (unsigned *)(cq + p->cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    u->cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+
+    return 0;
+}
+
+struct uring_backend *uring_backend_new(void) {
+    struct uring_backend *u = salloc(sizeof(struct uring_backend), NULL);
+    struct io_uring_params params;
+
+    /* COOP_TASKRUN (5.19+) avoids interrupting the task to post
+     * completions; completions are only needed when we enter anyway. */
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    u->ringfd = sys_io_uring_setup(URING_NUM_ENTRIES, &params);
+
+    if (u->ringfd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        u->ringfd = sys_io_uring_setup(URING_NUM_ENTRIES, &params);
+    }
+
+    if (u->ringfd < 0) {
+        info("io_uring_setup error: '%s'", strerror(errno));
+        salloc(0, u);
+        return NULL;
+    }
+
+    /* Multishot polls need 5.13+; there is no feature flag for it as such
+     * so use one introduced shortly after as a proxy. */
+    if (!(params.features & IORING_FEAT_NODROP) ||
+        !(params.features & IORING_FEAT_CQE_SKIP)) {
+        info("io_uring: kernel too old");
+        uring_backend_destroy(u);
+        return NULL;
+    }
+
+    if (map_rings(u, &params) != 0) {
+        error("failed to mmap io_uring rings: '%s'", strerror(errno));
+        uring_backend_destroy(u);
+        return NULL;
+    }
+
+    if (!probe_opcodes(u)) {
+        info("io_uring: required opcodes not supported");
+        uring_backend_destroy(u);
+        return NULL;
+    }
+
+    return u;
+}
+
+void uring_backend_destroy(struct uring_backend *u) {
+    if (!u) return;
+
+    /* closing the ring cancels all requests and unregisters buffers */
+    if (u->ringfd >= 0) close(u->ringfd);
+
+    if (u->sqes) munmap(u->sqes, u->sqes_size);
+    if (u->cq_ring && u->cq_ring != u->sq_ring) {
+        munmap(u->cq_ring, u->cq_ring_size);
+    }
+    if (u->sq_ring) munmap(u->sq_ring, u->sq_ring_size);
+    if (u->bufring) munmap(u->bufring, u->bufring_size);
+
+    salloc(0, u->bufs);
+    salloc(0, u->watches);
+    salloc(0, u->rearm);
+    salloc(0, u);
+}
+
+/*
+ * Publish queued SQEs and enter the kernel to submit them and, if
+ * min_complete > 0, to wait for completions. */
+static int submit_and_wait(struct uring_backend *u, unsigned min_complete) {
+    __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit =
+      u->sqe_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+    if (to_submit == 0 && min_complete == 0) return 0;
+
+    int rc = sys_io_uring_enter(u->ringfd, to_submit, min_complete, flags);
+    if (rc < 0) {
+        /* interrupted by a signal handler, or completions must be reaped
+         * before more can be submitted: not errors */
+        if (errno == EINTR || errno == EBUSY || errno == EAGAIN) return 0;
+        error("io_uring_enter error: '%s'", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static struct io_uring_sqe *get_sqe(struct uring_backend *u) {
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+    /* full: submit what is queued to make room */
+    if (u->sqe_tail - head >= u->sq_entries) {
+        if (submit_and_wait(u, 0) != 0) return NULL;
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (u->sqe_tail - head >= u->sq_entries) return NULL;
+    }
+
+    unsigned idx = u->sqe_tail & u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    u->sq_array[idx] = idx;
+    u->sqe_tail++;
+
+    return sqe;
+}
+
+static inline void provide_buffer(struct uring_backend *u,
+                                  uint16_t bid, unsigned offset) {
+    /* NOTE assign the fields individually: the ring tail aliases the
+     * 'resv' field of the first entry */
+    struct io_uring_buf *buf =
+      &u->bufring->bufs[(u->bufring_tail + offset) & (URING_NUM_BUFS - 1)];
+    buf->addr = (uintptr_t)(u->bufs + (size_t)bid * EVP_RECV_BUFFER_SIZE);
+    buf->len = EVP_RECV_BUFFER_SIZE;
+    buf->bid = bid;
+}
+
+static inline void advance_bufring(struct uring_backend *u, unsigned n) {
+    u->bufring_tail += n;
+    __atomic_store_n(&u->bufring->tail, u->bufring_tail, __ATOMIC_RELEASE);
+}
+
+/* Give the buffers consumed since the last call back to the kernel. */
+static void recycle_buffers(struct uring_backend *u) {
+    if (u->num_used == 0) return;
+
+    for (unsigned i = 0; i < u->num_used; ++i) {
+        provide_buffer(u, u->used[i], i);
+    }
+
+    advance_bufring(u, u->num_used);
+    u->num_used = 0;
+}
+
+static int setup_bufring(struct uring_backend *u) {
+    if (u->bufring) return 0;
+    if (u->bufring_failed || !u->have_recv) return -1;
+
+    u->bufring_size = URING_NUM_BUFS * sizeof(struct io_uring_buf);
+    void *ring = mmap(NULL, u->bufring_size, PROT_READ | PROT_WRITE,
+                      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        error("failed to mmap buffer ring: '%s'", strerror(errno));
+        u->bufring_failed = true;
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)ring;
+    reg.ring_entries = URING_NUM_BUFS;
+    reg.bgid = URING_BUF_GROUP;
+
+    if (sys_io_uring_register(u->ringfd, IORING_REGISTER_PBUF_RING,
+                              &reg, 1) < 0) {
+        info("failed to register io_uring buffer ring: '%s'",
+             strerror(errno));
+        munmap(ring, u->bufring_size);
+        u->bufring_failed = true;
+        return -1;
+    }
+
+    u->bufring = ring;
+    u->bufs = salloc((size_t)URING_NUM_BUFS * EVP_RECV_BUFFER_SIZE, NULL);
+
+    for (uint16_t i = 0; i < URING_NUM_BUFS; ++i) {
+        provide_buffer(u, i, i);
+    }
+    advance_bufring(u, URING_NUM_BUFS);
+
+    return 0;
+}
+
+/* Ensure the watch table can be indexed by fd. */
+static void reserve_watches(struct uring_backend *u, int fd) {
+    size_t needed = (size_t)fd + 1;
+    if (needed <= u->num_watches) return;
+
+    size_t n = MAX(needed, u->num_watches * 2);
+    u->watches = salloc(n * sizeof(struct uring_watch), u->watches);
+    u->rearm = salloc(n * sizeof(int), u->rearm);
+    memset(&u->watches[u->num_watches], 0,
+           (n - u->num_watches) * sizeof(struct uring_watch));
+    u->num_watches = n;
+}
+
+static inline uint32_t poll_mask(uint32_t evmask) {
+    uint32_t mask = 0;
+    if (evmask & FD_EVENT_READABLE) mask |= POLLIN | POLLRDHUP;
+    if (evmask & FD_EVENT_WRITABLE) mask |= POLLOUT;
+    return mask;
+}
+
+static int arm_watch(struct uring_backend *u, int fd) {
+    struct uring_watch *w = &u->watches[fd];
+    assert(w->fdev);
+    assert(!w->armed);
+
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) {
+        error("io_uring submission queue full");
+        return -1;
+    }
+
+    sqe->fd = fd;
+    sqe->user_data = make_tag(fd, w->gen);
+
+    if (w->recv) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUF_GROUP;
+    } else {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = poll_mask(w->fdev->evmask);
+        if (w->fdev->evmask & FD_EVENT_EDGE_TRIGGERED) {
+            sqe->len = IORING_POLL_ADD_MULTI;
+        }
+    }
+
+    w->armed = true;
+    return 0;
+}
+
+static inline void schedule_rearm(struct uring_backend *u, int fd) {
+    struct uring_watch *w = &u->watches[fd];
+    if (w->rearm) return;
+
+    w->rearm = true;
+    u->rearm[u->num_rearm++] = fd;
+}
+
+static void rearm_watches(struct uring_backend *u) {
+    for (size_t i = 0; i < u->num_rearm; ++i) {
+        int fd = u->rearm[i];
+        struct uring_watch *w = &u->watches[fd];
+        w->rearm = false;
+
+        /* unregistered, or re-registered (and so re-armed) meanwhile */
+        if (!w->fdev || w->armed) continue;
+        arm_watch(u, fd);
+    }
+
+    u->num_rearm = 0;
+}
+
+static void cancel_watch(struct uring_backend *u, int fd) {
+    struct uring_watch *w = &u->watches[fd];
+
+    if (w->armed) {
+        struct io_uring_sqe *sqe = get_sqe(u);
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = make_tag(fd, w->gen);
+            sqe->user_data = URING_CANCEL_TAG;
+        }
+
+        /* submit right away: a multishot recv left armed would otherwise
+         * keep consuming data the user may now want to read directly */
+        if (w->recv) submit_and_wait(u, 0);
+    }
+
+    w->fdev = NULL;
+    w->armed = false;
+    w->gen++;  /* anything still in flight is now stale */
+}
+
+int uring_add_fd_event_monitor(struct uring_backend *u,
+                               struct fd_event *fdev) {
+    assert(u);
+    assert(fdev);
+    assert(fdev->fd >= 0);
+
+    int fd = fdev->fd;
+    reserve_watches(u, fd);
+    struct uring_watch *w = &u->watches[fd];
+
+    if (w->fdev && w->fdev != fdev) {
+        error("fd %d is already being monitored", fd);
+        return -1;
+    }
+
+    /* modification: cancel and re-arm with the new event mask */
+    if (w->fdev) cancel_watch(u, fd);
+
+    w->fdev = fdev;
+    w->recv = (fdev->evmask & FD_EVENT_RECV) && setup_bufring(u) == 0;
+
+    return arm_watch(u, fd);
+}
+
+int uring_remove_fd_event_monitor(struct uring_backend *u,
+                                  struct fd_event *fdev) {
+    assert(u);
+    assert(fdev);
+
+    int fd = fdev->fd;
+    if (fd < 0 || (size_t)fd >= u->num_watches) return 0;
+    if (u->watches[fd].fdev != fdev) return 0;
+
+    cancel_watch(u, fd);
+    return 0;
+}
+
+static inline void enqueue(struct evp_handle *handle, struct fd_event *fdev,
+                           uint32_t revents) {
+    bool queued = (fdev->revents != 0);
+    fdev->revents |= revents;
+    if (!queued && fdev->revents) Dll_pushback(&handle->evq, fdev, link);
+}
+
+static void handle_read_completion(struct uring_backend *u,
+                                   struct evp_handle *handle, int fd,
+                                   const struct io_uring_cqe *cqe) {
+    struct uring_watch *w = &u->watches[fd];
+    struct fd_event *fdev = w->fdev;
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    if (cqe->res > 0) {
+        assert(cqe->flags & IORING_CQE_F_BUFFER);
+        uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        u->used[u->num_used++] = bid;
+
+        fdev->rxbuf = u->bufs + (size_t)bid * EVP_RECV_BUFFER_SIZE;
+        fdev->rxlen = (size_t)cqe->res;
+        enqueue(handle, fdev, FD_EVENT_RECV);
+        if (!more) schedule_rearm(u, fd);
+        return;
+    }
+
+    switch (cqe->res) {
+    case 0: /* EOF; nothing more to read so do not re-arm */
+        fdev->rxbuf = NULL;
+        fdev->rxlen = 0;
+        enqueue(handle, fdev, FD_EVENT_RECV);
+        break;
+
+    case -ENOBUFS: /* buffer ring exhausted; re-arm once recycled */
+        schedule_rearm(u, fd);
+        break;
+
+    case -ENOTSOCK:
+    case -EINVAL:
+    case -EOPNOTSUPP:
+        /* not a socket, or multishot recv not supported by the kernel:
+         * degrade to a poll and let dispatch_events do the read */
+        w->recv = false;
+        schedule_rearm(u, fd);
+        break;
+
+    default:
+        enqueue(handle, fdev, FD_EVENT_ERROR);
+        if (cqe->res == -EAGAIN || cqe->res == -EINTR) schedule_rearm(u, fd);
+        break;
+    }
+}
+
+static void handle_poll_completion(struct uring_backend *u,
+                                   struct evp_handle *handle, int fd,
+                                   const struct io_uring_cqe *cqe) {
+    struct fd_event *fdev = u->watches[fd].fdev;
+    uint32_t revents = 0;
+
+    if (cqe->res < 0) {
+        revents |= FD_EVENT_ERROR;
+    } else {
+        uint32_t mask = (uint32_t)cqe->res;
+        if (mask & POLLIN)    revents |= FD_EVENT_READABLE;
+        if (mask & POLLRDHUP) revents |= FD_EVENT_READABLE;
+        if (mask & POLLOUT)   revents |= FD_EVENT_WRITABLE;
+        if (mask & POLLERR)   revents |= FD_EVENT_ERROR;
+        if (mask & POLLHUP)   revents |= FD_EVENT_ERROR;
+    }
+
+    enqueue(handle, fdev, revents);
+    if (!(cqe->flags & IORING_CQE_F_MORE)) schedule_rearm(u, fd);
+}
+
+/*
+ * Return false if the completion cannot be handled yet and must be left
+ * on the completion queue; see the comment at the top fmi. */
+static bool handle_completion(struct uring_backend *u,
+                              struct evp_handle *handle,
+                              const struct io_uring_cqe *cqe) {
+    if (cqe->user_data == URING_CANCEL_TAG) return true;
+
+    int fd = (int)(uint32_t)cqe->user_data;
+    uint32_t gen = (uint32_t)(cqe->user_data >> 32);
+    struct uring_watch *w =
+      ((size_t)fd < u->num_watches) ? &u->watches[fd] : NULL;
+
+    /* stale: the monitor has been removed since */
+    if (!w || !w->fdev || w->gen != gen) {
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            u->used[u->num_used++] =
+              (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        return true;
+    }
+
+    if (w->recv && w->fdev->revents) return false;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) w->armed = false;
+
+    if (w->recv) handle_read_completion(u, handle, fd, cqe);
+    else handle_poll_completion(u, handle, fd, cqe);
+
+    return true;
+}
+
+static void reap_completions(struct uring_backend *u,
+                             struct evp_handle *handle) {
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+        if (!handle_completion(u, handle, &u->cqes[head & u->cq_mask])) break;
+    }
+
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+int uring_pump_events(struct uring_backend *u, struct evp_handle *handle,
+                      bool block) {
+    assert(u);
+    assert(handle);
+
+    /* the callbacks for the previous batch have been run by now, unless
+     * some were left over (see evp_handle.backlog); their data must then
+     * stay put until they have been */
+    if (u->bufring && Dll_empty(&handle->evq)) recycle_buffers(u);
+    rearm_watches(u);
+
+    bool have_completions =
+      (*u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE));
+    bool have_submissions =
+      (u->sqe_tail != __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE));
+
+    /* Will unblock when the timerfd (see main event pump loop) or some
+     * other event fires, whichever happens first. With a backlog of events
+     * to get through (or when asked not to block), never wait: the
+     * completions already posted can be reaped without entering the kernel
+     * at all */
+    bool wait = block && !have_completions && !handle->backlog;
+    if (wait || have_submissions) {
+        handle->num_syscalls++;
+        if (submit_and_wait(u, wait ? 1 : 0) != 0) return -1;
+    }
+
+    reap_completions(u, handle);
+    return 0;
+}
+
+#else   /* HAVE_IO_URING */
+
+struct uring_backend *uring_backend_new(void) {
+    info("built without io_uring support");
+    return NULL;
+}
+
+void uring_backend_destroy(struct uring_backend *uring) {
+    UNUSED(uring);
+}
+
+int uring_add_fd_event_monitor(struct uring_backend *uring,
+                               struct fd_event *fdev) {
+    UNUSED(uring);
+    UNUSED(fdev);
+    return -1;
+}
+
+int uring_remove_fd_event_monitor(struct uring_backend *uring,
+                                  struct fd_event *fdev) {
+    UNUSED(uring);
+    UNUSED(fdev);
+    return -1;
+}
+
+int uring_pump_events(struct uring_backend *uring, struct evp_handle *handle,
+                      bool block) {
+    UNUSED(uring);
+    UNUSED(handle);
+    UNUSED(block);
+    return -1;
+}
+
+#endif  /* HAVE_IO_URING */
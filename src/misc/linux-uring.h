@@ -0,0 +1,38 @@
+#ifndef LINUX_URING_H__
+#define LINUX_URING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+#include <tarp/event.h>
+
+/*
+ * io_uring backend for the event pump; see linux-uring.c fmi.
+ * These mirror the os_event_api_handle interface in event_shared_defs.h
+ * and are called from linux-event.c when the io_uring backend is in use.
+ *
+ * uring_backend_new returns NULL if io_uring is not supported or not
+ * usable, in which case the caller should fall back to epoll.
+ */
+struct uring_backend;
+
+struct uring_backend *uring_backend_new(void);
+void uring_backend_destroy(struct uring_backend *uring);
+
+int uring_add_fd_event_monitor(struct uring_backend *uring,
+                               struct fd_event *fdev);
+
+int uring_remove_fd_event_monitor(struct uring_backend *uring,
+                                  struct fd_event *fdev);
+
+int uring_pump_events(struct uring_backend *uring, struct evp_handle *handle,
+                      bool block);
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif
+
+#endif
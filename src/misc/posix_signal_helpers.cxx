@@ -4,6 +4,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <system_error>
+
+#include <pthread.h>
 
 namespace tarp {
 
@@ -32,4 +35,30 @@ void set_up_signals(std::initializer_list<int> signals,
     }
 }
 
+static void change_signal_mask(int how, std::initializer_list<int> signals) {
+    sigset_t mask;
+    sigemptyset(&mask);
+
+    for (auto &sig : signals) {
+        if (sigaddset(&mask, sig) != 0) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "invalid signal number");
+        }
+    }
+
+    int rc = pthread_sigmask(how, &mask, NULL);
+    if (rc != 0) {
+        throw std::system_error(rc, std::generic_category(),
+                                "failed to change the signal mask");
+    }
+}
+
+void block_signals(std::initializer_list<int> signals) {
+    change_signal_mask(SIG_BLOCK, signals);
+}
+
+void unblock_signals(std::initializer_list<int> signals) {
+    change_signal_mask(SIG_UNBLOCK, signals);
+}
+
 }  // namespace tarp
@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <time.h>      /* clock_gettime, clock_nanosleep */
 #include <poll.h>
+#include <signal.h>
 
 #include <tarp/common.h>
 #include <tarp/error.h>
@@ -251,6 +252,7 @@ static int fork_and_exec(
         int errstream)
 {
     int rc = 0;
+    sigset_t mask;
 
     pid_t child_pid = fork();
 
@@ -258,6 +260,11 @@ static int fork_and_exec(
     case -1:
         return -1;
     case 0:
+        /* the mask is inherited across exec; do not pass on signals blocked
+         * for the sake of e.g. an event pump (see async_exec) */
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
         if (instream == STREAM_ACTION_DEVNULL){
             attach_fd_to_dev_null(STDIN_FILENO);
         } else if (instream != STREAM_ACTION_PASS){
@@ -606,6 +613,7 @@ int sync_exec(
 struct async_process_state {
     struct timer_event killer;
     struct timer_event reaper;
+    struct signal_watch sigchld;
     struct fd_event std_in;
     struct fd_event std_out;
     struct fd_event std_err;
@@ -617,23 +625,15 @@ struct async_process_state {
     void *user_priv;
 };
 
-// cyclic timer: periodicaly tries to reap process and ultimately stops
-// once process is reaped.
-static void async_process_reaper(struct timer_event *tev, void *priv){
-    UNUSED(tev);
-
-    assert(priv);
-    struct async_process_state *state = priv;
-
+/*
+ * Reap the process if it has exited and, if so, destroy all its state and
+ * invoke the completion callback. Return false if it is still running. */
+static bool reap_async_process(struct async_process_state *state){
     int pid;
     int exit_status = PROC_NOSTATUS;
 
-    /* if not reaped, try again later */
     if (!(pid = waitpid(state->pid, &exit_status, WNOHANG))){
-        Evp_set_timer_interval_ms(&state->reaper,
-                ASYNC_PROCESS_REAPER_CHECK_INTERVAL_MS);
-        Evp_register_timer(state->evp, &state->reaper);
-        return;
+        return false;
     }
 
     exit_status = maybe_decode_process_exit_status(exit_status);
@@ -662,15 +662,59 @@ static void async_process_reaper(struct timer_event *tev, void *priv){
      * This is even though there may be scheduled timer callbacks
      * for either or both. We free the state here so any scheduled
      * callbacks would cause a use-after free. Therefore they must
-     * be unscheduled. */
+     * be unscheduled. The same goes for the SIGCHLD watch. */
     Evp_unregister_timer(state->evp, &state->killer);
     Evp_unregister_timer(state->evp, &state->reaper);
+    Evp_unregister_signal_watch(state->evp, &state->sigchld);
 
     close_fds_if_required(state->fds);
     free(state);
 
     if (completion_cb)
         completion_cb(pid, exit_status, user_priv);
+
+    return true;
+}
+
+/*
+ * Try to reap the process now; if it is still running, wait for the next
+ * SIGCHLD if watching for it, else try again later. */
+static void reap_or_retry(struct async_process_state *state){
+    if (reap_async_process(state)) return;
+    if (state->sigchld.registered) return;
+
+    Evp_unregister_timer(state->evp, &state->reaper);
+    Evp_set_timer_interval_ms(&state->reaper,
+            ASYNC_PROCESS_REAPER_CHECK_INTERVAL_MS);
+    Evp_register_timer(state->evp, &state->reaper);
+}
+
+// cyclic timer: periodicaly tries to reap process and ultimately stops
+// once process is reaped. Only used if SIGCHLD is not blocked.
+static void async_process_reaper(struct timer_event *tev, void *priv){
+    UNUSED(tev);
+
+    assert(priv);
+    reap_or_retry(priv);
+}
+
+// SIGCHLD watch: the process may have exited. NOTE SIGCHLD does not queue
+// and only carries the pid of one child, so each process checks for itself.
+static void async_process_sigchld(struct signal_watch *sw,
+        const struct signalfd_siginfo *info, void *priv)
+{
+    UNUSED(sw);
+    UNUSED(info);
+
+    assert(priv);
+    reap_async_process(priv);
+}
+
+/* true if SIGCHLD is blocked in the calling thread; see async_exec */
+static bool sigchld_blocked(void){
+    sigset_t mask;
+    if (pthread_sigmask(SIG_BLOCK, NULL, &mask) != 0) return false;
+    return sigismember(&mask, SIGCHLD) == 1;
 }
 
 /*
@@ -723,8 +767,8 @@ void async_process_killer(struct timer_event *tev, void *priv){
 
     try_kill(state->pid, SIGKILL, false);
 
-    /* reap *now* */
-    async_process_reaper(&state->reaper, state);
+    /* reap *now* if possible */
+    reap_or_retry(state);
 }
 
 /*
@@ -798,7 +842,17 @@ int async_exec__(
 
     Evp_init_timer_ms(&state->reaper, ASYNC_PROCESS_REAPER_CHECK_INTERVAL_MS,
             async_process_reaper, state);
-    Evp_register_timer(state->evp, &state->reaper);
+
+    /* reap on SIGCHLD if it can be received through the event pump, else
+     * fall back to polling */
+    if (!sigchld_blocked() ||
+        Evp_init_signal_watch(&state->sigchld, SIGCHLD,
+            async_process_sigchld, state) != ERRORCODE_SUCCESS ||
+        Evp_register_signal_watch(state->evp, &state->sigchld)
+            != ERRORCODE_SUCCESS)
+    {
+        Evp_register_timer(state->evp, &state->reaper);
+    }
 
     if (use_killer){
         Evp_init_timer_ms(&state->killer, ms_timeout, async_process_killer, state);
@@ -0,0 +1,275 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <tarp/common.h>
+#include <tarp/dllist.h>
+#include <tarp/error.h>
+#include <tarp/event.h>
+#include <tarp/event_flags.h>
+#include <tarp/log.h>
+#include <tarp/math.h>
+#include <tarp/timeutils.h>
+
+#include "event_shared_defs.h"
+#include "sim-event.h"
+
+/*
+ * Simulated backend for the event pump.
+ *
+ * No system call is ever made: the backend never blocks, and instead
+ * moves the virtual clock of the event pump (see evp_handle (15)) straight
+ * to the time the timer wheel next needs attention whenever the pump would
+ * otherwise go to sleep. If there is no such time -- no timer registered --
+ * and nothing else is pending either, the simulation is over and the pump
+ * is told to stop.
+ *
+ * File descriptors are simulated by in-memory pipes, in a table indexed by
+ * fd along with the monitors. Each pipe buffers the data written into it
+ * (see sim_write) until it can be handed to the monitor for its fd. Pipes
+ * with data pending (or an EOF yet to be reported) are kept on the 'ready'
+ * list, in the order they first became ready, and are gone through on each
+ * call to sim_pump_events: each gets at most one event queued per loop
+ * iteration, with the data for FD_EVENT_RECV monitors copied into the
+ * pipe's own receive buffer, which stays valid until the callback returns
+ * even if the callback writes into the pipe again.
+ *
+ * (1) The pipe has been closed by a write of 0 bytes; eof_reported is set
+ * once the monitor has been told.
+ */
+struct sim_pipe {
+    struct dlnode link;
+    int fd;
+    uint8_t *buf;
+    size_t off;
+    size_t len;
+    size_t cap;
+    uint8_t *rxbuf;
+    bool closed;                                                    /* (1) */
+    bool eof_reported;
+    bool ready;
+};
+
+struct sim_backend {
+    struct fd_event **watches;
+    struct sim_pipe **pipes;
+    size_t num_fds;
+    struct dllist ready;
+};
+
+struct sim_backend *sim_backend_new(void) {
+    struct sim_backend *sim = salloc(sizeof(struct sim_backend), NULL);
+    sim->watches = NULL;
+    sim->pipes = NULL;
+    sim->num_fds = 0;
+    Dll_init(&sim->ready, NULL);
+    return sim;
+}
+
+void sim_backend_destroy(struct sim_backend *sim) {
+    if (!sim) return;
+
+    for (size_t i = 0; i < sim->num_fds; ++i) {
+        struct sim_pipe *pipe = sim->pipes[i];
+        if (!pipe) continue;
+
+        salloc(0, pipe->buf);
+        salloc(0, pipe->rxbuf);
+        salloc(0, pipe);
+    }
+
+    salloc(0, sim->watches);
+    salloc(0, sim->pipes);
+    salloc(0, sim);
+}
+
+/* Ensure the tables can be indexed by fd. */
+static void reserve_fds(struct sim_backend *sim, int fd) {
+    size_t needed = (size_t)fd + 1;
+    if (needed <= sim->num_fds) return;
+
+    size_t n = MAX(needed, sim->num_fds * 2);
+    sim->watches = salloc(n * sizeof(struct fd_event *), sim->watches);
+    sim->pipes = salloc(n * sizeof(struct sim_pipe *), sim->pipes);
+    memset(&sim->watches[sim->num_fds], 0,
+           (n - sim->num_fds) * sizeof(struct fd_event *));
+    memset(&sim->pipes[sim->num_fds], 0,
+           (n - sim->num_fds) * sizeof(struct sim_pipe *));
+    sim->num_fds = n;
+}
+
+int sim_add_fd_event_monitor(struct sim_backend *sim, struct fd_event *fdev) {
+    assert(sim);
+    assert(fdev);
+    assert(fdev->fd >= 0);
+
+    /* these read from the fd themselves */
+    if (fdev->evmask & FD_EVENT_DRAIN) {
+        error("FD_EVENT_DRAIN monitors cannot be simulated");
+        return -1;
+    }
+
+    reserve_fds(sim, fdev->fd);
+
+    struct fd_event **watch = &sim->watches[fdev->fd];
+    if (*watch && *watch != fdev) {
+        error("A monitor is already registered for simulated fd %d", fdev->fd);
+        return -1;
+    }
+
+    *watch = fdev;
+    return 0;
+}
+
+int sim_remove_fd_event_monitor(struct sim_backend *sim,
+                                struct fd_event *fdev) {
+    assert(sim);
+    assert(fdev);
+
+    int fd = fdev->fd;
+    if (fd < 0 || (size_t)fd >= sim->num_fds) return 0;
+    if (sim->watches[fd] == fdev) sim->watches[fd] = NULL;
+    return 0;
+}
+
+int sim_write(struct sim_backend *sim, int fd, const void *data, size_t len) {
+    assert(sim);
+    assert(fd >= 0);
+    assert(data || len == 0);
+
+    reserve_fds(sim, fd);
+
+    struct sim_pipe *pipe = sim->pipes[fd];
+    if (!pipe) {
+        pipe = salloc(sizeof(struct sim_pipe), NULL);
+        pipe->fd = fd;
+        sim->pipes[fd] = pipe;
+    }
+
+    if (pipe->closed) return ERROR_INVALIDVALUE;
+
+    if (len == 0) {
+        pipe->closed = true;
+    } else {
+        /* make room: move the unread data to the front first */
+        if (pipe->off > 0 && pipe->len + len > pipe->cap) {
+            memmove(pipe->buf, pipe->buf + pipe->off, pipe->len);
+            pipe->off = 0;
+        }
+
+        if (pipe->len + len > pipe->cap) {
+            pipe->cap = MAX(pipe->len + len, pipe->cap * 2);
+            pipe->buf = salloc(pipe->cap, pipe->buf);
+        }
+
+        memcpy(pipe->buf + pipe->off + pipe->len, data, len);
+        pipe->len += len;
+    }
+
+    if (!pipe->ready) {
+        pipe->ready = true;
+        Dll_pushback(&sim->ready, pipe, link);
+    }
+
+    return ERRORCODE_SUCCESS;
+}
+
+static inline void enqueue(struct evp_handle *handle, struct fd_event *fdev,
+                           uint32_t revents) {
+    bool queued = (fdev->revents != 0);
+    fdev->revents |= revents;
+    if (!queued && fdev->revents) Dll_pushback(&handle->evq, fdev, link);
+}
+
+/*
+ * Queue the next event for the pipe. FD_EVENT_RECV monitors get a buffer's
+ * worth of data, or the EOF once all the data has been passed on; other
+ * monitors are only told the pipe is readable, and the data is dropped. */
+static void feed_monitor(struct evp_handle *handle, struct sim_pipe *pipe,
+                         struct fd_event *fdev) {
+    if (!(fdev->evmask & FD_EVENT_RECV)) {
+        pipe->off = pipe->len = 0;
+        if (pipe->closed) pipe->eof_reported = true;
+        enqueue(handle, fdev, FD_EVENT_READABLE);
+        return;
+    }
+
+    if (pipe->len == 0) {
+        assert(pipe->closed);
+        pipe->eof_reported = true;
+        fdev->rxbuf = NULL;
+        fdev->rxlen = 0;
+        enqueue(handle, fdev, FD_EVENT_RECV);
+        return;
+    }
+
+    if (!pipe->rxbuf) pipe->rxbuf = salloc(EVP_RECV_BUFFER_SIZE, NULL);
+
+    size_t n = MIN(pipe->len, (size_t)EVP_RECV_BUFFER_SIZE);
+    memcpy(pipe->rxbuf, pipe->buf + pipe->off, n);
+    pipe->off += n;
+    pipe->len -= n;
+    if (pipe->len == 0) pipe->off = 0;
+
+    fdev->rxbuf = pipe->rxbuf;
+    fdev->rxlen = n;
+    enqueue(handle, fdev, FD_EVENT_RECV);
+}
+
+static inline bool pipe_drained(const struct sim_pipe *pipe) {
+    return pipe->len == 0 && (!pipe->closed || pipe->eof_reported);
+}
+
+/*
+ * Nothing left to dispatch right now (other than what the pipes hold for fds
+ * without a monitor, which nothing will consume). */
+static inline bool idle(const struct evp_handle *handle, bool fed) {
+    return !fed && !handle->backlog && Dll_empty(&handle->evq) &&
+           Dll_empty(&handle->timers.expired) && !handle->uev_backlog &&
+           uevq_empty(&handle->uevq);
+}
+
+int sim_pump_events(struct sim_backend *sim, struct evp_handle *handle,
+                    bool block) {
+    assert(sim);
+    assert(handle);
+
+    struct sim_pipe *pipe;
+    struct fd_event *fdev;
+    bool fed = false;
+    size_t num_ready = Dll_count(&sim->ready);
+
+    /* NOTE the pipes are rotated through so that each gets its turn */
+    while (num_ready-- > 0) {
+        pipe = Dll_popfront(&sim->ready, struct sim_pipe, link);
+        if (!pipe) break;
+
+        fdev = sim->watches[pipe->fd];
+
+        /* not yet dispatched since the last time round */
+        if (fdev && !fdev->revents) {
+            feed_monitor(handle, pipe, fdev);
+            fed = true;
+        }
+
+        if (pipe_drained(pipe)) {
+            pipe->ready = false;
+            continue;
+        }
+
+        Dll_pushback(&sim->ready, pipe, link);
+    }
+
+    if (!block || !idle(handle, fed)) return 0;
+
+    struct timespec next;
+    if (timer_wheel_next_wakeup(&handle->timers, &next)) {
+        if (timespec_cmp(&next, &handle->vclock) == GT) handle->vclock = next;
+        return 0;
+    }
+
+    /* nothing registered that could ever fire */
+    handle->stop = true;
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef SIM_EVENT_H__
+#define SIM_EVENT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <tarp/event.h>
+
+/*
+ * Simulated backend for the event pump (EVP_BACKEND_SIMULATED); see
+ * sim-event.c fmi. These mirror the os_event_api_handle interface in
+ * event_shared_defs.h and are called from linux-event.c when the simulated
+ * backend is in use.
+ *
+ * sim_write feeds a simulated pipe; see Evp_sim_write.
+ */
+struct sim_backend;
+
+struct sim_backend *sim_backend_new(void);
+void sim_backend_destroy(struct sim_backend *sim);
+
+int sim_add_fd_event_monitor(struct sim_backend *sim, struct fd_event *fdev);
+int sim_remove_fd_event_monitor(struct sim_backend *sim,
+                                struct fd_event *fdev);
+
+int sim_pump_events(struct sim_backend *sim, struct evp_handle *handle,
+                    bool block);
+
+int sim_write(struct sim_backend *sim, int fd, const void *data, size_t len);
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+#include <assert.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tarp/common.h>
+#include <tarp/dllist.h>
+#include <tarp/event.h>
+
+#include "slab_pool.h"
+
+/* slabs are linked together for slab_pool_destroy; the buffers follow */
+struct slab {
+    struct slab *next;
+};
+
+#define ALIGN_UP(n) \
+    (((n) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+static inline size_t cell_size(const struct slab_pool *pool) {
+    return ALIGN_UP(sizeof(struct evp_slice) + pool->bufsz);
+}
+
+static void free_pool(struct slab_pool *pool) {
+    struct slab *slab;
+
+    while ((slab = pool->slabs)) {
+        pool->slabs = slab->next;
+        salloc(0, slab);
+    }
+
+    salloc(0, pool);
+}
+
+/*
+ * Allocate a new slab; put all its buffers but the first on the free list
+ * and return the first one. */
+static struct evp_slice *grow(struct slab_pool *pool) {
+    size_t stride = cell_size(pool);
+    size_t offset = ALIGN_UP(sizeof(struct slab));
+    uint8_t *block = salloc(offset + stride * SLAB_POOL_SLAB_BUFFERS, NULL);
+
+    struct slab *slab = (struct slab *)block;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    struct evp_slice *first = NULL;
+    for (size_t i = 0; i < SLAB_POOL_SLAB_BUFFERS; ++i) {
+        struct evp_slice *slice = (struct evp_slice *)(block + offset + i * stride);
+        slice->pool = pool;
+        slice->data = slab_pool_buffer(slice);
+
+        if (first) Dll_pushback(&pool->free, slice, link);
+        else first = slice;
+    }
+
+    return first;
+}
+
+struct slab_pool *slab_pool_new(size_t bufsz) {
+    assert(bufsz > 0);
+
+    struct slab_pool *pool = salloc(sizeof(struct slab_pool), NULL);
+    pool->bufsz = bufsz;
+    Dll_init(&pool->free, NULL);
+    pool->slabs = NULL;
+    pool->outstanding = 0;
+    pool->orphaned = false;
+
+    return pool;
+}
+
+void slab_pool_destroy(struct slab_pool *pool) {
+    assert(pool);
+
+    if (pool->outstanding > 0) {
+        pool->orphaned = true;
+        return;
+    }
+
+    free_pool(pool);
+}
+
+struct evp_slice *slab_pool_alloc(struct slab_pool *pool) {
+    assert(pool);
+    assert(!pool->orphaned);
+
+    struct evp_slice *slice = Dll_popback(&pool->free, struct evp_slice, link);
+    if (!slice) slice = grow(pool);
+    slice->len = 0;
+    slice->refs = 1;
+    pool->outstanding++;
+
+    return slice;
+}
+
+void slab_pool_release(struct evp_slice *slice) {
+    assert(slice);
+    assert(slice->refs == 0);
+
+    struct slab_pool *pool = slice->pool;
+    assert(pool->outstanding > 0);
+
+    pool->outstanding--;
+    if (pool->orphaned) {
+        if (pool->outstanding == 0) free_pool(pool);
+        return;
+    }
+
+    Dll_pushback(&pool->free, slice, link);
+}
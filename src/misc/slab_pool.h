@@ -0,0 +1,77 @@
+#ifndef SLAB_POOL_H__
+#define SLAB_POOL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tarp/event.h>
+
+/*
+ * Pool of fixed-size buffers for the slices FD_EVENT_DRAIN monitors are
+ * drained into (see Evp_get_fdev_slices).
+ *
+ * Buffers are carved out of slabs of SLAB_POOL_SLAB_BUFFERS buffers at a
+ * time, each buffer directly preceded by its evp_slice header. Released
+ * buffers go onto a free list and are handed out again most recently
+ * released first, i.e. while still warm in the cache. Slabs are only freed
+ * along with the pool.
+ *
+ * The header records the pool the buffer came from, so a slice can be
+ * released without reference to the event pump. This also means the pool
+ * can outlive the event pump: if slices are still outstanding when the pool
+ * is destroyed, it is only freed once the last of them is released.
+ *
+ * NOTE not thread-safe: buffers must be allocated and released by the
+ * thread running the event pump.
+ */
+#define SLAB_POOL_SLAB_BUFFERS 16
+
+/*
+ * (1) The number of buffers currently allocated (i.e. not on the free list).
+ *
+ * (2) Set by slab_pool_destroy if buffers were still outstanding at the
+ * time: the pool is then freed on release of the last one.
+ */
+struct slab_pool {
+    size_t bufsz;
+    struct dllist free;
+    struct slab *slabs;
+    size_t outstanding;                                             /* (1) */
+    bool orphaned;                                                  /* (2) */
+};
+
+/*
+ * Get a new pool of buffers of bufsz bytes each. No slab is allocated
+ * until the first buffer is. */
+struct slab_pool *slab_pool_new(size_t bufsz);
+
+/*
+ * Free the pool and all its slabs, or mark it to be freed when its last
+ * outstanding buffer is released (see above). */
+void slab_pool_destroy(struct slab_pool *pool);
+
+/*
+ * Get a slice with an empty buffer of pool->bufsz bytes (see
+ * slab_pool_buffer), and a reference count of 1. */
+struct evp_slice *slab_pool_alloc(struct slab_pool *pool);
+
+/*
+ * Give the slice back to the pool it came from. Called by
+ * Evp_slice_release when the reference count drops to 0. */
+void slab_pool_release(struct evp_slice *slice);
+
+/* The (writable) buffer of the slice. */
+static inline uint8_t *slab_pool_buffer(struct evp_slice *slice) {
+    return (uint8_t *)(slice + 1);
+}
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif
+
+#endif
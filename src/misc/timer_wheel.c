@@ -0,0 +1,285 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <tarp/common.h>
+#include <tarp/dllist.h>
+#include <tarp/event.h>
+#include <tarp/timeutils.h>
+
+#include "timer_wheel.h"
+
+#define LEVEL_SHIFT(level) ((level)*TIMER_WHEEL_LEVEL_BITS)
+#define SLOT_MASK          ((uint64_t)TIMER_WHEEL_NUM_SLOTS - 1)
+#define TOP_LEVEL          (TIMER_WHEEL_NUM_LEVELS - 1)
+
+static_assert(TIMER_WHEEL_NUM_SLOTS == 64,
+              "pending-slot bitmaps assume 64 slots per level");
+
+static inline uint64_t rotl64(uint64_t v, unsigned n) {
+    n &= 63;
+    return n ? (v << n) | (v >> (64 - n)) : v;
+}
+
+static inline uint64_t rotr64(uint64_t v, unsigned n) {
+    n &= 63;
+    return n ? (v >> n) | (v << (64 - n)) : v;
+}
+
+/* index of least/most significant set bit; v must be non-zero. */
+static inline unsigned lsb64(uint64_t v) {
+    assert(v);
+    return (unsigned)__builtin_ctzll(v);
+}
+
+static inline unsigned msb64(uint64_t v) {
+    assert(v);
+    return 63U - (unsigned)__builtin_clzll(v);
+}
+
+static inline uint64_t timespec2ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * NSECS_PER_SEC + (uint64_t)ts->tv_nsec;
+}
+
+static inline struct timespec ticks2timespec(uint64_t ticks) {
+    uint64_t ns = ticks * TIMER_WHEEL_TICK_NS;
+    struct timespec ts = {.tv_sec = ns / NSECS_PER_SEC,
+                          .tv_nsec = ns % NSECS_PER_SEC};
+    return ts;
+}
+
+/* the tick in which 'now' falls */
+static inline uint64_t current_tick(const struct timespec *now) {
+    return timespec2ns(now) / TIMER_WHEEL_TICK_NS;
+}
+
+/*
+ * The first tick at or after the timer's deadline; or, for a timer with
+ * slack, the latest tick in [deadline, deadline + slack] that is a multiple
+ * of the greatest power of 2 not exceeding the slack -- see (2) in
+ * timer_wheel.h. */
+static inline uint64_t expiration_tick(const struct timer_event *tev) {
+    uint64_t ns = timespec2ns(&tev->tspec);
+    uint64_t tick = ns / TIMER_WHEEL_TICK_NS + (ns % TIMER_WHEEL_TICK_NS != 0);
+    uint64_t slack = (uint64_t)tev->slack_us * NSECS_PER_USEC / TIMER_WHEEL_TICK_NS;
+
+    if (slack > 0) {
+        unsigned granularity = msb64(slack);
+        tick = ((tick + slack) >> granularity) << granularity;
+    }
+
+    return tick;
+}
+
+static inline void
+link_timer(struct timer_event *tev, struct dllist *slot) {
+    Dll_pushback(slot, tev, link);
+    tev->slot = slot;
+}
+
+/*
+ * Link the timer into the slot where it belongs given the current wheel
+ * time. NOTE this does not touch the timer count.
+ *
+ * The level is given by the most significant bit in which the expiration
+ * tick and the current time differ. At that level, the slot index of the
+ * expiration tick is by construction strictly 'ahead' of the slot index of
+ * the current time, and all bits above it are equal: the timer is reached
+ * precisely when the wheel time advances into that slot. */
+static void place_timer(struct timer_wheel *tw, struct timer_event *tev) {
+    uint64_t expires = expiration_tick(tev);
+
+    /* already expired: collect on the next advance */
+    if (expires <= tw->now) expires = tw->now + 1;
+
+    unsigned level = msb64(expires ^ tw->now) / TIMER_WHEEL_LEVEL_BITS;
+    unsigned slot;
+
+    if (level > TOP_LEVEL) {
+        /* beyond the wheel range; park in the top-level slot reached last
+         * and cascade again from there */
+        level = TOP_LEVEL;
+        slot = ((tw->now >> LEVEL_SHIFT(level)) - 1) & SLOT_MASK;
+    } else {
+        slot = (expires >> LEVEL_SHIFT(level)) & SLOT_MASK;
+    }
+
+    link_timer(tev, &tw->slots[level][slot]);
+    tw->pending[level] |= (UINT64_C(1) << slot);
+}
+
+/* Unlink the timer from the wheel slot or expired list it is in. */
+static void unplace_timer(struct timer_wheel *tw, struct timer_event *tev) {
+    assert(tev->slot);
+
+    struct dllist *slot = tev->slot;
+    Dll_popnode(slot, tev, link);
+    tev->slot = NULL;
+
+    if (slot == &tw->expired || !Dll_empty(slot)) return;
+
+    /* slot now empty: clear its pending bit */
+    size_t idx = (size_t)(slot - &tw->slots[0][0]);
+    assert(idx < TIMER_WHEEL_NUM_LEVELS * TIMER_WHEEL_NUM_SLOTS);
+    tw->pending[idx / TIMER_WHEEL_NUM_SLOTS] &=
+      ~(UINT64_C(1) << (idx % TIMER_WHEEL_NUM_SLOTS));
+}
+
+void timer_wheel_init(struct timer_wheel *tw, const struct timespec *now) {
+    assert(tw);
+    assert(now);
+
+    tw->now = current_tick(now);
+    tw->count = 0;
+    memset(tw->pending, 0, sizeof(tw->pending));
+
+    for (unsigned i = 0; i < TIMER_WHEEL_NUM_LEVELS; ++i) {
+        for (unsigned j = 0; j < TIMER_WHEEL_NUM_SLOTS; ++j) {
+            Dll_init(&tw->slots[i][j], NULL);
+        }
+    }
+
+    Dll_init(&tw->expired, NULL);
+}
+
+static void clear_list(struct dllist *list) {
+    struct timer_event *tev;
+    while ((tev = Dll_popfront(list, struct timer_event, link))) {
+        tev->slot = NULL;
+        tev->registered = false;
+    }
+}
+
+void timer_wheel_clear(struct timer_wheel *tw) {
+    assert(tw);
+
+    for (unsigned i = 0; i < TIMER_WHEEL_NUM_LEVELS; ++i) {
+        uint64_t pending = tw->pending[i];
+        while (pending) {
+            clear_list(&tw->slots[i][lsb64(pending)]);
+            pending &= pending - 1;
+        }
+        tw->pending[i] = 0;
+    }
+
+    clear_list(&tw->expired);
+    tw->count = 0;
+}
+
+void timer_wheel_add(struct timer_wheel *tw, struct timer_event *tev) {
+    assert(tw);
+    assert(tev);
+    assert(!tev->slot);
+
+    place_timer(tw, tev);
+    tw->count++;
+}
+
+void timer_wheel_remove(struct timer_wheel *tw, struct timer_event *tev) {
+    assert(tw);
+    assert(tev);
+
+    if (!tev->slot) return;
+
+    unplace_timer(tw, tev);
+    assert(tw->count > 0);
+    tw->count--;
+}
+
+void timer_wheel_advance(struct timer_wheel *tw, const struct timespec *now) {
+    assert(tw);
+    assert(now);
+
+    uint64_t then = tw->now;
+    uint64_t tick = current_tick(now);
+    if (tick <= then) return;
+
+    struct dllist todo = DLLIST_INITIALIZER(NULL);
+    struct timer_event *tev;
+
+    /*
+     * At each level, collect the slots the wheel time moves over, in
+     * chronological order. If the slot index does not change at a given
+     * level, it cannot change at any of the levels above it either. */
+    for (unsigned level = 0; level < TIMER_WHEEL_NUM_LEVELS; ++level) {
+        uint64_t from = then >> LEVEL_SHIFT(level);
+        uint64_t to = tick >> LEVEL_SHIFT(level);
+        if (from == to) break;
+
+        uint64_t span = to - from; /* slots (from, to] are due */
+        uint64_t due = (span >= TIMER_WHEEL_NUM_SLOTS)
+                         ? ~UINT64_C(0)
+                         : rotl64((UINT64_C(1) << span) - 1, from + 1);
+
+        /* rotate such that bit 0 corresponds to the slot after 'from' */
+        due = rotr64(due & tw->pending[level], from + 1);
+
+        while (due) {
+            unsigned slot = (lsb64(due) + from + 1) & SLOT_MASK;
+            due &= due - 1;
+
+            struct dllist *list = &tw->slots[level][slot];
+            while ((tev = Dll_popfront(list, struct timer_event, link))) {
+                link_timer(tev, &todo);
+            }
+
+            tw->pending[level] &= ~(UINT64_C(1) << slot);
+        }
+    }
+
+    tw->now = tick;
+
+    /* expire or cascade everything collected */
+    while ((tev = Dll_popfront(&todo, struct timer_event, link))) {
+        if (expiration_tick(tev) <= tick) {
+            link_timer(tev, &tw->expired);
+        } else {
+            place_timer(tw, tev);
+        }
+    }
+}
+
+struct timer_event *timer_wheel_pop_expired(struct timer_wheel *tw) {
+    assert(tw);
+
+    struct timer_event *tev = Dll_front(&tw->expired, struct timer_event, link);
+    if (tev) timer_wheel_remove(tw, tev);
+    return tev;
+}
+
+bool timer_wheel_next_wakeup(const struct timer_wheel *tw,
+                             struct timespec *tspec) {
+    assert(tw);
+    assert(tspec);
+
+    if (tw->count == 0) return false;
+
+    if (!Dll_empty(&tw->expired)) {
+        *tspec = ticks2timespec(tw->now);
+        return true;
+    }
+
+    uint64_t earliest = UINT64_MAX;
+
+    for (unsigned level = 0; level < TIMER_WHEEL_NUM_LEVELS; ++level) {
+        if (!tw->pending[level]) continue;
+
+        uint64_t idx = tw->now >> LEVEL_SHIFT(level);
+
+        /* distance (in slots at this level) to the first non-empty slot */
+        uint64_t dist = lsb64(rotr64(tw->pending[level], idx + 1)) + 1;
+        uint64_t tick = (idx + dist) << LEVEL_SHIFT(level);
+
+        if (tick < earliest) earliest = tick;
+    }
+
+    assert(earliest != UINT64_MAX);
+    *tspec = ticks2timespec(earliest);
+    return true;
+}
+
+size_t timer_wheel_count(const struct timer_wheel *tw) {
+    assert(tw);
+    return tw->count;
+}
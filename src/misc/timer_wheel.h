@@ -0,0 +1,114 @@
+#ifndef TIMER_WHEEL_H__
+#define TIMER_WHEEL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <tarp/dllist.h>
+#include <tarp/event.h>
+
+/*
+ * Hierarchical timing wheel used by the event pump as its timer store.
+ *
+ * Time is measured in ticks of TIMER_WHEEL_TICK_NS nanoseconds on the
+ * monotonic clock. The wheel consists of TIMER_WHEEL_NUM_LEVELS levels
+ * of TIMER_WHEEL_NUM_SLOTS slots each; each slot at level L spans
+ * TIMER_WHEEL_NUM_SLOTS^L ticks. A timer is linked (via its dlnode) into
+ * the slot at the level where its expiration tick first differs from the
+ * current wheel time. As the wheel time advances, the slots passed over are
+ * emptied: timers that have expired are moved onto the 'expired' list and
+ * the rest cascade down to a lower level, closer to their expiration.
+ *
+ * A per-level bitmap records which slots are non-empty so that advancing
+ * the wheel and finding the next deadline never has to look at empty slots.
+ *
+ * Runtime characteristics:
+ *  - add:        O(1)
+ *  - remove:     O(1)
+ *  - advance:    O(levels + timers moved); each timer is moved at most
+ *                once per level during its lifetime => amortized O(1).
+ *  - next wake:  O(levels)
+ *
+ * (1) Expiration ticks are rounded *up* (i.e. a timer never expires before
+ * its deadline). With the default resolution of 1us, a timer expires at most
+ * 1us after its deadline -- well below the resolution of the timerfd wakeup
+ * anyway. With 8 levels of 64 slots, the wheel covers 2^48 ticks (~8.9
+ * years); timers further out than that are parked in the top level and
+ * simply cascade again when reached.
+ *
+ * (2) A timer may have a slack (see Evp_set_timer_slack_us), i.e. it may
+ * expire anywhere in [deadline, deadline + slack]. Its expiration tick is
+ * then moved to the latest tick in that window that is a multiple of 2^k,
+ * with 2^k the greatest power of 2 not exceeding the slack. Timers with
+ * similar slack whose windows overlap thus tend to get the very same
+ * expiration tick and are expired in one go, on a single wakeup. Since the
+ * bits below k are then 0, such timers also tend to expire straight out of
+ * a higher-level slot, with fewer cascades. Like in (1), a timer never
+ * expires before its deadline.
+ *
+ * NOTE timers expiring in the same call to timer_wheel_advance are put on
+ * the expired list roughly, but not strictly, in order of expiration.
+ */
+#define TIMER_WHEEL_TICK_NS     1000U                            /* (1) */
+#define TIMER_WHEEL_LEVEL_BITS  6U
+#define TIMER_WHEEL_NUM_SLOTS   (1U << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_NUM_LEVELS  8U
+
+struct timer_wheel {
+    uint64_t now;                 /* ticks up to and including this are done */
+    size_t count;                 /* number of timers in the wheel */
+    uint64_t pending[TIMER_WHEEL_NUM_LEVELS];
+    struct dllist slots[TIMER_WHEEL_NUM_LEVELS][TIMER_WHEEL_NUM_SLOTS];
+    struct dllist expired;
+};
+
+/*
+ * Initialize the wheel such that its current time is 'now'. */
+void timer_wheel_init(struct timer_wheel *tw, const struct timespec *now);
+
+/*
+ * Unlink all timers (without invoking their callbacks) and mark them
+ * as unregistered. */
+void timer_wheel_clear(struct timer_wheel *tw);
+
+/*
+ * Add/remove a timer to/from the wheel. tev->tspec must be an absolute
+ * monotonic timepoint. A timer must be removed before it is re-added.
+ * If the deadline is already in the past, the timer will expire on the
+ * next call to timer_wheel_advance. */
+void timer_wheel_add(struct timer_wheel *tw, struct timer_event *tev);
+void timer_wheel_remove(struct timer_wheel *tw, struct timer_event *tev);
+
+/*
+ * Advance the wheel time to 'now', moving all timers that have expired in
+ * the meantime onto the expired list; see timer_wheel_pop_expired. */
+void timer_wheel_advance(struct timer_wheel *tw, const struct timespec *now);
+
+/*
+ * Unlink and return the first timer on the expired list, or NULL if empty.
+ * NOTE timers added while the expired list is being drained are never put
+ * directly on the expired list; they are only collected by a later call to
+ * timer_wheel_advance. This means a timer callback that re-registers its
+ * own timer cannot cause the drain loop to run indefinitely. */
+struct timer_event *timer_wheel_pop_expired(struct timer_wheel *tw);
+
+/*
+ * Populate tspec with the absolute monotonic timepoint at which the wheel
+ * next needs to be advanced: either because a timer expires or because
+ * timers must cascade to a lower level. Return false if the wheel is empty,
+ * in which case tspec is left untouched. */
+bool timer_wheel_next_wakeup(const struct timer_wheel *tw,
+                             struct timespec *tspec);
+
+size_t timer_wheel_count(const struct timer_wheel *tw);
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif
+
+#endif
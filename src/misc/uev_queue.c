@@ -0,0 +1,147 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <tarp/common.h>
+#include <tarp/event.h>
+
+#include "uev_queue.h"
+
+static_assert(UEVQ_POOL_SIZE < UINT32_MAX, "UEVQ_POOL_SIZE too large");
+
+#define FREE_INDEX(free)  ((uint32_t)((free) & UINT32_MAX))
+#define FREE_COUNT(free)  ((uint32_t)((free) >> 32))
+#define MAKE_FREE(count, index) (((uint64_t)(count) << 32) | (index))
+
+static inline bool is_pooled(const struct uevq *q,
+                             const struct user_event *ev) {
+    return ev >= q->pool && ev < q->pool + UEVQ_POOL_SIZE;
+}
+
+void uevq_init(struct uevq *q) {
+    assert(q);
+
+    q->head = NULL;
+    q->pool = salloc(sizeof(struct user_event) * UEVQ_POOL_SIZE, NULL);
+
+    /* node i links to node i+1; indices are stored +1, 0 terminates */
+    for (uint32_t i = 0; i < UEVQ_POOL_SIZE; ++i) {
+        q->pool[i].next_free = (i + 1 < UEVQ_POOL_SIZE) ? i + 2 : 0;
+    }
+    q->free = MAKE_FREE(0, 1);
+}
+
+void uevq_destroy(struct uevq *q) {
+    assert(q);
+
+    struct user_event *ev = uevq_take_all(q);
+    while (ev) {
+        struct user_event *next = ev->next;
+        if (!is_pooled(q, ev)) salloc(0, ev);
+        ev = next;
+    }
+
+    salloc(0, q->pool);
+    q->pool = NULL;
+}
+
+struct user_event *uevq_alloc(struct uevq *q) {
+    assert(q);
+
+    uint64_t free = __atomic_load_n(&q->free, __ATOMIC_ACQUIRE);
+    uint64_t newfree;
+    struct user_event *ev;
+
+    do {
+        uint32_t idx = FREE_INDEX(free);
+        if (idx == 0) return salloc(sizeof(struct user_event), NULL);
+
+        ev = &q->pool[idx - 1];
+
+        /* NOTE the node may have been popped and reused by another thread
+         * in the meantime, in which case the value read here is stale; the
+         * CAS then fails thanks to the counter */
+        uint32_t next = __atomic_load_n(&ev->next_free, __ATOMIC_RELAXED);
+        newfree = MAKE_FREE(FREE_COUNT(free) + 1, next);
+    } while (!__atomic_compare_exchange_n(&q->free,
+                                          &free,
+                                          newfree,
+                                          true,
+                                          __ATOMIC_ACQUIRE,
+                                          __ATOMIC_ACQUIRE));
+
+    return ev;
+}
+
+void uevq_release(struct uevq *q, struct user_event *ev) {
+    assert(q);
+    assert(ev);
+
+    if (!is_pooled(q, ev)) {
+        salloc(0, ev);
+        return;
+    }
+
+    uint32_t idx = (uint32_t)(ev - q->pool) + 1;
+    uint64_t free = __atomic_load_n(&q->free, __ATOMIC_RELAXED);
+    uint64_t newfree;
+
+    do {
+        __atomic_store_n(&ev->next_free, FREE_INDEX(free), __ATOMIC_RELAXED);
+        newfree = MAKE_FREE(FREE_COUNT(free) + 1, idx);
+    } while (!__atomic_compare_exchange_n(&q->free,
+                                          &free,
+                                          newfree,
+                                          true,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+bool uevq_push(struct uevq *q,
+               struct user_event *first,
+               struct user_event *last) {
+    assert(q);
+    assert(first);
+    assert(last);
+
+    /* The stack is LIFO: link the chain in reverse, so that last ends up
+     * closest to the top. */
+    struct user_event *prev = NULL, *ev = first, *next;
+    while (ev != last) {
+        next = ev->next;
+        ev->next = prev;
+        prev = ev;
+        ev = next;
+    }
+
+    struct user_event *head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    last->next = prev;
+    do {
+        first->next = head;
+    } while (!__atomic_compare_exchange_n(&q->head,
+                                          &head,
+                                          last,
+                                          true,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+
+    return head == NULL;
+}
+
+struct user_event *uevq_take_all(struct uevq *q) {
+    assert(q);
+
+    struct user_event *ev = __atomic_exchange_n(&q->head, NULL,
+                                                __ATOMIC_ACQUIRE);
+
+    /* reverse LIFO => FIFO */
+    struct user_event *prev = NULL, *next;
+    while (ev) {
+        next = ev->next;
+        ev->next = prev;
+        prev = ev;
+        ev = next;
+    }
+
+    return prev;
+}
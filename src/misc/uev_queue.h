@@ -0,0 +1,95 @@
+#ifndef UEV_QUEUE_H__
+#define UEV_QUEUE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <tarp/event.h>
+
+/*
+ * Lock-free multi-producer single-consumer queue of user events (see
+ * Evp_push_uev and Evp_post), used by the event pump as its user event queue.
+ *
+ * Producers push onto an intrusive singly-linked stack, with a
+ * compare-and-swap on its head. The consumer takes the entire stack in one
+ * atomic exchange, then reverses it to get FIFO order. IOW neither side ever
+ * blocks the other, and the consumer does a single atomic operation for any
+ * number of events. A whole chain of events can be pushed with a single CAS
+ * as well (see uevq_push).
+ *
+ * The push that finds the queue empty is told so: this is the only one that
+ * needs to wake up the consumer.
+ *
+ * Event nodes come from a pool of UEVQ_POOL_SIZE nodes preallocated with
+ * the queue. The pool's free list is a lock-free stack as well: its head
+ * packs a node index with a counter that is incremented on every update to
+ * prevent ABA. When the pool is exhausted, nodes are allocated on the heap
+ * instead (and freed rather than recycled when released).
+ *
+ * NOTE FIFO order is only guaranteed for events pushed by the same producer.
+ */
+#define UEVQ_POOL_SIZE 1024
+
+/*
+ * A user event (see Evp_push_uev) or, if fn is non-NULL, a call posted
+ * with Evp_post; either way data is the argument. */
+struct user_event {
+    struct user_event *next;
+    uint32_t next_free;       /* see uevq.free */
+    unsigned event_type;
+    post_callback fn;
+    void *data;
+};
+
+/*
+ * (1) Counter in the top 32 bits, 1 + the index in the pool of the first free
+ * node in the bottom 32 bits; 0 if the pool is exhausted.
+ */
+struct uevq {
+    struct user_event *head;
+    uint64_t free;                                                  /* (1) */
+    struct user_event *pool;
+};
+
+void uevq_init(struct uevq *q);
+
+/*
+ * Free all events still in the queue and the pool. The queue must not be
+ * in use by any other thread. */
+void uevq_destroy(struct uevq *q);
+
+/*
+ * Get a node for an event to be pushed / give back one that has been
+ * popped and dispatched. Thread-safe. */
+struct user_event *uevq_alloc(struct uevq *q);
+void uevq_release(struct uevq *q, struct user_event *ev);
+
+/*
+ * Push the chain of events first .. last, linked through their 'next'
+ * pointers, first to last. Thread-safe.
+ * Return true if the queue was empty. */
+bool uevq_push(struct uevq *q, struct user_event *first,
+               struct user_event *last);
+
+/*
+ * Take all the events in the queue, linked through their 'next' pointers,
+ * in the order they were pushed in. NULL if empty. To be called by the
+ * consumer only. */
+struct user_event *uevq_take_all(struct uevq *q);
+
+/*
+ * True if there is nothing to take. Only a snapshot if producers are
+ * pushing concurrently. */
+static inline bool uevq_empty(const struct uevq *q) {
+    return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == NULL;
+}
+
+#ifdef __cplusplus
+}   /* extern "C" */
+#endif
+
+#endif
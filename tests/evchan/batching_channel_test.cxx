@@ -0,0 +1,171 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include <tarp/evchan.hxx>
+
+#include "batching_channel_test.hxx"
+#include "test_utils.hxx"
+
+using namespace std;
+using namespace std::chrono_literals;
+namespace E = tarp::evchan::ts;
+
+namespace {
+struct readable_counter : public E::interfaces::notifier{
+    std::atomic<unsigned> count {0};
+    bool notify(uint32_t states, uint32_t action) override{
+        if ((states & E::chanState::READABLE) && action) count++;
+        return true;
+    }
+};
+}
+
+// Check a batching channel completes batches by count and by deadline, that
+// monitors only hear of complete batches, that the knobs apply at runtime,
+// that it pushes back when backed up, and that recycled vectors are reused.
+// Then stream events from num_producers threads to a blocked consumer, and
+// compare the number of consumer wakeups with that of a trunk.
+bool test_batching_channel(unsigned num_producers, unsigned num_msgs, unsigned batchsz)
+{
+  bool test_passed{true};
+
+  using batch_t = std::vector<unsigned>;
+
+  // by count.
+  {
+    auto chan = std::make_shared<E::batching_channel<unsigned>>(4, 1h);
+    auto readable = std::make_shared<readable_counter>();
+    chan->add_monitor(readable, E::chanState::READABLE);
+
+    for (unsigned i = 0; i < 3; ++i) chan->try_push(i);
+    test_passed &= expect(readable->count == 0 && chan->empty() && chan->pending() == 3, "incomplete batch not readable");
+    test_passed &= expect(!chan->try_get(), "no batch to get");
+
+    chan->try_push(3u);
+    test_passed &= expect(readable->count == 1 && chan->size() == 1 && chan->pending() == 0, "full batch readable");
+    auto batch = chan->try_get();
+    test_passed &= expect(batch && *batch == batch_t{0, 1, 2, 3}, "batch in order");
+
+    // recycled vectors are reused.
+    auto data = batch->data();
+    chan->recycle(std::move(*batch));
+    std::vector<unsigned> input(10);
+    std::iota(input.begin(), input.end(), 0);
+    test_passed &= expect(chan->try_push_n(input.begin(), input.end()) == 10, "batch push");
+    test_passed &= expect(chan->size() == 2 && chan->pending() == 2, "batch push completes batches");
+    auto batches = chan->get_all();
+    test_passed &= expect(batches.size() == 2 && batches[1].data() == data, "recycled vector reused");
+
+    // knobs.
+    chan->set_max_items(2);
+    test_passed &= expect(chan->size() == 1 && chan->pending() == 0, "smaller batch size applies to pending batch");
+    test_passed &= expect(chan->max_items() == 2, "batch size updated");
+    chan->try_get();
+    chan->try_push(0u);
+    chan->set_max_delay(0ms);
+    test_passed &= expect(chan->poll() && chan->size() == 1, "shorter delay applies to pending batch");
+
+    chan->flush();
+    chan->close();
+    test_passed &= expect(!chan->try_push(0u).first && !chan->try_get(), "closed");
+  }
+
+  // by deadline.
+  {
+    E::batching_channel<unsigned> chan(100, 5ms);
+    auto readable = std::make_shared<readable_counter>();
+    chan.add_monitor(readable, E::chanState::READABLE);
+
+    auto start = std::chrono::steady_clock::now();
+    chan.try_push(1u);
+    chan.try_push(2u);
+    test_passed &= expect(chan.next_deadline() && *chan.next_deadline() >= start + 5ms, "deadline from first item");
+    test_passed &= expect(!chan.poll() && readable->count == 0, "not due yet");
+
+    auto batch = chan.try_get_for(1s);
+    auto waited = std::chrono::steady_clock::now() - start;
+    test_passed &= expect(batch && *batch == batch_t{1, 2}, "due batch delivered to blocked reader");
+    test_passed &= expect(waited >= 5ms && waited < 500ms, "delivered when due");
+    test_passed &= expect(readable->count == 1, "one notification per batch");
+    test_passed &= expect(!chan.try_get_for(10ms) && !chan.next_deadline(), "nothing pending");
+  }
+
+  // backed up.
+  {
+    E::batching_channel<unsigned> chan(2, 1h, 1);
+    for (unsigned i = 0; i < 4; ++i) chan.try_push(i);
+    auto [ok, ev] = chan.try_push(4u);
+    test_passed &= expect(!ok && ev && *ev == 4 && chan.pending() == 2, "push fails when backed up");
+    test_passed &= expect(chan.try_get() && chan.size() == 1 && chan.pending() == 0, "read makes room for full batch");
+    test_passed &= expect(chan.try_push(4u).first, "push succeeds after read");
+  }
+
+  // throughput, with a blocked consumer.
+  auto stream = [&](auto &&push, auto &&consume){
+    std::vector<std::thread> producers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < num_producers; ++i){
+      producers.emplace_back([&, i]{
+        for (unsigned j = 0; j < num_msgs; ++j) push(i * num_msgs + j);
+      });
+    }
+
+    std::uint64_t sum = 0, wakeups = 0;
+    consume(sum, wakeups);
+    for (auto &t : producers) t.join();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::uint64_t n = std::uint64_t{num_producers} * num_msgs;
+    return std::make_tuple(sum == n * (n - 1) / 2, wakeups, elapsed.count() / n);
+  };
+
+  const std::uint64_t total = std::uint64_t{num_producers} * num_msgs;
+
+  E::batching_channel<unsigned> batched(batchsz, 1ms, 64);
+  auto [batched_ok, batched_wakeups, batched_ns] = stream(
+    [&](unsigned v){
+      while (!batched.try_push(v).first) std::this_thread::yield();
+    },
+    [&](std::uint64_t &sum, std::uint64_t &wakeups){
+      std::uint64_t received = 0;
+      while (received < total){
+        auto batch = batched.try_get_for(1s);
+        if (!batch) break;
+        ++wakeups;
+        received += batch->size();
+        for (auto v : *batch) sum += v;
+        batched.recycle(std::move(*batch));
+      }
+    });
+  test_passed &= expect(batched_ok, "batched: all events received");
+
+  E::trunk<unsigned> trunk;
+  auto [trunk_ok, trunk_wakeups, trunk_ns] = stream(
+    [&](unsigned v){ trunk.push(v); },
+    [&](std::uint64_t &sum, std::uint64_t &wakeups){
+      for (std::uint64_t i = 0; i < total; ++i){
+        auto v = trunk.get();
+        if (!v) break;
+        ++wakeups;
+        sum += *v;
+      }
+    });
+  test_passed &= expect(trunk_ok, "trunk: all events received");
+
+  char line[160];
+  snprintf(line, sizeof(line), "%-8s: %lu consumer wakeups for %lu events, %.0f ns per event",
+           "trunk", trunk_wakeups, total, trunk_ns);
+  std::cerr << line << std::endl;
+  snprintf(line, sizeof(line), "%-8s: %lu consumer wakeups for %lu events, %.0f ns per event (batches of up to %u)",
+           "batching", batched_wakeups, total, batched_ns, batchsz);
+  std::cerr << line << std::endl;
+
+  batched.close();
+  return test_passed;
+}
@@ -0,0 +1,136 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include <tarp/evchan.hxx>
+#include <tarp/evchan_pump.hxx>
+#include <tarp/event.hxx>
+
+#include "evchan_pump_test.hxx"
+#include "test_utils.hxx"
+
+using namespace std;
+using namespace std::chrono_literals;
+namespace E = tarp::evchan::ts;
+
+// Check channels and aggregators attached to an EventPump are drained in
+// batches on the pump thread: a burst of pushes must produce a single
+// callback (then one per further batch), closing must detach the bridge.
+// Then stream events from num_producers threads through the pump.
+bool test_pump_bridge(unsigned num_producers, unsigned num_msgs, unsigned batchsz)
+{
+  bool test_passed{true};
+
+  auto pump = tarp::make_event_pump();
+
+  // a burst, already pending on attachment.
+  {
+    auto chan = std::make_shared<E::event_channel<unsigned>>(1000, false);
+    std::vector<unsigned> burst(100);
+    std::iota(burst.begin(), burst.end(), 0);
+    chan->try_push_n(burst.begin(), burst.end());
+
+    std::vector<std::size_t> batches;
+    bool closed = false;
+    int rc = tarp::evchan::attach_to_pump(*pump, chan,
+        [&](std::vector<unsigned> &events){
+          if (events.empty()) closed = true;
+          else batches.push_back(events.size());
+          return true;
+        }, 64);
+    test_passed &= expect(rc == ERRORCODE_SUCCESS, "attach");
+
+    pump->run_once();
+    test_passed &= expect(batches == std::vector<std::size_t>({64}), "one callback per batch");
+    pump->run_once();
+    test_passed &= expect(batches == std::vector<std::size_t>({64, 36}), "rest in next batch");
+
+    // no more events => no more callbacks.
+    pump->run_once(1ms);
+    test_passed &= expect(batches.size() == 2, "no spurious callbacks");
+
+    chan->try_push_n(burst.begin(), burst.begin() + 10);
+    chan->try_push_n(burst.begin(), burst.begin() + 10);
+    pump->run_once();
+    test_passed &= expect(batches.size() == 3 && batches.back() == 20, "coalesced wakeup");
+
+    chan->close();
+    pump->run_once();
+    test_passed &= expect(closed, "told of closing");
+  }
+
+  // an aggregator, as one.
+  {
+    auto a = std::make_shared<E::event_aggregator<unsigned, unsigned>>();
+    auto c1 = a->channel(1, 10), c2 = a->channel(2, 10);
+    std::size_t received = 0, calls = 0;
+
+    tarp::evchan::attach_to_pump(*pump, a,
+        [&](std::vector<unsigned> &events){
+          received += events.size();
+          ++calls;
+          return true;
+        }, 64);
+
+    for (unsigned i = 0; i < 5; ++i){
+      c1->try_push(i);
+      c2->try_push(i);
+    }
+    pump->run_once();
+    test_passed &= expect(calls == 1 && received == 10, "aggregator: one callback");
+
+    a->close();
+    pump->run_once();
+    test_passed &= expect(calls == 2, "aggregator: told of closing");
+  }
+
+  // producer threads, no consumer thread.
+  {
+    auto chan = std::make_shared<E::event_channel<std::uint64_t>>(1024, false);
+    std::uint64_t total = std::uint64_t{num_producers} * num_msgs;
+    std::uint64_t received = 0, calls = 0;
+    std::size_t max_batch = 0;
+
+    tarp::evchan::attach_to_pump(*pump, chan,
+        [&](std::vector<std::uint64_t> &events){
+          received += events.size();
+          max_batch = std::max(max_batch, events.size());
+          ++calls;
+          if (received == total) pump->stop();
+          return true;
+        }, batchsz);
+
+    std::vector<std::thread> producers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned p = 0; p < num_producers; ++p){
+      producers.emplace_back([&chan, num_msgs]{
+        for (std::uint64_t i = 0; i < num_msgs; ++i){
+          while (!chan->try_push(i).first){
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+
+    pump->run(10);
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    for (auto &t : producers) t.join();
+
+    test_passed &= expect(received == total, "all events received");
+    test_passed &= expect(max_batch <= batchsz, "batch size respected");
+
+    char line[160];
+    snprintf(line, sizeof(line),
+             "%uP via EventPump: %.0f events/s, %lu callbacks (%.1f events/callback)",
+             num_producers, static_cast<double>(received) / elapsed.count(),
+             calls, calls ? static_cast<double>(received) / static_cast<double>(calls) : 0);
+    std::cerr << line << std::endl;
+  }
+
+  return test_passed;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+bool test_pump_bridge(unsigned num_producers, unsigned num_msgs, unsigned batchsz);
@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
+#include <deque>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
@@ -8,11 +11,16 @@
 #include <tarp/semaphore.hxx>
 #include <thread>
 #include <map>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <tuple>
 
 #include <tarp/evchan.hxx>
 #include <utility>
 
 #include "evchan_test.hxx"
+#include "test_utils.hxx"
 
 using namespace std;
 using namespace std::chrono_literals;
@@ -150,7 +158,7 @@ bool test_chan_monitor(uint32_t num_producers, uint32_t num_consumers,
 
 
   while(std::chrono::steady_clock::now() < deadline){
-    auto evs = mon.wait_until(deadline);
+    const auto &evs = mon.wait_until(deadline);
     //cerr << "\n\nUNBLOCKED\n";
     for (auto [k, mask]: evs){
         //std::cerr << "::chan=" << k << ", events=" << mask << endl;
@@ -247,12 +255,13 @@ bool test_chan_monitor(uint32_t num_producers, uint32_t num_consumers,
 // Create a single sender and receiver and connect them on the same trunk.
 // The sender uses a wtrunk and the receiver uses an trunk.
 // NUM msgs are passed from sender to receiver.
-bool test_chan_interfaces(unsigned num_msgs, unsigned chan_capacity, std::chrono::seconds duration)
+template<typename chan_t>
+static bool run_chan_interfaces(unsigned num_msgs, unsigned chan_capacity, std::chrono::seconds duration)
 {
-    auto channel = make_shared<E::event_channel<unsigned, bool>>(chan_capacity, false);
+    auto channel = make_shared<chan_t>(chan_capacity, false);
 
-    using wchan_type = shared_ptr<decltype(channel)::element_type::wchan_t>;
-    using rchan_type = shared_ptr<decltype(channel)::element_type::rchan_t>;
+    using wchan_type = shared_ptr<typename chan_t::wchan_t>;
+    using rchan_type = shared_ptr<typename chan_t::rchan_t>;
 
     uint32_t num_msgs_received = 0;
     
@@ -321,3 +330,657 @@ bool test_chan_interfaces(unsigned num_msgs, unsigned chan_capacity, std::chrono
 }
 
 
+
+bool test_chan_interfaces(unsigned num_msgs, unsigned chan_capacity, std::chrono::seconds duration)
+{
+    return run_chan_interfaces<E::event_channel<unsigned, bool>>(num_msgs, chan_capacity, duration);
+}
+
+// Check the ring-buffer channel variants: they must behave like an
+// event_channel (capacity, circular mode, monitors, closing) and carry move-only
+// and multi-item payloads.
+bool test_ring_channels(unsigned num_msgs, unsigned chan_capacity, std::chrono::seconds duration)
+{
+    bool test_passed{true};
+
+    // circular: the last 3 events are kept.
+    {
+        E::spsc_channel<unsigned> chan(3, true);
+        for (unsigned i = 0; i < 10; ++i){
+            test_passed &= expect(chan.try_push(i).first, "circular push");
+        }
+        test_passed &= expect(chan.size() == 3, "circular size");
+        auto events = chan.get_all();
+        test_passed &= expect(events == std::deque<unsigned>({7, 8, 9}), "circular contents");
+        test_passed &= expect(chan.empty(), "empty after get_all");
+    }
+
+    // bounded: pushes fail when full and hand back the (move-only) payload.
+    {
+        E::mpsc_channel<std::unique_ptr<unsigned>> chan(2, false);
+        test_passed &= expect(chan.try_push(std::make_unique<unsigned>(1)).first, "push 1");
+        test_passed &= expect(chan.try_push(std::make_unique<unsigned>(2)).first, "push 2");
+        auto [ok, data] = chan.try_push(std::make_unique<unsigned>(3));
+        test_passed &= expect(!ok && data.has_value() && **data == 3, "push into full channel");
+
+        auto first = chan.try_get();
+        test_passed &= expect(first.has_value() && **first == 1, "FIFO order");
+        test_passed &= expect(chan.try_push(std::make_unique<unsigned>(3)).first, "push after get");
+    }
+
+    // level-triggered monitoring, and closing.
+    {
+        E::spsc_channel<unsigned> chan(1, false);
+        E::monitor mon;
+        mon.watch(chan, E::chanState::READABLE, 1);
+
+        test_passed &= expect(mon.wait_for(10ms).empty(), "nothing readable yet");
+        chan.try_push(1);
+        auto evs = mon.wait_for(1s);
+        test_passed &= expect(evs.size() == 1 && evs.front().first == 1 &&
+                              (evs.front().second & E::chanState::READABLE), "readable");
+        chan.try_get();
+        test_passed &= expect(mon.wait_for(10ms).empty(), "no longer readable");
+
+        chan.try_push(2);
+        chan.close();
+        evs = mon.wait_for(1s);
+        test_passed &= expect(!evs.empty() && (evs.front().second & E::chanState::CLOSED), "closed");
+        test_passed &= expect(!chan.try_get().has_value() && chan.empty(), "no reads once closed");
+        test_passed &= expect(!chan.try_push(3).first, "no writes once closed");
+    }
+
+    // blocking producer and consumer woken by notifiers.
+    test_passed &= expect(run_chan_interfaces<E::spsc_channel<unsigned, bool>>(num_msgs, chan_capacity, duration),
+                          "spsc interfaces");
+    test_passed &= expect(run_chan_interfaces<E::mpsc_channel<unsigned, bool>>(num_msgs, chan_capacity, duration),
+                          "mpsc interfaces");
+
+    return test_passed;
+}
+
+// num_producers threads each push num_msgs events into the same channel for a
+// single consumer thread to get. The payload encodes the producer and a
+// sequence number, so that the per-producer order can be verified. Return the
+// throughput in events per second, or 0 if any event was lost or reordered.
+template<typename chan_t>
+static double measure_throughput(unsigned num_producers, unsigned num_msgs, unsigned chan_capacity)
+{
+    chan_t chan(chan_capacity, false);
+    std::vector<std::thread> producers;
+    std::vector<uint32_t> next(num_producers, 0);
+    bool in_order = true;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned p = 0; p < num_producers; ++p){
+        producers.emplace_back([&chan, p, num_msgs]{
+            for (uint32_t i = 0; i < num_msgs; ++i){
+                uint64_t event = (uint64_t{p} << 32) | i;
+                while (!chan.try_push(event).first){
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    uint64_t total = uint64_t{num_producers} * num_msgs;
+    for (uint64_t received = 0; received < total;){
+        auto event = chan.try_get();
+        if (!event.has_value()){
+            std::this_thread::yield();
+            continue;
+        }
+
+        auto p = static_cast<uint32_t>(*event >> 32);
+        auto i = static_cast<uint32_t>(*event & 0xffffffff);
+        if (p >= num_producers || i != next[p]++){
+            in_order = false;
+        }
+        ++received;
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    for (auto &t : producers){
+        t.join();
+    }
+
+    return in_order ? static_cast<double>(total) / elapsed.count() : 0;
+}
+
+// Compare the throughput of the mutex-guarded event_channel with that of the
+// ring-buffer variants, for 1, 4 and 8 producers and a single consumer.
+bool bench_chan_throughput(unsigned num_msgs, unsigned chan_capacity)
+{
+    bool test_passed{true};
+
+    auto report = [&](const char *name, unsigned num_producers, double events_per_sec){
+        char line[128];
+        snprintf(line, sizeof(line), "%uP1C %-16s %12.0f events/s",
+                 num_producers, name, events_per_sec);
+        std::cerr << line << std::endl;
+        if (events_per_sec == 0){
+            test_passed = false;
+        }
+    };
+
+    report("event_channel", 1, measure_throughput<E::event_channel<uint64_t>>(1, num_msgs, chan_capacity));
+    report("spsc_channel", 1, measure_throughput<E::spsc_channel<uint64_t>>(1, num_msgs, chan_capacity));
+    report("mpsc_channel", 1, measure_throughput<E::mpsc_channel<uint64_t>>(1, num_msgs, chan_capacity));
+
+    for (unsigned num_producers : {4, 8}){
+        report("event_channel", num_producers,
+               measure_throughput<E::event_channel<uint64_t>>(num_producers, num_msgs, chan_capacity));
+        report("mpsc_channel", num_producers,
+               measure_throughput<E::mpsc_channel<uint64_t>>(num_producers, num_msgs, chan_capacity));
+    }
+
+    return test_passed;
+}
+
+// helper counting the edge notifications received for each channel state.
+struct edge_counter : public E::interfaces::notifier{
+    std::atomic<unsigned> set[8] {};
+    std::atomic<unsigned> cleared[8] {};
+    bool notify(uint32_t states, uint32_t action) override{
+        for (uint32_t s : {E::chanState::READABLE, E::chanState::WRITABLE}){
+            if (states & s){
+                (action ? set[s] : cleared[s])++;
+            }
+        }
+        return true;
+    }
+};
+
+// Check the batch APIs (try_push_n, try_get_n, drain_into) on every kind of
+// channel: each batch must be all-or-as-much-as-fits, in order, and must
+// produce at most one edge notification per state change.
+// Then compare single-event and batched transfer costs.
+bool test_batch_ops(unsigned num_msgs, unsigned batchsz)
+{
+  bool test_passed{true};
+
+  const std::vector<unsigned> input {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  const unsigned R = E::chanState::READABLE, W = E::chanState::WRITABLE;
+
+  {
+    auto chan = std::make_shared<E::event_channel<unsigned>>(8, false);
+    auto edges = std::make_shared<edge_counter>();
+    chan->add_monitor(edges, R | W);
+
+    test_passed &= expect(chan->try_push_n(input.begin(), input.begin() + 5) == 5, "channel: push 5");
+    test_passed &= expect(edges->set[R] == 1, "channel: one readable edge");
+    test_passed &= expect(chan->try_push_n(input.begin() + 5, input.end()) == 3, "channel: push to capacity");
+    test_passed &= expect(edges->cleared[W] == 1, "channel: one writable falling edge");
+
+    std::vector<unsigned> out;
+    test_passed &= expect(chan->try_get_n(std::back_inserter(out), 3) == 3, "channel: get 3");
+    test_passed &= expect(edges->set[W] == 1, "channel: one writable edge");
+    test_passed &= expect(chan->drain_into(out) == 5 && chan->empty(), "channel: drain");
+    test_passed &= expect(edges->cleared[R] == 1, "channel: one readable falling edge");
+    test_passed &= expect(out == std::vector<unsigned>(input.begin(), input.begin() + 8), "channel: in order");
+
+    auto ring = std::make_shared<E::event_channel<unsigned>>(3, true);
+    test_passed &= expect(ring->try_push_n(input.begin(), input.end()) == 10, "ring: push all");
+    out.clear();
+    unsigned last[3];
+    test_passed &= expect(ring->try_get_n(last, 10) == 3 && last[0] == 7 && last[2] == 9, "ring: newest kept");
+
+    chan->close();
+    test_passed &= expect(chan->try_push_n(input.begin(), input.end()) == 0, "channel: closed");
+  }
+
+  {
+    auto chan = std::make_shared<E::spsc_channel<unsigned>>(8, false);
+    auto edges = std::make_shared<edge_counter>();
+    chan->add_monitor(edges, R | W);
+
+    test_passed &= expect(chan->try_push_n(input.begin(), input.end()) == 8, "spsc: push to capacity");
+    test_passed &= expect(edges->set[R] == 1 && edges->cleared[W] == 1, "spsc: one edge each");
+
+    auto rchan = std::static_pointer_cast<E::spsc_channel<unsigned>::rchan_t>(chan);
+    std::vector<unsigned> out;
+    test_passed &= expect(rchan->try_get_n(std::back_inserter(out), 3) == 3, "spsc: get 3");
+    test_passed &= expect(rchan->drain_into(out) == 5, "spsc: drain");
+    test_passed &= expect(edges->cleared[R] == 1 && edges->set[W] == 1, "spsc: one edge each");
+    test_passed &= expect(out == std::vector<unsigned>(input.begin(), input.begin() + 8), "spsc: in order");
+  }
+
+  // unbuffered trunk: batches only go through to waiting peers, of
+  // which there are at most 3 receivers and then 4 senders at any time.
+  {
+    auto trunk = std::make_shared<E::trunk<unsigned>>();
+    std::atomic<unsigned> received {0};
+    std::vector<std::thread> peers;
+
+    for (unsigned i = 0; i < 3; ++i){
+      peers.emplace_back([&]{
+        if (trunk->get().has_value()) ++received;
+      });
+    }
+
+    std::size_t pushed = 0;
+    while (pushed < 3){
+      auto n = trunk->try_push_n(input.begin(), input.end());
+      test_passed &= expect(n <= 3, "trunk: at most one per receiver");
+      pushed += n;
+      std::this_thread::sleep_for(1ms);
+    }
+    for (auto &t : peers) t.join();
+    peers.clear();
+    test_passed &= expect(pushed == 3 && received == 3, "trunk: receivers served");
+
+    for (unsigned i = 0; i < 4; ++i){
+      peers.emplace_back([&trunk, i]{ trunk->push(i); });
+    }
+
+    std::vector<unsigned> out;
+    while (out.size() < 4){
+      trunk->try_get_n(std::back_inserter(out), 1);
+      trunk->drain_into(out);
+      std::this_thread::sleep_for(1ms);
+    }
+    for (auto &t : peers) t.join();
+    std::sort(out.begin(), out.end());
+    test_passed &= expect(out == std::vector<unsigned>({0, 1, 2, 3}), "trunk: senders drained");
+  }
+
+  {
+    E::mpmc_trunk<unsigned> trunk(4);
+    std::vector<unsigned> out;
+    test_passed &= expect(trunk.try_push_n(input.begin(), input.end()) == 4, "mpmc_trunk: push to capacity");
+    test_passed &= expect(trunk.try_get_n(std::back_inserter(out), 2) == 2, "mpmc_trunk: get 2");
+    test_passed &= expect(trunk.drain_into(out) == 2, "mpmc_trunk: drain");
+  }
+
+  {
+    E::event_rstream<unsigned> s(false, 16);
+    auto chan = s.interface().channel();
+    test_passed &= expect(s.try_push_n(input.begin(), input.end()) == 10, "rstream: buffer");
+    s.flush();
+    std::vector<unsigned> out;
+    test_passed &= expect(chan->drain_into(out) == 10 && out == input, "rstream: flushed");
+  }
+
+  {
+    E::event_aggregator<unsigned, unsigned> a;
+    auto c1 = a.channel(1, 10), c2 = a.channel(2, 10);
+    c1->try_push_n(input.begin(), input.begin() + 5);
+    c2->try_push_n(input.begin() + 5, input.end());
+
+    std::vector<unsigned> out;
+    test_passed &= expect(a.try_get_n(std::back_inserter(out), 4) == 4, "aggregator: get 4");
+    test_passed &= expect(std::count_if(out.begin(), out.end(), [](unsigned v){ return v < 5; }) == 2,
+                          "aggregator: fair share");
+    test_passed &= expect(a.drain_into(out) == 6 && out.size() == 10, "aggregator: drain");
+  }
+
+  // single-threaded round trips, per event vs per batch.
+  auto time_transfer = [&](bool batched){
+    E::event_channel<unsigned> chan(batchsz, false);
+    std::vector<unsigned> in(batchsz), out;
+    out.reserve(batchsz);
+    std::uint64_t sum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned sent = 0; sent < num_msgs; sent += batchsz){
+      std::iota(in.begin(), in.end(), sent);
+      out.clear();
+      if (batched){
+        chan.try_push_n(in.begin(), in.end());
+        chan.drain_into(out);
+      } else {
+        for (auto v : in) chan.try_push(v);
+        for (auto ev = chan.try_get(); ev.has_value(); ev = chan.try_get()){
+          out.push_back(*ev);
+        }
+      }
+      for (auto v : out) sum += v;
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+    std::uint64_t n = num_msgs / batchsz * batchsz;
+    test_passed &= expect(sum == n * (n - 1) / 2, "transfer: all events received");
+    return elapsed.count() / static_cast<double>(n);
+  };
+
+  double single = time_transfer(false);
+  double batched = time_transfer(true);
+  char line[128];
+  snprintf(line, sizeof(line), "event_channel: %.1f ns/event single, %.1f ns/event in batches of %u",
+           single, batched, batchsz);
+  std::cerr << line << std::endl;
+
+  return test_passed;
+}
+
+// Watch num_chans channels with a single monitor. Make a different subset
+// readable each round: the monitor must report exactly that subset, in the
+// order the channels became readable. Unwatched and re-watched ids must only
+// report their current channel.
+bool test_monitor_scaling(unsigned num_chans, unsigned num_rounds)
+{
+  bool test_passed{true};
+
+  const std::uint32_t base_id = 100 * 1000;
+  std::vector<std::shared_ptr<E::event_channel<unsigned>>> chans;
+  E::monitor mon;
+
+  for (unsigned i = 0; i < num_chans; ++i){
+    chans.push_back(std::make_shared<E::event_channel<unsigned>>(1, false));
+    mon.watch(*chans.back(), E::chanState::READABLE, base_id + i);
+  }
+
+  std::chrono::nanoseconds waited {0};
+  std::size_t num_reported = 0;
+
+  for (unsigned r = 0; r < num_rounds; ++r){
+    std::vector<std::uint32_t> expected;
+    for (unsigned j = 0; j < 1 + r % 64; ++j){
+      unsigned i = (r * 131 + j * 977) % num_chans;
+      if (std::find(expected.begin(), expected.end(), base_id + i) != expected.end()) continue;
+      chans[i]->try_push(r);
+      expected.push_back(base_id + i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const auto &evs = mon.wait_for(1s);
+    waited += std::chrono::steady_clock::now() - start;
+    num_reported += evs.size();
+
+    std::vector<std::uint32_t> reported;
+    for (auto [id, mask] : evs){
+      if (mask & E::chanState::READABLE) reported.push_back(id);
+    }
+    test_passed &= expect(reported == expected, "ready channels reported in order");
+
+    for (auto id : expected){
+      chans[id - base_id]->try_get();
+    }
+    test_passed &= expect(mon.wait_for(0ms).empty(), "nothing left ready");
+  }
+
+  // unwatched: no more reports.
+  for (unsigned i = 0; i < num_chans; i += 2){
+    mon.unwatch(base_id + i);
+  }
+  chans[0]->try_push(1);
+  chans[1]->try_push(1);
+  auto evs = mon.wait_for(1s);
+  test_passed &= expect(evs.size() == 1 && evs.front().first == base_id + 1, "unwatched channel silent");
+  chans[1]->try_get();
+
+  // re-watched: the id now stands for another channel.
+  auto other = std::make_shared<E::event_channel<unsigned>>(1, false);
+  mon.watch(*other, E::chanState::READABLE, base_id + 3);
+  chans[3]->try_push(1);
+  test_passed &= expect(mon.wait_for(10ms).empty(), "old channel of re-watched id silent");
+  other->try_push(1);
+  evs = mon.wait_for(1s);
+  test_passed &= expect(evs.size() == 1 && evs.front().first == base_id + 3, "re-watched id reported");
+
+  char line[128];
+  snprintf(line, sizeof(line), "%u channels: %.0f ns per wait, %.1f ready channels per wait",
+           num_chans, static_cast<double>(waited.count()) / num_rounds,
+           static_cast<double>(num_reported) / num_rounds);
+  std::cerr << line << std::endl;
+
+  return test_passed;
+}
+
+// A conflating channel must keep a single pending event per key, the latest,
+// and hand keys out in the order in which they became pending. Check that
+// against a reference model under random churn (with keys chosen to collide
+// in the index), then compare what a slow consumer gets to process with that
+// of a circular event_channel of the same capacity.
+bool test_conflating_channel(unsigned num_keys, unsigned num_updates)
+{
+  bool test_passed{true};
+
+  using ev_t = std::tuple<unsigned, unsigned>;  // key, sequence number
+  const unsigned R = E::chanState::READABLE, W = E::chanState::WRITABLE;
+
+  {
+    auto chan = std::make_shared<E::conflating_channel<unsigned, unsigned, unsigned>>(4);
+    auto edges = std::make_shared<edge_counter>();
+    chan->add_monitor(edges, R | W);
+
+    for (auto [k, seq] : std::vector<std::pair<unsigned, unsigned>>{{1, 0}, {2, 0}, {1, 1}, {3, 0}, {2, 1}, {1, 2}}){
+      test_passed &= expect(chan->try_push(k, seq).first, "push");
+    }
+    test_passed &= expect(chan->size() == 3 && chan->num_conflated() == 3, "one event per key");
+    test_passed &= expect(edges->set[R] == 1, "one readable edge");
+
+    test_passed &= expect(chan->try_push(4, 0).first, "push to capacity");
+    test_passed &= expect(edges->cleared[W] == 1, "writable falling edge when full");
+    auto [ok, ev] = chan->try_push(5, 0);
+    test_passed &= expect(!ok && ev && std::get<0>(*ev) == 5, "new key rejected when full");
+    test_passed &= expect(chan->try_push(3, 1).first, "pending key updated when full");
+
+    auto all = chan->get_all();
+    test_passed &= expect(all == std::deque<ev_t>{{1, 2}, {2, 1}, {3, 1}, {4, 0}}, "latest values in first-pending order");
+    test_passed &= expect(edges->cleared[R] == 1 && edges->set[W] == 1, "falling readable, rising writable edges");
+
+    // a key that was read is pending anew, at the back.
+    const std::vector<ev_t> batch {{2, 2}, {1, 3}, {2, 3}, {6, 0}, {7, 0}, {8, 0}, {9, 0}};
+    test_passed &= expect(chan->try_push_n(batch.begin(), batch.end()) == 5, "batch push stops when full");
+    std::vector<ev_t> out;
+    test_passed &= expect(chan->try_get_n(std::back_inserter(out), 2) == 2 && chan->drain_into(out) == 2, "batch get");
+    test_passed &= expect(out == std::vector<ev_t>{{2, 3}, {1, 3}, {6, 0}, {7, 0}}, "batch order");
+    test_passed &= expect(edges->set[R] == 2 && edges->cleared[R] == 2, "one edge per batch");
+
+    chan->close();
+    test_passed &= expect(!chan->try_push(1, 0).first && !chan->try_get(), "closed");
+  }
+
+  {
+    struct quote { std::string sym; double px; };
+    E::conflating_channel<std::string, quote> quotes(8, [](const quote &q){ return q.sym; });
+    quotes.try_push(quote{"ABC", 1.0});
+    quotes.try_push(quote{"XYZ", 5.0});
+    quotes.try_push(quote{"ABC", 1.5});
+    auto q = quotes.try_get();
+    test_passed &= expect(q && q->sym == "ABC" && q->px == 1.5 && quotes.size() == 1, "custom key function");
+
+    bool threw = false;
+    try {
+      E::conflating_channel<unsigned, unsigned> nokey(8);
+    } catch (const std::logic_error &){
+      threw = true;
+    }
+    test_passed &= expect(threw, "no key function for non-tuple events");
+  }
+
+  // churn against a reference model. Keys are multiples of 1024 so that
+  // std::hash (the identity) alone would put them all in one bucket.
+  {
+    const unsigned cap = num_keys / 4;
+    E::conflating_channel<unsigned, unsigned, unsigned> chan(cap);
+    std::deque<unsigned> order;
+    std::map<unsigned, unsigned> latest;
+    std::uint64_t state = 42;
+    bool ok = true;
+
+    for (unsigned i = 0; i < num_updates && ok; ++i){
+      state = state * 6364136223846793005ull + 1442695040888963407ull;
+      unsigned r = static_cast<unsigned>(state >> 33);
+      unsigned key = (r % num_keys) * 1024;
+
+      if (r % 3 != 0){
+        bool fits = latest.count(key) || latest.size() < cap;
+        ok = (chan.try_push(key, i).first == fits);
+        if (fits){
+          if (!latest.count(key)) order.push_back(key);
+          latest[key] = i;
+        }
+        continue;
+      }
+
+      auto ev = chan.try_get();
+      if (order.empty()){
+        ok = !ev;
+        continue;
+      }
+      ok = ev && std::get<0>(*ev) == order.front() && std::get<1>(*ev) == latest[order.front()];
+      latest.erase(order.front());
+      order.pop_front();
+    }
+    test_passed &= expect(ok && chan.size() == order.size(), "same as reference model");
+  }
+
+  // A slow consumer that only gets to drain the channel once every num_keys
+  // updates, 90% of which are for 5% of the keys.
+  std::vector<unsigned> seqs(num_keys);
+  std::uint64_t state = 7;
+  auto next_key = [&]{
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    unsigned r = static_cast<unsigned>(state >> 33);
+    return (r % 10 == 0) ? (r / 10) % num_keys : (r / 10) % (num_keys / 20);
+  };
+
+  auto consume = [&](auto &chan, const char *name){
+    std::fill(seqs.begin(), seqs.end(), 0);
+    std::vector<unsigned> seen(num_keys, 0);
+    std::size_t processed = 0, stale = 0;
+
+    auto drain = [&]{
+      while (auto ev = chan.try_get()){
+        auto [k, seq] = *ev;
+        ++processed;
+        if (seq != seqs[k]) ++stale;
+        seen[k] = std::max(seen[k], seq);
+      }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 1; i <= num_updates; ++i){
+      unsigned k = next_key();
+      seqs[k] = i;
+      chan.try_push(k, i);
+      if (i % num_keys == 0) drain();
+    }
+    drain();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::size_t lost = 0;
+    for (unsigned k = 0; k < num_keys; ++k){
+      if (seen[k] != seqs[k]) ++lost;
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "%-10s: %zu events processed, %zu stale, latest value lost for %zu/%u keys; %.0f ns per update",
+             name, processed, stale, lost, num_keys, elapsed.count() / num_updates);
+    std::cerr << line << std::endl;
+    return std::make_pair(processed, std::make_pair(stale, lost));
+  };
+
+  E::event_channel<unsigned, unsigned> circular(num_keys, true);
+  E::conflating_channel<unsigned, unsigned, unsigned> conflating(num_keys);
+  auto [circular_processed, circular_errs] = consume(circular, "circular");
+  auto [processed, errs] = consume(conflating, "conflating");
+  test_passed &= expect(errs.first == 0 && errs.second == 0, "slow consumer sees only the latest values");
+  test_passed &= expect(processed < circular_processed, "slow consumer does less work");
+  (void)circular_errs;
+
+  return test_passed;
+}
+
+// With several consumers taking from an mpmc ring channel fed by a single
+// producer, try_get() must never report the channel empty while events are
+// buffered. Every event pushed (and counted in `pushed`) before a try_get()
+// that returns nullopt must by the time it returns have been taken, either
+// by a consumer that has since counted it in `taken` or by one still busy
+// (counted in `busy`).
+bool test_ring_false_empties(unsigned num_consumers, unsigned num_msgs)
+{
+  E::mpmc_channel<unsigned> chan(64, false);
+
+  std::atomic<std::uint64_t> pushed{0}, taken{0}, false_empties{0};
+  std::atomic<unsigned> busy{0};
+
+  std::vector<std::thread> consumers;
+  for (unsigned i = 0; i < num_consumers; ++i){
+    consumers.emplace_back([&]{
+      while (taken < num_msgs){
+        ++busy;
+        auto p = pushed.load();
+        if (chan.try_get()){
+          ++taken;
+          --busy;
+          continue;
+        }
+        --busy;
+
+        auto b = busy.load();
+        auto t = taken.load();
+        if (p > t + b) ++false_empties;
+      }
+    });
+  }
+
+  for (unsigned i = 0; i < num_msgs; ++i){
+    while (!chan.try_push(i).first) std::this_thread::yield();
+    ++pushed;
+  }
+
+  for (auto &t : consumers) t.join();
+
+  std::cerr << num_msgs << " events taken by " << num_consumers
+            << " consumers, false empties: " << false_empties << std::endl;
+  return taken == num_msgs && false_empties == 0;
+}
+
+// A circular ring channel whose producer keeps overrunning it (discarding
+// the oldest events) while the consumer reads must not look empty to the
+// consumer when it is not. The producer pushes increasing numbers: the
+// newest one pushed before a try_get() can only leave the ring by being
+// taken, since only older ones are discarded; so if the consumer has not
+// received it yet, try_get() must return something.
+//
+// Nor must a push discard more than the one event it makes room for: the
+// push of event i only discards i - capacity, so any event the consumer
+// skips must be at least capacity behind the newest one pushed.
+bool test_ring_circular_overrun(unsigned num_msgs)
+{
+  const unsigned capacity = 4;
+  E::spsc_channel<unsigned> chan(capacity, true);
+
+  std::atomic<unsigned> pushed{0};
+  std::atomic<bool> done{false};
+  std::uint64_t received = 0, false_empties = 0, overdiscards = 0;
+
+  std::thread consumer([&]{
+    std::optional<unsigned> last;
+    while (!done || !chan.empty()){
+      auto p = pushed.load();
+      auto ev = chan.try_get();
+      if (ev){
+        // the pushes done, or under way, are of events up to pushed; so
+        // at most events up to pushed - capacity can have been discarded.
+        if (last && *ev > *last + 1 && *ev - 1 + capacity > pushed.load()){
+          ++overdiscards;
+        }
+        ++received;
+        last = *ev;
+        continue;
+      }
+
+      if (p > 0 && (!last || *last < p - 1)) ++false_empties;
+    }
+  });
+
+  // yield now and then, so the consumer gets to run alongside the
+  // producer even with a single CPU.
+  for (unsigned i = 0; i < num_msgs; ++i){
+    chan.try_push(i);
+    pushed = i + 1;
+    if (i % 16 == 0) std::this_thread::yield();
+  }
+  done = true;
+  consumer.join();
+
+  std::cerr << num_msgs << " events pushed, " << received
+            << " received, false empties: " << false_empties
+            << ", events discarded too early: " << overdiscards << std::endl;
+  return received > 0 && false_empties == 0 && overdiscards == 0;
+}
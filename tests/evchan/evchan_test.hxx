@@ -11,3 +11,17 @@ bool test_chan_monitor(uint32_t num_producers, uint32_t num_consumers,
 
 bool test_chan_interfaces(unsigned num_msgs, unsigned chan_capacity, std::chrono::seconds duration);
  
+
+bool test_ring_channels(unsigned num_msgs, unsigned chan_capacity, std::chrono::seconds duration);
+
+bool bench_chan_throughput(unsigned num_msgs, unsigned chan_capacity);
+
+bool test_batch_ops(unsigned num_msgs, unsigned batchsz);
+
+bool test_monitor_scaling(unsigned num_chans, unsigned num_rounds);
+
+bool test_conflating_channel(unsigned num_keys, unsigned num_updates);
+
+bool test_ring_false_empties(unsigned num_consumers, unsigned num_msgs);
+
+bool test_ring_circular_overrun(unsigned num_msgs);
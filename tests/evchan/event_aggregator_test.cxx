@@ -1,4 +1,5 @@
 #include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
 #include <memory>
@@ -8,6 +9,8 @@
 #include <tarp/evchan.hxx>
 #include <utility>
 
+#include "test_utils.hxx"
+
 using namespace std;
 using namespace std::chrono_literals;
 namespace E = tarp::evchan::ts;
@@ -116,3 +119,122 @@ bool test_event_aggregator(
   return test_passed;
 }
 
+
+// Aggregate num_chans channels, one 'hot' one with a backlog of
+// hot_backlog events and num_cold others with 10 events each. try_get()
+// must serve the readable channels round-robin, so the hot channel only
+// gets its fair share while the others have events. Then time try_get()
+// with one and with all channels readable: neither should depend on
+// num_chans. Channels closed or removed while readable must be skipped.
+bool test_aggregator_fairness(unsigned num_chans, unsigned num_cold, unsigned hot_backlog)
+{
+  using event = std::pair<unsigned, unsigned>;  // channel, seq
+  bool test_passed{true};
+
+  E::event_aggregator<unsigned, event> a;
+  std::vector<decltype(a.channel(0))> chans;
+  for (unsigned i = 0; i < num_chans; ++i){
+    chans.push_back(a.channel(i, hot_backlog));
+  }
+
+  const unsigned hot = num_chans / 2;
+  for (unsigned s = 0; s < hot_backlog; ++s) chans[hot]->try_push(event{hot, s});
+  for (unsigned c = 0; c < num_cold; ++c){
+    unsigned k = (c * 7919) % num_chans;
+    if (k == hot) k = (k + 1) % num_chans;
+    for (unsigned s = 0; s < 10; ++s) chans[k]->try_push(event{k, s});
+  }
+
+  // while cold channels have events, the hot one gets 1 in num_cold+1.
+  std::map<unsigned, unsigned> served;
+  unsigned num_hot = 0;
+  for (unsigned n = 0; n < 10 * (num_cold + 1); ++n){
+    auto ev = a.try_get();
+    if (!ev.has_value()) break;
+    ++served[ev->first];
+    if (ev->first == hot) ++num_hot;
+  }
+  test_passed &= expect(served.size() == num_cold + 1 && num_hot == 10, "round-robin across readable channels");
+  std::cerr << "hot channel served " << num_hot << " of " << 10 * (num_cold + 1)
+            << " events while " << num_cold << " cold channels had events" << std::endl;
+
+  // just the hot backlog left.
+  unsigned rest = 0;
+  while (a.try_get().has_value()) ++rest;
+  test_passed &= expect(rest == hot_backlog - 10, "backlog drained");
+
+  auto time_gets = [&](unsigned num_readable){
+    for (unsigned i = 0; i < num_readable; ++i){
+      for (unsigned s = 0; s < 10; ++s) chans[(i * 7919 + hot) % num_chans]->try_push(event{i, s});
+    }
+    unsigned n = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (a.try_get().has_value()) ++n;
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    test_passed &= expect(n == 10 * num_readable, "all events received");
+    return elapsed.count() / n;
+  };
+
+  double one = time_gets(1);
+  double all = time_gets(num_chans);
+  char line[128];
+  snprintf(line, sizeof(line), "%u channels: %.0f ns per try_get with 1 readable, %.0f ns with all readable",
+           num_chans, one, all);
+  std::cerr << line << std::endl;
+
+  // closed or removed while readable.
+  chans[1]->try_push(event{1, 0});
+  chans[2]->try_push(event{2, 0});
+  chans[3]->try_push(event{3, 0});
+  std::static_pointer_cast<E::event_channel<event>>(chans[1])->close();
+  a.remove(2);
+  auto ev = a.try_get();
+  test_passed &= expect(ev.has_value() && ev->first == 3 && !a.try_get().has_value(), "closed and removed channels skipped");
+
+  return test_passed;
+}
+
+// The monitors of an event_aggregator are told it is closed once its
+// channels are gone; any calls they make back into it must then find it
+// empty rather than look up the channels gone.
+bool test_aggregator_close()
+{
+  using aggregator_t = E::event_aggregator<unsigned, unsigned>;
+
+  struct close_monitor : public E::interfaces::notifier{
+    aggregator_t &a;
+    bool closed {false};
+    bool empty {false};
+
+    explicit close_monitor(aggregator_t &agg) : a(agg) {}
+
+    bool notify(uint32_t states, uint32_t) override{
+      // NOTE readability is notified with the aggregator locked.
+      if (!(states & E::chanState::CLOSED)) return true;
+      closed = true;
+      empty = !a.try_get().has_value() && a.get_all().empty() &&
+              a.channel(0) == nullptr;
+      a.remove(1);
+      return false;
+    }
+  };
+
+  bool test_passed{true};
+  aggregator_t a;
+  for (unsigned i = 0; i < 4; ++i){
+    a.channel(i, 10)->try_push(i);
+  }
+
+  auto mon = std::make_shared<close_monitor>(a);
+  if (a.add_monitor(mon) != E::chanState::READABLE){
+    std::cerr << "aggregator with events not readable" << std::endl;
+    return false;
+  }
+
+  a.close();
+  test_passed = mon->closed && mon->empty && !a.try_get().has_value();
+  std::cerr << "Monitor notified of close: " << mon->closed
+            << ", found aggregator empty: " << mon->empty << std::endl;
+
+  return test_passed;
+}
@@ -10,3 +10,7 @@ bool test_event_aggregator(
         std::chrono::seconds max_wait,
         std::chrono::microseconds producer_period
         );
+
+bool test_aggregator_fairness(unsigned num_chans, unsigned num_cold, unsigned hot_backlog);
+
+bool test_aggregator_close();
@@ -1,4 +1,5 @@
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <iostream>
@@ -6,10 +7,12 @@
 #include <thread>
 #include <map>
 #include <utility>
+#include <vector>
 
 #include <tarp/evchan.hxx>
 
 #include "event_broadcaster_test.hxx"
+#include "test_utils.hxx"
 
 using namespace std;
 using namespace std::chrono_literals;
@@ -135,3 +138,110 @@ bool test_event_broadcaster(
   return test_passed;
 }
 
+
+// Time broadcasting num_events of payload_size bytes to num_subscribers
+// ring-buffer channels, with the given broadcaster type.
+template<typename broadcaster_t, typename channel_t>
+static double time_fanout(unsigned num_subscribers, std::size_t payload_size, unsigned num_events)
+{
+  broadcaster_t br(false);
+  std::vector<std::shared_ptr<channel_t>> channels;
+  for (unsigned i = 0; i < num_subscribers; ++i){
+    channels.push_back(std::make_shared<channel_t>(4, true));
+    br.connect(channels.back());
+  }
+
+  std::vector<char> snapshot(payload_size, 'x');
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < num_events; ++i){
+    br.push(snapshot);
+    br.dispatch();
+  }
+  auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+  return elapsed.count() / num_events;
+}
+
+// A shared_broadcaster must deliver one and the same payload to all
+// subscribers, which must be able to connect while events are being
+// dispatched. Compare the fan-out latency with that of copying the payload.
+bool test_shared_broadcaster(unsigned num_subscribers, unsigned payload_size, unsigned num_events)
+{
+  using payload = std::vector<char>;
+  using shared_channel = E::event_channel<E::shared_event<payload>>;
+  bool test_passed{true};
+
+  {
+    E::shared_broadcaster<payload> br(true);
+    std::vector<std::shared_ptr<shared_channel>> channels;
+    for (unsigned i = 0; i < num_subscribers; ++i){
+      channels.push_back(std::make_shared<shared_channel>(10, false));
+      br.connect(channels.back());
+    }
+
+    br.push(payload(payload_size, 'x'));
+
+    std::vector<E::shared_event<payload>> received;
+    for (auto &chan : channels){
+      auto ev = chan->try_get();
+      if (ev.has_value()) received.push_back(std::move(*ev));
+    }
+
+    bool same = received.size() == num_subscribers;
+    for (auto &ev : received){
+      same = same && ev && ev->size() == payload_size && ev.get() == received[0].get() &&
+             ev.use_count() == num_subscribers;
+    }
+    test_passed &= expect(same, "one payload, shared by all subscribers");
+    received.clear();
+
+    // dead channels are pruned on dispatch.
+    channels.resize(num_subscribers / 2);
+    br.push(payload(1));
+    test_passed &= expect(br.num_channels() == num_subscribers / 2, "dead channels pruned");
+  }
+
+  // subscribers joining while events are being dispatched.
+  {
+    E::shared_broadcaster<payload> br(false);
+    std::atomic<bool> done {false};
+    std::vector<std::shared_ptr<shared_channel>> channels;
+
+    std::thread joiner([&]{
+      for (unsigned i = 0; i < 1000; ++i){
+        channels.push_back(std::make_shared<shared_channel>(1, true));
+        br.connect(channels.back());
+      }
+      done = true;
+    });
+
+    unsigned num_dispatched = 0;
+    while (!done){
+      br.push(payload(16));
+      br.dispatch();
+      ++num_dispatched;
+    }
+    joiner.join();
+
+    br.push(payload(16));
+    br.dispatch();
+    unsigned num_received = 0;
+    for (auto &chan : channels){
+      if (chan->try_get().has_value()) ++num_received;
+    }
+    test_passed &= expect(br.num_channels() == 1000 && num_received == 1000, "concurrent joins");
+    std::cerr << num_dispatched << " dispatches while subscribers joined" << std::endl;
+  }
+
+  double copied = time_fanout<E::event_broadcaster<payload>, E::event_channel<payload>>(
+      num_subscribers, payload_size, num_events);
+  double shared = time_fanout<E::shared_broadcaster<payload>, shared_channel>(
+      num_subscribers, payload_size, num_events);
+
+  char line[160];
+  snprintf(line, sizeof(line),
+           "%u B to %u subscribers: %.2f us per event copied, %.2f us shared",
+           payload_size, num_subscribers, copied, shared);
+  std::cerr << line << std::endl;
+
+  return test_passed;
+}
@@ -8,3 +8,5 @@ bool test_event_broadcaster(
         std::chrono::microseconds broadcast_period,
         uint32_t num_consumers,
         unsigned consumer_buffsz);
+
+bool test_shared_broadcaster(unsigned num_subscribers, unsigned payload_size, unsigned num_events);
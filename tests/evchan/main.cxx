@@ -4,6 +4,8 @@
 
 #include "trunk_test.hxx"
 #include "evchan_test.hxx"
+#include "batching_channel_test.hxx"
+#include "evchan_pump_test.hxx"
 #include "event_broadcaster_test.hxx"
 #include "event_aggregator_test.hxx"
 #include "event_stream_test.hxx"
@@ -41,6 +43,9 @@ int main(int, const char **) {
   run_test(test_try_for_timings);
   run_test(test_trunk_monitor,100, 100, 2000, 10s);
   run_test(test_trunk_interfaces,5000, 2s);
+  run_test(test_mpmc_trunk_timings);
+  run_test(test_mpmc_trunk, 4, 4, 200 * 1000, 1024);
+  run_test(test_mpmc_trunk_no_stall, 2, 4, 200 * 1000);
 
   //run_test(test_benchmark, 2, 20, 100 * 1000 * 1000, 10s);
 
@@ -60,10 +65,21 @@ int main(int, const char **) {
   //to 8 million per second.
   run_test(test_chan_interfaces,1000 * 1000,  500, 10s);
 
+  run_test(test_ring_channels, 1000 * 1000, 500, 1s);
+  run_test(test_ring_false_empties, 4, 1000 * 1000);
+  run_test(test_ring_circular_overrun, 1000 * 1000);
+  run_test(bench_chan_throughput, 1000 * 1000, 1024);
+  run_test(test_batch_ops, 1000 * 1000, 64);
+  run_test(test_pump_bridge, 4, 100 * 1000, 256);
+  run_test(test_monitor_scaling, 4096, 1000);
+  run_test(test_conflating_channel, 1000, 1000 * 1000);
+  run_test(test_batching_channel, 4, 100 * 1000, 64);
+
   //=====================================
   // ===== Test class `event_broadcaster`
   //=====================================
   run_test(test_event_broadcaster, 1000, 10ms, 1 * 1000, 1);
+  run_test(test_shared_broadcaster, 100, 4096, 10 * 1000);
 
   //=====================================
   // ===== Test class `event_aggregator`
@@ -72,6 +88,8 @@ int main(int, const char **) {
   // event being lost whatsoever -- just for the purpose of the test, so
   // it does not fail because of fast senders outpacing the sole receiver.
   run_test(test_event_aggregator, 1000, 500, 1000, 10s, 100us);
+  run_test(test_aggregator_fairness, 10 * 1000, 99, 1000);
+  run_test(test_aggregator_close);
 
   //=======================================
   // ===== Test classes `event_{r,w}stream`
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <iostream>
+
+// Report a failed expectation. The test carries on (e.g. to join its
+// threads) and only fails at the end:
+//     test_passed &= expect(chan.empty(), "channel drained");
+inline bool expect(bool cond, const char *what) {
+    if (!cond) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return cond;
+}
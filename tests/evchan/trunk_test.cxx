@@ -1,5 +1,7 @@
 #include "trunk_test.hxx"
+#include "test_utils.hxx"
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cinttypes>
 #include <cstdio>
@@ -683,7 +685,7 @@ bool test_trunk_monitor(uint32_t num_producers, uint32_t num_consumers,
 
 
   while(std::chrono::steady_clock::now() < deadline){
-    auto evs = mon.wait_until(deadline);
+    const auto &evs = mon.wait_until(deadline);
     //cerr << "\n\nUNBLOCKED\n";
     for (auto [k, mask]: evs){
         //std::cerr << "::chan=" << k << ", events=" << mask << endl;
@@ -837,3 +839,202 @@ bool test_trunk_interfaces(unsigned num_msgs, std::chrono::seconds duration){
     return num_msgs == num_msgs_received;
 }
 
+
+// The timed operations of an mpmc_trunk must wait no longer than asked when
+// they cannot go through, and must go through as soon as they can;
+// close() must unblock waiting senders and receivers straight away.
+bool test_mpmc_trunk_timings() {
+  using CLOCK = std::chrono::steady_clock;
+  constexpr auto TIMEOUT{100ms};
+  constexpr auto OVERHEAD{50ms};
+
+  E::mpmc_trunk<std::unique_ptr<unsigned>> trunk(2);
+  bool test_passed{true};
+
+  auto within = [](auto start, auto min, auto max) {
+    auto elapsed = CLOCK::now() - start;
+    return elapsed >= min && elapsed < max;
+  };
+
+  // nothing to get: time out.
+  auto start = CLOCK::now();
+  test_passed &= expect(!trunk.try_get_for(TIMEOUT).has_value(), "get from empty trunk");
+  test_passed &= expect(within(start, TIMEOUT, TIMEOUT + OVERHEAD), "get timeout");
+
+  // no room: time out, and get the data back.
+  test_passed &= expect(trunk.try_push(std::make_unique<unsigned>(1)).first, "push 1");
+  test_passed &= expect(trunk.push(std::make_unique<unsigned>(2)).first, "push 2");
+  start = CLOCK::now();
+  auto [ok, returned] = trunk.try_push_for(TIMEOUT, std::make_unique<unsigned>(3));
+  test_passed &= expect(!ok && returned.has_value() && **returned == 3, "push into full trunk");
+  test_passed &= expect(within(start, TIMEOUT, TIMEOUT + OVERHEAD), "push timeout");
+
+  // room made midway through the wait: go through then.
+  std::thread consumer([&trunk] {
+    std::this_thread::sleep_for(50ms);
+    trunk.get();
+  });
+  start = CLOCK::now();
+  test_passed &= expect(trunk.try_push_for(1s, std::make_unique<unsigned>(3)).first, "push once room is made");
+  test_passed &= expect(within(start, 50ms, 50ms + OVERHEAD), "push wakeup");
+  consumer.join();
+
+  auto first = trunk.get();
+  test_passed &= expect(first.has_value() && **first == 2, "FIFO order");
+  trunk.get();
+
+  // close() unblocks everyone waiting.
+  std::vector<std::thread> receivers;
+  std::atomic<unsigned> num_closed_gets{0};
+  for (unsigned i = 0; i < 4; ++i) {
+    receivers.emplace_back([&trunk, &num_closed_gets] {
+      if (!trunk.get().has_value()) ++num_closed_gets;
+    });
+  }
+  std::this_thread::sleep_for(50ms);
+  start = CLOCK::now();
+  trunk.close();
+  for (auto &t : receivers) {
+    t.join();
+  }
+  test_passed &= expect(num_closed_gets == 4, "get from closed trunk");
+  test_passed &= expect(within(start, 0ms, OVERHEAD), "close wakeup");
+  test_passed &= expect(!trunk.push(std::make_unique<unsigned>(1)).first, "push into closed trunk");
+
+  return test_passed;
+}
+
+// Pass num_msgs events from each of num_producers to num_consumers through
+// an mpmc_trunk, with blocking push() and get() calls. Every event must be
+// received exactly once, and each consumer must get the events of any one
+// producer in order. For comparison, the same is timed for a trunk.
+bool test_mpmc_trunk(uint32_t num_producers, uint32_t num_consumers,
+        uint32_t num_msgs, uint32_t capacity)
+{
+  auto run = [&](auto &trunk) {
+    std::vector<std::thread> producers;
+    std::vector<std::thread> consumers;
+    std::vector<std::vector<uint32_t>> received(num_consumers,
+            std::vector<uint32_t>(num_producers, 0));
+    bool in_order = true;
+    std::atomic<uint64_t> num_received{0};
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t c = 0; c < num_consumers; ++c) {
+      consumers.emplace_back([&, c] {
+        std::vector<uint32_t> next(num_producers, 0);
+        for (;;) {
+          auto event = trunk.get();
+          if (!event.has_value()) {
+            break;
+          }
+
+          auto p = static_cast<uint32_t>(*event >> 32);
+          auto i = static_cast<uint32_t>(*event & 0xffffffff);
+          if (p >= num_producers || i < next[p]) {
+            in_order = false;
+            continue;
+          }
+          next[p] = i + 1;
+          received[c][p]++;
+          num_received++;
+        }
+      });
+    }
+
+    for (uint32_t p = 0; p < num_producers; ++p) {
+      producers.emplace_back([&trunk, p, num_msgs] {
+        for (uint32_t i = 0; i < num_msgs; ++i) {
+          trunk.push((uint64_t{p} << 32) | i);
+        }
+      });
+    }
+
+    for (auto &t : producers) {
+      t.join();
+    }
+
+    // wait for the consumers to get everything, then stop them.
+    uint64_t expected = uint64_t{num_producers} * num_msgs;
+    auto deadline = start + 30s;
+    for (;;) {
+      std::this_thread::sleep_for(1ms);
+      if (num_received == expected || std::chrono::steady_clock::now() > deadline) {
+        break;
+      }
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    trunk.close();
+    for (auto &t : consumers) {
+      t.join();
+    }
+
+    uint64_t total = 0;
+    bool all_received = true;
+    for (uint32_t p = 0; p < num_producers; ++p) {
+      uint64_t n = 0;
+      for (uint32_t c = 0; c < num_consumers; ++c) {
+        n += received[c][p];
+      }
+      total += n;
+      all_received = all_received && (n == num_msgs);
+    }
+
+    std::cerr << "  " << total << "/" << expected << " events in "
+              << static_cast<unsigned>(elapsed.count() * 1000) << " ms ("
+              << static_cast<uint64_t>(total / elapsed.count()) << " events/s)"
+              << endl;
+
+    return all_received && in_order;
+  };
+
+  std::cerr << num_producers << "P" << num_consumers << "C mpmc_trunk (capacity "
+            << capacity << "):" << endl;
+  E::mpmc_trunk<uint64_t> mpmc(capacity);
+  bool test_passed = run(mpmc);
+
+  std::cerr << num_producers << "P" << num_consumers << "C trunk:" << endl;
+  E::trunk<uint64_t> trunk;
+  test_passed = run(trunk) && test_passed;
+
+  return test_passed;
+}
+
+// Consumers blocked on an mpmc_trunk must not be left parked while events
+// are buffered: with the producers gone, every wait for the events still
+// to be taken must return one well before it times out.
+bool test_mpmc_trunk_no_stall(uint32_t num_producers, uint32_t num_consumers,
+        uint32_t num_msgs)
+{
+  E::mpmc_trunk<uint32_t> trunk(64);
+  const uint64_t total = uint64_t{num_producers} * num_msgs;
+  std::atomic<uint64_t> taken{0}, stalls{0};
+
+  std::vector<std::thread> consumers;
+  for (uint32_t i = 0; i < num_consumers; ++i) {
+    consumers.emplace_back([&] {
+      while (taken < total) {
+        if (trunk.try_get_for(1s)) {
+          ++taken;
+        } else if (taken < total) {
+          ++stalls;
+        }
+      }
+    });
+  }
+
+  std::vector<std::thread> producers;
+  for (uint32_t i = 0; i < num_producers; ++i) {
+    producers.emplace_back([&] {
+      for (uint32_t j = 0; j < num_msgs; ++j) trunk.push(j);
+    });
+  }
+
+  for (auto &t : producers) t.join();
+  for (auto &t : consumers) t.join();
+
+  cerr << total << " events taken by " << num_consumers
+       << " consumers, stalled waits: " << stalls << endl;
+  return taken == total && stalls == 0;
+}
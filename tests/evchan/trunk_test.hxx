@@ -16,3 +16,11 @@ bool test_trunk_monitor(uint32_t num_producers, uint32_t num_consumers,
 
 bool test_trunk_interfaces(unsigned num_msgs, std::chrono::seconds duration);
 
+
+bool test_mpmc_trunk_timings();
+
+bool test_mpmc_trunk(uint32_t num_producers, uint32_t num_consumers,
+        uint32_t num_msgs, uint32_t capacity);
+
+bool test_mpmc_trunk_no_stall(uint32_t num_producers, uint32_t num_consumers,
+        uint32_t num_msgs);
@@ -0,0 +1,492 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <tarp/cohort.h>
+#include <tarp/common.h>
+#include <tarp/event.h>
+#include <tarp/log.h>
+#include <tarp/math.h>
+#include <tarp/timeutils.h>
+
+#include "misc/event_shared_defs.h"
+
+/* only exposed by fcntl.h with _GNU_SOURCE */
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
+#endif
+
+/*
+ * Tests and benchmarks for the OS event backends (epoll, io_uring) of the
+ * C event pump. */
+
+static const char *backend2str(enum evp_backend backend) {
+    switch (backend) {
+    case EVP_BACKEND_EPOLL: return "epoll";
+    case EVP_BACKEND_IO_URING: return "io_uring";
+    default: return "default";
+    }
+}
+
+struct reader {
+    struct fd_event fdev;
+    struct evp_handle *evp;
+    char data[64];
+    size_t len;
+    unsigned calls;
+    bool eof;
+};
+
+/* readiness-based: read one byte at a time to check the callback keeps
+ * being invoked while there is data left (level-triggered) */
+static void readiness_cb(struct fd_event *fdev, int fd, uint32_t events,
+                         void *priv) {
+    UNUSED(events);
+    struct reader *r = priv;
+    assert(fdev == &r->fdev);
+    r->calls++;
+
+    char c;
+    ssize_t rc = read(fd, &c, 1);
+    if (rc == 1 && r->len < sizeof(r->data)) {
+        r->data[r->len++] = c;
+    } else if (rc == 0) {
+        r->eof = true;
+        Evp_unregister_fdmon(r->evp, fdev);
+    }
+}
+
+static void recv_cb(struct fd_event *fdev, int fd, uint32_t events,
+                    void *priv) {
+    UNUSED(fd);
+    struct reader *r = priv;
+    assert(fdev == &r->fdev);
+    r->calls++;
+
+    if (!(events & FD_EVENT_RECV)) return;
+
+    size_t len;
+    const uint8_t *data = Evp_get_fdev_data(fdev, &len);
+
+    if (len == 0) {
+        r->eof = true;
+        Evp_unregister_fdmon(r->evp, fdev);
+        return;
+    }
+
+    assert(data);
+    assert(r->len + len <= sizeof(r->data));
+    memcpy(r->data + r->len, data, len);
+    r->len += len;
+}
+
+struct writer {
+    int fds[3];
+};
+
+static void writer_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    struct writer *w = priv;
+    const char *msg = "hello";
+
+    for (size_t i = 0; i < ARRLEN(w->fds); ++i) {
+        ssize_t rc = write(w->fds[i], msg, strlen(msg));
+        UNUSED(rc);
+        close(w->fds[i]);
+    }
+}
+
+static bool check_reader(const struct reader *r, const char *what) {
+    if (r->len != 5 || memcmp(r->data, "hello", 5) != 0 || !r->eof) {
+        debug("%s: got %zu bytes ('%.*s'), eof=%s", what, r->len,
+              (int)r->len, r->data, bool2str(r->eof));
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Data written to the monitored fds must be delivered in full followed by
+ * EOF, both for readiness-based monitors and FD_EVENT_RECV monitors on
+ * sockets and on pipes (where io_uring falls back to readiness + read). */
+static enum testStatus test_fdmon(enum evp_backend backend) {
+    struct evp_handle *evp = Evp_new_with_backend(backend);
+    assert(evp);
+    debug("requested %s, got %s", backend2str(backend),
+          backend2str(Evp_get_backend(evp)));
+
+    int pipe_a[2], pipe_c[2], socks[2];
+    if (pipe(pipe_a) || pipe(pipe_c) ||
+        socketpair(AF_UNIX, SOCK_STREAM, 0, socks)) {
+        return TEST_FAIL;
+    }
+
+    struct reader a = {.evp = evp}, b = {.evp = evp}, c = {.evp = evp};
+
+    Evp_init_fdmon(&a.fdev, pipe_a[0], FD_EVENT_READABLE, readiness_cb, &a);
+    Evp_init_fdmon(&b.fdev, socks[0], FD_EVENT_RECV, recv_cb, &b);
+    Evp_init_fdmon(&c.fdev, pipe_c[0], FD_EVENT_RECV, recv_cb, &c);
+    Evp_register_fdmon(evp, &a.fdev);
+    Evp_register_fdmon(evp, &b.fdev);
+    Evp_register_fdmon(evp, &c.fdev);
+
+    struct writer w = {.fds = {pipe_a[1], socks[1], pipe_c[1]}};
+    struct timer_event tev;
+    Evp_init_timer_ms(&tev, 10, writer_cb, &w);
+    Evp_register_timer(evp, &tev);
+
+    Evp_run(evp, 1);
+
+    enum testStatus status = TEST_PASS;
+    if (!check_reader(&a, "pipe (readiness)")) status = TEST_FAIL;
+    if (!check_reader(&b, "socket (recv)")) status = TEST_FAIL;
+    if (!check_reader(&c, "pipe (recv)")) status = TEST_FAIL;
+
+    /* one call per byte, plus eof */
+    if (a.calls != 6) {
+        debug("readiness callback called %u times", a.calls);
+        status = TEST_FAIL;
+    }
+
+    close(pipe_a[0]);
+    close(pipe_c[0]);
+    close(socks[0]);
+    Evp_destroy(&evp);
+    return status;
+}
+
+enum testStatus test_fdmon_epoll(void) {
+    return test_fdmon(EVP_BACKEND_EPOLL);
+}
+
+enum testStatus test_fdmon_io_uring(void) {
+    return test_fdmon(EVP_BACKEND_IO_URING);
+}
+
+struct drainer {
+    struct fd_event fdev;
+    struct evp_handle *evp;
+    struct dllist kept;     /* every other slice, taken off the list */
+    uint8_t *data;
+    size_t len;
+    unsigned calls;
+    size_t max_slices;
+    bool partial;           /* a slice other than the last not full */
+    bool eof;
+};
+
+static void drain_cb(struct fd_event *fdev, int fd, uint32_t events,
+                     void *priv) {
+    UNUSED(fd);
+    UNUSED(events);
+    struct drainer *d = priv;
+    struct evp_slice *slice;
+    size_t i = 0;
+
+    d->calls++;
+    struct dllist *slices = Evp_get_fdev_slices(fdev, &d->eof);
+    size_t count = Dll_count(slices);
+    d->max_slices = MAX(d->max_slices, count);
+
+    Dll_foreach(slices, slice, struct evp_slice, link) {
+        if (i + 1 < count && slice->len != EVP_DRAIN_SLICE_SIZE) {
+            d->partial = true;
+        }
+
+        memcpy(d->data + d->len, slice->data, slice->len);
+        d->len += slice->len;
+
+        /* shared, then let go of again */
+        Evp_slice_ref(slice);
+        Evp_slice_release(slice);
+
+        if (i++ % 2 == 0) {
+            Dll_popnode(slices, slice, link);
+            Dll_pushback(&d->kept, slice, link);
+        }
+    }
+
+    if (d->eof) Evp_unregister_fdmon(d->evp, fdev);
+}
+
+/*
+ * FD_EVENT_DRAIN monitors must be handed all the data, in order, in full
+ * slices but for the last; no more than EVP_DRAIN_MAX_SLICES at a time.
+ * Slices must go back to the pool once released, whether by the event
+ * pump or by the user, before or after the event pump is destroyed. */
+static enum testStatus test_fdmon_drain(enum evp_backend backend) {
+    enum testStatus status = TEST_PASS;
+    struct evp_handle *evp = Evp_new_with_backend(backend);
+    struct drainer d = {.evp = evp};
+    struct evp_slice *slice;
+    int fds[2];
+
+    /* enough to need more than one callback invocation */
+    size_t len = EVP_DRAIN_SLICE_SIZE * EVP_DRAIN_MAX_SLICES * 3 / 2;
+    uint8_t *data = salloc(len, NULL);
+    for (size_t i = 0; i < len; ++i) data[i] = (uint8_t)(i * 7 + i / 251);
+
+    d.data = salloc(len, NULL);
+    Dll_init(&d.kept, NULL);
+
+    if (pipe(fds) != 0) return TEST_FAIL;
+    if (fcntl(fds[1], F_SETPIPE_SZ, (int)len) < (int)len) {
+        debug("cannot grow pipe to %zu bytes; draining less", len);
+        len = (size_t)fcntl(fds[1], F_GETPIPE_SZ);
+    }
+
+    if (write(fds[1], data, len) != (ssize_t)len) return TEST_FAIL;
+    close(fds[1]);
+
+    Evp_init_fdmon(&d.fdev, fds[0], FD_EVENT_DRAIN, drain_cb, &d);
+    Evp_register_fdmon(evp, &d.fdev);
+    Evp_run(evp, 1);
+
+    debug("%s: %zu bytes in %u calls, up to %zu slices per call",
+          backend2str(Evp_get_backend(evp)), d.len, d.calls, d.max_slices);
+
+    if (d.len != len || memcmp(d.data, data, len) != 0 || !d.eof ||
+        d.partial || d.max_slices > EVP_DRAIN_MAX_SLICES)
+    {
+        status = TEST_FAIL;
+    }
+
+    if (len > EVP_DRAIN_SLICE_SIZE * EVP_DRAIN_MAX_SLICES && d.calls != 2) {
+        status = TEST_FAIL;
+    }
+
+    /* only the slices kept are still out */
+    if (evp->slices->outstanding != Dll_count(&d.kept)) status = TEST_FAIL;
+
+    /* release half the kept slices now, the rest after the pump is gone */
+    size_t n = Dll_count(&d.kept) / 2;
+    while (n-- > 0) {
+        slice = Dll_popfront(&d.kept, struct evp_slice, link);
+        Evp_slice_release(slice);
+    }
+
+    Evp_destroy(&evp);
+    close(fds[0]);
+
+    while ((slice = Dll_popfront(&d.kept, struct evp_slice, link))) {
+        Evp_slice_release(slice);
+    }
+
+    salloc(0, data);
+    salloc(0, d.data);
+    return status;
+}
+
+enum testStatus test_fdmon_drain_epoll(void) {
+    return test_fdmon_drain(EVP_BACKEND_EPOLL);
+}
+
+enum testStatus test_fdmon_drain_io_uring(void) {
+    return test_fdmon_drain(EVP_BACKEND_IO_URING);
+}
+
+/*
+ * Loopback TCP echo benchmark.
+ *
+ * A client thread keeps ECHO_NUM_CONNS connections busy in lockstep: it
+ * sends one ECHO_MSG_LEN message on each, then waits for all of the echoes.
+ * The server is an event pump with one monitor per connection that echoes
+ * back whatever it receives. Only the syscalls made on the server side are
+ * counted: those made by the event loop and those made by the callbacks.
+ */
+#define ECHO_NUM_CONNS       8
+#define ECHO_MSG_LEN         64
+#define ECHO_DURATION_SECS   1.0
+
+struct echo_conn {
+    struct fd_event fdev;
+    uint64_t *num_syscalls;
+};
+
+struct echo_client {
+    int fds[ECHO_NUM_CONNS];
+    uint64_t num_msgs;
+    double elapsed;
+};
+
+static void echo_readiness_cb(struct fd_event *fdev, int fd, uint32_t events,
+                              void *priv) {
+    UNUSED(fdev);
+    UNUSED(events);
+    struct echo_conn *conn = priv;
+    uint8_t buff[EVP_RECV_BUFFER_SIZE];
+
+    ssize_t n = read(fd, buff, sizeof(buff));
+    (*conn->num_syscalls)++;
+    if (n <= 0) return;
+
+    ssize_t rc = write(fd, buff, (size_t)n);
+    (*conn->num_syscalls)++;
+    UNUSED(rc);
+}
+
+static void echo_recv_cb(struct fd_event *fdev, int fd, uint32_t events,
+                         void *priv) {
+    struct echo_conn *conn = priv;
+    if (!(events & FD_EVENT_RECV)) return;
+
+    size_t len;
+    const uint8_t *data = Evp_get_fdev_data(fdev, &len);
+    if (len == 0) return;
+
+    ssize_t rc = write(fd, data, len);
+    (*conn->num_syscalls)++;
+    UNUSED(rc);
+}
+
+static bool read_exactly(int fd, uint8_t *buff, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buff, len);
+        if (n <= 0) return false;
+        buff += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void *echo_client_thread(void *arg) {
+    struct echo_client *client = arg;
+    uint8_t msg[ECHO_MSG_LEN];
+    uint8_t reply[ECHO_MSG_LEN];
+    memset(msg, 'x', sizeof(msg));
+
+    double start = time_now_monotonic_dbs();
+
+    while (time_now_monotonic_dbs() - start < ECHO_DURATION_SECS) {
+        for (size_t i = 0; i < ECHO_NUM_CONNS; ++i) {
+            if (write(client->fds[i], msg, sizeof(msg)) != sizeof(msg)) {
+                return NULL;
+            }
+        }
+
+        for (size_t i = 0; i < ECHO_NUM_CONNS; ++i) {
+            if (!read_exactly(client->fds[i], reply, sizeof(reply))) {
+                return NULL;
+            }
+            client->num_msgs++;
+        }
+    }
+
+    client->elapsed = time_now_monotonic_dbs() - start;
+    return NULL;
+}
+
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/* connect 'n' client sockets to 'n' server sockets over loopback TCP */
+static bool make_connections(int *clients, int *servers, size_t n) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) return false;
+
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(listener, (int)n) ||
+        getsockname(listener, (struct sockaddr *)&addr, &addrlen)) {
+        close(listener);
+        return false;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        clients[i] = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(clients[i], (struct sockaddr *)&addr, sizeof(addr))) {
+            close(listener);
+            return false;
+        }
+        servers[i] = accept(listener, NULL, NULL);
+        set_nodelay(clients[i]);
+        set_nodelay(servers[i]);
+    }
+
+    close(listener);
+    return true;
+}
+
+static bool run_echo_benchmark(enum evp_backend backend, bool use_recv) {
+    struct evp_handle *evp = Evp_new_with_backend(backend);
+    assert(evp);
+
+    struct echo_client client;
+    memset(&client, 0, sizeof(client));
+    int servers[ECHO_NUM_CONNS];
+    if (!make_connections(client.fds, servers, ECHO_NUM_CONNS)) {
+        Evp_destroy(&evp);
+        return false;
+    }
+
+    uint64_t callback_syscalls = 0;
+    struct echo_conn conns[ECHO_NUM_CONNS];
+
+    for (size_t i = 0; i < ECHO_NUM_CONNS; ++i) {
+        conns[i].num_syscalls = &callback_syscalls;
+        Evp_init_fdmon(&conns[i].fdev, servers[i],
+                       use_recv ? FD_EVENT_RECV : FD_EVENT_READABLE,
+                       use_recv ? echo_recv_cb : echo_readiness_cb,
+                       &conns[i]);
+        Evp_register_fdmon(evp, &conns[i].fdev);
+    }
+
+    pthread_t tid;
+    pthread_create(&tid, NULL, echo_client_thread, &client);
+
+    uint64_t loop_syscalls_before = evp->num_syscalls;
+    Evp_run(evp, (int)ECHO_DURATION_SECS + 1);
+    pthread_join(tid, NULL);
+
+    uint64_t loop_syscalls = evp->num_syscalls - loop_syscalls_before;
+    uint64_t total = loop_syscalls + callback_syscalls;
+    double msgs = (double)MAX(client.num_msgs, 1);
+
+    info("echo %-8s (%-9s): %8.0f msgs/s, syscalls/msg: %.2f "
+         "(loop %.2f, callbacks %.2f)",
+         backend2str(Evp_get_backend(evp)),
+         use_recv ? "recv" : "readiness",
+         client.elapsed > 0 ? (double)client.num_msgs / client.elapsed : 0,
+         (double)total / msgs,
+         (double)loop_syscalls / msgs,
+         (double)callback_syscalls / msgs);
+
+    for (size_t i = 0; i < ECHO_NUM_CONNS; ++i) {
+        Evp_unregister_fdmon(evp, &conns[i].fdev);
+        close(servers[i]);
+        close(client.fds[i]);
+    }
+
+    Evp_destroy(&evp);
+    return client.num_msgs > 0;
+}
+
+enum testStatus bench_echo(void) {
+    bool ok = true;
+    ok = run_echo_benchmark(EVP_BACKEND_EPOLL, false) && ok;
+    ok = run_echo_benchmark(EVP_BACKEND_EPOLL, true) && ok;
+    ok = run_echo_benchmark(EVP_BACKEND_IO_URING, false) && ok;
+    ok = run_echo_benchmark(EVP_BACKEND_IO_URING, true) && ok;
+    return ok ? TEST_PASS : TEST_FAIL;
+}
@@ -0,0 +1,437 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tarp/cohort.h>
+#include <tarp/common.h>
+#include <tarp/event.h>
+#include <tarp/log.h>
+#include <tarp/timeutils.h>
+
+#include "misc/event_shared_defs.h"
+
+/*
+ * Tests and benchmarks for the dispatch policy (see Evp_set_dispatch_policy)
+ * of the C event pump. */
+
+#define UEV_TYPE 1
+
+static const enum evp_backend backends[] = {
+    EVP_BACKEND_EPOLL, EVP_BACKEND_IO_URING
+};
+
+static const char *backend2str(enum evp_backend backend) {
+    return (backend == EVP_BACKEND_IO_URING) ? "io_uring" : "epoll";
+}
+
+static void stop_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    Evp_stop(priv);
+}
+
+/*===================================================
+ * user event burst vs fd event
+ *==================================================*/
+struct burst_ctx {
+    struct evp_handle *evp;
+    struct fd_event fdev;
+    struct user_event_watch watch;
+    int pipe[2];
+    unsigned expected;
+    unsigned num_uevs;
+    unsigned uevs_before_fd;  /* user events dispatched before the fd event */
+    bool fd_done;
+};
+
+static void burst_fd_cb(struct fd_event *fdev, int fd, uint32_t events,
+                        void *priv) {
+    UNUSED(events);
+    struct burst_ctx *ctx = priv;
+    char c;
+
+    if (read(fd, &c, 1) != 1) return;
+    ctx->uevs_before_fd = ctx->num_uevs;
+    ctx->fd_done = true;
+    Evp_unregister_fdmon(ctx->evp, fdev);
+    if (ctx->num_uevs == ctx->expected) Evp_stop(ctx->evp);
+}
+
+static void burst_uev_cb(struct user_event_watch *uev, unsigned event_type,
+                         void *data, void *priv) {
+    UNUSED(uev);
+    UNUSED(event_type);
+    UNUSED(data);
+    struct burst_ctx *ctx = priv;
+
+    /* the fd becomes readable right as the burst starts being dispatched */
+    if (ctx->num_uevs++ == 0) {
+        if (write(ctx->pipe[1], "x", 1) != 1) abort();
+    }
+
+    if (ctx->num_uevs == ctx->expected && ctx->fd_done) Evp_stop(ctx->evp);
+}
+
+/*
+ * Return the number of user events out of a burst of num_events that get
+ * dispatched before an fd event that occurs as the burst starts being
+ * dispatched. */
+static unsigned run_burst(enum evp_backend backend,
+                          const struct evp_dispatch_policy *policy,
+                          unsigned num_events) {
+    struct burst_ctx ctx = {.evp = Evp_new_with_backend(backend),
+                            .expected = num_events};
+    if (pipe(ctx.pipe) != 0) abort();
+
+    Evp_set_dispatch_policy(ctx.evp, policy);
+    Evp_init_fdmon(&ctx.fdev, ctx.pipe[0], FD_EVENT_READABLE, burst_fd_cb, &ctx);
+    Evp_register_fdmon(ctx.evp, &ctx.fdev);
+    Evp_init_uev_watch(&ctx.watch, UEV_TYPE, burst_uev_cb, &ctx);
+    Evp_register_uev_watch(ctx.evp, &ctx.watch);
+
+    for (unsigned i = 0; i < num_events; ++i) {
+        Evp_push_uev(ctx.evp, UEV_TYPE, NULL);
+    }
+    Evp_run(ctx.evp, 5);
+
+    if (ctx.num_uevs != num_events || !ctx.fd_done) {
+        ctx.uevs_before_fd = UINT32_MAX;
+    }
+
+    Evp_unregister_fdmon(ctx.evp, &ctx.fdev);
+    Evp_destroy(&ctx.evp);
+    close(ctx.pipe[0]);
+    close(ctx.pipe[1]);
+    return ctx.uevs_before_fd;
+}
+
+/*===================================================
+ * timer storm
+ *==================================================*/
+#define NUM_TIMERS 100
+
+struct storm_ctx {
+    struct timer_event timers[NUM_TIMERS];
+    unsigned fired;
+};
+
+static void storm_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    struct storm_ctx *ctx = priv;
+    ctx->fired++;
+}
+
+static unsigned run_timer_storm(enum evp_backend backend,
+                                const struct evp_dispatch_policy *policy) {
+    struct evp_handle *evp = Evp_new_with_backend(backend);
+    struct storm_ctx ctx = {.fired = 0};
+    struct timer_event stop;
+
+    Evp_set_dispatch_policy(evp, policy);
+    for (unsigned i = 0; i < NUM_TIMERS; ++i) {
+        Evp_init_timer_ms(&ctx.timers[i], 1, storm_cb, &ctx);
+        Evp_register_timer(evp, &ctx.timers[i]);
+    }
+
+    Evp_init_timer_ms(&stop, 50, stop_cb, evp);
+    Evp_register_timer(evp, &stop);
+    Evp_run(evp, 5);
+
+    Evp_destroy(&evp);
+    return ctx.fired;
+}
+
+/*===================================================
+ * fd events unregistered while queued
+ *==================================================*/
+struct pair_ctx {
+    struct evp_handle *evp;
+    struct fd_event fdev;
+    struct pair_ctx *other;
+    unsigned *calls;
+};
+
+/* whichever is dispatched first unregisters both */
+static void pair_cb(struct fd_event *fdev, int fd, uint32_t events,
+                    void *priv) {
+    UNUSED(fd);
+    UNUSED(events);
+    struct pair_ctx *ctx = priv;
+
+    (*ctx->calls)++;
+    Evp_unregister_fdmon(ctx->evp, fdev);
+    Evp_unregister_fdmon(ctx->evp, &ctx->other->fdev);
+}
+
+static unsigned run_pair(enum evp_backend backend,
+                         const struct evp_dispatch_policy *policy) {
+    struct evp_handle *evp = Evp_new_with_backend(backend);
+    struct pair_ctx a, b;
+    struct timer_event stop;
+    unsigned calls = 0;
+    int p1[2], p2[2];
+
+    if (pipe(p1) != 0 || pipe(p2) != 0) abort();
+    if (write(p1[1], "x", 1) != 1 || write(p2[1], "x", 1) != 1) abort();
+
+    a = (struct pair_ctx){.evp = evp, .other = &b, .calls = &calls};
+    b = (struct pair_ctx){.evp = evp, .other = &a, .calls = &calls};
+
+    Evp_set_dispatch_policy(evp, policy);
+    Evp_init_fdmon(&a.fdev, p1[0], FD_EVENT_READABLE, pair_cb, &a);
+    Evp_init_fdmon(&b.fdev, p2[0], FD_EVENT_READABLE, pair_cb, &b);
+    Evp_register_fdmon(evp, &a.fdev);
+    Evp_register_fdmon(evp, &b.fdev);
+
+    Evp_init_timer_ms(&stop, 50, stop_cb, evp);
+    Evp_register_timer(evp, &stop);
+    Evp_run(evp, 5);
+
+    Evp_destroy(&evp);
+    close(p1[0]);
+    close(p1[1]);
+    close(p2[0]);
+    close(p2[1]);
+    return calls;
+}
+
+/*
+ * With a budget for user events, an fd event occurring during a burst of
+ * user events must be dispatched before the burst is over; without one,
+ * only after. Expired timers and fd events beyond their budget must be
+ * carried over to later iterations, and fd events carried over must be
+ * dropped if unregistered in the meantime. */
+enum testStatus test_dispatch_budgets(void) {
+    const unsigned num_events = 1000;
+    enum testStatus status = TEST_PASS;
+
+    struct evp_dispatch_policy policy;
+    memset(&policy, 0, sizeof(policy));
+    policy.budget[EVP_CLASS_TIMER].max_events = 1;
+    policy.budget[EVP_CLASS_FD].max_events = 1;
+    policy.budget[EVP_CLASS_USER].max_events = 16;
+
+    for (size_t i = 0; i < ARRLEN(backends); ++i) {
+        const char *name = backend2str(backends[i]);
+
+        unsigned unbudgeted = run_burst(backends[i], NULL, num_events);
+        unsigned budgeted = run_burst(backends[i], &policy, num_events);
+        debug("[%s] user events dispatched before the fd event: "
+              "%u without budget, %u with", name, unbudgeted, budgeted);
+
+        if (unbudgeted != num_events) status = TEST_FAIL;
+        if (budgeted > num_events / 2) status = TEST_FAIL;
+
+        unsigned fired = run_timer_storm(backends[i], &policy);
+        debug("[%s] timers fired: %u/%u", name, fired, NUM_TIMERS);
+        if (fired != NUM_TIMERS) status = TEST_FAIL;
+
+        unsigned calls = run_pair(backends[i], NULL);
+        unsigned calls_budgeted = run_pair(backends[i], &policy);
+        debug("[%s] unregistered fd events dispatched: %u without budget, "
+              "%u with", name, calls - 1, calls_budgeted - 1);
+        if (calls != 1 || calls_budgeted != 1) status = TEST_FAIL;
+    }
+
+    return status;
+}
+
+/*===================================================
+ * user events pushed from user event callbacks
+ *==================================================*/
+#define CHAIN_LEN 64
+
+struct chain_ctx {
+    struct evp_handle *evp;
+    struct user_event_watch watch;
+    unsigned num_uevs;
+};
+
+/* every user event pushes the next one, until the chain is complete */
+static void chain_uev_cb(struct user_event_watch *uev, unsigned event_type,
+                         void *data, void *priv) {
+    UNUSED(uev);
+    UNUSED(event_type);
+    UNUSED(data);
+    struct chain_ctx *ctx = priv;
+
+    if (++ctx->num_uevs == CHAIN_LEN) {
+        Evp_stop(ctx->evp);
+        return;
+    }
+
+    Evp_push_uev(ctx->evp, UEV_TYPE, NULL);
+}
+
+/*
+ * With a dispatch policy set and user events dispatched first, a user
+ * event pushed from inside a user event callback must still wake up the
+ * event pump, with no other event source to do so. */
+enum testStatus test_dispatch_user_first_wakeup(void) {
+    enum testStatus status = TEST_PASS;
+
+    struct evp_dispatch_policy policy;
+    memset(&policy, 0, sizeof(policy));
+    policy.budget[EVP_CLASS_USER].max_events = 16;
+
+    for (size_t i = 0; i < ARRLEN(backends); ++i) {
+        struct chain_ctx ctx = {.evp = Evp_new_with_backend(backends[i])};
+
+        Evp_set_dispatch_policy(ctx.evp, &policy);
+        ctx.evp->first_class = EVP_CLASS_USER;
+        Evp_init_uev_watch(&ctx.watch, UEV_TYPE, chain_uev_cb, &ctx);
+        Evp_register_uev_watch(ctx.evp, &ctx.watch);
+
+        Evp_push_uev(ctx.evp, UEV_TYPE, NULL);
+        Evp_run(ctx.evp, 1);
+
+        debug("[%s] chained user events dispatched: %u/%u",
+              backend2str(backends[i]), ctx.num_uevs, CHAIN_LEN);
+        if (ctx.num_uevs != CHAIN_LEN) status = TEST_FAIL;
+
+        Evp_unregister_uev_watch(ctx.evp, &ctx.watch);
+        Evp_destroy(&ctx.evp);
+    }
+
+    return status;
+}
+
+/*===================================================
+ * latency benchmark
+ *==================================================*/
+#define MAX_SAMPLES 4096
+
+/*
+ * A recirculating burst of user events (every callback busy-works for
+ * UEV_WORK_US then pushes a new event) keeps the event pump saturated
+ * while a pinger thread writes timestamps into a pipe; the latency of the
+ * fd event is how long each timestamp took to be read. */
+#define BURST_SIZE   2000
+#define UEV_WORK_US  5
+#define PING_US      1000
+#define BENCH_MS     1000
+
+struct latency_ctx {
+    struct evp_handle *evp;
+    struct fd_event fdev;
+    struct user_event_watch watch;
+    int pipe[2];
+    double samples[MAX_SAMPLES];
+    size_t num_samples;
+    uint64_t num_uevs;
+};
+
+static void latency_fd_cb(struct fd_event *fdev, int fd, uint32_t events,
+                          void *priv) {
+    UNUSED(fdev);
+    UNUSED(events);
+    struct latency_ctx *ctx = priv;
+    double sent;
+
+    while (read(fd, &sent, sizeof(sent)) == sizeof(sent)) {
+        if (ctx->num_samples < MAX_SAMPLES) {
+            ctx->samples[ctx->num_samples++] =
+              (time_now_monotonic_dbms() - sent) * 1000;
+        }
+    }
+}
+
+static void latency_uev_cb(struct user_event_watch *uev, unsigned event_type,
+                           void *data, void *priv) {
+    UNUSED(uev);
+    UNUSED(data);
+    struct latency_ctx *ctx = priv;
+
+    double until = time_now_monotonic_dbms() + UEV_WORK_US / 1000.0;
+    while (time_now_monotonic_dbms() < until) {}
+
+    ctx->num_uevs++;
+    Evp_push_uev(ctx->evp, event_type, NULL);
+}
+
+static void *ping(void *arg) {
+    struct latency_ctx *ctx = arg;
+    double end = time_now_monotonic_dbms() + BENCH_MS;
+
+    while (time_now_monotonic_dbms() < end) {
+        double now = time_now_monotonic_dbms();
+        if (write(ctx->pipe[1], &now, sizeof(now)) != sizeof(now)) break;
+        usleep(PING_US);
+    }
+
+    Evp_stop(ctx->evp);
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_latency_bench(const char *name,
+                              const struct evp_dispatch_policy *policy) {
+    struct latency_ctx *ctx = salloc(sizeof(struct latency_ctx), NULL);
+    ctx->evp = Evp_new();
+    if (pipe(ctx->pipe) != 0) abort();
+    fcntl(ctx->pipe[0], F_SETFL, O_NONBLOCK);
+
+    Evp_set_dispatch_policy(ctx->evp, policy);
+    Evp_init_fdmon(&ctx->fdev, ctx->pipe[0], FD_EVENT_READABLE,
+                   latency_fd_cb, ctx);
+    Evp_register_fdmon(ctx->evp, &ctx->fdev);
+    Evp_init_uev_watch(&ctx->watch, UEV_TYPE, latency_uev_cb, ctx);
+    Evp_register_uev_watch(ctx->evp, &ctx->watch);
+
+    for (unsigned i = 0; i < BURST_SIZE; ++i) {
+        Evp_push_uev(ctx->evp, UEV_TYPE, NULL);
+    }
+
+    pthread_t pinger;
+    pthread_create(&pinger, NULL, ping, ctx);
+    Evp_run(ctx->evp, -1);
+    pthread_join(pinger, NULL);
+
+    qsort(ctx->samples, ctx->num_samples, sizeof(double), cmp_double);
+    size_t n = ctx->num_samples;
+
+    if (n > 0) {
+        info("%-28s fd event latency (us): p50 %8.0f  p99 %8.0f  "
+             "max %8.0f; user events/s: %8.0f",
+             name,
+             ctx->samples[n / 2],
+             ctx->samples[n * 99 / 100],
+             ctx->samples[n - 1],
+             (double)ctx->num_uevs / BENCH_MS * 1000);
+    }
+
+    Evp_unregister_fdmon(ctx->evp, &ctx->fdev);
+    Evp_destroy(&ctx->evp);
+    close(ctx->pipe[0]);
+    close(ctx->pipe[1]);
+    salloc(0, ctx);
+}
+
+/*
+ * Tail latency of fd events while the event pump is saturated with user
+ * events: without a dispatch policy, with an event budget, and with a time
+ * budget for user events. */
+enum testStatus bench_dispatch_latency(void) {
+    struct evp_dispatch_policy policy;
+
+    run_latency_bench("no budget:", NULL);
+
+    memset(&policy, 0, sizeof(policy));
+    policy.budget[EVP_CLASS_USER].max_events = 64;
+    run_latency_bench("user events <= 64/iter:", &policy);
+
+    memset(&policy, 0, sizeof(policy));
+    policy.budget[EVP_CLASS_USER].max_us = 200;
+    run_latency_bench("user events <= 200us/iter:", &policy);
+
+    return TEST_PASS;
+}
@@ -0,0 +1,660 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <poll.h>
+
+#include <tarp/cohort.h>
+#include <tarp/common.h>
+#include <tarp/dllist.h>
+#include <tarp/error.h>
+#include <tarp/event.h>
+#include <tarp/log.h>
+#include <tarp/timeutils.h>
+
+#include "misc/event_shared_defs.h"
+#include "misc/timer_wheel.h"
+
+/*
+ * Tests and benchmarks for the C event pump (tarp/event.h). */
+
+#define NUM_TIMERS              500
+#define MAX_TIMER_INTERVAL_MS   300
+
+struct timer_ctx {
+    struct timer_event tev;
+    unsigned fired;
+    bool early;          /* fired before its deadline */
+    bool cancel_others;  /* unregister every timer in 'others' when fired */
+    struct evp_handle *evp;
+    struct timer_ctx *others;
+    size_t num_others;
+};
+
+static void timer_cb(struct timer_event *tev, void *priv) {
+    struct timer_ctx *ctx = priv;
+    assert(tev == &ctx->tev);
+
+    struct timespec now = time_now_monotonic();
+    if (gt(&tev->tspec, &now, timespec_cmp)) ctx->early = true;
+    ctx->fired++;
+
+    if (ctx->cancel_others) {
+        for (size_t i = 0; i < ctx->num_others; ++i) {
+            Evp_unregister_timer(ctx->evp, &ctx->others[i].tev);
+        }
+    }
+}
+
+/*
+ * Timers with intervals spread across several levels of the timer wheel
+ * must all fire, exactly once, and never before their deadline. */
+enum testStatus test_timers_fire_after_deadline(void) {
+    struct evp_handle *evp = Evp_new();
+    struct timer_ctx *timers = salloc(sizeof(struct timer_ctx) * NUM_TIMERS,
+                                      NULL);
+    srand(1);
+
+    for (size_t i = 0; i < NUM_TIMERS; ++i) {
+        uint32_t us = (uint32_t)(rand() % (MAX_TIMER_INTERVAL_MS * 1000));
+        Evp_init_timer_us(&timers[i].tev, us, timer_cb, &timers[i]);
+        Evp_register_timer(evp, &timers[i].tev);
+    }
+
+    Evp_run(evp, 1);
+
+    enum testStatus status = TEST_PASS;
+    for (size_t i = 0; i < NUM_TIMERS; ++i) {
+        if (timers[i].fired != 1 || timers[i].early) {
+            debug("timer %zu fired %u times (early=%s)",
+                  i,
+                  timers[i].fired,
+                  bool2str(timers[i].early));
+            status = TEST_FAIL;
+            break;
+        }
+    }
+
+    salloc(0, timers);
+    Evp_destroy(&evp);
+    return status;
+}
+
+/*
+ * Timers unregistered before expiration must not fire. This includes
+ * timers unregistered from inside a timer callback that expires at the
+ * same time as them. */
+enum testStatus test_timer_cancellation(void) {
+    struct evp_handle *evp = Evp_new();
+    struct timer_ctx *timers = salloc(sizeof(struct timer_ctx) * NUM_TIMERS,
+                                      NULL);
+
+    struct timer_ctx canceller = {
+        .cancel_others = true,
+        .evp = evp,
+        .others = &timers[NUM_TIMERS / 2],
+        .num_others = NUM_TIMERS / 2,
+    };
+
+    /* all timers expire shortly after the canceller, typically in the
+     * same dispatch pass */
+    Evp_init_timer_ms(&canceller.tev, 50, timer_cb, &canceller);
+    Evp_register_timer(evp, &canceller.tev);
+
+    for (size_t i = 0; i < NUM_TIMERS; ++i) {
+        Evp_init_timer_us(&timers[i].tev, 50 * 1000 + 100, timer_cb,
+                          &timers[i]);
+        Evp_register_timer(evp, &timers[i].tev);
+    }
+
+    /* explicitly cancel every other timer in the first half */
+    for (size_t i = 0; i < NUM_TIMERS / 2; i += 2) {
+        Evp_unregister_timer(evp, &timers[i].tev);
+    }
+
+    Evp_run(evp, 1);
+
+    enum testStatus status = (canceller.fired == 1) ? TEST_PASS : TEST_FAIL;
+    for (size_t i = 0; i < NUM_TIMERS; ++i) {
+        bool cancelled = (i >= NUM_TIMERS / 2) || (i % 2 == 0);
+        if (timers[i].fired != (cancelled ? 0 : 1)) {
+            debug("timer %zu fired %u times", i, timers[i].fired);
+            status = TEST_FAIL;
+            break;
+        }
+    }
+
+    salloc(0, timers);
+    Evp_destroy(&evp);
+    return status;
+}
+
+struct rearm_ctx {
+    struct evp_handle *evp;
+    struct timer_event tev;
+    unsigned count;
+};
+
+static void rearm_cb(struct timer_event *tev, void *priv) {
+    struct rearm_ctx *ctx = priv;
+    ctx->count++;
+    Evp_set_timer_interval_us(tev, 0);
+    Evp_register_timer(ctx->evp, tev);
+}
+
+/*
+ * A timer with a 0 interval that re-registers itself from its own callback
+ * must be called once per loop iteration rather than hang the dispatch. */
+enum testStatus test_timer_rearm_from_callback(void) {
+    struct rearm_ctx ctx = {.evp = Evp_new(), .count = 0};
+
+    Evp_init_timer_us(&ctx.tev, 0, rearm_cb, &ctx);
+    Evp_register_timer(ctx.evp, &ctx.tev);
+    Evp_run(ctx.evp, 1);
+
+    Evp_unregister_timer(ctx.evp, &ctx.tev);
+    Evp_destroy(&ctx.evp);
+
+    debug("rearming timer was called %u times", ctx.count);
+    return (ctx.count > 1) ? TEST_PASS : TEST_FAIL;
+}
+
+static void dummy_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    UNUSED(priv);
+}
+
+#define PERIOD_US 1000
+
+struct periodic_ctx {
+    struct evp_handle *evp;
+    struct timer_event tev;
+    struct timespec deadline;   /* of the next expiration */
+    unsigned calls;
+    unsigned max_calls;
+    unsigned stall_at;          /* stall this call for 5.5 periods */
+    uint32_t overruns;
+    unsigned late;              /* expirations over a period late */
+    bool early;                 /* expired before its deadline */
+    bool drift;                 /* deadlines not whole periods apart */
+};
+
+static void periodic_cb(struct timer_event *tev, void *priv) {
+    struct periodic_ctx *ctx = priv;
+    struct timespec now = time_now_monotonic();
+    double lag_ms = timespec2dbms(&now) - timespec2dbms(&ctx->deadline);
+
+    if (timespec_cmp(&now, &ctx->deadline) == LT) ctx->early = true;
+    if (lag_ms > PERIOD_US / 1000.0) ctx->late++;
+
+    /* the next deadline must already be set, a whole number of periods on */
+    uint32_t overruns = Evp_get_timer_overruns(tev);
+    ctx->overruns += overruns;
+    for (uint32_t i = 0; i <= overruns; ++i) {
+        struct timespec period = {.tv_sec = 0, .tv_nsec = PERIOD_US * NSECS_PER_USEC};
+        timespec_add(&ctx->deadline, &period, &ctx->deadline);
+    }
+    if (timespec_cmp(&ctx->deadline, &tev->tspec) != EQ) ctx->drift = true;
+
+    if (++ctx->calls == ctx->stall_at) usleep(PERIOD_US * 11 / 2);
+
+    if (ctx->calls == ctx->max_calls) {
+        Evp_unregister_timer(ctx->evp, tev);
+        Evp_stop(ctx->evp);
+    }
+}
+
+static enum testStatus run_periodic_timer(enum evp_timer_overrun overrun) {
+    enum testStatus status = TEST_PASS;
+    struct periodic_ctx ctx = {.evp = Evp_new(), .max_calls = 50, .stall_at = 10};
+
+    Evp_init_periodic_timer_us(&ctx.tev, PERIOD_US, overrun, periodic_cb, &ctx);
+    Evp_register_timer(ctx.evp, &ctx.tev);
+    ctx.deadline = ctx.tev.tspec;
+
+    if (Evp_register_timer(ctx.evp, &ctx.tev) != ERROR_INVALIDVALUE) {
+        status = TEST_FAIL;
+    }
+
+    Evp_run(ctx.evp, 5);
+
+    debug("%s: %u calls, %u overruns, %u late",
+          (overrun == EVP_TIMER_SKIP) ? "skip" : "catch-up",
+          ctx.calls, ctx.overruns, ctx.late);
+
+    if (ctx.calls != ctx.max_calls || ctx.early || ctx.drift ||
+        ctx.tev.registered || timer_wheel_count(&ctx.evp->timers) != 0)
+    {
+        status = TEST_FAIL;
+    }
+
+    /* the stall makes for ~5 missed deadlines: skipped (only the deadline
+     * set before the stall is late), or caught up on, late */
+    if (overrun == EVP_TIMER_SKIP && (ctx.overruns < 3 || ctx.late > 2)) {
+        status = TEST_FAIL;
+    }
+    if (overrun == EVP_TIMER_CATCH_UP && (ctx.overruns != 0 || ctx.late < 3)) {
+        status = TEST_FAIL;
+    }
+
+    Evp_destroy(&ctx.evp);
+    return status;
+}
+
+/*
+ * Periodic timers must expire every period, never early, with each deadline
+ * a whole number of periods after the previous one; on overrun they must
+ * skip or catch up on the deadlines missed, according to their policy. */
+enum testStatus test_periodic_timers(void) {
+    enum testStatus status = TEST_PASS;
+    struct evp_handle *evp = Evp_new();
+    struct timer_event tev;
+
+    Evp_init_periodic_timer_us(&tev, 0, EVP_TIMER_SKIP, dummy_cb, NULL);
+    if (Evp_register_timer(evp, &tev) != ERROR_INVALIDVALUE) status = TEST_FAIL;
+    Evp_destroy(&evp);
+
+    if (run_periodic_timer(EVP_TIMER_SKIP) != TEST_PASS) status = TEST_FAIL;
+    if (run_periodic_timer(EVP_TIMER_CATCH_UP) != TEST_PASS) status = TEST_FAIL;
+
+    return status;
+}
+
+struct step_ctx {
+    struct evp_handle *evp;
+    struct fd_event fdev;
+    struct timer_event tev;
+    unsigned fd_calls;
+    unsigned timer_calls;
+};
+
+static void step_fd_cb(struct fd_event *fdev, int fd, uint32_t events,
+                       void *priv) {
+    UNUSED(fdev);
+    UNUSED(events);
+    struct step_ctx *ctx = priv;
+    char c;
+
+    if (read(fd, &c, 1) == 1) ctx->fd_calls++;
+}
+
+static void step_timer_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    struct step_ctx *ctx = priv;
+    ctx->timer_calls++;
+}
+
+/*
+ * Evp_run_once must only poll with a 0 timeout and wait no longer than a
+ * bounded one; it must report the next timer deadline, and the pollfd must
+ * become readable for the pump's events, timers included. */
+enum testStatus test_run_once(void) {
+    struct step_ctx ctx = {.evp = Evp_new()};
+    struct evp_step step;
+    int pipefd[2];
+    double start, elapsed;
+    enum testStatus status = TEST_PASS;
+
+    if (pipe(pipefd) != 0) return TEST_FAIL;
+    Evp_init_fdmon(&ctx.fdev, pipefd[0], FD_EVENT_READABLE, step_fd_cb, &ctx);
+    Evp_register_fdmon(ctx.evp, &ctx.fdev);
+
+    start = time_now_monotonic_dbms();
+    Evp_run_once(ctx.evp, 0, &step);
+    elapsed = time_now_monotonic_dbms() - start;
+    debug("poll: %u events in %.3f ms", step.handled, elapsed);
+    if (step.handled != 0 || step.next_us != -1 || elapsed > 50) {
+        status = TEST_FAIL;
+    }
+
+    start = time_now_monotonic_dbms();
+    Evp_run_once(ctx.evp, 2000, &step);
+    elapsed = time_now_monotonic_dbms() - start;
+    debug("2 ms wait: %u events in %.3f ms", step.handled, elapsed);
+    if (step.handled != 0 || elapsed < 2 || elapsed > 50) status = TEST_FAIL;
+
+    if (write(pipefd[1], "x", 1) != 1) status = TEST_FAIL;
+    Evp_run_once(ctx.evp, 0, &step);
+    if (step.handled != 1 || ctx.fd_calls != 1) status = TEST_FAIL;
+
+    /* nested: wait on the pollfd, as some other loop would */
+    Evp_init_timer_ms(&ctx.tev, 3, step_timer_cb, &ctx);
+    Evp_register_timer(ctx.evp, &ctx.tev);
+    Evp_run_once(ctx.evp, 0, &step);
+    debug("next timer due in %ld us", step.next_us);
+    if (step.next_us <= 0 || step.next_us > 3000) status = TEST_FAIL;
+
+    /* readability may precede expiry (timer wheel cascades): step until due */
+    struct pollfd pfd = {.fd = Evp_get_pollfd(ctx.evp), .events = POLLIN};
+    for (unsigned i = 0; i < 16 && ctx.timer_calls == 0; ++i) {
+        if (poll(&pfd, 1, 1000) != 1) status = TEST_FAIL;
+        Evp_run_once(ctx.evp, 0, &step);
+    }
+    if (ctx.timer_calls != 1 || step.handled != 1 || step.next_us != -1) {
+        status = TEST_FAIL;
+    }
+
+    Evp_stop(ctx.evp);
+    if (poll(&pfd, 1, 1000) != 1) status = TEST_FAIL;
+    Evp_run_once(ctx.evp, 0, &step);
+    if (!step.stop) status = TEST_FAIL;
+    Evp_run_once(ctx.evp, 0, &step);
+    if (step.stop) status = TEST_FAIL;
+
+    Evp_unregister_fdmon(ctx.evp, &ctx.fdev);
+    Evp_destroy(&ctx.evp);
+    close(pipefd[0]);
+    close(pipefd[1]);
+
+    /* the io_uring backend has no pollfd */
+    struct evp_handle *evp = Evp_new_with_backend(EVP_BACKEND_IO_URING);
+    if (Evp_get_backend(evp) == EVP_BACKEND_IO_URING && Evp_get_pollfd(evp) != -1) {
+        status = TEST_FAIL;
+    }
+    Evp_destroy(&evp);
+
+    return status;
+}
+
+static struct timespec ns2timespec(uint64_t ns) {
+    struct timespec ts = {.tv_sec = ns / NSECS_PER_SEC,
+                          .tv_nsec = ns % NSECS_PER_SEC};
+    return ts;
+}
+
+/*
+ * Drive the timer wheel directly with a simulated clock, with deadlines
+ * ranging from microseconds to years away. Every timer must expire in the
+ * first advance that moves the wheel time past its deadline -- no sooner,
+ * no later. */
+enum testStatus test_timer_wheel_simulated_clock(void) {
+    const size_t num_timers = 20 * 1000;
+    struct timer_event *timers =
+      salloc(sizeof(struct timer_event) * num_timers, NULL);
+    struct timer_wheel *tw = salloc(sizeof(struct timer_wheel), NULL);
+
+    uint64_t now = 1000 * NSECS_PER_SEC;
+    struct timespec ts = ns2timespec(now);
+    timer_wheel_init(tw, &ts);
+
+    srand(1);
+    for (size_t i = 0; i < num_timers; ++i) {
+        /* spread deadlines over every level: 1us .. 2^55 ns (~1.1 years) */
+        uint64_t range = UINT64_C(1) << (10 + rand() % 46);
+        uint64_t delta = 1 + (((uint64_t)rand() << 31) ^ (uint64_t)rand()) %
+                               range;
+        Evp_init_timer_us(&timers[i], 0, dummy_cb, NULL);
+        timers[i].tspec = ns2timespec(now + delta);
+        timer_wheel_add(tw, &timers[i]);
+    }
+
+    enum testStatus status = TEST_PASS;
+    size_t num_expired = 0;
+    struct timer_event *tev;
+
+    while (timer_wheel_count(tw) > 0 && status == TEST_PASS) {
+        struct timespec next;
+        if (!timer_wheel_next_wakeup(tw, &next)) break;
+
+        /* advance either exactly to the next wakeup or a random step
+         * beyond it */
+        uint64_t prev = now;
+        now = (uint64_t)next.tv_sec * NSECS_PER_SEC + (uint64_t)next.tv_nsec;
+        if (now < prev) now = prev;
+        if (rand() % 2) now += (uint64_t)(rand() % 5000);
+
+        ts = ns2timespec(now);
+        timer_wheel_advance(tw, &ts);
+
+        while ((tev = timer_wheel_pop_expired(tw))) {
+            ++num_expired;
+            if (gt(&tev->tspec, &ts, timespec_cmp)) {
+                debug("timer expired early");
+                status = TEST_FAIL;
+            }
+        }
+    }
+
+    /* nothing must be left unexpired with a deadline in the past */
+    if (num_expired != num_timers) {
+        debug("expired %zu of %zu timers", num_expired, num_timers);
+        status = TEST_FAIL;
+    }
+
+    salloc(0, tw);
+    salloc(0, timers);
+    return status;
+}
+
+/*
+ * Expire num_timers timers, each with the given slack and a deadline
+ * spread over 'range_ns', driving the wheel from one wakeup to the next
+ * with a simulated clock. Return the number of wakeups it took, or 0 if
+ * any timer expired outside of [deadline, deadline + slack]. */
+static size_t count_wheel_wakeups(size_t num_timers, uint64_t range_ns,
+                                  uint32_t slack_us) {
+    struct timer_event *timers =
+      salloc(sizeof(struct timer_event) * num_timers, NULL);
+    struct timer_wheel *tw = salloc(sizeof(struct timer_wheel), NULL);
+
+    uint64_t now = 1000 * NSECS_PER_SEC;
+    struct timespec ts = ns2timespec(now);
+    timer_wheel_init(tw, &ts);
+
+    srand(1);
+    for (size_t i = 0; i < num_timers; ++i) {
+        uint64_t delta = 1 + (((uint64_t)rand() << 31) ^ (uint64_t)rand()) %
+                               range_ns;
+        Evp_init_timer_us_slack(&timers[i], 0, slack_us, dummy_cb, NULL);
+        timers[i].tspec = ns2timespec(now + delta);
+        timer_wheel_add(tw, &timers[i]);
+    }
+
+    size_t wakeups = 0, num_expired = 0;
+    bool ok = true;
+    struct timer_event *tev;
+
+    while (timer_wheel_count(tw) > 0 && ok) {
+        if (!timer_wheel_next_wakeup(tw, &ts)) break;
+        timer_wheel_advance(tw, &ts);
+        ++wakeups;
+
+        /* slack, plus the rounding up of the deadline to a whole tick */
+        struct timespec latest;
+        struct timespec slack = ns2timespec(
+            (uint64_t)slack_us * NSECS_PER_USEC + TIMER_WHEEL_TICK_NS);
+
+        while ((tev = timer_wheel_pop_expired(tw))) {
+            ++num_expired;
+            timespec_add(&tev->tspec, &slack, &latest);
+            if (gt(&tev->tspec, &ts, timespec_cmp) ||
+                gt(&ts, &latest, timespec_cmp))
+            {
+                debug("timer expired outside its window");
+                ok = false;
+            }
+        }
+    }
+
+    if (num_expired != num_timers) ok = false;
+
+    salloc(0, tw);
+    salloc(0, timers);
+    return ok ? wakeups : 0;
+}
+
+/*
+ * Timers with slack must expire within their window and, with deadlines
+ * this dense, on far fewer wakeups than timers without. */
+enum testStatus test_timer_wheel_slack(void) {
+    const size_t num_timers = 20 * 1000;
+    const uint64_t range = 200 * NSECS_PER_MSEC;
+
+    size_t exact = count_wheel_wakeups(num_timers, range, 0);
+    size_t coalesced = count_wheel_wakeups(num_timers, range, 1000);
+    size_t odd = count_wheel_wakeups(num_timers, range, 777);
+
+    debug("wakeups for %zu timers over 200ms: %zu without slack, "
+          "%zu with 1ms slack, %zu with 777us slack",
+          num_timers, exact, coalesced, odd);
+
+    if (exact == 0 || coalesced == 0 || odd == 0) return TEST_FAIL;
+
+    /* at most one expiration per 512us slot, plus cascades */
+    if (coalesced * 20 > exact || odd * 20 > exact) return TEST_FAIL;
+
+    return TEST_PASS;
+}
+
+struct slack_bench_ctx {
+    struct evp_handle *evp;
+    size_t pending;
+    bool early;
+};
+
+static void slack_bench_cb(struct timer_event *tev, void *priv) {
+    struct slack_bench_ctx *ctx = priv;
+
+    struct timespec now = time_now_monotonic();
+    if (gt(&tev->tspec, &now, timespec_cmp)) ctx->early = true;
+    if (--ctx->pending == 0) Evp_stop(ctx->evp);
+}
+
+/* run num_timers timers spread over range_ms, each with the given slack;
+ * return the number of event loop iterations it took, or 0 on failure. */
+static uint64_t run_dense_timers(size_t num_timers, uint32_t range_ms,
+                                 uint32_t slack_us, uint64_t *syscalls) {
+    struct timer_event *timers =
+      salloc(sizeof(struct timer_event) * num_timers, NULL);
+    struct slack_bench_ctx ctx = {.evp = Evp_new(), .pending = num_timers};
+    struct evp_stats stats;
+
+    srand(1);
+    for (size_t i = 0; i < num_timers; ++i) {
+        uint32_t us = (uint32_t)(rand() % (range_ms * 1000));
+        Evp_init_timer_us_slack(&timers[i], us, slack_us, slack_bench_cb, &ctx);
+        Evp_register_timer(ctx.evp, &timers[i]);
+    }
+
+    Evp_run(ctx.evp, 5);
+
+    uint64_t iterations = 0;
+    if (Evp_get_stats(ctx.evp, &stats) == ERRORCODE_SUCCESS &&
+        ctx.pending == 0 && !ctx.early)
+    {
+        iterations = stats.iterations;
+    }
+
+    *syscalls = ctx.evp->num_syscalls;
+
+    Evp_destroy(&ctx.evp);
+    salloc(0, timers);
+    return iterations;
+}
+
+/*
+ * Count the event loop wakeups (and system calls) needed to get through a
+ * dense population of timers with and without slack. */
+enum testStatus bench_timer_slack(void) {
+    const size_t num_timers = 5000;
+    const uint32_t range_ms = 500;
+    const uint32_t slacks_us[] = {0, 100, 1000, 10000};
+
+    if (EVP_STATS_LEVEL == 0) {
+        info("timer slack benchmark needs EVP_STATS_LEVEL > 0; skipped");
+        return TEST_PASS;
+    }
+
+    for (size_t i = 0; i < ARRLEN(slacks_us); ++i) {
+        uint64_t syscalls = 0;
+        uint64_t wakeups = run_dense_timers(num_timers, range_ms,
+                                            slacks_us[i], &syscalls);
+        if (wakeups == 0) return TEST_FAIL;
+
+        info("%zu timers over %ums, slack %5uus: %6lu wakeups, "
+             "%6lu syscalls",
+             num_timers, range_ms, slacks_us[i], wakeups, syscalls);
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * The timer queue the event pump used before the timer wheel: a sorted
+ * list, with O(n) insertion. Kept here as a baseline for benchmarking. */
+static void list_register_timer(struct dllist *timers,
+                                 struct timer_event *tev) {
+    struct timespec now = time_now_monotonic();
+    timespec_add(&now, &tev->tspec, &tev->tspec);
+
+    struct timer_event *timer;
+    Dll_foreach(timers, timer, struct timer_event, link) {
+        if (gt(&timer->tspec, &tev->tspec, timespec_cmp)) {
+            Dll_put_before(timers, timer, tev, link);
+            return;
+        }
+    }
+
+    Dll_pushback(timers, tev, link);
+}
+
+/* register then cancel num_timers timers with random intervals of up to a
+ * minute, either with the event pump or with the sorted-list baseline;
+ * return the average cost in ns per register+cancel pair. */
+static double time_register_cancel(size_t num_timers, bool use_list) {
+    struct timer_event *timers =
+      salloc(sizeof(struct timer_event) * num_timers, NULL);
+    struct evp_handle *evp = Evp_new();
+    struct dllist list = DLLIST_INITIALIZER(NULL);
+
+    srand(1);
+    for (size_t i = 0; i < num_timers; ++i) {
+        uint32_t ms = 1 + (uint32_t)(rand() % (60 * 1000));
+        Evp_init_timer_ms(&timers[i], ms, dummy_cb, NULL);
+    }
+
+    double start = time_now_monotonic_dbms();
+
+    for (size_t i = 0; i < num_timers; ++i) {
+        if (use_list) list_register_timer(&list, &timers[i]);
+        else Evp_register_timer(evp, &timers[i]);
+    }
+
+    for (size_t i = 0; i < num_timers; ++i) {
+        if (use_list) Dll_popnode(&list, &timers[i], link);
+        else Evp_unregister_timer(evp, &timers[i]);
+    }
+
+    double elapsed = time_now_monotonic_dbms() - start;
+
+    Evp_destroy(&evp);
+    salloc(0, timers);
+
+    return (elapsed * 1e6) / (double)num_timers;
+}
+
+/*
+ * Compare the cost of arming and cancelling timers using the timer wheel
+ * vs the sorted-list timer queue. The list baseline is quadratic so it is
+ * only measured at a smaller scale. */
+enum testStatus bench_timer_register_cancel(void) {
+    const size_t small = 20 * 1000;
+    const size_t large = 1000 * 1000;
+
+    double list_small = time_register_cancel(small, true);
+    double wheel_small = time_register_cancel(small, false);
+    double wheel_large = time_register_cancel(large, false);
+
+    info("register+cancel, sorted list,  %7zu timers: %10.1f ns/timer",
+         small, list_small);
+    info("register+cancel, timer wheel,  %7zu timers: %10.1f ns/timer",
+         small, wheel_small);
+    info("register+cancel, timer wheel,  %7zu timers: %10.1f ns/timer",
+         large, wheel_large);
+
+    return TEST_PASS;
+}
@@ -0,0 +1,216 @@
+#include <assert.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/signalfd.h>
+
+#include <tarp/cohort.h>
+#include <tarp/common.h>
+#include <tarp/error.h>
+#include <tarp/event.h>
+#include <tarp/log.h>
+#include <tarp/process.h>
+#include <tarp/timeutils.h>
+
+#include "misc/event_shared_defs.h"
+
+/*
+ * Tests for signal watches (see Evp_register_signal_watch) and for the
+ * reaping of asynchronous processes on SIGCHLD. */
+
+struct signal_ctx {
+    struct evp_handle *evp;
+    struct timer_event tev;
+    struct signal_watch usr1[2];
+    struct signal_watch usr2;
+    unsigned usr1_calls[2];
+    unsigned usr2_calls;
+    bool bad_info;
+};
+
+static void raise_signals_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    UNUSED(priv);
+    kill(getpid(), SIGUSR1);
+    kill(getpid(), SIGUSR2);
+}
+
+static void usr1_cb(struct signal_watch *sw,
+                    const struct signalfd_siginfo *info,
+                    void *priv) {
+    struct signal_ctx *ctx = priv;
+    size_t i = (size_t)(sw - ctx->usr1);
+
+    if (info->ssi_signo != SIGUSR1 || info->ssi_pid != (uint32_t)getpid()) {
+        ctx->bad_info = true;
+    }
+
+    ctx->usr1_calls[i]++;
+}
+
+static void usr2_cb(struct signal_watch *sw,
+                    const struct signalfd_siginfo *info,
+                    void *priv) {
+    UNUSED(sw);
+    struct signal_ctx *ctx = priv;
+
+    if (info->ssi_signo != SIGUSR2) ctx->bad_info = true;
+    ctx->usr2_calls++;
+    Evp_stop(ctx->evp);
+}
+
+static enum testStatus run_signal_watches(enum evp_backend backend) {
+    struct signal_ctx ctx;
+    enum testStatus status = TEST_PASS;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.evp = Evp_new_with_backend(backend);
+    if (!ctx.evp) return TEST_FAIL;
+
+    Evp_init_timer_ms(&ctx.tev, 1, raise_signals_cb, &ctx);
+    Evp_register_timer(ctx.evp, &ctx.tev);
+
+    for (size_t i = 0; i < ARRLEN(ctx.usr1); ++i) {
+        Evp_init_signal_watch(&ctx.usr1[i], SIGUSR1, usr1_cb, &ctx);
+        Evp_register_signal_watch(ctx.evp, &ctx.usr1[i]);
+    }
+    Evp_init_signal_watch(&ctx.usr2, SIGUSR2, usr2_cb, &ctx);
+    Evp_register_signal_watch(ctx.evp, &ctx.usr2);
+
+    Evp_run(ctx.evp, 2);
+
+    if (ctx.usr1_calls[0] != 1 || ctx.usr1_calls[1] != 1 ||
+        ctx.usr2_calls != 1 || ctx.bad_info)
+    {
+        debug("SIGUSR1 watches called %u and %u times, SIGUSR2 watch %u times",
+              ctx.usr1_calls[0], ctx.usr1_calls[1], ctx.usr2_calls);
+        status = TEST_FAIL;
+    }
+
+    /* no longer watched: the signal stays pending (blocked) rather than
+     * reaching any watch */
+    Evp_unregister_signal_watch(ctx.evp, &ctx.usr1[0]);
+    Evp_unregister_signal_watch(ctx.evp, &ctx.usr1[1]);
+    if (sigismember(&ctx.evp->sigmask, SIGUSR1)) status = TEST_FAIL;
+
+    kill(getpid(), SIGUSR1);
+    kill(getpid(), SIGUSR2);
+    Evp_run(ctx.evp, 1);
+    if (ctx.usr1_calls[0] != 1 || ctx.usr2_calls != 2) status = TEST_FAIL;
+
+    if (EVP_STATS_LEVEL >= 1) {
+        struct evp_stats stats;
+        Evp_get_stats(ctx.evp, &stats);
+        if (stats.dispatched[EVP_CLASS_SIGNAL] != 4) status = TEST_FAIL;
+    }
+
+    Evp_unregister_signal_watch(ctx.evp, &ctx.usr2);
+    Evp_destroy(&ctx.evp);
+
+    /* discard the SIGUSR1 left pending */
+    sigset_t pending;
+    int signo;
+    sigpending(&pending);
+    if (sigismember(&pending, SIGUSR1)) {
+        sigset_t usr1;
+        sigemptyset(&usr1);
+        sigaddset(&usr1, SIGUSR1);
+        sigwait(&usr1, &signo);
+    }
+
+    return status;
+}
+
+/*
+ * Blocked signals must be delivered to every watch registered for them,
+ * through both backends; watches can be unregistered. */
+enum testStatus test_signal_watches(void) {
+    enum testStatus status = TEST_PASS;
+    struct signal_watch sw;
+    sigset_t mask, old;
+
+    if (Evp_init_signal_watch(&sw, SIGKILL, usr1_cb, NULL) != ERROR_INVALIDVALUE ||
+        Evp_init_signal_watch(&sw, 0, usr1_cb, NULL) != ERROR_OUTOFBOUNDS ||
+        Evp_init_signal_watch(&sw, NSIG, usr1_cb, NULL) != ERROR_OUTOFBOUNDS)
+    {
+        return TEST_FAIL;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &mask, &old);
+
+    if (run_signal_watches(EVP_BACKEND_EPOLL) != TEST_PASS) status = TEST_FAIL;
+    if (run_signal_watches(EVP_BACKEND_IO_URING) != TEST_PASS) {
+        status = TEST_FAIL;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return status;
+}
+
+struct reap_ctx {
+    struct evp_handle *evp;
+    double spawned_at;
+    double reaped_after;
+    int status;
+};
+
+static void completion_cb(pid_t pid, int status, void *priv) {
+    UNUSED(pid);
+    struct reap_ctx *ctx = priv;
+
+    ctx->reaped_after = time_now_monotonic_dbms() - ctx->spawned_at;
+    ctx->status = status;
+    Evp_stop(ctx->evp);
+}
+
+/* spawn 'true' asynchronously; return the number of timers the event
+ * pump has registered as a result. */
+static size_t spawn_true(struct reap_ctx *ctx) {
+    const char *cmd[] = {"/bin/true", "true", NULL};
+
+    ctx->status = PROC_NOSTATUS;
+    ctx->spawned_at = time_now_monotonic_dbms();
+
+    int rc = async_exec(ctx->evp, cmd, NULL, false, STREAM_ACTION_DEVNULL,
+                        STREAM_ACTION_DEVNULL, STREAM_ACTION_DEVNULL, -1,
+                        NULL, NULL, completion_cb, ctx);
+    if (rc != 0) return SIZE_MAX;
+
+    return timer_wheel_count(&ctx->evp->timers);
+}
+
+/*
+ * With SIGCHLD blocked, asynchronous processes must be reaped on SIGCHLD,
+ * without any polling timer; otherwise the polling fallback must be used. */
+enum testStatus test_async_exec_sigchld(void) {
+    enum testStatus status = TEST_PASS;
+    struct reap_ctx ctx = {.evp = Evp_new()};
+    sigset_t mask, old;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &mask, &old);
+
+    if (spawn_true(&ctx) != 0) status = TEST_FAIL;
+    Evp_run(ctx.evp, 2);
+    debug("reaped on SIGCHLD after %.3f ms", ctx.reaped_after);
+    if (ctx.status != 0) status = TEST_FAIL;
+
+    pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+
+    if (spawn_true(&ctx) != 1) status = TEST_FAIL;
+    Evp_run(ctx.evp, 2);
+    debug("reaped by polling after %.3f ms", ctx.reaped_after);
+    if (ctx.status != 0) status = TEST_FAIL;
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    Evp_destroy(&ctx.evp);
+    return status;
+}
@@ -0,0 +1,273 @@
+#include <assert.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <tarp/cohort.h>
+#include <tarp/common.h>
+#include <tarp/error.h>
+#include <tarp/event.h>
+#include <tarp/log.h>
+#include <tarp/math.h>
+#include <tarp/timeutils.h>
+
+#include "misc/event_shared_defs.h"
+
+/*
+ * Tests for the simulated backend (EVP_BACKEND_SIMULATED): the virtual
+ * clock and the simulated pipes. */
+
+#define SECS_PER_DAY 86400
+#define NUM_SIM_TIMERS 100
+
+static int64_t elapsed_ns(const struct timespec *from,
+                          const struct timespec *to) {
+    return (int64_t)(to->tv_sec - from->tv_sec) * NSECS_PER_SEC +
+           (to->tv_nsec - from->tv_nsec);
+}
+
+struct sim_timer {
+    struct timer_event tev;
+    struct evp_handle *evp;
+    struct timespec start;
+    uint32_t interval_ms;
+    uint64_t calls;
+    bool early;
+    int64_t max_lag_ns;
+};
+
+static void sim_timer_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    struct sim_timer *t = priv;
+    struct timespec now = Evp_now(t->evp);
+
+    t->calls++;
+    int64_t lag = elapsed_ns(&t->start, &now) -
+                  (int64_t)(t->calls * t->interval_ms) * NSECS_PER_MSEC;
+
+    if (lag < 0) t->early = true;
+    if (lag > t->max_lag_ns) t->max_lag_ns = lag;
+}
+
+/*
+ * A day's worth of periodic timers must run in (much) less than a day,
+ * each timer expiring exactly as many times as it would have on the real
+ * clock, and never early. With nothing left registered, Evp_run must
+ * return straight away. */
+enum testStatus test_sim_day_of_timers(void) {
+    struct evp_handle *evp = Evp_new_with_backend(EVP_BACKEND_SIMULATED);
+    assert(evp);
+    if (Evp_get_backend(evp) != EVP_BACKEND_SIMULATED) return TEST_FAIL;
+
+    static struct sim_timer timers[NUM_SIM_TIMERS];
+    struct timespec start = Evp_now(evp);
+
+    /* intervals between 10s and 60s, none of which divides a day: no
+     * expiration coincides with the end of the run */
+    uint32_t interval = 10000;
+    for (size_t i = 0; i < NUM_SIM_TIMERS; ++i) {
+        do {
+            interval += 497;
+        } while (interval % 2 == 0 || interval % 3 == 0 || interval % 5 == 0);
+
+        struct sim_timer *t = &timers[i];
+        memset(t, 0, sizeof(*t));
+        t->evp = evp;
+        t->start = start;
+        t->interval_ms = interval;
+        Evp_init_periodic_timer_ms(&t->tev, interval, EVP_TIMER_CATCH_UP,
+                                   sim_timer_cb, t);
+        Evp_register_timer(evp, &t->tev);
+    }
+
+    double wall_start = time_now_monotonic_dbms();
+    Evp_run(evp, SECS_PER_DAY);
+    double wall_ms = time_now_monotonic_dbms() - wall_start;
+
+    enum testStatus status = TEST_PASS;
+    uint64_t total = 0;
+    int64_t max_lag_ns = 0;
+
+    for (size_t i = 0; i < NUM_SIM_TIMERS; ++i) {
+        struct sim_timer *t = &timers[i];
+        uint64_t expected = (uint64_t)SECS_PER_DAY * MSECS_PER_SEC / t->interval_ms;
+
+        if (t->calls != expected || t->early) {
+            debug("timer %zu (%ums): %lu calls, expected %lu, early=%s", i,
+                  t->interval_ms, t->calls, expected, bool2str(t->early));
+            status = TEST_FAIL;
+        }
+
+        total += t->calls;
+        max_lag_ns = MAX(max_lag_ns, t->max_lag_ns);
+        Evp_unregister_timer(evp, &t->tev);
+    }
+
+    struct timespec end = Evp_now(evp);
+    debug("simulated %.0fs (%lu expirations) in %.1f ms; max lag %ld ns",
+          (double)elapsed_ns(&start, &end) / NSECS_PER_SEC, total, wall_ms,
+          max_lag_ns);
+
+    if (elapsed_ns(&start, &end) < (int64_t)SECS_PER_DAY * (int64_t)NSECS_PER_SEC) {
+        status = TEST_FAIL;
+    }
+
+    /* nothing left to simulate */
+    Evp_run(evp, -1);
+    struct timespec after = Evp_now(evp);
+    if (timespec_cmp(&after, &end) != EQ) status = TEST_FAIL;
+
+    Evp_destroy(&evp);
+    return status;
+}
+
+#define SIM_RECV_FD 1000
+#define SIM_READABLE_FD 1001
+#define SIM_PIPE_BYTES 10000
+
+struct sim_reader {
+    struct fd_event fdev;
+    struct evp_handle *evp;
+    uint8_t data[SIM_PIPE_BYTES];
+    size_t len;
+    unsigned calls;
+    bool eof;
+    struct timespec eof_time;
+};
+
+static void sim_recv_cb(struct fd_event *fdev, int fd, uint32_t events,
+                        void *priv) {
+    UNUSED(fd);
+    struct sim_reader *r = priv;
+    r->calls++;
+
+    if (!(events & FD_EVENT_RECV)) return;
+
+    size_t len;
+    const uint8_t *data = Evp_get_fdev_data(fdev, &len);
+
+    if (len == 0) {
+        r->eof = true;
+        r->eof_time = Evp_now(r->evp);
+        Evp_unregister_fdmon(r->evp, fdev);
+        return;
+    }
+
+    if (r->len + len > sizeof(r->data)) return;
+    memcpy(r->data + r->len, data, len);
+    r->len += len;
+}
+
+static void sim_readable_cb(struct fd_event *fdev, int fd, uint32_t events,
+                            void *priv) {
+    UNUSED(fdev);
+    UNUSED(fd);
+    struct sim_reader *r = priv;
+    if (events & FD_EVENT_READABLE) r->calls++;
+}
+
+static void sim_writer_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    struct evp_handle *evp = priv;
+    uint8_t buff[SIM_PIPE_BYTES];
+
+    for (size_t i = 0; i < sizeof(buff); ++i) buff[i] = (uint8_t)(i % 251);
+
+    /* written in uneven pieces, delivered in read-sized chunks */
+    Evp_sim_write(evp, SIM_RECV_FD, buff, 3000);
+    Evp_sim_write(evp, SIM_RECV_FD, buff + 3000, sizeof(buff) - 3000);
+    Evp_sim_write(evp, SIM_RECV_FD, NULL, 0);
+
+    for (unsigned i = 0; i < 3; ++i) Evp_sim_write(evp, SIM_READABLE_FD, "x", 1);
+    Evp_sim_write(evp, SIM_READABLE_FD, NULL, 0);
+}
+
+static void dummy_fd_cb(struct fd_event *fdev, int fd, uint32_t events,
+                        void *priv) {
+    UNUSED(fdev);
+    UNUSED(fd);
+    UNUSED(events);
+    UNUSED(priv);
+}
+
+static void dummy_signal_cb(struct signal_watch *sw,
+                            const struct signalfd_siginfo *info, void *priv) {
+    UNUSED(sw);
+    UNUSED(info);
+    UNUSED(priv);
+}
+
+/*
+ * Data written into simulated pipes an hour (of virtual time) in must be
+ * delivered in full to FD_EVENT_RECV monitors, followed by EOF; other
+ * monitors must be told the pipe is readable. Evp_run must return once all
+ * is done. Unsupported uses must be rejected. */
+enum testStatus test_sim_pipes(void) {
+    struct evp_handle *evp = Evp_new_with_backend(EVP_BACKEND_SIMULATED);
+    assert(evp);
+
+    static struct sim_reader r, s;
+    memset(&r, 0, sizeof(r));
+    memset(&s, 0, sizeof(s));
+    r.evp = s.evp = evp;
+
+    Evp_init_fdmon(&r.fdev, SIM_RECV_FD, FD_EVENT_RECV, sim_recv_cb, &r);
+    Evp_init_fdmon(&s.fdev, SIM_READABLE_FD, FD_EVENT_READABLE,
+                   sim_readable_cb, &s);
+    Evp_register_fdmon(evp, &r.fdev);
+    Evp_register_fdmon(evp, &s.fdev);
+
+    struct timer_event tev;
+    Evp_init_timer_secs(&tev, 3600, sim_writer_cb, evp);
+    Evp_register_timer(evp, &tev);
+
+    struct timespec start = Evp_now(evp);
+    Evp_run(evp, -1);
+
+    enum testStatus status = TEST_PASS;
+    bool intact = (r.len == SIM_PIPE_BYTES);
+    for (size_t i = 0; intact && i < r.len; ++i) {
+        if (r.data[i] != (uint8_t)(i % 251)) intact = false;
+    }
+
+    /* 3 chunks of at most 4096 bytes, then EOF */
+    int64_t eof_after = elapsed_ns(&start, &r.eof_time);
+    if (!intact || !r.eof || r.calls != 4 || s.calls != 1 ||
+        eof_after < (int64_t)3600 * (int64_t)NSECS_PER_SEC) {
+        debug("recv: %zu bytes (intact=%s), %u calls, eof=%s after %ld ns; "
+              "readable: %u calls", r.len, bool2str(intact), r.calls,
+              bool2str(r.eof), eof_after, s.calls);
+        status = TEST_FAIL;
+    }
+
+    /* closed pipes take no more data */
+    if (Evp_sim_write(evp, SIM_RECV_FD, "x", 1) != ERROR_INVALIDVALUE) {
+        status = TEST_FAIL;
+    }
+
+    /* FD_EVENT_DRAIN monitors and signals cannot be simulated */
+    struct fd_event drain;
+    Evp_init_fdmon(&drain, 1002, FD_EVENT_DRAIN, dummy_fd_cb, NULL);
+    if (Evp_register_fdmon(evp, &drain) == ERRORCODE_SUCCESS) status = TEST_FAIL;
+
+    struct signal_watch sw;
+    Evp_init_signal_watch(&sw, SIGUSR1, dummy_signal_cb, NULL);
+    if (Evp_register_signal_watch(evp, &sw) != ERROR_MISCONFIGURED) {
+        status = TEST_FAIL;
+    }
+
+    Evp_unregister_fdmon(evp, &s.fdev);
+    Evp_destroy(&evp);
+
+    /* simulated pipes need the simulated backend */
+    evp = Evp_new();
+    assert(evp);
+    if (Evp_sim_write(evp, SIM_RECV_FD, "x", 1) != ERROR_MISCONFIGURED) {
+        status = TEST_FAIL;
+    }
+    Evp_destroy(&evp);
+
+    return status;
+}
@@ -0,0 +1,155 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tarp/cohort.h>
+#include <tarp/common.h>
+#include <tarp/error.h>
+#include <tarp/event.h>
+#include <tarp/log.h>
+#include <tarp/timeutils.h>
+
+/*
+ * Tests for the instrumentation (see Evp_get_stats) of the C event pump. */
+
+#define SLOW_CALLBACK_MS 3
+
+struct stats_ctx {
+    struct evp_handle *evp;
+    struct timer_event tev;
+    struct fd_event fdev;
+    struct user_event_watch watch;
+    struct evp_histogram fd_hist;
+    int pipe[2];
+    unsigned calls;
+};
+
+static void spin_ms(double ms) {
+    double until = time_now_monotonic_dbms() + ms;
+    while (time_now_monotonic_dbms() < until) {}
+}
+
+static void slow_timer_cb(struct timer_event *tev, void *priv) {
+    UNUSED(tev);
+    struct stats_ctx *ctx = priv;
+    ctx->calls++;
+    spin_ms(SLOW_CALLBACK_MS);
+    if (write(ctx->pipe[1], "x", 1) != 1) ctx->calls = 0;
+}
+
+static void fd_cb(struct fd_event *fdev, int fd, uint32_t events, void *priv) {
+    UNUSED(events);
+    struct stats_ctx *ctx = priv;
+    char c;
+
+    ctx->calls++;
+    if (read(fd, &c, 1) != 1) return;
+    Evp_unregister_fdmon(ctx->evp, fdev);
+    Evp_push_uev(ctx->evp, 1, NULL);
+}
+
+static void uev_cb(struct user_event_watch *uev, unsigned event_type,
+                   void *data, void *priv) {
+    UNUSED(uev);
+    UNUSED(event_type);
+    UNUSED(data);
+    struct stats_ctx *ctx = priv;
+
+    ctx->calls++;
+    Evp_stop(ctx->evp);
+}
+
+/*
+ * A timer firing writes to a pipe, whose fd callback pushes a user event,
+ * whose callback stops the pump: each class of events must be accounted
+ * for, and the (deliberately slow) timer callback must be on record as the
+ * slowest one. */
+enum testStatus test_evp_stats(void) {
+    struct stats_ctx ctx;
+    struct evp_stats stats;
+    enum testStatus status = TEST_PASS;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.evp = Evp_new();
+    if (pipe(ctx.pipe) != 0) return TEST_FAIL;
+
+    Evp_init_timer_ms(&ctx.tev, 1, slow_timer_cb, &ctx);
+    Evp_register_timer(ctx.evp, &ctx.tev);
+    Evp_init_fdmon(&ctx.fdev, ctx.pipe[0], FD_EVENT_READABLE, fd_cb, &ctx);
+    Evp_set_fdmon_histogram(&ctx.fdev, &ctx.fd_hist);
+    Evp_register_fdmon(ctx.evp, &ctx.fdev);
+    Evp_init_uev_watch(&ctx.watch, 1, uev_cb, &ctx);
+    Evp_register_uev_watch(ctx.evp, &ctx.watch);
+
+    Evp_run(ctx.evp, 5);
+
+    int rc = Evp_get_stats(ctx.evp, &stats);
+
+    if (EVP_STATS_LEVEL == 0) {
+        if (rc != ERROR_MISCONFIGURED) status = TEST_FAIL;
+        goto out;
+    }
+
+    if (rc != ERRORCODE_SUCCESS || ctx.calls != 3) {
+        status = TEST_FAIL;
+        goto out;
+    }
+
+    debug("iterations: %lu, blocked: %lu ns, busy: %lu ns, "
+          "timer lag p50: < %lu ns",
+          stats.iterations, stats.blocked_ns, stats.busy_ns,
+          Evp_histogram_percentile(&stats.timer_lag, 50));
+
+    if (stats.iterations == 0) status = TEST_FAIL;
+    if (stats.busy_ns < SLOW_CALLBACK_MS * NSECS_PER_MSEC) status = TEST_FAIL;
+    if (Evp_histogram_count(&stats.timer_lag) != 1) status = TEST_FAIL;
+    if (Evp_histogram_count(&stats.busy) != stats.iterations) {
+        status = TEST_FAIL;
+    }
+
+    /* the timer for the run timeout is still pending */
+    if (stats.dispatched[EVP_CLASS_TIMER] != 1 ||
+        stats.dispatched[EVP_CLASS_FD] != 1 ||
+        stats.dispatched[EVP_CLASS_USER] != 2)  /* including Evp_stop */
+    {
+        status = TEST_FAIL;
+    }
+
+    if (EVP_STATS_LEVEL >= 2) {
+        debug("slowest callback: %lu ns (class %d), timer callback p99: < %lu ns",
+              stats.slowest.ns, stats.slowest.event_class,
+              Evp_histogram_percentile(&stats.callbacks[EVP_CLASS_TIMER], 99));
+
+        if (stats.slowest.priv != &ctx ||
+            stats.slowest.event_class != EVP_CLASS_TIMER ||
+            stats.slowest.ns < SLOW_CALLBACK_MS * NSECS_PER_MSEC)
+        {
+            status = TEST_FAIL;
+        }
+
+        if (Evp_histogram_percentile(&stats.callbacks[EVP_CLASS_TIMER], 50) <
+            SLOW_CALLBACK_MS * NSECS_PER_MSEC)
+        {
+            status = TEST_FAIL;
+        }
+
+        if (Evp_histogram_count(&ctx.fd_hist) != 1 ||
+            Evp_histogram_count(&stats.callbacks[EVP_CLASS_USER]) != 2)
+        {
+            status = TEST_FAIL;
+        }
+    }
+
+    Evp_reset_stats(ctx.evp);
+    Evp_get_stats(ctx.evp, &stats);
+    if (stats.iterations != 0 || stats.slowest.priv != NULL) status = TEST_FAIL;
+
+out:
+    Evp_destroy(&ctx.evp);
+    close(ctx.pipe[0]);
+    close(ctx.pipe[1]);
+    return status;
+}
@@ -0,0 +1,76 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <tarp/common.h>
+#include <tarp/cohort.h>
+
+extern enum testStatus test_timers_fire_after_deadline(void);
+extern enum testStatus test_timer_cancellation(void);
+extern enum testStatus test_timer_rearm_from_callback(void);
+extern enum testStatus test_run_once(void);
+extern enum testStatus test_periodic_timers(void);
+extern enum testStatus test_timer_wheel_simulated_clock(void);
+extern enum testStatus test_timer_wheel_slack(void);
+extern enum testStatus bench_timer_register_cancel(void);
+extern enum testStatus bench_timer_slack(void);
+extern enum testStatus test_fdmon_epoll(void);
+extern enum testStatus test_fdmon_io_uring(void);
+extern enum testStatus test_fdmon_drain_epoll(void);
+extern enum testStatus test_fdmon_drain_io_uring(void);
+extern enum testStatus bench_echo(void);
+extern enum testStatus test_uev_mpsc_ordering(void);
+extern enum testStatus bench_uev_throughput(void);
+extern enum testStatus test_uev_multiple_watchers(void);
+extern enum testStatus test_dispatch_budgets(void);
+extern enum testStatus test_dispatch_user_first_wakeup(void);
+extern enum testStatus bench_dispatch_latency(void);
+extern enum testStatus test_evp_stats(void);
+extern enum testStatus test_sim_day_of_timers(void);
+extern enum testStatus test_sim_pipes(void);
+
+extern enum testStatus test_signal_watches(void);
+extern enum testStatus test_async_exec_sigchld(void);
+
+int main(int argc, char **argv){
+    UNUSED(argv);
+    UNUSED(argc);
+
+    fprintf(stderr, "==============================\n"
+                    "-------- event tests ---------\n"
+                    "==============================\n"
+                    );
+
+    struct cohort *tests = Cohort_init();
+    assert(tests != NULL);
+
+    Cohort_add(tests, test_timers_fire_after_deadline, "timers fire once, never before their deadline");
+    Cohort_add(tests, test_timer_cancellation, "unregistered timers do not fire");
+    Cohort_add(tests, test_timer_rearm_from_callback, "timers can re-register themselves from their callback");
+    Cohort_add(tests, test_periodic_timers, "periodic timers do not drift, and skip or catch up on overrun");
+    Cohort_add(tests, test_run_once, "the pump can be stepped, with bounded waits, and nested via its pollfd");
+    Cohort_add(tests, test_timer_wheel_simulated_clock, "timer wheel expires timers on time across all levels");
+    Cohort_add(tests, test_timer_wheel_slack, "timers with slack expire within their window, on fewer wakeups");
+    Cohort_add(tests, test_fdmon_epoll, "fd monitors deliver data and EOF (epoll backend)");
+    Cohort_add(tests, test_fdmon_io_uring, "fd monitors deliver data and EOF (io_uring backend)");
+    Cohort_add(tests, test_fdmon_drain_epoll, "drained fd monitors get all data as pooled slices (epoll backend)");
+    Cohort_add(tests, test_fdmon_drain_io_uring, "drained fd monitors get all data as pooled slices (io_uring backend)");
+    Cohort_add(tests, test_uev_mpsc_ordering, "user events from concurrent producers arrive once, in order");
+    Cohort_add(tests, test_uev_multiple_watchers, "user events are dispatched to every watch for their type");
+    Cohort_add(tests, test_dispatch_budgets, "dispatch budgets keep event classes from starving each other");
+    Cohort_add(tests, test_dispatch_user_first_wakeup, "user events pushed from user callbacks wake the pump whatever the dispatch order");
+    Cohort_add(tests, test_evp_stats, "event pump statistics account for every event and callback");
+    Cohort_add(tests, test_sim_day_of_timers, "a simulated day of periodic timers runs on the virtual clock");
+    Cohort_add(tests, test_sim_pipes, "simulated pipes deliver data and EOF on the virtual clock");
+    Cohort_add(tests, test_signal_watches, "blocked signals are dispatched to every watch via signalfd");
+    Cohort_add(tests, test_async_exec_sigchld, "async processes are reaped on SIGCHLD, or by polling otherwise");
+
+    Cohort_add(tests, bench_timer_register_cancel, "benchmark: timer register/cancel (wheel vs sorted list)");
+    Cohort_add(tests, bench_timer_slack, "benchmark: wakeups for dense timers (with vs without slack)");
+    Cohort_add(tests, bench_echo, "benchmark: loopback echo (epoll vs io_uring)");
+    Cohort_add(tests, bench_uev_throughput, "benchmark: user event throughput (mutex vs lock-free)");
+    Cohort_add(tests, bench_dispatch_latency, "benchmark: fd event latency under a user event flood (dispatch budgets)");
+
+    enum testStatus res = Cohort_decimate(tests);
+    Cohort_destroy(tests);
+    return res;
+}
@@ -0,0 +1,341 @@
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+#include <tarp/cohort.h>
+#include <tarp/common.h>
+#include <tarp/error.h>
+#include <tarp/event.h>
+#include <tarp/log.h>
+#include <tarp/timeutils.h>
+
+/*
+ * Tests and benchmarks for the user event queue of the C event pump. */
+
+#define NUM_PRODUCERS 4
+#define BATCH_SIZE    64
+#define UEV_TYPE      1
+
+/* the data pointer of each event encodes the producer and a sequence number */
+#define ENCODE(producer, seq) ((void *)(((uintptr_t)(producer) << 32) | (seq)))
+#define PRODUCER(data)        ((unsigned)((uintptr_t)(data) >> 32))
+#define SEQ(data)             ((uint32_t)((uintptr_t)(data)&UINT32_MAX))
+
+struct uev_ctx {
+    struct evp_handle *evp;
+    struct user_event_watch watch;
+    size_t expected;
+    size_t received;
+    uint32_t next_seq[NUM_PRODUCERS];
+    bool out_of_order;
+};
+
+struct producer {
+    pthread_t tid;
+    unsigned id;
+    struct evp_handle *evp;
+    uint32_t num_events;
+    size_t batch_size; /* 1 => Evp_push_uev */
+};
+
+static void uev_cb(struct user_event_watch *uev,
+                   unsigned event_type,
+                   void *data,
+                   void *priv) {
+    UNUSED(uev);
+    UNUSED(event_type);
+    struct uev_ctx *ctx = priv;
+
+    unsigned producer = PRODUCER(data);
+    if (producer >= NUM_PRODUCERS || SEQ(data) != ctx->next_seq[producer]) {
+        ctx->out_of_order = true;
+    } else {
+        ctx->next_seq[producer]++;
+    }
+
+    if (++ctx->received == ctx->expected) Evp_stop(ctx->evp);
+}
+
+static void *produce(void *arg) {
+    struct producer *p = arg;
+    struct uev_item batch[BATCH_SIZE];
+    size_t n = 0;
+
+    for (uint32_t seq = 0; seq < p->num_events; ++seq) {
+        if (p->batch_size == 1) {
+            Evp_push_uev(p->evp, UEV_TYPE, ENCODE(p->id, seq));
+            continue;
+        }
+
+        batch[n].event_type = UEV_TYPE;
+        batch[n].data = ENCODE(p->id, seq);
+        if (++n == p->batch_size || seq + 1 == p->num_events) {
+            Evp_push_uev_batch(p->evp, batch, n);
+            n = 0;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Run NUM_PRODUCERS producer threads against an event pump until all events
+ * have been received; return the time taken, in ms. */
+static double run_producers(struct uev_ctx *ctx,
+                            uint32_t events_per_producer,
+                            size_t batch_size) {
+    struct producer producers[NUM_PRODUCERS];
+
+    memset(ctx->next_seq, 0, sizeof(ctx->next_seq));
+    ctx->received = 0;
+    ctx->expected = (size_t)events_per_producer * NUM_PRODUCERS;
+    ctx->out_of_order = false;
+
+    double start = time_now_monotonic_dbms();
+
+    for (unsigned i = 0; i < NUM_PRODUCERS; ++i) {
+        producers[i].id = i;
+        producers[i].evp = ctx->evp;
+        producers[i].num_events = events_per_producer;
+        producers[i].batch_size = batch_size;
+        pthread_create(&producers[i].tid, NULL, produce, &producers[i]);
+    }
+
+    Evp_run(ctx->evp, 10);
+
+    for (unsigned i = 0; i < NUM_PRODUCERS; ++i) {
+        pthread_join(producers[i].tid, NULL);
+    }
+
+    return time_now_monotonic_dbms() - start;
+}
+
+/*
+ * Events pushed concurrently by several producers, one at a time or in
+ * batches, must all be received exactly once, and in the order they were
+ * pushed in by each producer. Enough events are pushed to run out of
+ * preallocated event nodes. */
+enum testStatus test_uev_mpsc_ordering(void) {
+    struct uev_ctx ctx = {.evp = Evp_new()};
+
+    Evp_init_uev_watch(&ctx.watch, UEV_TYPE, uev_cb, &ctx);
+    Evp_register_uev_watch(ctx.evp, &ctx.watch);
+
+    enum testStatus status = TEST_PASS;
+    size_t batch_sizes[] = {1, 7, BATCH_SIZE};
+
+    for (size_t i = 0; i < ARRLEN(batch_sizes); ++i) {
+        run_producers(&ctx, 100 * 1000, batch_sizes[i]);
+
+        debug("batch size %zu: received %zu of %zu events, in order: %s",
+              batch_sizes[i],
+              ctx.received,
+              ctx.expected,
+              bool2str(!ctx.out_of_order));
+
+        if (ctx.received != ctx.expected || ctx.out_of_order) {
+            status = TEST_FAIL;
+        }
+    }
+
+    Evp_unregister_uev_watch(ctx.evp, &ctx.watch);
+    Evp_destroy(&ctx.evp);
+    return status;
+}
+
+/*
+ * The user event queue the event pump used before the lock-free queue: a
+ * mutex-protected list, with an allocation and an eventfd write for every
+ * push and a lock for every pop. Kept here as a baseline for benchmarking. */
+struct locked_node {
+    struct locked_node *next;
+    void *data;
+};
+
+struct locked_queue {
+    pthread_mutex_t mtx;
+    struct locked_node *head, *tail;
+    int efd;
+    size_t expected;
+};
+
+static void *locked_produce(void *arg) {
+    struct producer *p = arg;
+    struct locked_queue *q = (struct locked_queue *)p->evp;
+    uint64_t one = 1;
+
+    for (uint32_t seq = 0; seq < p->num_events; ++seq) {
+        struct locked_node *node = salloc(sizeof(struct locked_node), NULL);
+        node->data = ENCODE(p->id, seq);
+
+        pthread_mutex_lock(&q->mtx);
+        if (q->tail) q->tail->next = node;
+        else q->head = node;
+        q->tail = node;
+        pthread_mutex_unlock(&q->mtx);
+
+        if (write(q->efd, &one, sizeof(one)) != sizeof(one)) abort();
+    }
+
+    return NULL;
+}
+
+static double run_locked_baseline(uint32_t events_per_producer) {
+    struct producer producers[NUM_PRODUCERS];
+    struct locked_queue q = {.head = NULL, .tail = NULL};
+    pthread_mutex_init(&q.mtx, NULL);
+    q.efd = eventfd(0, EFD_CLOEXEC);
+    q.expected = (size_t)events_per_producer * NUM_PRODUCERS;
+
+    double start = time_now_monotonic_dbms();
+
+    for (unsigned i = 0; i < NUM_PRODUCERS; ++i) {
+        producers[i].id = i;
+        producers[i].evp = (struct evp_handle *)&q;
+        producers[i].num_events = events_per_producer;
+        pthread_create(&producers[i].tid, NULL, locked_produce, &producers[i]);
+    }
+
+    size_t received = 0;
+    uint64_t buff;
+    struct pollfd pfd = {.fd = q.efd, .events = POLLIN};
+
+    while (received < q.expected) {
+        poll(&pfd, 1, -1);
+        if (read(q.efd, &buff, sizeof(buff)) != sizeof(buff)) break;
+
+        for (;;) {
+            pthread_mutex_lock(&q.mtx);
+            struct locked_node *node = q.head;
+            if (node) {
+                q.head = node->next;
+                if (!q.head) q.tail = NULL;
+            }
+            pthread_mutex_unlock(&q.mtx);
+
+            if (!node) break;
+            salloc(0, node);
+            received++;
+        }
+    }
+
+    for (unsigned i = 0; i < NUM_PRODUCERS; ++i) {
+        pthread_join(producers[i].tid, NULL);
+    }
+
+    double elapsed = time_now_monotonic_dbms() - start;
+    close(q.efd);
+    pthread_mutex_destroy(&q.mtx);
+    return elapsed;
+}
+
+/*
+ * Throughput of user events from NUM_PRODUCERS threads into one event pump:
+ * the mutex-based baseline vs the lock-free queue, with single and batched
+ * pushes. */
+enum testStatus bench_uev_throughput(void) {
+    const uint32_t num_events = 250 * 1000;
+    const double total = (double)num_events * NUM_PRODUCERS;
+    struct uev_ctx ctx = {.evp = Evp_new()};
+
+    Evp_init_uev_watch(&ctx.watch, UEV_TYPE, uev_cb, &ctx);
+    Evp_register_uev_watch(ctx.evp, &ctx.watch);
+
+    double locked = run_locked_baseline(num_events);
+    double single = run_producers(&ctx, num_events, 1);
+    double batched = run_producers(&ctx, num_events, BATCH_SIZE);
+
+    info("%u producers, mutex + eventfd per push: %10.0f events/s",
+         NUM_PRODUCERS, total / locked * 1000);
+    info("%u producers, Evp_push_uev:             %10.0f events/s",
+         NUM_PRODUCERS, total / single * 1000);
+    info("%u producers, Evp_push_uev_batch (%u):  %10.0f events/s",
+         NUM_PRODUCERS, BATCH_SIZE, total / batched * 1000);
+
+    Evp_unregister_uev_watch(ctx.evp, &ctx.watch);
+    Evp_destroy(&ctx.evp);
+    return TEST_PASS;
+}
+
+struct watcher {
+    struct user_event_watch watch;
+    struct evp_handle *evp;
+    unsigned calls;
+    struct watcher *victim; /* unregister this one when called */
+};
+
+static void watcher_cb(struct user_event_watch *uev,
+                       unsigned event_type,
+                       void *data,
+                       void *priv) {
+    UNUSED(event_type);
+    UNUSED(data);
+    struct watcher *w = priv;
+    assert(uev == &w->watch);
+    UNUSED(uev);
+
+    w->calls++;
+    if (w->victim) {
+        Evp_unregister_uev_watch(w->evp, &w->victim->watch);
+        w->victim = NULL;
+    }
+}
+
+/*
+ * Every watch registered for an event type must be invoked for each event
+ * of that type, including for sparse and large event types. Watches
+ * unregistered from inside a callback, by themselves or by others, must
+ * not be invoked again. */
+enum testStatus test_uev_multiple_watchers(void) {
+    struct evp_handle *evp = Evp_new();
+    struct watcher w[5];
+    unsigned types[] = {3, 3, 3, 3, 5000};
+
+    memset(w, 0, sizeof(w));
+    for (size_t i = 0; i < ARRLEN(w); ++i) {
+        w[i].evp = evp;
+        Evp_init_uev_watch(&w[i].watch, types[i], watcher_cb, &w[i]);
+        if (Evp_register_uev_watch(evp, &w[i].watch) != ERRORCODE_SUCCESS) {
+            Evp_destroy(&evp);
+            return TEST_FAIL;
+        }
+    }
+
+    w[0].victim = &w[1]; /* the next one in line */
+    w[2].victim = &w[2]; /* itself */
+
+    for (unsigned i = 0; i < 3; ++i) {
+        Evp_push_uev(evp, 3, NULL);
+        Evp_push_uev(evp, 5000, NULL);
+        Evp_push_uev(evp, 4, NULL); /* no watchers */
+    }
+    Evp_stop(evp);
+    Evp_run(evp, -1);
+
+    unsigned expected[] = {3, 0, 1, 3, 3};
+    enum testStatus status = TEST_PASS;
+
+    for (size_t i = 0; i < ARRLEN(w); ++i) {
+        if (w[i].calls != expected[i]) {
+            debug("watch %zu called %u times, expected %u",
+                  i, w[i].calls, expected[i]);
+            status = TEST_FAIL;
+        }
+    }
+
+    if (Evp_init_uev_watch(&w[0].watch, MAX_USER_EVENT_TYPE_VALUE,
+                           watcher_cb, NULL) != ERROR_OUTOFBOUNDS) {
+        status = TEST_FAIL;
+    }
+
+    Evp_destroy(&evp);
+    return status;
+}
@@ -0,0 +1,856 @@
+#include "evgroup_test.hxx"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <tarp/event.hxx>
+#include <tarp/event_group.hxx>
+#include <tarp/posix_signal_helpers.hxx>
+
+using namespace std;
+using namespace std::chrono_literals;
+
+// Count the allocations made through the global operator new, for
+// test_timer_allocations.
+static atomic<size_t> num_allocations{0};
+
+void *operator new(size_t size) {
+  ++num_allocations;
+  if (void *p = malloc(size ? size : 1)) return p;
+  throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Poll pred until it returns true or the timeout is reached.
+template <typename F>
+static bool wait_for(F &&pred, chrono::milliseconds timeout = 5s) {
+  auto deadline = chrono::steady_clock::now() + timeout;
+  while (!pred()) {
+    if (chrono::steady_clock::now() > deadline) return false;
+    this_thread::sleep_for(1ms);
+  }
+  return true;
+}
+
+// Functions posted from several threads must all get run, in the thread
+// running the pump. stop() must then make run() return.
+bool test_post_and_stop(unsigned num_posters, unsigned num_posts) {
+  auto pump = tarp::make_event_pump();
+
+  size_t num_run{0}; /* only touched by the pump thread */
+  bool wrong_thread{false};
+  thread::id pump_thread_id;
+
+  thread t([&] {
+    pump_thread_id = this_thread::get_id();
+    pump->run(-1);
+  });
+
+  vector<thread> posters;
+  for (unsigned i = 0; i < num_posters; ++i) {
+    posters.emplace_back([&] {
+      for (unsigned j = 0; j < num_posts; ++j) {
+        pump->post([&] {
+          ++num_run;
+          if (this_thread::get_id() != pump_thread_id) wrong_thread = true;
+        });
+      }
+    });
+  }
+
+  for (auto &poster : posters) poster.join();
+
+  pump->stop();
+  t.join();
+
+  cerr << "functions posted: " << num_posters * num_posts
+       << ", run: " << num_run << endl;
+
+  return num_run == num_posters * num_posts && !wrong_thread;
+}
+
+// Several callbacks set for the same user event type must all be called,
+// in order; one removing itself (by returning false) must not affect the
+// others.
+bool test_user_event_subscribers(unsigned num_subscribers,
+                                 unsigned num_events) {
+  auto pump = tarp::make_event_pump();
+  constexpr unsigned EVENT_TYPE = 7;
+
+  vector<unsigned> calls(num_subscribers, 0);
+  vector<unsigned> order;
+
+  for (unsigned i = 0; i < num_subscribers; ++i) {
+    pump->set_user_event_callback(EVENT_TYPE, [&, i](unsigned, void *) {
+      ++calls[i];
+      order.push_back(i);
+      return i != 0; /* the first one only wants one event */
+    });
+  }
+
+  for (unsigned i = 0; i < num_events; ++i) pump->push_event(EVENT_TYPE);
+  pump->stop();
+  pump->run(-1);
+
+  bool ok = (calls[0] == 1);
+  for (unsigned i = 1; i < num_subscribers; ++i) {
+    if (calls[i] != num_events) ok = false;
+  }
+
+  // callbacks for the first event were called in the order they were set in
+  for (unsigned i = 0; i < num_subscribers && i < order.size(); ++i) {
+    if (order[i] != i) ok = false;
+  }
+
+  return ok;
+}
+
+// The stats must account for every callback run, and be readable from
+// another thread while the pump is running.
+bool test_pump_stats(unsigned num_timers) {
+  auto pump = tarp::make_event_pump();
+  atomic<unsigned> num_fired{0};
+
+  for (unsigned i = 0; i < num_timers; ++i) {
+    pump->set_timer_callback(chrono::milliseconds(i + 1), [&] {
+      ++num_fired;
+      return false;
+    });
+  }
+
+  thread t([&] { pump->run(-1); });
+
+  bool ok = wait_for([&] { return num_fired == num_timers; });
+  if (EVP_STATS_LEVEL > 0) {
+    ok = ok && wait_for([&] {
+           return pump->stats().dispatched[EVP_CLASS_TIMER] == num_timers;
+         });
+  }
+
+  pump->stop();
+  t.join();
+
+  if (EVP_STATS_LEVEL == 0) {
+    try {
+      pump->stats();
+      return false;
+    } catch (const std::logic_error &) {
+      return ok;
+    }
+  }
+
+  auto stats = pump->stats();
+  cerr << "iterations: " << stats.iterations
+       << ", timers dispatched: " << stats.dispatched[EVP_CLASS_TIMER]
+       << ", timer lag p99 < "
+       << Evp_histogram_percentile(&stats.timer_lag, 99) << " ns" << endl;
+
+  pump->reset_stats();
+  return ok && stats.iterations > 0 && pump->stats().iterations == 0;
+}
+
+// Worker threads must be able to register fd callbacks with a running pump
+// and have functions run by it no earlier than a given deadline; all of it
+// must happen in the pump thread.
+bool test_cross_thread_registration(unsigned num_workers) {
+  auto pump = tarp::make_event_pump();
+  auto delay = 5ms;
+
+  atomic<unsigned> num_read{0};
+  atomic<unsigned> num_early{0};
+  atomic<bool> wrong_thread{false};
+  atomic<bool> running{false};
+  thread::id pump_thread_id;
+
+  thread t([&] {
+    pump_thread_id = this_thread::get_id();
+    pump->run(-1);
+  });
+
+  // registrations are only posted once the pump has been run
+  pump->post([&] { running = true; });
+  bool ok = wait_for([&] { return running.load(); });
+
+  vector<array<int, 2>> pipes(num_workers);
+  vector<thread> workers;
+  for (unsigned i = 0; i < num_workers && ok; ++i) {
+    if (pipe(pipes[i].data()) != 0) return false;
+
+    workers.emplace_back([&, i] {
+      int rfd = pipes[i][0], wfd = pipes[i][1];
+
+      pump->set_fd_event_callback(rfd, FD_EVENT_READABLE, [&](int fd, uint32_t) {
+        char c;
+        if (read(fd, &c, 1) == 1) ++num_read;
+        if (this_thread::get_id() != pump_thread_id) wrong_thread = true;
+        return false;
+      });
+
+      auto deadline = chrono::steady_clock::now() + delay;
+      pump->post_at(deadline, [&, wfd, deadline] {
+        if (chrono::steady_clock::now() < deadline) ++num_early;
+        if (this_thread::get_id() != pump_thread_id) wrong_thread = true;
+        if (write(wfd, "x", 1) != 1) wrong_thread = true;
+      });
+    });
+  }
+
+  for (auto &worker : workers) worker.join();
+  ok = ok && wait_for([&] { return num_read == num_workers; });
+
+  pump->stop();
+  t.join();
+
+  for (auto &fds : pipes) {
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  cerr << "read from " << num_read << " of " << num_workers
+       << " pipes, early: " << num_early << endl;
+
+  // once the pump has returned, registrations are made straight away (a
+  // bad one fails) rather than posted to a pump no longer running. The
+  // pipes have been closed.
+  int rc = pump->set_fd_event_callback(pipes[0][0], FD_EVENT_READABLE,
+                                       [](int, uint32_t) { return false; });
+  bool stopped_ok = (rc != ERRORCODE_SUCCESS);
+
+  // registrations racing with the pump starting up must all take effect.
+  atomic<unsigned> num_fired{0};
+  workers.clear();
+  for (unsigned i = 0; i < num_workers; ++i) {
+    workers.emplace_back([&, i] {
+      pump->set_user_event_callback(i + 1, [&](unsigned, void *) {
+        if (this_thread::get_id() != pump_thread_id) wrong_thread = true;
+        ++num_fired;
+        return false;
+      });
+      pump->push_event(i + 1, nullptr);
+    });
+  }
+
+  thread t2([&] {
+    pump_thread_id = this_thread::get_id();
+    pump->run(-1);
+  });
+
+  for (auto &worker : workers) worker.join();
+  bool raced_ok = wait_for([&] { return num_fired == num_workers; });
+
+  pump->stop();
+  t2.join();
+
+  cerr << "user events fired with racing registrations: " << num_fired
+       << " of " << num_workers << endl;
+
+  return ok && stopped_ok && raced_ok && num_early == 0 && !wrong_thread;
+}
+
+// A callback throwing out of run_once() must not leave the pump marked as
+// running on this thread: registrations from other threads are then made
+// straight away (a bad one fails) rather than posted.
+bool test_throwing_callback() {
+  auto pump = tarp::make_event_pump();
+  pump->set_timer_callback(1ms, []() -> bool { throw runtime_error("boom"); });
+
+  bool thrown = false;
+  try {
+    while (true) pump->run_once(-1us);
+  } catch (const runtime_error &) {
+    thrown = true;
+  }
+
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  close(fds[0]);
+  close(fds[1]);
+
+  int rc = ERRORCODE_SUCCESS;
+  thread t([&] {
+    rc = pump->set_fd_event_callback(fds[0], FD_EVENT_READABLE,
+                                     [](int, uint32_t) { return false; });
+  });
+  t.join();
+
+  return thrown && rc != ERRORCODE_SUCCESS;
+}
+
+// NOTE: a benchmark, really: create and fire one-shot timers in batches,
+// counting the allocations. Once the first batch has warmed up the
+// callback pool and slot table, timers should not allocate at all.
+bool test_timer_allocations(unsigned num_timers, unsigned batch_size) {
+  auto pump = tarp::make_event_pump();
+  unsigned num_fired = 0;
+  auto fire = [&num_fired] {
+    ++num_fired;
+    return false;
+  };
+
+  auto run_batch = [&] {
+    unsigned target = num_fired + batch_size;
+    for (unsigned i = 0; i < batch_size; ++i) {
+      pump->set_timer_callback(1us, fire);
+    }
+    while (num_fired < target) pump->run_once(-1us);
+  };
+
+  run_batch();
+  num_fired = 0;
+
+  size_t allocations = num_allocations;
+  auto start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < num_timers / batch_size; ++i) run_batch();
+  auto elapsed = chrono::duration_cast<chrono::milliseconds>(
+      chrono::steady_clock::now() - start);
+  allocations = num_allocations - allocations;
+
+  cerr << num_fired << " timers fired in " << elapsed.count() << "ms, "
+       << allocations << " allocations ("
+       << static_cast<double>(allocations) / num_fired << " per timer)"
+       << endl;
+
+  return num_fired == num_timers / batch_size * batch_size &&
+         allocations < num_fired / 100;
+}
+
+// Timer callbacks are periodic: the time the callback itself takes must not
+// add up over the periods. Changing the interval from the callback must
+// take effect, and returning false must stop the timer.
+bool test_periodic_timer_callback(unsigned num_periods) {
+  auto pump = tarp::make_event_pump();
+  auto period = 2ms;
+  unsigned num_called = 0;
+  chrono::steady_clock::time_point start, end;
+
+  auto cb = pump->make_explicit_timer_callback(period);
+  cb->set_func([&] {
+    if (++num_called == num_periods) {
+      end = chrono::steady_clock::now();
+      cb->set_interval(1h);
+      return true;
+    }
+
+    if (num_called == num_periods + 1) return false;
+
+    // a good chunk of the period
+    this_thread::sleep_for(period / 2);
+    return true;
+  });
+
+  start = chrono::steady_clock::now();
+  cb->activate();
+
+  thread t([&] { pump->run(-1); });
+  // the new interval only applies after the expiration already scheduled
+  bool ok = wait_for([&] { return num_called > num_periods; }, 10s);
+  pump->stop();
+  t.join();
+
+  auto elapsed = chrono::duration_cast<chrono::microseconds>(end - start);
+  auto expected = chrono::duration_cast<chrono::microseconds>(period * num_periods);
+  cerr << num_periods << " periods of " << period.count() << "ms in "
+       << elapsed.count() << "us" << endl;
+
+  // re-arming after each callback would take 1.5x as long
+  return ok && elapsed >= expected && elapsed < expected * 5 / 4 &&
+         !cb->is_active();
+}
+
+// Activating a timer callback that is already active must fail and leave
+// the timer registered once, as it was.
+bool test_timer_double_activation() {
+  auto pump = tarp::make_event_pump();
+  unsigned num_called = 0;
+
+  auto cb = pump->make_explicit_timer_callback(1ms);
+  cb->set_func([&] { return ++num_called < 3; });
+
+  if (cb->activate() != ERRORCODE_SUCCESS) return false;
+  if (cb->activate() == ERRORCODE_SUCCESS) return false;
+
+  while (num_called < 3) pump->run_once(-1us);
+
+  // a second copy of the timer in the store would still expire
+  auto deadline = chrono::steady_clock::now() + 20ms;
+  while (chrono::steady_clock::now() < deadline) pump->run_once(5ms);
+
+  return num_called == 3 && !cb->is_active();
+}
+
+bool test_signal_callback() {
+  auto pump = tarp::make_event_pump();
+  atomic<unsigned> num_caught{0};
+  atomic<uint32_t> sender{0};
+
+  try {
+    pump->set_signal_callback(SIGKILL, [](auto &) { return true; });
+    return false;
+  } catch (const std::invalid_argument &) {
+  }
+
+  // inherited by the pump thread
+  tarp::block_signals({SIGUSR1});
+
+  pump->set_signal_callback(SIGUSR1, [&](const struct signalfd_siginfo &info) {
+    sender = info.ssi_pid;
+    ++num_caught;
+    return false;
+  });
+
+  thread t([&] { pump->run(-1); });
+
+  kill(getpid(), SIGUSR1);
+  bool ok = wait_for([&] { return num_caught == 1; });
+
+  pump->stop();
+  t.join();
+
+  tarp::unblock_signals({SIGUSR1});
+  return ok && sender == static_cast<uint32_t>(getpid());
+}
+
+#ifdef TARP_EVP_COROUTINES
+namespace {
+
+constexpr unsigned COROUTINES_DONE = 3;
+
+// Read what is available on fd once it is readable; 0 on EOF.
+tarp::task<size_t> read_some(tarp::EventPump &pump, int fd) {
+  char buff[64];
+
+  co_await pump.readable(fd);
+  ssize_t n = read(fd, buff, sizeof(buff));
+  if (n < 0) throw std::runtime_error("read failed");
+  co_return static_cast<size_t>(n);
+}
+
+tarp::task<void> reader(tarp::EventPump &pump, int fd, size_t &total) {
+  size_t n;
+  while ((n = co_await read_some(pump, fd)) > 0) total += n;
+  close(fd);
+}
+
+tarp::task<void> writer(tarp::EventPump &pump, vector<int> fds,
+                        unsigned num_messages) {
+  for (unsigned i = 0; i < num_messages; ++i) {
+    for (int fd : fds) {
+      co_await pump.writable(fd);
+      if (write(fd, "ping", 4) != 4) throw std::runtime_error("write failed");
+    }
+    co_await pump.sleep_for(100us);
+  }
+
+  for (int fd : fds) close(fd);
+  pump.push_event(COROUTINES_DONE, &pump);
+}
+
+tarp::task<unsigned> identity(tarp::EventPump &, unsigned i) { co_return i; }
+
+tarp::task<bool> await_bad_fd(tarp::EventPump &pump) {
+  try {
+    co_await pump.readable(-1);
+  } catch (const std::runtime_error &) {
+    co_return true;
+  }
+  co_return false;
+}
+
+tarp::task<void> supervisor(tarp::EventPump &pump, unsigned num_chained,
+                            uint64_t &sum, bool &ok) {
+  // a long chain of tasks completing synchronously must not grow the stack
+  for (unsigned i = 0; i < num_chained; ++i) sum += co_await identity(pump, i);
+
+  ok = co_await await_bad_fd(pump);
+  ok = ok && (co_await pump.user_event(COROUTINES_DONE) == &pump);
+  pump.stop();
+}
+
+struct set_on_destruction {
+  bool &flag;
+  ~set_on_destruction() { flag = true; }
+};
+
+tarp::task<void> forever(tarp::EventPump &pump, int fd, bool &destroyed) {
+  set_on_destruction guard{destroyed};
+  co_await pump.readable(fd);
+}
+
+}  // namespace
+
+// Connections served by coroutines must see all the data written to them;
+// their frames must be recycled by the pump. Spawned coroutines still
+// suspended must be destroyed along with the pump.
+bool test_coroutines(unsigned num_connections, unsigned num_messages) {
+  constexpr unsigned NUM_CHAINED = 100 * 1000;
+
+  auto pump = tarp::make_event_pump();
+  vector<size_t> totals(num_connections, 0);
+  vector<int> write_ends;
+  uint64_t sum{0};
+  bool ok{false};
+  bool destroyed{false};
+  int idle[2];
+
+  for (unsigned i = 0; i < num_connections; ++i) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return false;
+    pump->spawn(reader(*pump, sv[0], totals[i]));
+    write_ends.push_back(sv[1]);
+  }
+
+  if (pipe(idle) != 0) return false;
+  pump->spawn(forever(*pump, idle[0], destroyed));
+  pump->spawn(writer(*pump, write_ends, num_messages));
+  pump->spawn(supervisor(*pump, NUM_CHAINED, sum, ok));
+  pump->run(10);
+
+  for (auto total : totals) {
+    if (total != 4 * num_messages) ok = false;
+  }
+
+  if (sum != uint64_t{NUM_CHAINED} * (NUM_CHAINED - 1) / 2) ok = false;
+
+  auto &frames = pump->frame_allocator();
+  cerr << "coroutine frames allocated: " << frames.num_allocated()
+       << ", cached: " << frames.num_cached() << endl;
+
+  // the roots were created outside the pump: only the frames of the
+  // read_some's (at most one per connection at once) and of the tasks
+  // awaited by the supervisor come from the pump
+  if (frames.num_allocated() > num_connections + 2) ok = false;
+
+  pump.reset();
+  close(idle[0]);
+  close(idle[1]);
+
+  return ok && destroyed;
+}
+#endif
+
+bool test_sharding_policies() {
+  tarp::RoundRobinSharding rr;
+  tarp::FdHashSharding fdhash;
+  tarp::LeastLoadedSharding least;
+
+  vector<size_t> loads{0, 0, 0};
+
+  for (size_t i = 0; i < 7; ++i) {
+    if (rr.pick(static_cast<int>(i), loads) != i % 3) return false;
+  }
+
+  if (fdhash.pick(7, loads) != 1) return false;
+  if (fdhash.pick(7, loads) != 1) return false;
+  if (fdhash.pick(9, loads) != 0) return false;
+  if (fdhash.pick(-1, loads) != 0) return false; /* timers: round-robin */
+  if (fdhash.pick(-1, loads) != 1) return false;
+
+  if (least.pick(3, {3, 1, 2}) != 1) return false;
+  if (least.pick(3, {1, 1, 1}) != 0) return false;
+  if (least.pick(3, {2, 2, 0}) != 2) return false;
+
+  return true;
+}
+
+// fds registered with a running group must be spread evenly across the
+// pumps by the least-loaded policy, and the load must be released again
+// when the callbacks die.
+bool test_group_fd_sharding(unsigned num_pumps, unsigned num_fds) {
+  tarp::EventPumpGroup group(num_pumps,
+                             make_unique<tarp::LeastLoadedSharding>());
+  group.start();
+
+  vector<array<int, 2>> pairs(num_fds);
+  mutex mtx;
+  set<thread::id> threads;
+  atomic<unsigned> num_called{0};
+
+  for (auto &pair : pairs) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data()) != 0) return false;
+
+    group.set_fd_event_callback(pair[0], FD_EVENT_READABLE,
+                                [&](int fd, uint32_t) {
+                                  char c;
+                                  if (read(fd, &c, 1) != 1) return true;
+                                  {
+                                    lock_guard<mutex> l(mtx);
+                                    threads.insert(this_thread::get_id());
+                                  }
+                                  ++num_called;
+                                  return false;
+                                });
+  }
+
+  bool ok = true;
+  for (unsigned i = 0; i < num_pumps; ++i) {
+    if (group.load(i) != num_fds / num_pumps) ok = false;
+  }
+
+  for (auto &pair : pairs) {
+    if (write(pair[1], "x", 1) != 1) ok = false;
+  }
+
+  ok = ok && wait_for([&] { return num_called == num_fds; });
+  ok = ok && wait_for([&] {
+         for (unsigned i = 0; i < num_pumps; ++i) {
+           if (group.load(i) != 0) return false;
+         }
+         return true;
+       });
+
+  group.stop();
+
+  for (auto &pair : pairs) {
+    close(pair[0]);
+    close(pair[1]);
+  }
+
+  cerr << "callbacks run: " << num_called << "/" << num_fds << ", on "
+       << threads.size() << " threads" << endl;
+
+  return ok && threads.size() == min(num_pumps, num_fds);
+}
+
+// Timers are sharded much like fds.
+bool test_group_timers(unsigned num_pumps, unsigned num_timers) {
+  tarp::EventPumpGroup group(num_pumps);
+
+  mutex mtx;
+  set<thread::id> threads;
+  atomic<unsigned> num_called{0};
+
+  /* half registered before start, half after */
+  auto add_timers = [&](unsigned n) {
+    for (unsigned i = 0; i < n; ++i) {
+      group.set_timer_callback(10ms, [&] {
+        {
+          lock_guard<mutex> l(mtx);
+          threads.insert(this_thread::get_id());
+        }
+        ++num_called;
+        return false;
+      });
+    }
+  };
+
+  add_timers(num_timers / 2);
+  group.start();
+  add_timers(num_timers - num_timers / 2);
+
+  bool ok = wait_for([&] { return num_called == num_timers; });
+  group.stop();
+
+  cerr << "timers fired: " << num_called << "/" << num_timers << ", on "
+       << threads.size() << " threads" << endl;
+
+  return ok && threads.size() == min(num_pumps, num_timers);
+}
+
+// A listener that fails to register with one of the pumps must not be left
+// registered with the others: replicate_listener returns the error and
+// closes all the sockets. The fds can then be registered afresh.
+bool test_replicate_listener_failure(unsigned num_pumps) {
+  tarp::EventPumpGroup group(num_pumps);
+  vector<array<int, 2>> pairs(num_pumps);
+  vector<int> fds;
+  atomic<unsigned> num_called{0};
+
+  for (auto &pair : pairs) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data()) != 0) return false;
+  }
+
+  // the last one cannot be monitored with epoll.
+  auto make_socket = [&]() -> int {
+    int fd = (fds.size() + 1 < num_pumps) ? dup(pairs[fds.size()][0])
+                                          : open("/dev/null", O_RDONLY);
+    fds.push_back(fd);
+    return fd;
+  };
+
+  auto cb = [&](tarp::EventPump &, int fd, uint32_t) {
+    char c;
+    if (read(fd, &c, 1) == 1) ++num_called;
+    return true;
+  };
+
+  int rc = group.replicate_listener(make_socket, cb);
+  bool closed = true;
+  for (int fd : fds) {
+    if (fcntl(fd, F_GETFD) != -1) closed = false;
+  }
+
+  fds.clear();
+  auto make_good_socket = [&] {
+    int fd = dup(pairs[fds.size()][0]);
+    fds.push_back(fd);
+    return fd;
+  };
+
+  bool ok = group.replicate_listener(make_good_socket, cb) == ERRORCODE_SUCCESS;
+  group.start();
+  for (auto &pair : pairs) {
+    if (write(pair[1], "x", 1) != 1) ok = false;
+  }
+
+  ok = ok && wait_for([&] { return num_called == num_pumps; });
+  group.stop();
+
+  for (auto &pair : pairs) {
+    close(pair[0]);
+    close(pair[1]);
+  }
+
+  cerr << "failed replication: rc=" << rc << ", sockets closed: " << closed
+       << "; then " << num_called << " of " << num_pumps
+       << " listeners called" << endl;
+
+  return rc != ERRORCODE_SUCCESS && closed && ok;
+}
+
+// Bind a socket to an ephemeral loopback port; the socket is left open
+// and not listening, to reserve the port.
+static int reserve_port(struct sockaddr_in &addr) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  socklen_t len = sizeof(addr);
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), len) != 0 ||
+      getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+// Echo server on SO_REUSEPORT listeners replicated across the pumps; each
+// connection is handled by the pump that accepted it. Blocking clients
+// each ping-pong messages over their own connection for the specified
+// duration. NOTE the scaling reported depends on the number of cores.
+bool test_reuseport_echo(unsigned num_pumps, unsigned num_clients,
+                         std::chrono::seconds duration) {
+  constexpr size_t MSG_SIZE = 64;
+
+  auto group = make_unique<tarp::EventPumpGroup>(num_pumps);
+  vector<atomic<unsigned>> accepted(num_pumps);
+
+  /* closed only once the group is gone, to not close fds still monitored */
+  mutex mtx;
+  vector<int> conns;
+
+  struct sockaddr_in addr;
+  int reserved = reserve_port(addr);
+  if (reserved < 0) return false;
+
+  auto echo = [](int fd, uint32_t) {
+    char buff[MSG_SIZE * 4];
+    ssize_t n = read(fd, buff, sizeof(buff));
+    if (n <= 0) {
+      return (n < 0 && errno == EAGAIN);
+    }
+    return write(fd, buff, static_cast<size_t>(n)) == n;
+  };
+
+  int rc = group->add_reuseport_listener(
+      reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr),
+      [&](tarp::EventPump &pump, int fd, uint32_t) {
+        int conn;
+        while ((conn = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+          for (unsigned i = 0; i < num_pumps; ++i) {
+            if (group->pump(i).get() == &pump) ++accepted[i];
+          }
+          {
+            lock_guard<mutex> l(mtx);
+            conns.push_back(conn);
+          }
+          pump.set_fd_event_callback(conn, FD_EVENT_READABLE, echo);
+        }
+        return true;
+      });
+
+  close(reserved);
+  if (rc != ERRORCODE_SUCCESS) return false;
+
+  group->start();
+
+  atomic<uint64_t> num_msgs{0};
+  atomic<bool> failed{false};
+  vector<thread> clients;
+
+  auto start = chrono::steady_clock::now();
+  for (unsigned i = 0; i < num_clients; ++i) {
+    clients.emplace_back([&] {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                  sizeof(addr)) != 0) {
+        failed = true;
+        close(fd);
+        return;
+      }
+
+      char out[MSG_SIZE], in[MSG_SIZE];
+      memset(out, 'a', sizeof(out));
+      uint64_t n = 0;
+
+      while (chrono::steady_clock::now() - start < duration) {
+        if (write(fd, out, sizeof(out)) != sizeof(out)) break;
+
+        size_t got = 0;
+        while (got < sizeof(in)) {
+          ssize_t r = read(fd, in + got, sizeof(in) - got);
+          if (r <= 0) break;
+          got += static_cast<size_t>(r);
+        }
+
+        if (got != sizeof(in) || memcmp(in, out, sizeof(in)) != 0) {
+          failed = true;
+          break;
+        }
+        ++n;
+      }
+
+      num_msgs += n;
+      close(fd);
+    });
+  }
+
+  for (auto &client : clients) client.join();
+  double secs =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  group.reset();
+  for (int conn : conns) close(conn);
+
+  cerr << "echo: " << num_pumps << " pump(s), " << num_clients
+       << " clients: " << static_cast<uint64_t>(num_msgs / secs)
+       << " msgs/s; connections per pump:";
+  for (auto &n : accepted) cerr << " " << n;
+  cerr << endl;
+
+  return !failed && num_msgs > 0;
+}
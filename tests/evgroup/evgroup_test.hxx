@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include <tarp/event.hxx>
+
+bool test_post_and_stop(unsigned num_posters, unsigned num_posts);
+bool test_user_event_subscribers(unsigned num_subscribers, unsigned num_events);
+bool test_pump_stats(unsigned num_timers);
+bool test_cross_thread_registration(unsigned num_workers);
+bool test_throwing_callback();
+bool test_timer_allocations(unsigned num_timers, unsigned batch_size);
+bool test_periodic_timer_callback(unsigned num_periods);
+bool test_timer_double_activation();
+bool test_signal_callback();
+#ifdef TARP_EVP_COROUTINES
+bool test_coroutines(unsigned num_connections, unsigned num_messages);
+#endif
+bool test_sharding_policies();
+bool test_group_fd_sharding(unsigned num_pumps, unsigned num_fds);
+bool test_group_timers(unsigned num_pumps, unsigned num_timers);
+bool test_replicate_listener_failure(unsigned num_pumps);
+bool test_reuseport_echo(unsigned num_pumps, unsigned num_clients,
+                         std::chrono::seconds duration);
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include "evgroup_test.hxx"
+
+using namespace std;
+using namespace std::chrono_literals;
+
+
+int main(int, const char **) {
+  unsigned num_test{0};
+  unsigned num_total{0};
+  unsigned num_passed{0};
+
+  auto run_test = [&](auto &&test_func, auto &&...args) {
+    ++num_total;
+    ++num_test;
+    cerr << "\n=== Starting test === " << num_test << endl;
+    bool ok = test_func(std::forward<decltype(args)>(args)...);
+    std::cerr << "Test " << num_test << " " << (ok ? "passed" : "failed")
+              << endl;
+
+    if (ok) {
+      ++num_passed;
+    }
+  };
+
+  unsigned num_cores = std::max(2u, std::thread::hardware_concurrency());
+
+  //==============================
+  // ===== Test class `EventPump`
+  //==============================
+  run_test(test_post_and_stop, 8, 10 * 1000);
+  run_test(test_user_event_subscribers, 5, 100);
+  run_test(test_pump_stats, 10);
+  run_test(test_cross_thread_registration, 16);
+  run_test(test_throwing_callback);
+  run_test(test_periodic_timer_callback, 100);
+  run_test(test_timer_double_activation);
+
+  // NOTE: a benchmark, really; see the test.
+  run_test(test_timer_allocations, 10 * 1000 * 1000, 10 * 1000);
+  run_test(test_signal_callback);
+#ifdef TARP_EVP_COROUTINES
+  run_test(test_coroutines, 8, 100);
+#endif
+
+  //===================================
+  // ===== Test class `EventPumpGroup`
+  //===================================
+  run_test(test_sharding_policies);
+  run_test(test_group_fd_sharding, 4, 100);
+  run_test(test_group_timers, 4, 100);
+  run_test(test_replicate_listener_failure, 4);
+
+  // NOTE: a benchmark, really: compare the echo throughput of a single
+  // pump with that of a pump per core. Only scales with multiple cores.
+  run_test(test_reuseport_echo, 1, 2 * num_cores, 2s);
+  run_test(test_reuseport_echo, num_cores, 2 * num_cores, 2s);
+
+  cerr << endl;
+  cerr << "Passed: " << num_passed << "/" << num_total << "." << endl;
+
+  bool passed = num_passed == num_total;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}